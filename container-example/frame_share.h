@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file defines how the frame server shares frames with its
+ * clients, and is included by both. It only depends on the C library, so
+ * that clients can be built in any container image.
+ *
+ * Frames are captured straight into a fixed set of memfd backed slots. A
+ * client connects to a SOCK_SEQPACKET Unix socket and receives a
+ * frame_share_hello message, carrying the descriptors of a release ring
+ * followed by those of all slots with SCM_RIGHTS. The client maps them once.
+ * After that the server sends a frame_share_frame message per frame, naming
+ * the slot the frame is in, and the client reads the frame where it is.
+ *
+ * When the client is done with a frame, it writes the slot number to its
+ * release ring, in shared memory. The server counts the clients holding
+ * each slot, and hands a slot back to the video stream once no client holds
+ * it. A client that disconnects releases everything it held.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define FRAME_SHARE_MAGIC 0x46524d53
+#define FRAME_SHARE_VERSION 1
+
+// Upper limit of the number of slots, and so of the descriptors in a hello message
+#define FRAME_SHARE_MAX_SLOTS 16
+
+// Releases a client can have written that the server has not yet read
+#define FRAME_SHARE_RING_SIZE 64
+
+// Sent once, when a client connects, with the ring and slot descriptors
+struct frame_share_hello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t width;
+    uint32_t height;
+    // nv12, y800, h264, h265 or jpeg, NUL terminated
+    char format[8];
+    uint64_t slot_size;
+};
+
+// Sent for every frame, the frame data starts at the beginning of the slot
+struct frame_share_frame {
+    uint32_t slot;
+    uint32_t size;
+    // Capture time in microseconds
+    uint64_t timestamp;
+    uint32_t sequence;
+    // Nonzero for a frame that does not depend on earlier frames
+    uint32_t keyframe;
+};
+
+// Slots released by a client, written by the client and read by the server
+struct frame_share_ring {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t slots[FRAME_SHARE_RING_SIZE];
+};
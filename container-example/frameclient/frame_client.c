@@ -0,0 +1,195 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file implements the client side of frame_share.h.
+ *
+ * The descriptors received when connecting are mapped once and then closed,
+ * the mappings keep the memory alive. Receiving a frame is one recv call of a
+ * small message, and releasing it is a store to shared memory, so neither
+ * touches the frame data.
+ */
+
+#include "frame_client.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "frame_share.h"
+
+struct frame_client {
+    int fd;
+    struct frame_share_hello hello;
+    struct frame_share_ring* ring;
+    const uint8_t* slots[FRAME_SHARE_MAX_SLOTS];
+};
+
+static void close_fds(const int* fds, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        close(fds[i]);
+}
+
+// Receive the hello message and the descriptors that come with it
+static int receive_hello(struct frame_client* client, int* fds, size_t* num_fds) {
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * (1 + FRAME_SHARE_MAX_SLOTS))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov   = {&client->hello, sizeof(client->hello)};
+    struct msghdr msg  = {0};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t size = recvmsg(client->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (size < 0)
+        return errno;
+
+    *num_fds = 0;
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&msg); header;
+         header                 = CMSG_NXTHDR(&msg, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            *num_fds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(header), *num_fds * sizeof(int));
+        }
+    }
+
+    if (size == 0)
+        return ECONNRESET;
+    if ((size_t)size != sizeof(client->hello) || client->hello.magic != FRAME_SHARE_MAGIC ||
+        client->hello.version != FRAME_SHARE_VERSION ||
+        client->hello.num_slots > FRAME_SHARE_MAX_SLOTS ||
+        *num_fds != 1 + client->hello.num_slots || (msg.msg_flags & MSG_CTRUNC))
+        return EPROTO;
+    client->hello.format[sizeof(client->hello.format) - 1] = '\0';
+    return 0;
+}
+
+// Map the ring and the slots, the descriptors are not needed afterwards
+static int map_memory(struct frame_client* client, const int* fds) {
+    client->ring = mmap(NULL, sizeof(*client->ring), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (client->ring == MAP_FAILED) {
+        client->ring = NULL;
+        return errno;
+    }
+
+    for (uint32_t i = 0; i < client->hello.num_slots; i++) {
+        void* slot = mmap(NULL, client->hello.slot_size, PROT_READ, MAP_SHARED, fds[1 + i], 0);
+        if (slot == MAP_FAILED)
+            return errno;
+        client->slots[i] = slot;
+    }
+    return 0;
+}
+
+int frame_client_connect(const char* path, struct frame_client** client) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    int fds[1 + FRAME_SHARE_MAX_SLOTS];
+    size_t num_fds = 0;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return ENAMETOOLONG;
+    strcpy(address.sun_path, path);
+
+    struct frame_client* new_client = calloc(1, sizeof(*new_client));
+    if (!new_client)
+        return ENOMEM;
+
+    int ret        = 0;
+    new_client->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (new_client->fd < 0 ||
+        connect(new_client->fd, (struct sockaddr*)&address, sizeof(address)) < 0)
+        ret = errno;
+    if (!ret)
+        ret = receive_hello(new_client, fds, &num_fds);
+    if (!ret)
+        ret = map_memory(new_client, fds);
+    close_fds(fds, num_fds);
+
+    if (ret) {
+        frame_client_close(new_client);
+        return ret;
+    }
+    *client = new_client;
+    return 0;
+}
+
+const char* frame_client_get_format(const struct frame_client* client,
+                                    uint32_t* width,
+                                    uint32_t* height) {
+    *width  = client->hello.width;
+    *height = client->hello.height;
+    return client->hello.format;
+}
+
+int frame_client_get_fd(const struct frame_client* client) {
+    return client->fd;
+}
+
+int frame_client_next(struct frame_client* client, struct frame_client_frame* frame) {
+    struct frame_share_frame message;
+    ssize_t size;
+
+    do {
+        size = recv(client->fd, &message, sizeof(message), 0);
+    } while (size < 0 && errno == EINTR);
+    if (size < 0)
+        return errno;
+    if (size == 0)
+        return ECONNRESET;
+    if ((size_t)size != sizeof(message) || message.slot >= client->hello.num_slots ||
+        message.size > client->hello.slot_size)
+        return EPROTO;
+
+    frame->data      = client->slots[message.slot];
+    frame->size      = message.size;
+    frame->timestamp = message.timestamp;
+    frame->sequence  = message.sequence;
+    frame->keyframe  = message.keyframe != 0;
+    frame->slot      = message.slot;
+    return 0;
+}
+
+void frame_client_release(struct frame_client* client, const struct frame_client_frame* frame) {
+    struct frame_share_ring* ring = client->ring;
+
+    // A client holds fewer frames than the ring has room for, so it never fills up
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->slots[head % FRAME_SHARE_RING_SIZE] = frame->slot;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void frame_client_close(struct frame_client* client) {
+    if (!client)
+        return;
+
+    for (uint32_t i = 0; i < FRAME_SHARE_MAX_SLOTS; i++) {
+        if (client->slots[i])
+            munmap((void*)client->slots[i], client->hello.slot_size);
+    }
+    if (client->ring)
+        munmap(client->ring, sizeof(*client->ring));
+    if (client->fd >= 0)
+        close(client->fd);
+    free(client);
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file connects a process in a container to the frame server,
+ * and gives it the frames the server shares without copying them. It only
+ * depends on the C library. Functions that can fail return 0 on success and
+ * an errno value on failure.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct frame_client;
+
+struct frame_client_frame {
+    // Mapped read only, valid until the frame is released
+    const uint8_t* data;
+    size_t size;
+    // Capture time in microseconds
+    uint64_t timestamp;
+    uint32_t sequence;
+    int keyframe;
+    uint32_t slot;
+};
+
+/**
+ * brief Connect to the frame server and map all its slots.
+ *
+ * param path Path of the socket of the frame server.
+ * param client Set to the client on success.
+ * return 0 on success, or an errno value.
+ */
+int frame_client_connect(const char* path, struct frame_client** client);
+
+/**
+ * brief Get the format and resolution of the frames.
+ *
+ * param client A frame client.
+ * param width Set to the width of the frames.
+ * param height Set to the height of the frames.
+ * return The format, nv12, y800, h264, h265 or jpeg.
+ */
+const char* frame_client_get_format(const struct frame_client* client,
+                                    uint32_t* width,
+                                    uint32_t* height);
+
+/**
+ * brief Get the socket descriptor, to wait for frames with poll.
+ *
+ * param client A frame client.
+ * return The descriptor, readable when a frame is available.
+ */
+int frame_client_get_fd(const struct frame_client* client);
+
+/**
+ * brief Wait for the next frame.
+ *
+ * A frame is held until it is released. The server skips a client that holds
+ * too many frames, and skips all clients when together they hold all slots it
+ * can hand out, so frames should be released as soon as they are done with.
+ *
+ * param client A frame client.
+ * param frame Set to the frame on success.
+ * return 0 on success, ECONNRESET if the server has stopped, or an errno value.
+ */
+int frame_client_next(struct frame_client* client, struct frame_client_frame* frame);
+
+/**
+ * brief Release a frame, so that its slot can be filled again.
+ *
+ * param client A frame client.
+ * param frame A frame from frame_client_next, not to be used afterwards.
+ */
+void frame_client_release(struct frame_client* client, const struct frame_client_frame* frame);
+
+/**
+ * brief Disconnect from the server, which releases all held frames.
+ *
+ * param client A frame client, may be NULL.
+ */
+void frame_client_close(struct frame_client* client);
@@ -0,0 +1,114 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - frame_consumer -
+ *
+ * This application runs in a container and reads the frames of the frame
+ * server through frame_client.h. For raw frames it computes the mean luma,
+ * reading the frame where the video service wrote it. Every ten seconds it
+ * prints the frame rate and the number of frames missed, which the server
+ * skipped or which were dropped before they reached it.
+ *
+ * The application takes the path of the socket as its only argument,
+ * /run/frames/frames.sock by default.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_client.h"
+
+// Statistics are printed this often
+#define REPORT_INTERVAL_SEC 10
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// The luma plane comes first in both nv12 and y800
+static double mean_luma(const struct frame_client_frame* frame, uint32_t width, uint32_t height) {
+    size_t pixels = (size_t)width * height;
+    uint64_t sum  = 0;
+
+    if (pixels == 0 || frame->size < pixels)
+        return 0;
+    for (size_t i = 0; i < pixels; i++)
+        sum += frame->data[i];
+    return (double)sum / pixels;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "/run/frames/frames.sock";
+    struct frame_client* client;
+    uint32_t width;
+    uint32_t height;
+
+    int ret = frame_client_connect(path, &client);
+    if (ret) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", path, strerror(ret));
+        return EXIT_FAILURE;
+    }
+
+    const char* format = frame_client_get_format(client, &width, &height);
+    int raw            = strcmp(format, "nv12") == 0 || strcmp(format, "y800") == 0;
+    printf("Receiving %s frames of %ux%u from %s\n", format, width, height, path);
+    fflush(stdout);
+
+    double report_time     = now_seconds();
+    unsigned long frames   = 0;
+    unsigned long missed   = 0;
+    uint32_t last_sequence = 0;
+    int started            = 0;
+    double luma            = 0;
+    while (1) {
+        struct frame_client_frame frame;
+
+        ret = frame_client_next(client, &frame);
+        if (ret)
+            break;
+
+        if (raw)
+            luma = mean_luma(&frame, width, height);
+        if (started && frame.sequence - last_sequence > 1)
+            missed += frame.sequence - last_sequence - 1;
+        last_sequence = frame.sequence;
+        started       = 1;
+        frames++;
+        frame_client_release(client, &frame);
+
+        double now = now_seconds();
+        if (now - report_time >= REPORT_INTERVAL_SEC) {
+            printf("%.1f frames/s, %lu frames missed, mean luma %.1f\n",
+                   frames / (now - report_time),
+                   missed,
+                   luma);
+            fflush(stdout);
+            report_time = now;
+            frames      = 0;
+            missed      = 0;
+        }
+    }
+
+    fprintf(stderr, "Stopped receiving frames: %s\n", strerror(ret));
+    frame_client_close(client);
+    return ret == ECONNRESET ? EXIT_SUCCESS : EXIT_FAILURE;
+}
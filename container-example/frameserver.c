@@ -0,0 +1,533 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - frameserver -
+ *
+ * This application shares the frames of a VDO stream with processes in
+ * containers on the same device, without copying them.
+ *
+ * The stream is created with explicitly managed buffers, and every buffer is
+ * a memfd the application created. The video service therefore writes each
+ * frame straight into memory that the clients have mapped. The descriptors
+ * are passed to each client once, over a Unix socket, and after that only a
+ * small message per frame is sent. See frame_share.h for the protocol.
+ *
+ * Everything runs on one thread, waiting with poll on the listening socket,
+ * the stream and the clients. A slot is handed back to the stream once all
+ * clients it was sent to have released it. A client that holds on to too
+ * many slots is skipped rather than stalling the stream for the others, and
+ * a few slots are never handed out, so that clients stalling together cannot
+ * stall the stream either.
+ *
+ * The application takes the following options:
+ *     --format [nv12 (default), y800, h264, h265, jpeg]
+ *     --width, --height [resolution, default 640x360]
+ *     --socket [path of the socket, default localdata/frames.sock]
+ */
+
+// For memfd_create
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <glib.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "frame_share.h"
+#include "vdo-buffer.h"
+#include "vdo-error.h"
+#include "vdo-frame.h"
+#include "vdo-map.h"
+#include "vdo-stream.h"
+#include "vdo-types.h"
+
+#define FRAME_SERVER_ERROR g_quark_from_static_string("frame-server-error")
+
+#define NUM_SLOTS 8
+
+// Slots no client may take, so that the stream keeps going however many clients stall
+#define RESERVED_SLOTS 2
+
+// Slots a single client may hold, so that one stalled client leaves slots for the others
+#define MAX_HELD_SLOTS ((NUM_SLOTS - RESERVED_SLOTS) / 2)
+
+#define MAX_CLIENTS 8
+
+// Slots are whole pages, so each can be mapped on its own
+#define SLOT_ALIGNMENT 4096
+
+// Released slots are collected at least this often
+#define POLL_TIMEOUT_MS 20
+
+// Statistics are logged this often
+#define REPORT_INTERVAL_USEC (10 * G_USEC_PER_SEC)
+
+struct slot {
+    gint fd;
+    VdoBuffer* buffer;
+    guint refs;
+};
+
+struct client {
+    gint fd;
+    struct frame_share_ring* ring;
+    guint32 held;
+    guint num_held;
+    guint64 frames_sent;
+    guint64 frames_skipped;
+};
+
+struct server {
+    VdoStream* stream;
+    struct frame_share_hello hello;
+    struct slot slots[NUM_SLOTS];
+    // Slots held by at least one client
+    guint held_slots;
+    gint listen_fd;
+    struct client* clients[MAX_CLIENTS];
+    guint num_clients;
+    guint64 frames;
+    gint64 report_time;
+    guint64 report_frames;
+};
+
+static volatile sig_atomic_t shutdown_requested = 0;
+
+static void handle_signal(int signum) {
+    (void)signum;
+    shutdown_requested = 1;
+}
+
+// Give a slot back to the stream to be filled with a new frame
+static gboolean enqueue_slot(struct server* server, struct slot* slot, GError** error) {
+    return vdo_stream_buffer_enqueue(server->stream, slot->buffer, error);
+}
+
+static gboolean create_slots(struct server* server, GError** error) {
+    for (guint i = 0; i < NUM_SLOTS; i++) {
+        struct slot* slot = &server->slots[i];
+
+        slot->fd = memfd_create("frame-slot", MFD_CLOEXEC);
+        if (slot->fd < 0 || ftruncate(slot->fd, server->hello.slot_size) < 0) {
+            g_set_error(error,
+                        FRAME_SERVER_ERROR,
+                        0,
+                        "Failed to create a slot of %" G_GUINT64_FORMAT " bytes: %s",
+                        (guint64)server->hello.slot_size,
+                        g_strerror(errno));
+            return FALSE;
+        }
+
+        // The slot is found from the buffer through its opaque pointer
+        slot->buffer = vdo_buffer_new_full(slot->fd, server->hello.slot_size, 0, slot);
+        if (!slot->buffer || !enqueue_slot(server, slot, error))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean release_slot(struct server* server, struct client* client, guint32 index) {
+    GError* error = NULL;
+
+    // The ring is written by the client, so what it says is checked
+    if (index >= NUM_SLOTS || !(client->held & 1u << index))
+        return FALSE;
+    client->held &= ~(1u << index);
+    client->num_held--;
+
+    struct slot* slot = &server->slots[index];
+    if (--slot->refs > 0)
+        return TRUE;
+    server->held_slots--;
+    if (!enqueue_slot(server, slot, &error)) {
+        syslog(LOG_WARNING, "Failed to return a slot to the stream: %s", error->message);
+        g_clear_error(&error);
+    }
+    return TRUE;
+}
+
+static void collect_releases(struct server* server, struct client* client) {
+    struct frame_share_ring* ring = client->ring;
+    guint32 tail                  = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    guint32 head                  = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    // A client that writes more releases than it can have is treated as holding nothing new
+    if (head - tail > FRAME_SHARE_RING_SIZE)
+        tail = head - FRAME_SHARE_RING_SIZE;
+    for (; tail != head; tail++) {
+        if (!release_slot(server, client, ring->slots[tail % FRAME_SHARE_RING_SIZE]))
+            syslog(LOG_WARNING, "Client released a slot it does not hold");
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+}
+
+static void remove_client(struct server* server, guint position) {
+    struct client* client = server->clients[position];
+
+    // Everything the client held is released
+    collect_releases(server, client);
+    for (guint32 index = 0; index < NUM_SLOTS; index++) {
+        if (client->held & 1u << index)
+            release_slot(server, client, index);
+    }
+
+    syslog(LOG_INFO,
+           "Client disconnected, %" G_GUINT64_FORMAT " frames sent, %" G_GUINT64_FORMAT
+           " skipped",
+           client->frames_sent,
+           client->frames_skipped);
+    munmap(client->ring, sizeof(*client->ring));
+    close(client->fd);
+    g_free(client);
+    server->clients[position] = server->clients[--server->num_clients];
+}
+
+// Send the hello message, with the ring descriptor followed by all slot descriptors
+static gboolean send_hello(struct server* server, gint fd, gint ring_fd) {
+    gint fds[1 + NUM_SLOTS];
+    union {
+        char buffer[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+
+    fds[0] = ring_fd;
+    for (guint i = 0; i < NUM_SLOTS; i++)
+        fds[1 + i] = server->slots[i].fd;
+
+    struct iovec iov   = {&server->hello, sizeof(server->hello)};
+    struct msghdr msg  = {0};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&msg);
+    header->cmsg_level     = SOL_SOCKET;
+    header->cmsg_type      = SCM_RIGHTS;
+    header->cmsg_len       = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == sizeof(server->hello);
+}
+
+static void accept_client(struct server* server) {
+    gint fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    if (server->num_clients == MAX_CLIENTS) {
+        syslog(LOG_WARNING, "Refusing client, already serving %d clients", MAX_CLIENTS);
+        close(fd);
+        return;
+    }
+
+    // Each client gets a release ring of its own
+    struct frame_share_ring* ring = MAP_FAILED;
+    gint ring_fd                  = memfd_create("frame-release-ring", MFD_CLOEXEC);
+    if (ring_fd >= 0 && ftruncate(ring_fd, sizeof(*ring)) == 0)
+        ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+    if (ring == MAP_FAILED || !send_hello(server, fd, ring_fd)) {
+        syslog(LOG_WARNING, "Failed to set up client: %s", g_strerror(errno));
+        if (ring != MAP_FAILED)
+            munmap(ring, sizeof(*ring));
+        if (ring_fd >= 0)
+            close(ring_fd);
+        close(fd);
+        return;
+    }
+    close(ring_fd);
+
+    struct client* client                  = g_new0(struct client, 1);
+    client->fd                             = fd;
+    client->ring                           = ring;
+    server->clients[server->num_clients++] = client;
+    syslog(LOG_INFO, "Client connected, %u clients", server->num_clients);
+}
+
+// Send a frame to every client that has room for it, as long as the reserved slots stay free
+static void publish_frame(struct server* server, VdoBuffer* buffer) {
+    struct slot* slot = vdo_buffer_get_opaque(buffer);
+    VdoFrame* frame   = vdo_buffer_get_frame(buffer);
+    VdoFrameType type = vdo_frame_get_frame_type(frame);
+    GError* error     = NULL;
+
+    struct frame_share_frame message = {
+        .slot      = slot - server->slots,
+        .size      = vdo_frame_get_size(frame),
+        .timestamp = vdo_frame_get_timestamp(frame),
+        .sequence  = vdo_frame_get_sequence_nbr(frame),
+        .keyframe  = type != VDO_FRAME_TYPE_H264_P && type != VDO_FRAME_TYPE_H265_P,
+    };
+
+    for (guint i = 0; i < server->num_clients; i++) {
+        struct client* client = server->clients[i];
+
+        // Sharing a slot another client already holds takes no free slot
+        gboolean takes_slot = slot->refs == 0;
+
+        if (client->num_held >= MAX_HELD_SLOTS ||
+            (takes_slot && server->held_slots + 1 > NUM_SLOTS - RESERVED_SLOTS) ||
+            send(client->fd, &message, sizeof(message), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            client->frames_skipped++;
+            continue;
+        }
+        client->held |= 1u << message.slot;
+        client->num_held++;
+        client->frames_sent++;
+        slot->refs++;
+        server->held_slots += takes_slot;
+    }
+    server->frames++;
+
+    if (!slot->refs && !enqueue_slot(server, slot, &error)) {
+        syslog(LOG_WARNING, "Failed to return a slot to the stream: %s", error->message);
+        g_clear_error(&error);
+    }
+}
+
+// Fetch the frames that are ready, without blocking
+static gboolean fetch_frames(struct server* server, GError** error) {
+    while (TRUE) {
+        GError* fetch_error = NULL;
+        VdoBuffer* buffer   = vdo_stream_get_buffer(server->stream, &fetch_error);
+        if (!buffer) {
+            if (g_error_matches(fetch_error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
+                g_clear_error(&fetch_error);
+                return TRUE;
+            }
+            g_propagate_error(error, fetch_error);
+            return FALSE;
+        }
+
+        // The slot holds a reference of its own, the one from fetching is not needed
+        publish_frame(server, buffer);
+        g_object_unref(buffer);
+    }
+}
+
+static void report_if_due(struct server* server) {
+    gint64 now = g_get_monotonic_time();
+    if (now - server->report_time < REPORT_INTERVAL_USEC)
+        return;
+
+    syslog(LOG_INFO,
+           "Shared %.1f frames/s with %u clients, %u of %d slots held by clients",
+           (server->frames - server->report_frames) * (double)G_USEC_PER_SEC /
+               (now - server->report_time),
+           server->num_clients,
+           server->held_slots,
+           NUM_SLOTS);
+    server->report_time   = now;
+    server->report_frames = server->frames;
+}
+
+static gboolean serve(struct server* server, GError** error) {
+    struct pollfd fds[2 + MAX_CLIENTS];
+
+    gint stream_fd = vdo_stream_get_fd(server->stream, error);
+    if (stream_fd < 0)
+        return FALSE;
+
+    server->report_time = g_get_monotonic_time();
+    while (!shutdown_requested) {
+        fds[0] = (struct pollfd){.fd = server->listen_fd, .events = POLLIN};
+        fds[1] = (struct pollfd){.fd = stream_fd, .events = POLLIN};
+        for (guint i = 0; i < server->num_clients; i++)
+            fds[2 + i] = (struct pollfd){.fd = server->clients[i]->fd, .events = POLLIN};
+        guint num_clients = server->num_clients;
+
+        if (poll(fds, 2 + num_clients, POLL_TIMEOUT_MS) < 0 && errno != EINTR) {
+            g_set_error(error, FRAME_SERVER_ERROR, 0, "poll failed: %s", g_strerror(errno));
+            return FALSE;
+        }
+
+        // Clients never send anything, so a readable socket means it was closed
+        for (guint i = num_clients; i-- > 0;) {
+            if (fds[2 + i].revents)
+                remove_client(server, i);
+        }
+        for (guint i = 0; i < server->num_clients; i++)
+            collect_releases(server, server->clients[i]);
+
+        if (fds[1].revents && !fetch_frames(server, error))
+            return FALSE;
+        if (fds[0].revents)
+            accept_client(server);
+        report_if_due(server);
+    }
+    return TRUE;
+}
+
+static gint listen_on(const gchar* path, GError** error) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        g_set_error(error, FRAME_SERVER_ERROR, 0, "Socket path %s is too long", path);
+        return -1;
+    }
+    g_strlcpy(address.sun_path, path, sizeof(address.sun_path));
+
+    // Message boundaries are kept, so each frame is one message
+    unlink(path);
+    gint fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(fd, MAX_CLIENTS) < 0) {
+        g_set_error(error,
+                    FRAME_SERVER_ERROR,
+                    0,
+                    "Failed to listen on %s: %s",
+                    path,
+                    g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static gboolean set_format(VdoMap* settings, const gchar* format, GError** error) {
+    if (g_strcmp0(format, "nv12") == 0) {
+        vdo_map_set_uint32(settings, "format", VDO_FORMAT_YUV);
+        vdo_map_set_string(settings, "subformat", "NV12");
+    } else if (g_strcmp0(format, "y800") == 0) {
+        vdo_map_set_uint32(settings, "format", VDO_FORMAT_YUV);
+        vdo_map_set_string(settings, "subformat", "Y800");
+    } else if (g_strcmp0(format, "h264") == 0) {
+        vdo_map_set_uint32(settings, "format", VDO_FORMAT_H264);
+    } else if (g_strcmp0(format, "h265") == 0) {
+        vdo_map_set_uint32(settings, "format", VDO_FORMAT_H265);
+    } else if (g_strcmp0(format, "jpeg") == 0) {
+        vdo_map_set_uint32(settings, "format", VDO_FORMAT_JPEG);
+    } else {
+        g_set_error(error, FRAME_SERVER_ERROR, 0, "Format \"%s\" is not supported", format);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int main(int argc, char* argv[]) {
+    GError* error        = NULL;
+    gchar* format        = "nv12";
+    gint width           = 640;
+    gint height          = 360;
+    gchar* socket_path   = "localdata/frames.sock";
+    VdoMap* settings     = NULL;
+    VdoMap* info         = NULL;
+    struct server server = {.listen_fd = -1};
+
+    for (guint i = 0; i < NUM_SLOTS; i++)
+        server.slots[i].fd = -1;
+
+    openlog(NULL, LOG_PID, LOG_USER);
+
+    GOptionEntry options[] = {
+        {"format", 't', 0, G_OPTION_ARG_STRING, &format, "nv12, y800, h264, h265 or jpeg", NULL},
+        {"width", 'w', 0, G_OPTION_ARG_INT, &width, "frame width", NULL},
+        {"height", 'h', 0, G_OPTION_ARG_INT, &height, "frame height", NULL},
+        {"socket", 's', 0, G_OPTION_ARG_FILENAME, &socket_path, "path of the socket", NULL},
+        {NULL, 0, 0, 0, NULL, NULL, NULL}};
+
+    GOptionContext* context = g_option_context_new("- share frames with containers");
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+        goto exit;
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    // The buffers are provided by the application, and fetched without blocking
+    settings = vdo_map_new();
+    if (!set_format(settings, format, &error))
+        goto exit;
+    vdo_map_set_uint32(settings, "width", width);
+    vdo_map_set_uint32(settings, "height", height);
+    vdo_map_set_uint32(settings, "buffer.strategy", VDO_BUFFER_STRATEGY_EXPLICIT);
+    vdo_map_set_uint32(settings, "buffer.count", NUM_SLOTS);
+    vdo_map_set_boolean(settings, "socket.blocking", FALSE);
+
+    server.stream = vdo_stream_new(settings, NULL, &error);
+    if (!server.stream)
+        goto exit;
+
+    info = vdo_stream_get_info(server.stream, &error);
+    if (!info)
+        goto exit;
+
+    // A slot holds a full NV12 frame, which no encoded frame of the same size exceeds
+    server.hello.magic     = FRAME_SHARE_MAGIC;
+    server.hello.version   = FRAME_SHARE_VERSION;
+    server.hello.num_slots = NUM_SLOTS;
+    server.hello.width     = vdo_map_get_uint32(info, "width", width);
+    server.hello.height    = vdo_map_get_uint32(info, "height", height);
+    gsize frame_size       = server.hello.width * server.hello.height * 3 / 2;
+    server.hello.slot_size = (frame_size + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+    g_strlcpy(server.hello.format, format, sizeof(server.hello.format));
+
+    if (!create_slots(&server, &error))
+        goto exit;
+
+    server.listen_fd = listen_on(socket_path, &error);
+    if (server.listen_fd < 0)
+        goto exit;
+
+    if (!vdo_stream_start(server.stream, &error))
+        goto exit;
+
+    syslog(LOG_INFO,
+           "Sharing %s frames of %ux%u on %s",
+           format,
+           server.hello.width,
+           server.hello.height,
+           socket_path);
+
+    serve(&server, &error);
+
+exit:
+    if (shutdown_requested || vdo_error_is_expected(&error))
+        g_clear_error(&error);
+
+    gint ret = EXIT_SUCCESS;
+    if (error) {
+        syslog(LOG_ERR, "%s", error->message);
+        ret = EXIT_FAILURE;
+    }
+
+    while (server.num_clients)
+        remove_client(&server, 0);
+    if (server.listen_fd >= 0) {
+        close(server.listen_fd);
+        unlink(socket_path);
+    }
+    g_clear_object(&server.stream);
+    for (guint i = 0; i < NUM_SLOTS; i++) {
+        g_clear_object(&server.slots[i].buffer);
+        if (server.slots[i].fd >= 0)
+            close(server.slots[i].fd);
+    }
+    g_clear_object(&info);
+    g_clear_object(&settings);
+    g_clear_error(&error);
+    g_option_context_free(context);
+
+    return ret;
+}
@@ -1,2 +1,3 @@
 #!/bin/sh
 docker load -i alpine.tar
+docker load -i frame-consumer.tar
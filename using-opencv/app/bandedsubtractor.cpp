@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles background subtraction on horizontal bands of the image.
+ */
+
+#include "bandedsubtractor.h"
+
+#include <algorithm>
+
+using namespace cv;
+
+/**
+ * brief Loop body of cv::parallel_for_, processing one band per index.
+ */
+class BandedSubtractor::BandBody : public ParallelLoopBody {
+  public:
+    explicit BandBody(BandedSubtractor* subtractor) : subtractor(subtractor) {}
+
+    void operator()(const Range& range) const override {
+        for (int i = range.start; i < range.end; i++)
+            subtractor->applyBand(i);
+    }
+
+  private:
+    BandedSubtractor* subtractor;
+};
+
+BandedSubtractor::BandedSubtractor(int numBands, int kernelSize, double learningRate)
+    : bands(std::max(numBands, 1)),
+      kernel(getStructuringElement(MORPH_ELLIPSE, Size(kernelSize, kernelSize))),
+      learningRate(learningRate),
+      // An opening is an erosion followed by a dilation, each reaching half
+      // the element away
+      halo(2 * (kernelSize / 2)),
+      image(NULL) {
+    for (Band& band : bands) {
+        band.bgsub      = createBackgroundSubtractorMOG2();
+        band.foreground = 0;
+    }
+}
+
+void BandedSubtractor::applyBand(int index) {
+    Band& band   = bands[index];
+    int numBands = getNumBands();
+    int rows     = image->rows;
+
+    // The rows the band owns, and those it processes including its halo
+    int start     = rows * index / numBands;
+    int end       = rows * (index + 1) / numBands;
+    int haloStart = std::max(start - halo, 0);
+    int haloEnd   = std::min(end + halo, rows);
+
+    // The band is a view into the image, nothing is copied
+    band.bgsub->apply(image->rowRange(haloStart, haloEnd), band.fg, learningRate);
+    morphologyEx(band.fg, band.fg, MORPH_OPEN, kernel);
+
+    // Only the rows the band owns go into the foreground of the image
+    Mat owned       = band.fg.rowRange(start - haloStart, end - haloStart);
+    Mat target      = foreground.rowRange(start, end);
+    band.foreground = countNonZero(owned);
+    owned.copyTo(target);
+}
+
+int BandedSubtractor::apply(const Mat& frame) {
+    image = &frame;
+    foreground.create(frame.rows, frame.cols, CV_8UC1);
+    if (bands.size() == 1)
+        applyBand(0);
+    else
+        parallel_for_(Range(0, getNumBands()), BandBody(this), getNumBands());
+    image = NULL;
+
+    // Combine the scores of the bands
+    int pixels = 0;
+    for (const Band& band : bands)
+        pixels += band.foreground;
+    return pixels;
+}
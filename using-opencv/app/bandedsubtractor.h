@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles background subtraction on horizontal bands of the
+ * image, in parallel.
+ */
+
+#pragma once
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+#include <opencv2/video.hpp>
+#include <vector>
+
+/**
+ * brief Background subtraction and noise filtering split into bands.
+ *
+ * The image is split into horizontal bands of about equal height, and each
+ * band has a MOG2 background model of its own. The bands are processed with
+ * cv::parallel_for_, which runs them on the thread pool of OpenCV, kept
+ * between frames.
+ *
+ * MOG2 models every pixel on its own, but the opening that filters noise
+ * looks at the pixels around each one. Each band is therefore processed with
+ * a halo, the rows of its neighbors that the opening reaches, and only
+ * foreground in its own rows is counted. The result is the same as for the
+ * whole image at once, at the cost of modelling the halo rows twice.
+ */
+class BandedSubtractor {
+  public:
+    /**
+     * brief Create the background models.
+     *
+     * param numBands Number of bands, 1 processes the whole image at once.
+     * param kernelSize Size of the elliptic element that filters noise.
+     * param learningRate Learning rate of the background models.
+     */
+    BandedSubtractor(int numBands, int kernelSize, double learningRate);
+
+    /**
+     * brief Subtract the background of an image and filter noise.
+     *
+     * All images must have the same size and type.
+     *
+     * param image Image to subtract the background from.
+     * return Number of foreground pixels in the whole image.
+     */
+    int apply(const cv::Mat& image);
+
+    /**
+     * brief Get the number of bands.
+     *
+     * return Number of bands.
+     */
+    int getNumBands() const { return static_cast<int>(bands.size()); }
+
+    /**
+     * brief Get the foreground of the last image, after noise filtering.
+     *
+     * return Mask of the same size as the image, non-zero where it is foreground.
+     */
+    const cv::Mat& getForeground() const { return foreground; }
+
+  private:
+    struct Band {
+        cv::Ptr<cv::BackgroundSubtractorMOG2> bgsub;
+        cv::Mat fg;
+        int foreground;
+    };
+
+    class BandBody;
+
+    void applyBand(int index);
+
+    std::vector<Band> bands;
+    cv::Mat foreground;
+    cv::Mat kernel;
+    double learningRate;
+    int halo;
+    const cv::Mat* image;
+};
@@ -0,0 +1,139 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles finding connected regions of motion in a foreground mask.
+ */
+
+#include "blobfinder.h"
+
+#include <algorithm>
+
+using namespace cv;
+
+BlobFinder::BlobFinder(int cellSize, int minArea)
+    : cellSize(std::max(cellSize, 1)), minArea(minArea) {}
+
+int BlobFinder::findRoot(int run) {
+    // Halve the path on the way, so that later lookups are shorter
+    while (runs[run].parent != run) {
+        runs[run].parent = runs[runs[run].parent].parent;
+        run              = runs[run].parent;
+    }
+    return run;
+}
+
+void BlobFinder::unite(int a, int b) {
+    a = findRoot(a);
+    b = findRoot(b);
+
+    // The earlier run becomes the root, so roots always come first
+    if (a < b)
+        runs[b].parent = a;
+    else if (b < a)
+        runs[a].parent = b;
+}
+
+static bool largerArea(const MotionBlob& a, const MotionBlob& b) {
+    return a.area > b.area;
+}
+
+const std::vector<MotionBlob>& BlobFinder::find(const Mat& mask) {
+    runs.clear();
+    blobs.clear();
+
+    // Each cell gets the average of its pixels, so any foreground in it is non-zero
+    const Mat* grid = &mask;
+    if (cellSize > 1) {
+        resize(mask,
+               cells,
+               Size(mask.cols / cellSize, mask.rows / cellSize),
+               0,
+               0,
+               INTER_AREA);
+        grid = &cells;
+    }
+
+    // Split each row into runs and join them with the runs they touch in the row above
+    int previousStart = 0;
+    for (int y = 0; y < grid->rows; y++) {
+        const uchar* row = grid->ptr<uchar>(y);
+        int rowStart     = static_cast<int>(runs.size());
+        int above        = previousStart;
+
+        for (int x = 0; x < grid->cols;) {
+            if (!row[x]) {
+                x++;
+                continue;
+            }
+            Run run = {y, x, x, static_cast<int>(runs.size())};
+            while (x < grid->cols && row[x])
+                x++;
+            run.end = x;
+            runs.push_back(run);
+
+            // Runs are in order, so runs of the row above that end before this one are done
+            int index = static_cast<int>(runs.size()) - 1;
+            while (above < rowStart && runs[above].end < run.start)
+                above++;
+            for (int i = above; i < rowStart && runs[i].start <= run.end; i++)
+                unite(i, index);
+        }
+        previousStart = rowStart;
+    }
+
+    // Add up the cells of each region, weighted by how much of each is foreground
+    rootSums.assign(runs.size(), -1);
+    sums.clear();
+    for (int i = 0; i < static_cast<int>(runs.size()); i++) {
+        const Run& run = runs[i];
+        int root       = findRoot(i);
+        if (rootSums[root] < 0) {
+            Sums empty     = {run.start, run.row, run.end, run.row + 1, 0, 0, 0};
+            rootSums[root] = static_cast<int>(sums.size());
+            sums.push_back(empty);
+        }
+
+        Sums& sum        = sums[rootSums[root]];
+        sum.left         = std::min(sum.left, run.start);
+        sum.right        = std::max(sum.right, run.end);
+        sum.bottom       = run.row + 1;
+        const uchar* row = grid->ptr<uchar>(run.row);
+        for (int x = run.start; x < run.end; x++) {
+            sum.weight += row[x];
+            sum.weightX += row[x] * (x + 0.5);
+            sum.weightY += row[x] * (run.row + 0.5);
+        }
+    }
+
+    // A weight of 255 is a cell that is all foreground
+    double cellArea = cellSize * cellSize / 255.0;
+    for (const Sums& sum : sums) {
+        MotionBlob blob;
+        blob.area = static_cast<int>(sum.weight * cellArea + 0.5);
+        if (blob.area < minArea)
+            continue;
+        blob.box = Rect(sum.left * cellSize,
+                        sum.top * cellSize,
+                        (sum.right - sum.left) * cellSize,
+                        (sum.bottom - sum.top) * cellSize);
+        blob.centroidX = sum.weightX / sum.weight * cellSize;
+        blob.centroidY = sum.weightY / sum.weight * cellSize;
+        blobs.push_back(blob);
+    }
+    std::sort(blobs.begin(), blobs.end(), largerArea);
+    return blobs;
+}
@@ -0,0 +1,101 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles finding connected regions of motion in a
+ * foreground mask.
+ */
+
+#pragma once
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+#include <vector>
+
+/**
+ * brief A connected region of motion, in pixels of the mask.
+ */
+struct MotionBlob {
+    /// Bounding box of the region.
+    cv::Rect box;
+    /// Number of foreground pixels in the region.
+    int area;
+    /// Center of mass of the foreground pixels.
+    double centroidX;
+    double centroidY;
+};
+
+/**
+ * brief Find connected regions of foreground in a mask.
+ *
+ * The mask is first reduced to cells of cellSize x cellSize pixels, each
+ * holding the share of its pixels that are foreground. Each row of cells is
+ * then split into runs of cells with any foreground, and runs that touch a
+ * run of the row above, also diagonally, are joined with union-find. Work is
+ * thus done per run rather than per pixel, and regions split by a thin gap in
+ * the mask are still found as one.
+ */
+class BlobFinder {
+  public:
+    /**
+     * brief Create a blob finder.
+     *
+     * param cellSize Size of the cells the mask is reduced to, 1 keeps it as it is.
+     * param minArea Fewest foreground pixels a region must have to be kept.
+     */
+    BlobFinder(int cellSize, int minArea);
+
+    /**
+     * brief Find the regions of a mask.
+     *
+     * Rows and columns beyond the last whole cell are not looked at.
+     *
+     * param mask Mask of type CV_8UC1, non-zero where it is foreground.
+     * return The regions, largest first, valid until the next call.
+     */
+    const std::vector<MotionBlob>& find(const cv::Mat& mask);
+
+  private:
+    struct Run {
+        int row;
+        int start;
+        int end;
+        int parent;
+    };
+
+    struct Sums {
+        int left;
+        int top;
+        int right;
+        int bottom;
+        double weight;
+        double weightX;
+        double weightY;
+    };
+
+    int findRoot(int run);
+    void unite(int a, int b);
+
+    int cellSize;
+    int minArea;
+    cv::Mat cells;
+    std::vector<Run> runs;
+    std::vector<int> rootSums;
+    std::vector<Sums> sums;
+    std::vector<MotionBlob> blobs;
+};
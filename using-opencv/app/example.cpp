@@ -18,20 +18,225 @@
 #pragma GCC diagnostic ignored "-Wfloat-equal"
 #include <opencv2/imgproc.hpp>
 #pragma GCC diagnostic pop
+#include <opencv2/core/ocl.hpp>
 #include <opencv2/video.hpp>
+#include <getopt.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
+#include "bandedsubtractor.h"
+#include "blobfinder.h"
 #include "imgprovider.h"
+#include "motionevents.h"
+#include "tapibenchmark.h"
+#include "tapisubtractor.h"
 
 using namespace cv;
 
-int main(void) {
+// Frames between reports of the processing time, and of the agreement in compare mode
+#define REPORT_INTERVAL_FRAMES 300
+
+// Size of the filtering element at full resolution
+#define KERNEL_SIZE 9
+
+// Learning rate of the background models
+#define LEARNING_RATE 0.005
+
+// Most bands the frame can be split into
+#define MAX_BANDS 16
+
+// Motion regions are found on cells of this many stream pixels square, and
+// must cover at least this many stream pixels to be published
+#define BLOB_CELL_SIZE 8
+#define MIN_BLOB_AREA 256
+
+// Most regions published per frame, and how often they are published at most
+#define MAX_EVENT_BLOBS 8
+#define EVENT_INTERVAL_MS 200
+
+/**
+ * brief How motion is detected.
+ *
+ * MODE_BGR converts every frame to BGR and subtracts the background on all
+ * three channels. MODE_LUMA subtracts the background on the Y plane of the
+ * NV12 frame, optionally downscaled, without converting it. MODE_COMPARE runs
+ * both on every frame and reports how much faster the luma pipeline is and
+ * how often the two agree. MODE_BENCHMARK does not detect motion, but reports
+ * the time of each operation on the CPU and on the transparent API.
+ */
+enum MotionMode { MODE_BGR, MODE_LUMA, MODE_COMPARE, MODE_BENCHMARK };
+
+/**
+ * brief A background subtractor with its buffers.
+ */
+struct MotionPipeline {
+    Ptr<BandedSubtractor> subtractor;
+    /// Used instead of subtractor on the transparent API.
+    Ptr<TapiSubtractor> tapiSubtractor;
+    /// Converted or downscaled input, reused between frames.
+    Mat input;
+    UMat tapiInput;
+    /// Processing time since the last report.
+    int64 ticks;
+};
+
+static void initPipeline(MotionPipeline& pipeline, int numBands, int kernelSize, bool useTapi) {
+    // The filtering element is used to remove noise from the foreground
+    if (useTapi)
+        pipeline.tapiSubtractor = makePtr<TapiSubtractor>(kernelSize, LEARNING_RATE);
+    else
+        pipeline.subtractor = makePtr<BandedSubtractor>(numBands, kernelSize, LEARNING_RATE);
+    pipeline.ticks = 0;
+}
+
+/**
+ * brief Subtract the background and decide whether there is motion.
+ *
+ * param pipeline Pipeline with the background model of earlier frames.
+ * param image Image to subtract the background from.
+ * return True if any pixel is still foreground after filtering.
+ */
+static bool detectMotion(MotionPipeline& pipeline, const Mat& image) {
+    // We define movement in the image as any pixel being foreground in any band
+    return pipeline.subtractor->apply(image) > 0;
+}
+
+static bool detectMotion(MotionPipeline& pipeline, const UMat& image) {
+    return pipeline.tapiSubtractor->apply(image) > 0;
+}
+
+static bool detectMotionBgr(MotionPipeline& pipeline, const Mat& nv12) {
+    int64 start = getTickCount();
+    bool motion = false;
+
+    // Convert the NV12 data to BGR. On the transparent API the VDO buffer is
+    // wrapped in a UMat, without copying if the device shares memory with the
+    // CPU, and the wrapper is gone before the frame is released
+    if (pipeline.tapiSubtractor) {
+        UMat device = nv12.getUMat(ACCESS_READ);
+        cvtColor(device, pipeline.tapiInput, COLOR_YUV2BGR_NV12, 3);
+        motion = detectMotion(pipeline, pipeline.tapiInput);
+    } else {
+        cvtColor(nv12, pipeline.input, COLOR_YUV2BGR_NV12, 3);
+        motion = detectMotion(pipeline, pipeline.input);
+    }
+
+    pipeline.ticks += getTickCount() - start;
+    return motion;
+}
+
+static bool detectMotionLuma(MotionPipeline& pipeline, const Mat& luma, int scale) {
+    int64 start = getTickCount();
+    bool motion = false;
+    Size size(luma.cols / scale, luma.rows / scale);
+
+    // The Y plane is used where VDO wrote it, only a downscaled copy is made
+    if (pipeline.tapiSubtractor) {
+        UMat device = luma.getUMat(ACCESS_READ);
+        if (scale > 1) {
+            resize(device, pipeline.tapiInput, size, 0, 0, INTER_AREA);
+            device = pipeline.tapiInput;
+        }
+        motion = detectMotion(pipeline, device);
+    } else {
+        const Mat* image = &luma;
+        if (scale > 1) {
+            resize(luma, pipeline.input, size, 0, 0, INTER_AREA);
+            image = &pipeline.input;
+        }
+        motion = detectMotion(pipeline, *image);
+    }
+
+    pipeline.ticks += getTickCount() - start;
+    return motion;
+}
+
+/**
+ * brief Find the motion regions in the foreground of a pipeline.
+ *
+ * param finder Blob finder working on the foreground mask.
+ * param pipeline Pipeline that has processed the frame.
+ * param maskScale Stream pixels per foreground pixel, in each direction.
+ * param blobs Set to the regions, in pixels of the stream.
+ */
+static void findBlobs(BlobFinder& finder,
+                      const MotionPipeline& pipeline,
+                      int maskScale,
+                      std::vector<MotionBlob>& blobs) {
+    if (pipeline.tapiSubtractor)
+        blobs = finder.find(pipeline.tapiSubtractor->getForeground());
+    else
+        blobs = finder.find(pipeline.subtractor->getForeground());
+    for (MotionBlob& blob : blobs) {
+        blob.box = Rect(blob.box.x * maskScale,
+                        blob.box.y * maskScale,
+                        blob.box.width * maskScale,
+                        blob.box.height * maskScale);
+        blob.area *= maskScale * maskScale;
+        blob.centroidX *= maskScale;
+        blob.centroidY *= maskScale;
+    }
+}
+
+static double msPerFrame(const MotionPipeline& pipeline, unsigned int frames) {
+    return pipeline.ticks * 1000.0 / getTickFrequency() / frames;
+}
+
+static bool
+parseOptions(int argc, char** argv, MotionMode* mode, int* scale, int* numBands, bool* useTapi) {
+    static const struct option options[] = {{"mode", required_argument, NULL, 'm'},
+                                            {"scale", required_argument, NULL, 's'},
+                                            {"bands", required_argument, NULL, 'b'},
+                                            {"tapi", no_argument, NULL, 't'},
+                                            {NULL, 0, NULL, 0}};
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "m:s:b:t", options, NULL)) != -1) {
+        if (opt == 'm' && strcmp(optarg, "bgr") == 0) {
+            *mode = MODE_BGR;
+        } else if (opt == 'm' && strcmp(optarg, "luma") == 0) {
+            *mode = MODE_LUMA;
+        } else if (opt == 'm' && strcmp(optarg, "compare") == 0) {
+            *mode = MODE_COMPARE;
+        } else if (opt == 'm' && strcmp(optarg, "benchmark") == 0) {
+            *mode = MODE_BENCHMARK;
+        } else if (opt == 's' && atoi(optarg) >= 1 && atoi(optarg) <= 8) {
+            *scale = atoi(optarg);
+        } else if (opt == 'b' && atoi(optarg) >= 1 && atoi(optarg) <= MAX_BANDS) {
+            *numBands = atoi(optarg);
+        } else if (opt == 't') {
+            *useTapi = true;
+        } else {
+            syslog(LOG_ERR,
+                   "Usage: %s [--mode bgr|luma|compare|benchmark] [--scale 1-8] [--bands 1-%d] "
+                   "[--tapi]",
+                   argv[0],
+                   MAX_BANDS);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
     openlog("opencv_app", LOG_PID | LOG_CONS, LOG_USER);
     syslog(LOG_INFO, "Running OpenCV example with VDO as video source");
     ImgProvider_t* provider = NULL;
 
-    // The desired width and height of the BGR frame
+    // Luma is subtracted at 1/scale of the stream resolution in each
+    // direction. The frame is split into a band per core by default, unless
+    // the transparent API is used
+    MotionMode mode = MODE_LUMA;
+    int scale       = 2;
+    int numBands    = MIN(getNumberOfCPUs(), MAX_BANDS);
+    bool useTapi    = false;
+    if (!parseOptions(argc, argv, &mode, &scale, &numBands, &useTapi))
+        exit(1);
+    if (useTapi && !ocl::haveOpenCL())
+        syslog(LOG_WARNING, "OpenCL is not available, the transparent API runs on the CPU");
+
+    // The desired width and height of the frame
     unsigned int width  = 1024;
     unsigned int height = 576;
 
@@ -60,53 +265,125 @@ int main(void) {
         exit(3);
     }
 
-    // Create the background subtractor
-    Ptr<BackgroundSubtractorMOG2> bgsub = createBackgroundSubtractorMOG2();
+    // Create the background subtractors, each with a filtering element. Its
+    // size influences what is considered noise, with a bigger size
+    // corresponding to more denoising. The luma element is scaled with the
+    // image, so that the same objects count as noise
+    int lumaKernelSize = MAX(3, (KERNEL_SIZE / scale) | 1);
+    MotionPipeline bgr;
+    MotionPipeline luma;
+    initPipeline(bgr, numBands, KERNEL_SIZE, useTapi);
+    initPipeline(luma, numBands, lumaKernelSize, useTapi);
+
+    // The benchmark runs the luma pipeline on both the CPU and the transparent API
+    Ptr<TapiBenchmark> benchmark;
+    if (mode == MODE_BENCHMARK)
+        benchmark = makePtr<TapiBenchmark>(scale, lumaKernelSize, LEARNING_RATE);
 
-    // Create the filtering element. Its size influences what is considered
-    // noise, with a bigger size corresponding to more denoising
-    Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(9, 9));
+    if (mode == MODE_BENCHMARK)
+        syslog(LOG_INFO, "Timing each operation at 1/%d scale on the CPU and the T-API", scale);
+    else if (useTapi)
+        syslog(LOG_INFO,
+               "Detecting motion on %s on the transparent API",
+               mode == MODE_BGR       ? "BGR frames"
+               : mode == MODE_COMPARE ? "luma, compared to BGR,"
+                                      : "luma");
+    else if (mode == MODE_BGR)
+        syslog(LOG_INFO, "Detecting motion on BGR frames in %d bands", numBands);
+    else
+        syslog(LOG_INFO,
+               "Detecting motion on luma at 1/%d scale in %d bands%s",
+               scale,
+               numBands,
+               mode == MODE_COMPARE ? ", compared to BGR" : "");
 
-    // Create OpenCV Mats for the camera frame (nv12), the converted frame (bgr)
-    // and the foreground frame that is outputted by the background subtractor
-    Mat bgr_mat  = Mat(height, width, CV_8UC3);
-    Mat nv12_mat = Mat(height * 3 / 2, width, CV_8UC1);
-    Mat fg;
+    // Regions are found on the foreground that decides whether there is motion
+    int maskScale = mode == MODE_BGR ? 1 : scale;
+    BlobFinder finder(MAX(1, BLOB_CELL_SIZE / maskScale),
+                      MAX(1, MIN_BLOB_AREA / (maskScale * maskScale)));
+    MotionEventSender sender(EVENT_INTERVAL_MS, MAX_EVENT_BLOBS);
+    std::vector<MotionBlob> blobs;
+
+    unsigned int frames   = 0;
+    unsigned int agree    = 0;
+    unsigned int onlyBgr  = 0;
+    unsigned int onlyLuma = 0;
+    bool motion           = false;
+    bool bgrMotion        = false;
+    bool lumaMotion       = false;
 
     while (true) {
         // Get the latest NV12 image frame from VDO using the imageprovider
-        VdoBuffer* buf = getLastFrameBlocking(provider);
-        if (!buf) {
+        Frame frame = getLastFrame(provider);
+        if (!frame) {
             syslog(LOG_INFO, "No more frames available, exiting");
             exit(0);
         }
 
-        // Assign the VDO image buffer to the nv12_mat OpenCV Mat.
-        // This specific Mat is used as it is the one we created for NV12,
-        // which has a different layout than e.g., BGR.
-        nv12_mat.data = static_cast<uint8_t*>(vdo_buffer_get_data(buf));
+        // Time the operations instead of detecting motion
+        if (benchmark) {
+            benchmark->run(frame.getNv12(), frame.getYPlane());
+            frame.release();
+            if (++frames >= REPORT_INTERVAL_FRAMES) {
+                benchmark->report(frames);
+                frames = 0;
+            }
+            continue;
+        }
 
-        // Convert the NV12 data to BGR
-        cvtColor(nv12_mat, bgr_mat, COLOR_YUV2BGR_NV12, 3);
+        // The planes of the frame are OpenCV Mats on the VDO image buffer,
+        // nothing is copied
+        if (mode != MODE_LUMA)
+            bgrMotion = detectMotionBgr(bgr, frame.getNv12());
+        if (mode != MODE_BGR)
+            lumaMotion = detectMotionLuma(luma, frame.getYPlane(), scale);
+        motion = mode == MODE_BGR ? bgrMotion : lumaMotion;
 
-        // Perform background subtraction on the bgr image with
-        // learning rate 0.005. The resulting image should have
-        // pixel intensities > 0 only where changes have occurred
-        bgsub->apply(bgr_mat, fg, 0.005);
+        // Release the VDO frame buffer now, rather than when frame goes out of scope
+        frame.release();
 
-        // Filter noise from the image with the filtering element
-        morphologyEx(fg, fg, MORPH_OPEN, kernel);
+        // Publish where the motion is, the event system runs in the main context
+        blobs.clear();
+        if (motion)
+            findBlobs(finder, mode == MODE_BGR ? bgr : luma, maskScale, blobs);
+        sender.send(blobs);
+        g_main_context_iteration(NULL, FALSE);
 
-        // We define movement in the image as any pixel being non-zero
-        int nonzero_pixels = countNonZero(fg);
-        if (nonzero_pixels > 0) {
-            syslog(LOG_INFO, "Motion detected: YES");
+        if (motion) {
+            syslog(LOG_INFO, "Motion detected: YES, %zu regions", blobs.size());
         } else {
             syslog(LOG_INFO, "Motion detected: NO");
         }
 
-        // Release the VDO frame buffer
-        returnFrame(provider, buf);
+        frames++;
+        agree += bgrMotion == lumaMotion;
+        onlyBgr += bgrMotion && !lumaMotion;
+        onlyLuma += lumaMotion && !bgrMotion;
+        if (frames < REPORT_INTERVAL_FRAMES)
+            continue;
+
+        if (mode == MODE_BGR) {
+            syslog(LOG_INFO, "BGR pipeline: %.2f ms per frame", msPerFrame(bgr, frames));
+        } else if (mode == MODE_LUMA) {
+            syslog(LOG_INFO, "Luma pipeline: %.2f ms per frame", msPerFrame(luma, frames));
+        } else {
+            syslog(LOG_INFO,
+                   "BGR pipeline: %.2f ms, luma pipeline: %.2f ms per frame, %.1fx faster. "
+                   "Decisions agree on %.1f%% of frames, %u with motion only in BGR, %u only "
+                   "in luma",
+                   msPerFrame(bgr, frames),
+                   msPerFrame(luma, frames),
+                   luma.ticks ? static_cast<double>(bgr.ticks) / luma.ticks : 0,
+                   100.0 * agree / frames,
+                   onlyBgr,
+                   onlyLuma);
+        }
+        frames     = 0;
+        agree      = 0;
+        onlyBgr    = 0;
+        onlyLuma   = 0;
+        bgr.ticks  = 0;
+        luma.ticks = 0;
     }
     return EXIT_SUCCESS;
 }
@@ -25,6 +25,7 @@
 #include <gmodule.h>
 #include <syslog.h>
 
+#include "vdo-frame.h"
 #include "vdo-map.h"
 #include <vdo-channel.h>
 
@@ -103,6 +104,8 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
     }
 
     provider->vdoFormat    = format;
+    provider->width        = w;
+    provider->height       = h;
     provider->numAppFrames = numFrames;
 
     if (pthread_mutex_init(&provider->frameMutex, NULL)) {
@@ -391,6 +394,84 @@ void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
     pthread_mutex_unlock(&provider->frameMutex);
 }
 
+Frame::Frame() : provider(NULL), buffer(NULL), data(NULL) {}
+
+Frame::Frame(ImgProvider_t* provider, VdoBuffer* buffer)
+    : provider(provider),
+      buffer(buffer),
+      data(buffer ? static_cast<uint8_t*>(vdo_buffer_get_data(buffer)) : NULL) {}
+
+Frame::Frame(Frame&& other) noexcept
+    : provider(other.provider),
+      buffer(other.buffer),
+      data(other.data) {
+    other.buffer = NULL;
+    other.data   = NULL;
+}
+
+Frame& Frame::operator=(Frame&& other) noexcept {
+    if (this != &other) {
+        release();
+        provider     = other.provider;
+        buffer       = other.buffer;
+        data         = other.data;
+        other.buffer = NULL;
+        other.data   = NULL;
+    }
+    return *this;
+}
+
+Frame::~Frame() {
+    release();
+}
+
+void Frame::release() {
+    if (buffer)
+        returnFrame(provider, buffer);
+    buffer = NULL;
+    data   = NULL;
+}
+
+cv::Mat Frame::getNv12() const {
+    if (!buffer)
+        return cv::Mat();
+    return cv::Mat(provider->height * 3 / 2, provider->width, CV_8UC1, data);
+}
+
+cv::Mat Frame::getYPlane() const {
+    if (!buffer)
+        return cv::Mat();
+    return cv::Mat(provider->height, provider->width, CV_8UC1, data);
+}
+
+cv::Mat Frame::getUvPlane() const {
+    if (!buffer)
+        return cv::Mat();
+
+    // Each UV pair is two bytes, so a row of pairs is as many bytes as a row of luma
+    return cv::Mat(provider->height / 2,
+                   provider->width / 2,
+                   CV_8UC2,
+                   data + provider->width * provider->height,
+                   provider->width);
+}
+
+uint64_t Frame::getTimestamp() const {
+    if (!buffer)
+        return 0;
+    return vdo_frame_get_timestamp(vdo_buffer_get_frame(buffer));
+}
+
+unsigned int Frame::getSequenceNumber() const {
+    if (!buffer)
+        return 0;
+    return vdo_frame_get_sequence_nbr(vdo_buffer_get_frame(buffer));
+}
+
+Frame getLastFrame(ImgProvider_t* provider) {
+    return Frame(provider, getLastFrameBlocking(provider));
+}
+
 static void* threadEntry(void* data) {
     GError* error           = NULL;
     ImgProvider_t* provider = (ImgProvider_t*)data;
@@ -25,6 +25,12 @@
 #define _Atomic(X) std::atomic<X>
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
 
 #include "vdo-stream.h"
 #include "vdo-types.h"
@@ -41,6 +47,8 @@
 typedef struct ImgProvider {
     /// Stream configuration parameters.
     VdoFormat vdoFormat;
+    unsigned int width;
+    unsigned int height;
 
     /// Vdo stream and buffers handling.
     VdoStream* vdoStream;
@@ -131,3 +139,106 @@ VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider);
  * param buffer Pointer to the image buffer to be released.
  */
 void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer);
+
+/**
+ * brief A frame from an ImgProvider, returned to it when destroyed.
+ *
+ * A Frame owns its buffer until it is destroyed or released, and can be moved
+ * but not copied, so that a buffer is returned exactly once. A buffer that is
+ * never returned is lost to VDO, which eventually has none left to fill.
+ *
+ * The planes are cv::Mat headers on the buffer itself, nothing is copied.
+ * They must not be used after the frame has been released.
+ */
+class Frame {
+  public:
+    /**
+     * brief Create an empty frame, holding no buffer.
+     */
+    Frame();
+
+    /**
+     * brief Take ownership of a buffer from getLastFrameBlocking().
+     *
+     * param provider Pointer to the ImgProvider the buffer came from.
+     * param buffer Pointer to the image buffer, may be NULL.
+     */
+    Frame(ImgProvider_t* provider, VdoBuffer* buffer);
+
+    // noexcept, so that standard containers move frames rather than try to copy them
+    Frame(Frame&& other) noexcept;
+    Frame& operator=(Frame&& other) noexcept;
+    Frame(const Frame&)            = delete;
+    Frame& operator=(const Frame&) = delete;
+
+    /**
+     * brief Return the buffer to the ImgProvider, if the frame holds one.
+     */
+    ~Frame();
+
+    /**
+     * brief Return the buffer to the ImgProvider before the frame is destroyed.
+     */
+    void release();
+
+    /**
+     * brief Check whether the frame holds a buffer.
+     */
+    explicit operator bool() const { return buffer != NULL; }
+
+    /**
+     * brief Get the whole NV12 frame, the Y plane followed by the UV plane.
+     *
+     * return Single channel Mat of height * 3 / 2 rows, empty if the frame is.
+     */
+    cv::Mat getNv12() const;
+
+    /**
+     * brief Get the Y plane, the luma of each pixel.
+     *
+     * return Single channel Mat of the size of the frame, empty if the frame is.
+     */
+    cv::Mat getYPlane() const;
+
+    /**
+     * brief Get the UV plane, interleaved chroma of each 2 x 2 pixels.
+     *
+     * return Two channel Mat of half the width and height of the frame, empty if the frame
+     *        is.
+     */
+    cv::Mat getUvPlane() const;
+
+    /**
+     * brief Get the capture time of the frame.
+     *
+     * return Timestamp in microseconds, 0 if the frame is empty.
+     */
+    uint64_t getTimestamp() const;
+
+    /**
+     * brief Get the sequence number of the frame, counted by VDO.
+     *
+     * return Sequence number, 0 if the frame is empty.
+     */
+    unsigned int getSequenceNumber() const;
+
+    /**
+     * brief Get the VDO buffer, still owned by the frame.
+     *
+     * return Pointer to the image buffer, or NULL if the frame is empty.
+     */
+    VdoBuffer* getBuffer() const { return buffer; }
+
+  private:
+    ImgProvider_t* provider;
+    VdoBuffer* buffer;
+    uint8_t* data;
+};
+
+/**
+ * brief Get the most recent frame the thread has fetched from VDO.
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * return The frame, or an empty frame on failure.
+ */
+Frame getLastFrame(ImgProvider_t* provider);
@@ -0,0 +1,190 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles publishing motion regions as events.
+ */
+
+#include "motionevents.h"
+
+#include <algorithm>
+#include <syslog.h>
+
+// Integer and float data of the event, in the order they are added
+static const char* const intKeys[]   = {"Count", "Left", "Top", "Width", "Height", "Area"};
+static const char* const floatKeys[] = {"CentroidX", "CentroidY"};
+
+/**
+ * brief Add the keys of the event, with the values of a region.
+ *
+ * param keyValueSet Set to add the keys to.
+ * param index Position of the region in the frame.
+ * param count Number of regions in the frame.
+ * param blob The region.
+ */
+static void
+addKeys(AXEventKeyValueSet* keyValueSet, int index, int count, const MotionBlob& blob) {
+    const cv::Rect& box = blob.box;
+    int ints[]          = {count, box.x, box.y, box.width, box.height, blob.area};
+    double floats[]     = {blob.centroidX, blob.centroidY};
+    const int numInt    = sizeof(ints) / sizeof(ints[0]);
+    const int numFloat  = sizeof(floats) / sizeof(floats[0]);
+
+    ax_event_key_value_set_add_key_value(keyValueSet,
+                                         "Index",
+                                         NULL,
+                                         &index,
+                                         AX_VALUE_TYPE_INT,
+                                         NULL);
+    for (int i = 0; i < numInt; i++)
+        ax_event_key_value_set_add_key_value(keyValueSet,
+                                             intKeys[i],
+                                             NULL,
+                                             &ints[i],
+                                             AX_VALUE_TYPE_INT,
+                                             NULL);
+    for (int i = 0; i < numFloat; i++)
+        ax_event_key_value_set_add_key_value(keyValueSet,
+                                             floatKeys[i],
+                                             NULL,
+                                             &floats[i],
+                                             AX_VALUE_TYPE_DOUBLE,
+                                             NULL);
+}
+
+/**
+ * brief Setup a declaration of the event.
+ *
+ * Declare a stateless event that looks like this, using the Axis namespace
+ * "tnsaxis".
+ *
+ * Topic: tnsaxis:CameraApplicationPlatform/MotionBlob
+ * <tt:MessageDescription IsProperty="false">
+ *  <tt:Source>
+ *   <tt:SimpleItemDescription Name="Index" Type="xs:int"/>
+ *  </tt:Source>
+ *  <tt:Data>
+ *   <tt:SimpleItemDescription Name="Count" Type="xs:int"/>
+ *   <tt:SimpleItemDescription Name="Left" Type="xs:int"/>
+ *   ...
+ *   <tt:SimpleItemDescription Name="CentroidY" Type="xs:float"/>
+ *  </tt:Data>
+ * </tt:MessageDescription>
+ */
+MotionEventSender::MotionEventSender(unsigned int intervalMs, unsigned int maxBlobs)
+    : eventHandler(ax_event_handler_new()),
+      declaration(0),
+      declared(false),
+      intervalUs(static_cast<gint64>(intervalMs) * 1000),
+      maxBlobs(maxBlobs),
+      lastSent(0),
+      lastHadMotion(false) {
+    AXEventKeyValueSet* keyValueSet = ax_event_key_value_set_new();
+    GError* error                   = NULL;
+    MotionBlob none                 = {cv::Rect(), 0, 0, 0};
+
+    // Create keys and namespaces for the event
+    ax_event_key_value_set_add_key_value(keyValueSet,
+                                         "topic0",
+                                         "tnsaxis",
+                                         "CameraApplicationPlatform",
+                                         AX_VALUE_TYPE_STRING,
+                                         NULL);
+    ax_event_key_value_set_add_key_value(keyValueSet,
+                                         "topic1",
+                                         "tnsaxis",
+                                         "MotionBlob",
+                                         AX_VALUE_TYPE_STRING,
+                                         NULL);
+    addKeys(keyValueSet, 0, 0, none);
+
+    ax_event_key_value_set_mark_as_source(keyValueSet, "Index", NULL, NULL);
+    ax_event_key_value_set_mark_as_user_defined(keyValueSet, "Index", NULL, "wstype:xs:int", NULL);
+    for (const char* key : intKeys) {
+        ax_event_key_value_set_mark_as_data(keyValueSet, key, NULL, NULL);
+        ax_event_key_value_set_mark_as_user_defined(keyValueSet, key, NULL, "wstype:xs:int", NULL);
+    }
+    for (const char* key : floatKeys) {
+        ax_event_key_value_set_mark_as_data(keyValueSet, key, NULL, NULL);
+        ax_event_key_value_set_mark_as_user_defined(keyValueSet,
+                                                    key,
+                                                    NULL,
+                                                    "wstype:xs:float",
+                                                    NULL);
+    }
+
+    // Declare event
+    if (!ax_event_handler_declare(eventHandler,
+                                  keyValueSet,
+                                  TRUE,  // Indicate a stateless event
+                                  &declaration,
+                                  declarationComplete,
+                                  this,
+                                  &error)) {
+        syslog(LOG_WARNING, "Could not declare motion event: %s", error->message);
+        g_error_free(error);
+    }
+
+    // The key/value set is no longer needed
+    ax_event_key_value_set_free(keyValueSet);
+}
+
+MotionEventSender::~MotionEventSender() {
+    if (declaration)
+        ax_event_handler_undeclare(eventHandler, declaration, NULL);
+    ax_event_handler_free(eventHandler);
+}
+
+void MotionEventSender::declarationComplete(guint declaration, gpointer data) {
+    syslog(LOG_INFO, "Declaration complete for motion event: %u", declaration);
+    static_cast<MotionEventSender*>(data)->declared = true;
+}
+
+void MotionEventSender::sendBlob(int index, int count, const MotionBlob& blob) {
+    AXEventKeyValueSet* keyValueSet = ax_event_key_value_set_new();
+    addKeys(keyValueSet, index, count, blob);
+
+    // Use ax_event_new2 since ax_event_new is deprecated from 3.2
+    AXEvent* event = ax_event_new2(keyValueSet, NULL);
+    ax_event_key_value_set_free(keyValueSet);
+
+    ax_event_handler_send_event(eventHandler, declaration, event, NULL);
+    ax_event_free(event);
+}
+
+void MotionEventSender::send(const std::vector<MotionBlob>& blobs) {
+    gint64 now = g_get_monotonic_time();
+    if (!declared)
+        return;
+
+    // Motion stopping is sent right away, otherwise no more often than the interval
+    bool hasMotion = !blobs.empty();
+    if (!hasMotion && !lastHadMotion)
+        return;
+    if (hasMotion && lastHadMotion && now - lastSent < intervalUs)
+        return;
+
+    int count = static_cast<int>(std::min<size_t>(blobs.size(), maxBlobs));
+    if (!hasMotion) {
+        MotionBlob none = {cv::Rect(), 0, 0, 0};
+        sendBlob(0, 0, none);
+    }
+    for (int i = 0; i < count; i++)
+        sendBlob(i, count, blobs[i]);
+
+    lastSent      = now;
+    lastHadMotion = hasMotion;
+}
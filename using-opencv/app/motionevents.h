@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles publishing motion regions as events.
+ */
+
+#pragma once
+
+#include <axsdk/axevent.h>
+#include <glib.h>
+#include <vector>
+
+#include "blobfinder.h"
+
+/**
+ * brief Publisher of motion regions through the event system.
+ *
+ * A stateless event is declared under the topic
+ * tnsaxis:CameraApplicationPlatform/MotionBlob, and every region is sent as
+ * an event of its own. Index is the source of the event, the position of the
+ * region among the Count regions of the frame, largest first. The data is
+ * the bounding box Left, Top, Width and Height, the Area in pixels and the
+ * centroid CentroidX and CentroidY, all in pixels of the stream.
+ *
+ * Events are sent at most once per interval while there is motion, and once
+ * with Count 0 when the motion stops. The declaration completes through the
+ * default GLib main context, which the application must iterate.
+ */
+class MotionEventSender {
+  public:
+    /**
+     * brief Declare the event.
+     *
+     * param intervalMs Shortest time between two sets of events.
+     * param maxBlobs Most regions sent for one frame.
+     */
+    MotionEventSender(unsigned int intervalMs, unsigned int maxBlobs);
+
+    /**
+     * brief Undeclare the event.
+     */
+    ~MotionEventSender();
+
+    /**
+     * brief Send the regions of a frame, unless too soon after the last ones.
+     *
+     * param blobs Regions of the frame in pixels of the stream, largest first.
+     */
+    void send(const std::vector<MotionBlob>& blobs);
+
+  private:
+    MotionEventSender(const MotionEventSender&);
+    MotionEventSender& operator=(const MotionEventSender&);
+
+    static void declarationComplete(guint declaration, gpointer data);
+    void sendBlob(int index, int count, const MotionBlob& blob);
+
+    AXEventHandler* eventHandler;
+    guint declaration;
+    bool declared;
+    gint64 intervalUs;
+    unsigned int maxBlobs;
+    gint64 lastSent;
+    bool lastHadMotion;
+};
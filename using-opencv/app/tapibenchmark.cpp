@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles timing the operations of motion detection on the CPU and
+ * on the transparent API of OpenCV.
+ */
+
+#include "tapibenchmark.h"
+
+#include <opencv2/core/ocl.hpp>
+#include <string.h>
+#include <syslog.h>
+
+using namespace cv;
+
+// Names of the operations in the report, in the order of TapiBenchmark::Operation
+static const char* const operationNames[] =
+    {"map", "cvtColor", "resize", "MOG2", "opening", "countNonZero", "read back"};
+
+/**
+ * brief Get the ticks since the last lap, and start a new one.
+ *
+ * param start Start of the lap, set to now.
+ * return Ticks since start.
+ */
+static int64 lap(int64& start) {
+    int64 now   = getTickCount();
+    int64 ticks = now - start;
+    start       = now;
+    return ticks;
+}
+
+static double msPerFrame(int64 ticks, unsigned int frames) {
+    return ticks * 1000.0 / getTickFrequency() / frames;
+}
+
+TapiBenchmark::TapiBenchmark(int scale, int kernelSize, double learningRate)
+    : scale(scale),
+      learningRate(learningRate),
+      kernel(getStructuringElement(MORPH_ELLIPSE, Size(kernelSize, kernelSize))),
+      cpuBgsub(createBackgroundSubtractorMOG2()),
+      tapiBgsub(createBackgroundSubtractorMOG2()) {
+    memset(cpuTicks, 0, sizeof(cpuTicks));
+    memset(tapiTicks, 0, sizeof(tapiTicks));
+
+    if (ocl::haveOpenCL()) {
+        const ocl::Device& device = ocl::Device::getDefault();
+        syslog(LOG_INFO,
+               "Benchmarking the transparent API on %s, %s memory with the CPU",
+               device.name().c_str(),
+               device.hostUnifiedMemory() ? "sharing" : "not sharing");
+    } else {
+        syslog(LOG_WARNING, "OpenCL is not available, the transparent API runs on the CPU");
+    }
+}
+
+void TapiBenchmark::run(const Mat& nv12, const Mat& luma) {
+    Size small(luma.cols / scale, luma.rows / scale);
+
+    // The CPU pipeline works on the VDO buffer where it is
+    int64 start = getTickCount();
+    cvtColor(nv12, cpuBgr, COLOR_YUV2BGR_NV12, 3);
+    cpuTicks[OP_CONVERT] += lap(start);
+    const Mat* cpuImage = &luma;
+    if (scale > 1) {
+        resize(luma, cpuSmall, small, 0, 0, INTER_AREA);
+        cpuImage = &cpuSmall;
+    }
+    cpuTicks[OP_RESIZE] += lap(start);
+    cpuBgsub->apply(*cpuImage, cpuFg, learningRate);
+    cpuTicks[OP_SUBTRACT] += lap(start);
+    morphologyEx(cpuFg, cpuFg, MORPH_OPEN, kernel);
+    cpuTicks[OP_FILTER] += lap(start);
+    countNonZero(cpuFg);
+    cpuTicks[OP_COUNT] += lap(start);
+
+    // Where the device shares memory with the CPU, the VDO buffer is wrapped
+    // rather than copied. The wrappers must be gone before the frame is released
+    UMat tapiNv12  = nv12.getUMat(ACCESS_READ);
+    UMat tapiLuma  = tapiNv12.rowRange(0, luma.rows);
+    UMat tapiImage = tapiLuma;
+    tapiTicks[OP_MAP] += lap(start);
+    cvtColor(tapiNv12, tapiBgr, COLOR_YUV2BGR_NV12, 3);
+    ocl::finish();
+    tapiTicks[OP_CONVERT] += lap(start);
+    if (scale > 1) {
+        resize(tapiLuma, tapiSmall, small, 0, 0, INTER_AREA);
+        tapiImage = tapiSmall;
+    }
+    ocl::finish();
+    tapiTicks[OP_RESIZE] += lap(start);
+    tapiBgsub->apply(tapiImage, tapiFg, learningRate);
+    ocl::finish();
+    tapiTicks[OP_SUBTRACT] += lap(start);
+    morphologyEx(tapiFg, tapiFg, MORPH_OPEN, kernel);
+    ocl::finish();
+    tapiTicks[OP_FILTER] += lap(start);
+    countNonZero(tapiFg);
+    tapiTicks[OP_COUNT] += lap(start);
+    tapiFg.copyTo(tapiForeground);
+    tapiTicks[OP_READ_BACK] += lap(start);
+}
+
+void TapiBenchmark::report(unsigned int frames) {
+    int64 cpuTotal  = 0;
+    int64 tapiTotal = 0;
+
+    for (int i = 0; i < NUM_OPERATIONS; i++) {
+        if (i == OP_MAP || i == OP_READ_BACK) {
+            syslog(LOG_INFO,
+                   "%s: T-API %.2f ms per frame",
+                   operationNames[i],
+                   msPerFrame(tapiTicks[i], frames));
+        } else {
+            syslog(LOG_INFO,
+                   "%s: CPU %.2f ms, T-API %.2f ms per frame, %.1fx",
+                   operationNames[i],
+                   msPerFrame(cpuTicks[i], frames),
+                   msPerFrame(tapiTicks[i], frames),
+                   tapiTicks[i] ? static_cast<double>(cpuTicks[i]) / tapiTicks[i] : 0);
+        }
+        cpuTotal += cpuTicks[i];
+        tapiTotal += tapiTicks[i];
+    }
+    syslog(LOG_INFO,
+           "Total: CPU %.2f ms, T-API %.2f ms per frame, %.1fx",
+           msPerFrame(cpuTotal, frames),
+           msPerFrame(tapiTotal, frames),
+           tapiTotal ? static_cast<double>(cpuTotal) / tapiTotal : 0);
+
+    memset(cpuTicks, 0, sizeof(cpuTicks));
+    memset(tapiTicks, 0, sizeof(tapiTicks));
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles timing the operations of motion detection on the
+ * CPU and on the transparent API of OpenCV.
+ */
+
+#pragma once
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+#include <opencv2/video.hpp>
+#include <stdint.h>
+
+/**
+ * brief Per operation timing of motion detection on cv::Mat and cv::UMat.
+ *
+ * Every frame goes through the operations of motion detection twice, once on
+ * cv::Mat on the CPU and once on cv::UMat, which runs them as OpenCL kernels
+ * when OpenCL is available. Each operation on the transparent API is waited
+ * for with cv::ocl::finish() before it is timed, so that the time is that of
+ * running it rather than of queueing it.
+ *
+ * The operations are the conversion of the NV12 frame to BGR, the downscaling
+ * of the Y plane, MOG2 and the opening on the downscaled Y plane, and the
+ * count of foreground pixels. Mapping the VDO buffer into a cv::UMat and
+ * reading the foreground back to the CPU are timed too, as they are only
+ * needed on the transparent API.
+ */
+class TapiBenchmark {
+  public:
+    /**
+     * brief Create a background model for each side.
+     *
+     * param scale Times the Y plane is downscaled in each direction.
+     * param kernelSize Size of the elliptic element that filters noise.
+     * param learningRate Learning rate of the background models.
+     */
+    TapiBenchmark(int scale, int kernelSize, double learningRate);
+
+    /**
+     * brief Time the operations on a frame.
+     *
+     * The VDO buffer is only used during the call.
+     *
+     * param nv12 NV12 frame, with the Y plane first.
+     * param luma Y plane of the frame.
+     */
+    void run(const cv::Mat& nv12, const cv::Mat& luma);
+
+    /**
+     * brief Log the time per frame of each operation, and start over.
+     *
+     * param frames Number of frames run since the last report.
+     */
+    void report(unsigned int frames);
+
+  private:
+    enum Operation {
+        OP_MAP,
+        OP_CONVERT,
+        OP_RESIZE,
+        OP_SUBTRACT,
+        OP_FILTER,
+        OP_COUNT,
+        OP_READ_BACK,
+        NUM_OPERATIONS
+    };
+
+    int scale;
+    double learningRate;
+    cv::Mat kernel;
+
+    cv::Ptr<cv::BackgroundSubtractorMOG2> cpuBgsub;
+    cv::Mat cpuBgr;
+    cv::Mat cpuSmall;
+    cv::Mat cpuFg;
+    int64_t cpuTicks[NUM_OPERATIONS];
+
+    cv::Ptr<cv::BackgroundSubtractorMOG2> tapiBgsub;
+    cv::UMat tapiBgr;
+    cv::UMat tapiSmall;
+    cv::UMat tapiFg;
+    cv::Mat tapiForeground;
+    int64_t tapiTicks[NUM_OPERATIONS];
+};
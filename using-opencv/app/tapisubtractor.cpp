@@ -0,0 +1,46 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles background subtraction on the transparent API of OpenCV.
+ */
+
+#include "tapisubtractor.h"
+
+using namespace cv;
+
+TapiSubtractor::TapiSubtractor(int kernelSize, double learningRate)
+    : bgsub(createBackgroundSubtractorMOG2()),
+      kernel(getStructuringElement(MORPH_ELLIPSE, Size(kernelSize, kernelSize))),
+      learningRate(learningRate),
+      readBack(false) {}
+
+int TapiSubtractor::apply(const UMat& image) {
+    bgsub->apply(image, fg, learningRate);
+    morphologyEx(fg, fg, MORPH_OPEN, kernel);
+    readBack = false;
+
+    // Only the count comes back to the CPU
+    return countNonZero(fg);
+}
+
+const Mat& TapiSubtractor::getForeground() {
+    if (!readBack) {
+        fg.copyTo(foreground);
+        readBack = true;
+    }
+    return foreground;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles background subtraction on the transparent API of
+ * OpenCV.
+ */
+
+#pragma once
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+#include <opencv2/video.hpp>
+
+/**
+ * brief Background subtraction and noise filtering on cv::UMat.
+ *
+ * With cv::UMat images, MOG2, the opening that filters noise and the count of
+ * foreground pixels run as OpenCL kernels when OpenCL is available, and on
+ * the CPU otherwise. The whole image is processed at once, since the device
+ * spreads the work itself, and the foreground stays on the device unless it
+ * is asked for.
+ */
+class TapiSubtractor {
+  public:
+    /**
+     * brief Create the background model.
+     *
+     * param kernelSize Size of the elliptic element that filters noise.
+     * param learningRate Learning rate of the background model.
+     */
+    TapiSubtractor(int kernelSize, double learningRate);
+
+    /**
+     * brief Subtract the background of an image and filter noise.
+     *
+     * All images must have the same size and type.
+     *
+     * param image Image to subtract the background from.
+     * return Number of foreground pixels in the image.
+     */
+    int apply(const cv::UMat& image);
+
+    /**
+     * brief Get the foreground of the last image, after noise filtering.
+     *
+     * The foreground is read back from the device the first time after each
+     * image.
+     *
+     * return Mask of the same size as the image, non-zero where it is foreground.
+     */
+    const cv::Mat& getForeground();
+
+  private:
+    cv::Ptr<cv::BackgroundSubtractorMOG2> bgsub;
+    cv::UMat fg;
+    cv::Mat foreground;
+    cv::Mat kernel;
+    double learningRate;
+    bool readBack;
+};
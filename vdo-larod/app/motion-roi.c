@@ -0,0 +1,454 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles finding the areas of the image where there is motion, and
+ * covering them with crops of the size of the model input.
+ */
+
+#include "motion-roi.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <syslog.h>
+
+// Most regions of one image. With more, the whole view is used.
+#define MAX_MOTION_REGIONS (64)
+
+// The running average moves 1/BG_LEARN_RATE of the way to each new image
+#define BG_LEARN_RATE (16)
+
+// Cell means and the running average are kept in 1/BG_SCALE luma steps
+#define BG_SCALE (16)
+
+typedef struct Run {
+    unsigned int row;
+    unsigned int start;
+    unsigned int end;
+    size_t parent;
+} Run;
+
+typedef struct Region {
+    unsigned int left;
+    unsigned int top;
+    unsigned int right;
+    unsigned int bottom;
+    unsigned int cells;
+} Region;
+
+struct MotionRoi {
+    MotionRoiConfig config;
+    unsigned int gridWidth;
+    unsigned int gridHeight;
+
+    /// Sum of the luma of each cell of the current row of cells.
+    uint32_t* cellSums;
+    /// Running average of the mean luma of each cell.
+    int32_t* background;
+    /// Non-zero for each cell with motion in the last image.
+    uint8_t* mask;
+    bool seeded;
+
+    /// Runs of cells with motion, and the region each root run belongs to.
+    Run* runs;
+    size_t* rootRegions;
+    Region* regions;
+
+    /// Areas with motion in pixels of the stream, and the crops covering them.
+    MotionCrop boxes[MAX_MOTION_REGIONS];
+    MotionCrop windows[MAX_MOTION_REGIONS];
+};
+
+MotionRoi* createMotionRoi(const MotionRoiConfig* config) {
+    if (config->cellSize == 0 || config->cropWidth == 0 || config->cropHeight == 0 ||
+        config->cropWidth > config->streamWidth || config->cropHeight > config->streamHeight ||
+        config->maxCrops == 0 || config->maxCrops > MAX_MOTION_CROPS) {
+        syslog(LOG_ERR, "%s: Invalid motion analysis parameters", __func__);
+        return NULL;
+    }
+
+    MotionRoi* roi = calloc(1, sizeof(MotionRoi));
+    if (!roi) {
+        syslog(LOG_ERR, "%s: Unable to allocate MotionRoi", __func__);
+        return NULL;
+    }
+
+    roi->config     = *config;
+    roi->gridWidth  = config->streamWidth / config->cellSize;
+    roi->gridHeight = config->streamHeight / config->cellSize;
+    if (roi->gridWidth == 0 || roi->gridHeight == 0) {
+        syslog(LOG_ERR, "%s: Cells of %u pixels do not fit the stream", __func__, config->cellSize);
+        goto errorExit;
+    }
+
+    // Every other cell of a row can start a run, and each run can be a region
+    size_t numCells  = (size_t)roi->gridWidth * roi->gridHeight;
+    size_t maxRuns   = (size_t)roi->gridHeight * ((roi->gridWidth + 1) / 2);
+    roi->cellSums    = calloc(roi->gridWidth, sizeof(uint32_t));
+    roi->background  = calloc(numCells, sizeof(int32_t));
+    roi->mask        = calloc(numCells, sizeof(uint8_t));
+    roi->runs        = calloc(maxRuns, sizeof(Run));
+    roi->rootRegions = calloc(maxRuns, sizeof(size_t));
+    roi->regions     = calloc(maxRuns, sizeof(Region));
+    if (!roi->cellSums || !roi->background || !roi->mask || !roi->runs || !roi->rootRegions ||
+        !roi->regions) {
+        syslog(LOG_ERR, "%s: Unable to allocate motion buffers", __func__);
+        goto errorExit;
+    }
+
+    return roi;
+
+errorExit:
+    destroyMotionRoi(roi);
+
+    return NULL;
+}
+
+/**
+ * brief Reduce the luma plane to cells and mark the cells that changed.
+ *
+ * param roi Pointer to a MotionRoi.
+ * param luma Luma plane of the image.
+ */
+static void updateMask(MotionRoi* roi, const uint8_t* luma) {
+    const unsigned int cellSize = roi->config.cellSize;
+    const unsigned int stride   = roi->config.streamWidth;
+    const int32_t cellPixels    = (int32_t)(cellSize * cellSize);
+    const int32_t threshold     = (int32_t)roi->config.threshold * BG_SCALE;
+
+    for (unsigned int gy = 0; gy < roi->gridHeight; gy++) {
+        for (unsigned int gx = 0; gx < roi->gridWidth; gx++) {
+            roi->cellSums[gx] = 0;
+        }
+        for (unsigned int dy = 0; dy < cellSize; dy++) {
+            const uint8_t* row = luma + (size_t)(gy * cellSize + dy) * stride;
+            for (unsigned int gx = 0; gx < roi->gridWidth; gx++) {
+                const uint8_t* cell = row + gx * cellSize;
+                uint32_t sum        = 0;
+                for (unsigned int dx = 0; dx < cellSize; dx++) {
+                    sum += cell[dx];
+                }
+                roi->cellSums[gx] += sum;
+            }
+        }
+
+        for (unsigned int gx = 0; gx < roi->gridWidth; gx++) {
+            size_t i     = (size_t)gy * roi->gridWidth + gx;
+            int32_t mean = (int32_t)roi->cellSums[gx] * BG_SCALE / cellPixels;
+            if (!roi->seeded) {
+                roi->background[i] = mean;
+                roi->mask[i]       = 0;
+                continue;
+            }
+            int32_t diff = mean - roi->background[i];
+            roi->mask[i] = abs(diff) > threshold;
+            roi->background[i] += diff / BG_LEARN_RATE;
+        }
+    }
+    roi->seeded = true;
+}
+
+/**
+ * brief Find the root run of the region a run belongs to.
+ *
+ * param roi Pointer to a MotionRoi.
+ * param run Index of the run.
+ * return Index of the root run.
+ */
+static size_t findRoot(MotionRoi* roi, size_t run) {
+    // Halve the path on the way, so that later lookups are shorter
+    while (roi->runs[run].parent != run) {
+        roi->runs[run].parent = roi->runs[roi->runs[run].parent].parent;
+        run                   = roi->runs[run].parent;
+    }
+    return run;
+}
+
+/**
+ * brief Join the regions of two runs.
+ *
+ * param roi Pointer to a MotionRoi.
+ * param a Index of one run.
+ * param b Index of the other run.
+ */
+static void unite(MotionRoi* roi, size_t a, size_t b) {
+    a = findRoot(roi, a);
+    b = findRoot(roi, b);
+
+    // The earlier run becomes the root, so roots always come first
+    if (a < b) {
+        roi->runs[b].parent = a;
+    } else if (b < a) {
+        roi->runs[a].parent = b;
+    }
+}
+
+/**
+ * brief Find the connected regions of the mask as boxes in pixels of the stream.
+ *
+ * param roi Pointer to a MotionRoi.
+ * param numBoxes Number of boxes found, 0 if there is no motion.
+ * return False if there are more than MAX_MOTION_REGIONS regions, otherwise true.
+ */
+static bool findBoxes(MotionRoi* roi, size_t* numBoxes) {
+    size_t numRuns       = 0;
+    size_t previousStart = 0;
+
+    // Split each row into runs and join them with the runs they touch in the row above
+    for (unsigned int y = 0; y < roi->gridHeight; y++) {
+        const uint8_t* row = roi->mask + (size_t)y * roi->gridWidth;
+        size_t rowStart    = numRuns;
+        size_t above       = previousStart;
+
+        for (unsigned int x = 0; x < roi->gridWidth;) {
+            if (!row[x]) {
+                x++;
+                continue;
+            }
+            Run* run    = &roi->runs[numRuns];
+            run->row    = y;
+            run->start  = x;
+            run->parent = numRuns;
+            while (x < roi->gridWidth && row[x]) {
+                x++;
+            }
+            run->end = x;
+
+            // Runs are in order, so runs of the row above that end before this one are done
+            while (above < rowStart && roi->runs[above].end < run->start) {
+                above++;
+            }
+            for (size_t i = above; i < rowStart && roi->runs[i].start <= run->end; i++) {
+                unite(roi, i, numRuns);
+            }
+            numRuns++;
+        }
+        previousStart = rowStart;
+    }
+
+    // Add up the bounding box and number of cells of each region
+    size_t numRegions = 0;
+    for (size_t i = 0; i < numRuns; i++) {
+        const Run* run = &roi->runs[i];
+        size_t root    = findRoot(roi, i);
+        if (root == i) {
+            Region empty               = {run->start, run->row, run->end, run->row + 1, 0};
+            roi->rootRegions[i]        = numRegions;
+            roi->regions[numRegions++] = empty;
+        }
+
+        Region* region = &roi->regions[roi->rootRegions[root]];
+        if (run->start < region->left) {
+            region->left = run->start;
+        }
+        if (run->end > region->right) {
+            region->right = run->end;
+        }
+        region->bottom = run->row + 1;
+        region->cells += run->end - run->start;
+    }
+
+    const unsigned int cellSize = roi->config.cellSize;
+    *numBoxes                   = 0;
+    for (size_t i = 0; i < numRegions; i++) {
+        const Region* region = &roi->regions[i];
+        if (region->cells < roi->config.minCells) {
+            continue;
+        }
+        if (*numBoxes == MAX_MOTION_REGIONS) {
+            return false;
+        }
+        MotionCrop box = {region->left * cellSize,
+                          region->top * cellSize,
+                          (region->right - region->left) * cellSize,
+                          (region->bottom - region->top) * cellSize};
+        roi->boxes[(*numBoxes)++] = box;
+    }
+
+    return true;
+}
+
+/**
+ * brief Get the smallest box holding two boxes.
+ *
+ * param a One box.
+ * param b The other box.
+ * return Box holding both.
+ */
+static MotionCrop unionOf(const MotionCrop* a, const MotionCrop* b) {
+    unsigned int left   = a->x < b->x ? a->x : b->x;
+    unsigned int top    = a->y < b->y ? a->y : b->y;
+    unsigned int right  = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    unsigned int bottom = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+    MotionCrop box      = {left, top, right - left, bottom - top};
+    return box;
+}
+
+/**
+ * brief Check whether a box lies within another box.
+ *
+ * param outer The box that may hold the other.
+ * param inner The box that may be held.
+ * return True if inner lies within outer.
+ */
+static bool contains(const MotionCrop* outer, const MotionCrop* inner) {
+    return inner->x >= outer->x && inner->y >= outer->y &&
+           inner->x + inner->width <= outer->x + outer->width &&
+           inner->y + inner->height <= outer->y + outer->height;
+}
+
+/**
+ * brief Get the position of a crop centered on a box, kept within the stream.
+ *
+ * The position is rounded down to even pixels, as NV12 chroma covers 2 x 2
+ * pixels.
+ *
+ * param center Center of the box.
+ * param size Size of the crop.
+ * param limit Size of the stream.
+ * return Position of the crop.
+ */
+static unsigned int placeCrop(unsigned int center, unsigned int size, unsigned int limit) {
+    unsigned int pos = center > size / 2 ? center - size / 2 : 0;
+    if (pos + size > limit) {
+        pos = limit - size;
+    }
+    return pos & ~1u;
+}
+
+/**
+ * brief Get the crop of the model aspect ratio that covers a box.
+ *
+ * param roi Pointer to a MotionRoi.
+ * param box Box in pixels of the stream.
+ * param crop Crop to fill in.
+ * return False if the crop would not fit in the stream, otherwise true.
+ */
+static bool cropAround(const MotionRoi* roi, const MotionCrop* box, MotionCrop* crop) {
+    const MotionRoiConfig* config = &roi->config;
+    unsigned int width            = config->cropWidth;
+    unsigned int height           = config->cropHeight;
+
+    // A larger box is scaled down to the model input by preprocessing
+    if (box->width > width || box->height > height) {
+        unsigned int aspectWidth =
+            (box->height * config->cropWidth + config->cropHeight - 1) / config->cropHeight;
+        width  = box->width > aspectWidth ? box->width : aspectWidth;
+        height = (width * config->cropHeight + config->cropWidth - 1) / config->cropWidth;
+        if (width > config->streamWidth || height > config->streamHeight) {
+            return false;
+        }
+    }
+
+    crop->x      = placeCrop(box->x + box->width / 2, width, config->streamWidth);
+    crop->y      = placeCrop(box->y + box->height / 2, height, config->streamHeight);
+    crop->width  = width;
+    crop->height = height;
+
+    return true;
+}
+
+/**
+ * brief Order boxes by area, largest first.
+ *
+ * param a One box.
+ * param b The other box.
+ * return Negative if a is larger, positive if b is larger, otherwise 0.
+ */
+static int largerArea(const void* a, const void* b) {
+    const MotionCrop* boxA = a;
+    const MotionCrop* boxB = b;
+    unsigned long areaA    = (unsigned long)boxA->width * boxA->height;
+    unsigned long areaB    = (unsigned long)boxB->width * boxB->height;
+    return (areaA < areaB) - (areaA > areaB);
+}
+
+size_t findMotionCrops(MotionRoi* roi, const uint8_t* luma, MotionCrop* crops) {
+    size_t numBoxes = 0;
+
+    updateMask(roi, luma);
+    if (!findBoxes(roi, &numBoxes)) {
+        crops[0] = roi->config.fullView;
+        return 1;
+    }
+
+    // Merge the two boxes with the smallest union that still fits in one
+    // model-sized crop, until no two boxes do
+    for (;;) {
+        size_t bestA           = 0;
+        size_t bestB           = 0;
+        unsigned long bestArea = ULONG_MAX;
+        for (size_t a = 0; a < numBoxes; a++) {
+            for (size_t b = a + 1; b < numBoxes; b++) {
+                MotionCrop both    = unionOf(&roi->boxes[a], &roi->boxes[b]);
+                unsigned long area = (unsigned long)both.width * both.height;
+                if (both.width <= roi->config.cropWidth && both.height <= roi->config.cropHeight &&
+                    area < bestArea) {
+                    bestA    = a;
+                    bestB    = b;
+                    bestArea = area;
+                }
+            }
+        }
+        if (bestArea == ULONG_MAX) {
+            break;
+        }
+        roi->boxes[bestA] = unionOf(&roi->boxes[bestA], &roi->boxes[bestB]);
+        roi->boxes[bestB] = roi->boxes[--numBoxes];
+    }
+
+    qsort(roi->boxes, numBoxes, sizeof(MotionCrop), largerArea);
+    for (size_t i = 0; i < numBoxes; i++) {
+        if (!cropAround(roi, &roi->boxes[i], &roi->windows[i])) {
+            crops[0] = roi->config.fullView;
+            return 1;
+        }
+    }
+
+    // Crops of the largest boxes first, and no crop for a box already lying
+    // within one of them
+    size_t numCrops = 0;
+    for (size_t i = 0; i < numBoxes; i++) {
+        bool covered = false;
+        for (size_t j = 0; j < numCrops && !covered; j++) {
+            covered = contains(&crops[j], &roi->boxes[i]);
+        }
+        if (covered) {
+            continue;
+        }
+        if (numCrops == roi->config.maxCrops) {
+            crops[0] = roi->config.fullView;
+            return 1;
+        }
+        crops[numCrops++] = roi->windows[i];
+    }
+
+    return numCrops;
+}
+
+void destroyMotionRoi(MotionRoi* roi) {
+    if (!roi) {
+        return;
+    }
+
+    free(roi->cellSums);
+    free(roi->background);
+    free(roi->mask);
+    free(roi->runs);
+    free(roi->rootRegions);
+    free(roi->regions);
+    free(roi);
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles finding the areas of the image where there is
+ * motion, and covering them with crops of the size of the model input.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Most crops returned for one image.
+#define MAX_MOTION_CROPS (8)
+
+/**
+ * brief A type representing motion analysis of a stream.
+ */
+typedef struct MotionRoi MotionRoi;
+
+/**
+ * brief An area of the image, in pixels of the stream.
+ */
+typedef struct MotionCrop {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+} MotionCrop;
+
+/**
+ * brief Parameters of a MotionRoi.
+ */
+typedef struct MotionRoiConfig {
+    /// Size of the NV12 images, whose luma plane has a stride of streamWidth.
+    unsigned int streamWidth;
+    unsigned int streamHeight;
+    /// Size of the model input. Crops have this size, or this aspect ratio if larger.
+    unsigned int cropWidth;
+    unsigned int cropHeight;
+    /// Crop covering the whole view, used when motion needs too many crops.
+    MotionCrop fullView;
+    /// Side of the square cells the luma plane is reduced to, in pixels.
+    unsigned int cellSize;
+    /// Smallest change of the mean luma of a cell that is motion.
+    unsigned int threshold;
+    /// Fewest cells with motion that a region must have to be kept.
+    unsigned int minCells;
+    /// Most crops for one image, at most MAX_MOTION_CROPS.
+    size_t maxCrops;
+} MotionRoiConfig;
+
+/**
+ * brief Set up motion analysis.
+ *
+ * param config Parameters of the analysis.
+ * return Pointer to new MotionRoi, or NULL if failed.
+ */
+MotionRoi* createMotionRoi(const MotionRoiConfig* config);
+
+/**
+ * brief Find the crops that cover the motion of an image.
+ *
+ * The luma plane is reduced to the mean of each cell and compared with a
+ * running average of earlier images. Cells that changed more than the
+ * threshold are joined into regions with union-find, as long as they touch,
+ * also diagonally. Regions are then merged as long as they fit in one crop of
+ * the model input size, so that small objects are seen at the resolution of
+ * the stream. A region too large for one crop gets a larger crop of the same
+ * aspect ratio. If more than maxCrops crops are needed, the whole view is
+ * used instead.
+ *
+ * The first image only sets up the running average and has no motion.
+ *
+ * param roi Pointer to a MotionRoi.
+ * param luma Luma plane of an image of streamWidth x streamHeight pixels.
+ * param crops Array of at least MAX_MOTION_CROPS crops to fill in.
+ * return Number of crops, 0 if there is no motion.
+ */
+size_t findMotionCrops(MotionRoi* roi, const uint8_t* luma, MotionCrop* crops);
+
+/**
+ * brief Deallocate the MotionRoi.
+ *
+ * param roi Pointer to MotionRoi to be destroyed.
+ */
+void destroyMotionRoi(MotionRoi* roi);
@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Crop, bilinear scale and color convert an NV12 image to 8-bit RGB in one
+ * pass. Every work item produces one output pixel. The color conversion uses
+ * BT.601 limited range coefficients, the same as the cpu-proc backend.
+ */
+
+/* Bilinear sample of one byte channel, with positions clamped to the plane */
+float sample(__global const uchar *plane,
+             int stride,
+             int pixel_step,
+             int max_x,
+             int max_y,
+             float x,
+             float y)
+{
+    x = clamp(x, 0.0f, (float)max_x);
+    y = clamp(y, 0.0f, (float)max_y);
+
+    int x0 = (int)x;
+    int y0 = (int)y;
+    int x1 = min(x0 + 1, max_x);
+    int y1 = min(y0 + 1, max_y);
+    float fx = x - (float)x0;
+    float fy = y - (float)y0;
+
+    float top = mix((float)plane[y0 * stride + x0 * pixel_step],
+                    (float)plane[y0 * stride + x1 * pixel_step],
+                    fx);
+    float bottom = mix((float)plane[y1 * stride + x0 * pixel_step],
+                       (float)plane[y1 * stride + x1 * pixel_step],
+                       fx);
+    return mix(top, bottom, fy);
+}
+
+__kernel void nv12_to_rgb(__global const uchar *In,
+                          __global uchar *Out,
+                          int in_width,
+                          int in_height,
+                          float4 crop,
+                          int out_width,
+                          int out_height,
+                          int planar)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= out_width || y >= out_height)
+        return;
+
+    /* Center of the output pixel in input coordinates, crop is (x, y, w, h) */
+    float src_x = crop.s0 + ((float)x + 0.5f) * crop.s2 / (float)out_width - 0.5f;
+    float src_y = crop.s1 + ((float)y + 0.5f) * crop.s3 / (float)out_height - 0.5f;
+
+    __global const uchar *uv_plane = In + in_width * in_height;
+    int uv_width = in_width >> 1;
+    int uv_height = in_height >> 1;
+
+    /* Chroma is subsampled by two, with sample positions between luma pairs */
+    float uv_x = (src_x + 0.5f) * 0.5f - 0.5f;
+    float uv_y = (src_y + 0.5f) * 0.5f - 0.5f;
+
+    float luma = sample(In, in_width, 1, in_width - 1, in_height - 1, src_x, src_y);
+    float u = sample(uv_plane, in_width, 2, uv_width - 1, uv_height - 1, uv_x, uv_y);
+    float v = sample(uv_plane + 1, in_width, 2, uv_width - 1, uv_height - 1, uv_x, uv_y);
+
+    luma = 1.164f * (luma - 16.0f);
+    u -= 128.0f;
+    v -= 128.0f;
+
+    uchar3 rgb = convert_uchar3_sat_rte((float3)(luma + 1.596f * v,
+                                                 luma - 0.813f * v - 0.391f * u,
+                                                 luma + 2.018f * u));
+
+    if (planar) {
+        int plane_size = out_width * out_height;
+        int id = y * out_width + x;
+        Out[id] = rgb.x;
+        Out[id + plane_size] = rgb.y;
+        Out[id + 2 * plane_size] = rgb.z;
+    } else {
+        vstore3(rgb, y * out_width + x, Out);
+    }
+}
+
+/*
+ * The same conversion with the luma and chroma planes read as images. The
+ * sampler does the bilinear interpolation and clamps positions to the edges,
+ * so the GPU can use its texture units instead of four loads and three mixes
+ * per channel. Coordinates are not normalized, pixel centers are at +0.5.
+ */
+__constant sampler_t bilinear = CLK_NORMALIZED_COORDS_FALSE |
+                                CLK_ADDRESS_CLAMP_TO_EDGE |
+                                CLK_FILTER_LINEAR;
+
+__kernel void nv12_to_rgb_image(__read_only image2d_t In_y,
+                                __read_only image2d_t In_uv,
+                                __global uchar *Out,
+                                float4 crop,
+                                int out_width,
+                                int out_height,
+                                int planar)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= out_width || y >= out_height)
+        return;
+
+    /* Output pixel center in input image coordinates, crop is (x, y, w, h) */
+    float src_x = crop.s0 + ((float)x + 0.5f) * crop.s2 / (float)out_width;
+    float src_y = crop.s1 + ((float)y + 0.5f) * crop.s3 / (float)out_height;
+
+    /* Both planes are normalized from 8 bits, in_uv holds (u, v) pairs */
+    float luma = read_imagef(In_y, bilinear, (float2)(src_x, src_y)).x * 255.0f;
+    float2 uv = read_imagef(In_uv, bilinear, (float2)(src_x, src_y) * 0.5f).xy * 255.0f;
+
+    luma = 1.164f * (luma - 16.0f);
+    uv -= 128.0f;
+
+    uchar3 rgb = convert_uchar3_sat_rte((float3)(luma + 1.596f * uv.y,
+                                                 luma - 0.813f * uv.y - 0.391f * uv.x,
+                                                 luma + 2.018f * uv.x));
+
+    if (planar) {
+        int plane_size = out_width * out_height;
+        int id = y * out_width + x;
+        Out[id] = rgb.x;
+        Out[id + plane_size] = rgb.y;
+        Out[id + 2 * plane_size] = rgb.z;
+    } else {
+        vstore3(rgb, y * out_width + x, Out);
+    }
+}
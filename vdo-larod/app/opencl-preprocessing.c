@@ -0,0 +1,611 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles image preprocessing with OpenCL. The setup follows the
+ * vdo-opencl-filtering example.
+ *
+ * The input can be read as a buffer, with the interpolation done in the
+ * kernel, or as two image2d_t planes read through a bilinear sampler. Which
+ * one is faster depends on the texture hardware of the GPU.
+ */
+
+#include "opencl-preprocessing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+#define MAX_SOURCE_SIZE (0x100000)
+
+/// Number of input buffers to keep wrapped, at least the number of VDO buffers.
+#define MAX_INPUT_BUFFERS (8)
+
+/// Runs of each sampling path when timing them against each other.
+#define BENCHMARK_RUNS (10)
+
+#define KERNEL_NAME       "nv12_to_rgb"
+#define IMAGE_KERNEL_NAME "nv12_to_rgb_image"
+
+/**
+ * brief OpenCL memory objects wrapping one NV12 input buffer.
+ */
+typedef struct ClInput {
+    void* addr;
+    cl_mem buffer;
+    /// Luma and interleaved chroma planes, NULL unless the image path is used.
+    cl_mem yImage;
+    cl_mem uvImage;
+} ClInput;
+
+struct ClPreprocessor {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    cl_kernel imageKernel;
+
+    /// Sampling path in use, PP_SAMPLING_AUTO until both have been timed.
+    ClSamplingPath sampling;
+
+    /// Output memory object using the caller's buffer as storage.
+    cl_mem output;
+    void* outAddr;
+    size_t outSize;
+
+    unsigned int inWidth;
+    unsigned int inHeight;
+    size_t inSize;
+    size_t globalWorkSize[2];
+
+    /// Input memory objects, each wrapping the VDO buffer at inputs[i].addr.
+    ClInput inputs[MAX_INPUT_BUFFERS];
+    /// Next entry to replace when all entries are in use.
+    size_t nextInput;
+};
+
+/**
+ * brief Read the program source and build it for the device.
+ *
+ * param pp Pointer to the ClPreprocessor to build the program for.
+ * param fileName Path of the OpenCL program source.
+ * return False if any errors occur, otherwise true.
+ */
+static bool buildProgram(ClPreprocessor* pp, const char* fileName) {
+    cl_int ret;
+    FILE* fp = fopen(fileName, "r");
+    if (!fp) {
+        syslog(LOG_ERR, "%s: Failed to load kernel %s", __func__, fileName);
+        return false;
+    }
+    char* source      = (char*)malloc(MAX_SOURCE_SIZE);
+    size_t sourceSize = fread(source, 1, MAX_SOURCE_SIZE, fp);
+    fclose(fp);
+
+    pp->program = clCreateProgramWithSource(pp->context,
+                                            1,
+                                            (const char**)&source,
+                                            (const size_t*)&sourceSize,
+                                            &ret);
+    free(source);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not create cl program: %d", __func__, ret);
+        return false;
+    }
+
+    ret = clBuildProgram(pp->program, 1, &pp->device, "", NULL, NULL);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not build cl program: %d", __func__, ret);
+
+        if (ret == CL_BUILD_PROGRAM_FAILURE) {
+            size_t logSize;
+            clGetProgramBuildInfo(pp->program,
+                                  pp->device,
+                                  CL_PROGRAM_BUILD_LOG,
+                                  0,
+                                  NULL,
+                                  &logSize);
+            char* log = (char*)malloc(logSize);
+            clGetProgramBuildInfo(pp->program,
+                                  pp->device,
+                                  CL_PROGRAM_BUILD_LOG,
+                                  logSize,
+                                  log,
+                                  NULL);
+            syslog(LOG_INFO, "%s", log);
+            free(log);
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * brief Check if the device can sample the NV12 planes as images.
+ *
+ * The luma plane needs the CL_R and the chroma plane the CL_RG channel order,
+ * both with 8-bit normalized channels.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * return True if the image path can be used, otherwise false.
+ */
+static bool supportsImages(ClPreprocessor* pp) {
+    cl_bool imageSupport = CL_FALSE;
+    size_t maxWidth      = 0;
+    size_t maxHeight     = 0;
+    cl_uint numFormats   = 0;
+    bool hasR            = false;
+    bool hasRG           = false;
+
+    clGetDeviceInfo(pp->device, CL_DEVICE_IMAGE_SUPPORT, sizeof(imageSupport), &imageSupport, NULL);
+    clGetDeviceInfo(pp->device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(maxWidth), &maxWidth, NULL);
+    clGetDeviceInfo(pp->device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(maxHeight), &maxHeight, NULL);
+    if (!imageSupport || pp->inWidth > maxWidth || pp->inHeight > maxHeight) {
+        return false;
+    }
+
+    if (clGetSupportedImageFormats(pp->context,
+                                   CL_MEM_READ_ONLY,
+                                   CL_MEM_OBJECT_IMAGE2D,
+                                   0,
+                                   NULL,
+                                   &numFormats) != CL_SUCCESS ||
+        numFormats == 0) {
+        return false;
+    }
+
+    cl_image_format* formats = (cl_image_format*)malloc(numFormats * sizeof(cl_image_format));
+    if (!formats) {
+        return false;
+    }
+    clGetSupportedImageFormats(pp->context,
+                               CL_MEM_READ_ONLY,
+                               CL_MEM_OBJECT_IMAGE2D,
+                               numFormats,
+                               formats,
+                               NULL);
+    for (cl_uint i = 0; i < numFormats; i++) {
+        if (formats[i].image_channel_data_type != CL_UNORM_INT8) {
+            continue;
+        }
+        hasR |= formats[i].image_channel_order == CL_R;
+        hasRG |= formats[i].image_channel_order == CL_RG;
+    }
+    free(formats);
+
+    return hasR && hasRG;
+}
+
+/**
+ * brief Wrap one plane of an input buffer as an image without copying.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param addr Address of the first row of the plane.
+ * param order CL_R for the luma plane, CL_RG for the chroma plane.
+ * param width Width of the plane in pixels of the given channel order.
+ * param height Height of the plane in rows.
+ * return The image, or NULL if failed.
+ */
+static cl_mem createPlaneImage(ClPreprocessor* pp,
+                               void* addr,
+                               cl_channel_order order,
+                               size_t width,
+                               size_t height) {
+    cl_int ret;
+    cl_image_format format = {order, CL_UNORM_INT8};
+    cl_image_desc desc     = {0};
+
+    // Both planes have rows of inWidth bytes
+    desc.image_type      = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width     = width;
+    desc.image_height    = height;
+    desc.image_row_pitch = pp->inWidth;
+
+    cl_mem image = clCreateImage(pp->context,
+                                 CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+                                 &format,
+                                 &desc,
+                                 addr,
+                                 &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_WARNING, "%s: Unable to create input cl image: %d", __func__, ret);
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * brief Release the memory objects of an input entry.
+ *
+ * param input Pointer to the entry to clear.
+ */
+static void releaseInput(ClInput* input) {
+    if (input->buffer) {
+        clReleaseMemObject(input->buffer);
+    }
+    if (input->yImage) {
+        clReleaseMemObject(input->yImage);
+    }
+    if (input->uvImage) {
+        clReleaseMemObject(input->uvImage);
+    }
+    memset(input, 0, sizeof(*input));
+}
+
+/**
+ * brief Look up or create the OpenCL memory objects wrapping an input buffer.
+ *
+ * The planes are also wrapped as images unless the buffer path is used. If
+ * that fails, e.g. due to the row alignment the driver requires, the
+ * ClPreprocessor falls back to the buffer path.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param addr Address of the input buffer.
+ * return The input entry, or NULL if failed.
+ */
+static ClInput* getInput(ClPreprocessor* pp, void* addr) {
+    cl_int ret;
+
+    for (size_t i = 0; i < MAX_INPUT_BUFFERS; i++) {
+        if (pp->inputs[i].buffer && pp->inputs[i].addr == addr) {
+            return &pp->inputs[i];
+        }
+    }
+
+    // All entries are in use if the input buffers keep changing. Replace the
+    // oldest one, the kernels reading it have completed since runs block.
+    ClInput* input = &pp->inputs[pp->nextInput];
+    releaseInput(input);
+
+    input->buffer = clCreateBuffer(pp->context,
+                                   CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+                                   pp->inSize,
+                                   addr,
+                                   &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to create input cl memory object: %d", __func__, ret);
+        input->buffer = NULL;
+        return NULL;
+    }
+    input->addr   = addr;
+    pp->nextInput = (pp->nextInput + 1) % MAX_INPUT_BUFFERS;
+
+    if (pp->sampling != PP_SAMPLING_BUFFER) {
+        uint8_t* uvAddr = (uint8_t*)addr + (size_t)pp->inWidth * pp->inHeight;
+
+        input->yImage  = createPlaneImage(pp, addr, CL_R, pp->inWidth, pp->inHeight);
+        input->uvImage = createPlaneImage(pp, uvAddr, CL_RG, pp->inWidth / 2, pp->inHeight / 2);
+        if (!input->yImage || !input->uvImage) {
+            syslog(LOG_WARNING, "%s: Falling back to the buffer sampling path", __func__);
+            pp->sampling = PP_SAMPLING_BUFFER;
+        }
+    }
+    return input;
+}
+
+/**
+ * brief Enqueue the kernel of a sampling path on an input.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param input Input entry to read.
+ * param images True for the image path, false for the buffer path.
+ * return False if any errors occur, otherwise true.
+ */
+static bool enqueueKernel(ClPreprocessor* pp, const ClInput* input, bool images) {
+    cl_int ret;
+    cl_kernel kernel = images ? pp->imageKernel : pp->kernel;
+
+    if (images) {
+        ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input->yImage);
+        ret |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &input->uvImage);
+    } else {
+        ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input->buffer);
+    }
+    ret |= clEnqueueNDRangeKernel(pp->queue,
+                                  kernel,
+                                  2,
+                                  NULL,
+                                  pp->globalWorkSize,
+                                  NULL,
+                                  0,
+                                  NULL,
+                                  NULL);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to enqueue kernel: %d", __func__, ret);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * brief Time a sampling path on an input.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param input Input entry to read.
+ * param images True for the image path, false for the buffer path.
+ * return Milliseconds per run, or a negative value if failed.
+ */
+static double timeSamplingPath(ClPreprocessor* pp, const ClInput* input, bool images) {
+    struct timespec start;
+    struct timespec end;
+
+    // The first run includes any lazy allocation in the driver
+    if (!enqueueKernel(pp, input, images) || clFinish(pp->queue) != CL_SUCCESS) {
+        return -1.0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+        if (!enqueueKernel(pp, input, images)) {
+            return -1.0;
+        }
+    }
+    if (clFinish(pp->queue) != CL_SUCCESS) {
+        return -1.0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+    return ms / BENCHMARK_RUNS;
+}
+
+/**
+ * brief Time both sampling paths on the first input and keep the faster one.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param input Input entry to read.
+ */
+static void selectSamplingPath(ClPreprocessor* pp, const ClInput* input) {
+    double bufferMs = timeSamplingPath(pp, input, false);
+    double imageMs  = timeSamplingPath(pp, input, true);
+
+    if (imageMs < 0.0) {
+        syslog(LOG_WARNING, "%s: Image sampling path failed, using buffers", __func__);
+        pp->sampling = PP_SAMPLING_BUFFER;
+        return;
+    }
+
+    pp->sampling = bufferMs >= 0.0 && bufferMs <= imageMs ? PP_SAMPLING_BUFFER : PP_SAMPLING_IMAGE;
+    syslog(LOG_INFO,
+           "Preprocessing takes %.3f ms with buffers and %.3f ms with images, using %s",
+           bufferMs,
+           imageMs,
+           pp->sampling == PP_SAMPLING_IMAGE ? "images" : "buffers");
+}
+
+ClPreprocessor* createClPreprocessor(const ClPreprocessorConfig* config, void* outAddr) {
+    cl_platform_id platform;
+    cl_uint numPlatforms;
+    cl_uint numDevices;
+    cl_int ret;
+
+    ClPreprocessor* pp = (ClPreprocessor*)calloc(1, sizeof(ClPreprocessor));
+    if (!pp) {
+        syslog(LOG_ERR, "%s: Unable to allocate ClPreprocessor", __func__);
+        return NULL;
+    }
+
+    pp->sampling          = config->sampling;
+    pp->inWidth           = config->inWidth;
+    pp->inHeight          = config->inHeight;
+    pp->inSize            = (size_t)config->inWidth * config->inHeight * 3 / 2;
+    pp->outSize           = (size_t)config->outWidth * config->outHeight * 3;
+    pp->outAddr           = outAddr;
+    pp->globalWorkSize[0] = config->outWidth;
+    pp->globalWorkSize[1] = config->outHeight;
+
+    ret = clGetPlatformIDs(1, &platform, &numPlatforms);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not get platform id: %d", __func__, ret);
+        goto errorExit;
+    }
+
+    ret = clGetDeviceIDs(platform, CL_DEVICE_TYPE_DEFAULT, 1, &pp->device, &numDevices);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not get device id: %d", __func__, ret);
+        goto errorExit;
+    }
+
+    pp->context = clCreateContext(NULL, 1, &pp->device, NULL, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not create opencl context: %d", __func__, ret);
+        goto errorExit;
+    }
+
+    if (!buildProgram(pp, config->programFile)) {
+        goto errorExit;
+    }
+
+    pp->kernel = clCreateKernel(pp->program, KERNEL_NAME, &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not create kernel %s: %d", __func__, KERNEL_NAME, ret);
+        goto errorExit;
+    }
+
+    if (pp->sampling != PP_SAMPLING_BUFFER && !supportsImages(pp)) {
+        if (pp->sampling == PP_SAMPLING_IMAGE) {
+            syslog(LOG_WARNING, "%s: The device cannot sample NV12 planes as images", __func__);
+        }
+        pp->sampling = PP_SAMPLING_BUFFER;
+    }
+
+    if (pp->sampling != PP_SAMPLING_BUFFER) {
+        pp->imageKernel = clCreateKernel(pp->program, IMAGE_KERNEL_NAME, &ret);
+        if (ret != CL_SUCCESS) {
+            syslog(LOG_ERR,
+                   "%s: Could not create kernel %s: %d",
+                   __func__,
+                   IMAGE_KERNEL_NAME,
+                   ret);
+            goto errorExit;
+        }
+    }
+
+    pp->queue = clCreateCommandQueue(pp->context, pp->device, 0, &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Could not create command queue: %d", __func__, ret);
+        goto errorExit;
+    }
+
+    // Write straight into the caller's buffer, e.g. the larod input tensor.
+    pp->output = clCreateBuffer(pp->context,
+                                CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,
+                                pp->outSize,
+                                outAddr,
+                                &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to create output cl memory object: %d", __func__, ret);
+        goto errorExit;
+    }
+
+    // Everything but the input buffer is the same for every run.
+    cl_float4 crop   = {{(cl_float)config->cropX,
+                         (cl_float)config->cropY,
+                         (cl_float)config->cropWidth,
+                         (cl_float)config->cropHeight}};
+    cl_int inWidth   = config->inWidth;
+    cl_int inHeight  = config->inHeight;
+    cl_int outWidth  = config->outWidth;
+    cl_int outHeight = config->outHeight;
+    cl_int planar    = config->planar;
+
+    ret = clSetKernelArg(pp->kernel, 1, sizeof(cl_mem), &pp->output);
+    ret |= clSetKernelArg(pp->kernel, 2, sizeof(inWidth), &inWidth);
+    ret |= clSetKernelArg(pp->kernel, 3, sizeof(inHeight), &inHeight);
+    ret |= clSetKernelArg(pp->kernel, 4, sizeof(crop), &crop);
+    ret |= clSetKernelArg(pp->kernel, 5, sizeof(outWidth), &outWidth);
+    ret |= clSetKernelArg(pp->kernel, 6, sizeof(outHeight), &outHeight);
+    ret |= clSetKernelArg(pp->kernel, 7, sizeof(planar), &planar);
+    if (pp->imageKernel) {
+        ret |= clSetKernelArg(pp->imageKernel, 2, sizeof(cl_mem), &pp->output);
+        ret |= clSetKernelArg(pp->imageKernel, 3, sizeof(crop), &crop);
+        ret |= clSetKernelArg(pp->imageKernel, 4, sizeof(outWidth), &outWidth);
+        ret |= clSetKernelArg(pp->imageKernel, 5, sizeof(outHeight), &outHeight);
+        ret |= clSetKernelArg(pp->imageKernel, 6, sizeof(planar), &planar);
+    }
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to set kernel arguments: %d", __func__, ret);
+        goto errorExit;
+    }
+
+    return pp;
+
+errorExit:
+    destroyClPreprocessor(pp);
+
+    return NULL;
+}
+
+bool runClPreprocessor(ClPreprocessor* pp, uint8_t* nv12Data) {
+    cl_int ret;
+
+    ClInput* input = getInput(pp, nv12Data);
+    if (!input) {
+        return false;
+    }
+
+    if (pp->sampling == PP_SAMPLING_AUTO) {
+        selectSamplingPath(pp, input);
+    }
+
+    if (!enqueueKernel(pp, input, pp->sampling == PP_SAMPLING_IMAGE)) {
+        return false;
+    }
+
+    // Mapping a CL_MEM_USE_HOST_PTR buffer guarantees that the host memory is
+    // up to date. On devices sharing memory with the CPU this copies nothing.
+    void* mapped = clEnqueueMapBuffer(pp->queue,
+                                      pp->output,
+                                      CL_TRUE,
+                                      CL_MAP_READ,
+                                      0,
+                                      pp->outSize,
+                                      0,
+                                      NULL,
+                                      NULL,
+                                      &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to map output: %d", __func__, ret);
+        return false;
+    }
+
+    ret = clEnqueueUnmapMemObject(pp->queue, pp->output, mapped, 0, NULL, NULL);
+    ret |= clFinish(pp->queue);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to complete OpenCL operations: %d", __func__, ret);
+        return false;
+    }
+
+    return true;
+}
+
+bool setClPreprocessorCrop(ClPreprocessor* pp,
+                           unsigned int x,
+                           unsigned int y,
+                           unsigned int width,
+                           unsigned int height) {
+    cl_float4 crop = {{(cl_float)x, (cl_float)y, (cl_float)width, (cl_float)height}};
+
+    cl_int ret = clSetKernelArg(pp->kernel, 4, sizeof(crop), &crop);
+    if (pp->imageKernel) {
+        ret |= clSetKernelArg(pp->imageKernel, 3, sizeof(crop), &crop);
+    }
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "%s: Unable to set crop: %d", __func__, ret);
+        return false;
+    }
+
+    return true;
+}
+
+void destroyClPreprocessor(ClPreprocessor* pp) {
+    if (!pp) {
+        return;
+    }
+
+    if (pp->queue) {
+        clFinish(pp->queue);
+    }
+    for (size_t i = 0; i < MAX_INPUT_BUFFERS; i++) {
+        releaseInput(&pp->inputs[i]);
+    }
+    if (pp->output) {
+        clReleaseMemObject(pp->output);
+    }
+    if (pp->kernel) {
+        clReleaseKernel(pp->kernel);
+    }
+    if (pp->imageKernel) {
+        clReleaseKernel(pp->imageKernel);
+    }
+    if (pp->program) {
+        clReleaseProgram(pp->program);
+    }
+    if (pp->queue) {
+        clReleaseCommandQueue(pp->queue);
+    }
+    if (pp->context) {
+        clReleaseContext(pp->context);
+    }
+
+    free(pp);
+}
@@ -0,0 +1,122 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles image preprocessing with OpenCL: crop, bilinear
+ * scaling and conversion from NV12 to RGB in a single kernel.
+ *
+ * It only depends on OpenCL, so it can be built and tried on a host with a CPU
+ * OpenCL implementation such as PoCL.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * brief A type representing an OpenCL preprocessing pipeline.
+ */
+typedef struct ClPreprocessor ClPreprocessor;
+
+/**
+ * brief How a ClPreprocessor reads the NV12 input.
+ */
+typedef enum ClSamplingPath {
+    /// Benchmark both paths on the first image and keep the faster one.
+    PP_SAMPLING_AUTO = 0,
+    /// Read buffers and interpolate in the kernel.
+    PP_SAMPLING_BUFFER,
+    /// Read image2d_t planes through a bilinear sampler, if the device supports it.
+    PP_SAMPLING_IMAGE,
+} ClSamplingPath;
+
+/**
+ * brief Crop and output parameters of a ClPreprocessor.
+ */
+typedef struct ClPreprocessorConfig {
+    /// Path of the OpenCL program source, nv12_to_rgb.cl.
+    const char* programFile;
+    /// Size of the NV12 input images.
+    unsigned int inWidth;
+    unsigned int inHeight;
+    /// Area of the input image to scale to the output.
+    unsigned int cropX;
+    unsigned int cropY;
+    unsigned int cropWidth;
+    unsigned int cropHeight;
+    /// Size of the RGB output image.
+    unsigned int outWidth;
+    unsigned int outHeight;
+    /// Write RGB planes after each other instead of interleaved pixels.
+    bool planar;
+    /// Buffer or image input. The buffer path is used if images are not supported.
+    ClSamplingPath sampling;
+} ClPreprocessorConfig;
+
+/**
+ * brief Set up OpenCL and build the preprocessing program.
+ *
+ * The output is written directly to outAddr, e.g. the mapping of a larod input
+ * tensor, which the GPU accesses without copying.
+ *
+ * param config Crop and output parameters.
+ * param outAddr Output buffer of at least outWidth * outHeight * 3 bytes.
+ * return Pointer to new ClPreprocessor, or NULL if failed.
+ */
+ClPreprocessor* createClPreprocessor(const ClPreprocessorConfig* config, void* outAddr);
+
+/**
+ * brief Preprocess one NV12 image into the output buffer.
+ *
+ * Input buffers are wrapped as OpenCL memory objects without copying the
+ * first time they are seen, and the wrapper is reused for the same address
+ * later on. Blocks until the output is ready to be read by the CPU or larod.
+ *
+ * With PP_SAMPLING_AUTO the first call times both sampling paths on the image
+ * and logs the result, which takes a few extra runs.
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param nv12Data NV12 image of inWidth x inHeight pixels.
+ * return False if any errors occur, otherwise true.
+ */
+bool runClPreprocessor(ClPreprocessor* pp, uint8_t* nv12Data);
+
+/**
+ * brief Change the area of the input image that is scaled to the output.
+ *
+ * Applies to the following calls to runClPreprocessor().
+ *
+ * param pp Pointer to a ClPreprocessor.
+ * param x Left edge of the area.
+ * param y Top edge of the area.
+ * param width Width of the area.
+ * param height Height of the area.
+ * return False if any errors occur, otherwise true.
+ */
+bool setClPreprocessorCrop(ClPreprocessor* pp,
+                           unsigned int x,
+                           unsigned int y,
+                           unsigned int width,
+                           unsigned int height);
+
+/**
+ * brief Release OpenCL resources and deallocate the ClPreprocessor.
+ *
+ * param pp Pointer to ClPreprocessor to be destroyed.
+ */
+void destroyClPreprocessor(ClPreprocessor* pp);
@@ -16,6 +16,10 @@
 
 #include "imgprovider.h"
 #include "larod.h"
+#include "motion-roi.h"
+#ifdef OPENCL_PREPROCESSING
+#include "opencl-preprocessing.h"
+#endif
 #include "utility-functions.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
@@ -34,6 +38,30 @@
 
 volatile sig_atomic_t stopRunning = false;
 
+// Preprocessing backends that can be selected on the command line
+#define PP_BACKEND_CPU           "cpu-proc"
+#define PP_BACKEND_OPENCL        "opencl"
+#define PP_BACKEND_OPENCL_BUFFER "opencl-buffer"
+#define PP_BACKEND_OPENCL_IMAGE  "opencl-image"
+
+// OpenCL program used by the opencl preprocessing backend
+#define PP_OPENCL_PROGRAM "/usr/local/packages/vdo_larod/nv12_to_rgb.cl"
+
+// Areas of the image that inference runs on
+#define MODE_FULL       "full"
+#define MODE_MOTION_ROI "motion-roi"
+
+// With motion-roi, the stream is this many times the model input size, so
+// that a crop of the model input size covers a part of the view.
+#define ROI_STREAM_SCALE (2)
+// Motion analysis on cells of 16 x 16 pixels, where a change of the mean
+// luma by more than 12 in at least 2 touching cells is motion.
+#define ROI_CELL_SIZE (16)
+#define ROI_THRESHOLD (12)
+#define ROI_MIN_CELLS (2)
+// More crops than this are replaced by the whole view
+#define ROI_MAX_CROPS (4)
+
 /**
  * brief Invoked on SIGINT. Makes app exit cleanly asap if invoked once, but
  * forces an immediate exit without clean up if invoked at least twice.
@@ -130,6 +158,21 @@ end:
 
 /**
  * brief Main function that starts a stream with different options.
+ *
+ * Arguments: INF_CHIP MODEL_PATH WIDTH HEIGHT NUM_ROUNDS [PP_BACKEND] [MODE]
+ *
+ * PP_BACKEND selects how images are cropped, scaled and converted to RGB:
+ * cpu-proc (default) runs larod with the libyuv backend, opencl runs an
+ * OpenCL kernel on the GPU that writes directly to the inference input tensor.
+ * The kernel reads the input as a buffer with opencl-buffer, or as images
+ * through the texture sampler with opencl-image. With opencl the faster of
+ * the two is selected on the first frame.
+ *
+ * MODE selects the areas of the image that inference runs on: full (default)
+ * runs it once per frame on the whole view, motion-roi runs it only on crops
+ * of the model input size that cover the motion in the frame, taken from a
+ * stream of ROI_STREAM_SCALE times that size. Frames without motion are
+ * skipped.
  */
 int main(int argc, char** argv) {
     // Hardcode to use three image "color" channels (eg. RGB).
@@ -159,6 +202,10 @@ int main(int argc, char** argv) {
     size_t numOutputs             = 0;
     larodJobRequest* ppReq        = NULL;
     larodJobRequest* infReq       = NULL;
+#ifdef OPENCL_PREPROCESSING
+    ClPreprocessor* clPreprocessor = NULL;
+#endif
+    MotionRoi* motionRoi          = NULL;
     void* ppInputAddr             = MAP_FAILED;
     void* larodInputAddr          = MAP_FAILED;
     void* larodOutput1Addr        = MAP_FAILED;
@@ -173,6 +220,12 @@ int main(int argc, char** argv) {
     const int inputWidth          = atoi(argv[3]);
     const int inputHeight         = atoi(argv[4]);
     const int numRounds           = atoi(argv[5]);
+    const char* ppBackend         = argc > 6 ? argv[6] : PP_BACKEND_CPU;
+    const bool useOpenClPP        = strcmp(ppBackend, PP_BACKEND_OPENCL) == 0 ||
+                                    strcmp(ppBackend, PP_BACKEND_OPENCL_BUFFER) == 0 ||
+                                    strcmp(ppBackend, PP_BACKEND_OPENCL_IMAGE) == 0;
+    const char* mode              = argc > 7 ? argv[7] : MODE_FULL;
+    const bool useMotionRoi       = strcmp(mode, MODE_MOTION_ROI) == 0;
 
     // Open the syslog to report messages for "vdo_larod"
     openlog("vdo_larod", LOG_PID | LOG_CONS, LOG_USER);
@@ -181,17 +234,43 @@ int main(int argc, char** argv) {
     // but exits immediately if further invoked.
     signal(SIGINT, sigintHandler);
 
-    if (argc != 6) {
+    if (argc < 6 || argc > 8) {
         syslog(LOG_ERR,
                "Invalid number of arguments. Required arguments are: "
-               "INF_CHIP MODEL_PATH WIDTH HEIGHT NUM_ROUNDS");
+               "INF_CHIP MODEL_PATH WIDTH HEIGHT NUM_ROUNDS [PP_BACKEND] [MODE]");
+        goto end;
+    }
+
+    if (!useMotionRoi && strcmp(mode, MODE_FULL) != 0) {
+        syslog(LOG_ERR, "Unknown mode %s, use %s or %s", mode, MODE_FULL, MODE_MOTION_ROI);
         goto end;
     }
 
+    if (!useOpenClPP && strcmp(ppBackend, PP_BACKEND_CPU) != 0) {
+        syslog(LOG_ERR,
+               "Unknown preprocessing backend %s, use %s, %s, %s or %s",
+               ppBackend,
+               PP_BACKEND_CPU,
+               PP_BACKEND_OPENCL,
+               PP_BACKEND_OPENCL_BUFFER,
+               PP_BACKEND_OPENCL_IMAGE);
+        goto end;
+    }
+#ifndef OPENCL_PREPROCESSING
+    if (useOpenClPP) {
+        syslog(LOG_ERR, "This build does not support the %s preprocessing backend", ppBackend);
+        goto end;
+    }
+#endif
+
     // Create video stream provider
-    unsigned int streamWidth  = 0;
-    unsigned int streamHeight = 0;
-    if (!chooseStreamResolution(inputWidth, inputHeight, &streamWidth, &streamHeight)) {
+    unsigned int streamWidth       = 0;
+    unsigned int streamHeight      = 0;
+    const unsigned int streamScale = useMotionRoi ? ROI_STREAM_SCALE : 1;
+    if (!chooseStreamResolution(inputWidth * streamScale,
+                                inputHeight * streamScale,
+                                &streamWidth,
+                                &streamHeight)) {
         syslog(LOG_ERR, "%s: Failed choosing stream resolution", __func__);
         goto end;
     }
@@ -224,6 +303,26 @@ int main(int argc, char** argv) {
     unsigned int clipY = (streamHeight - clipH) / 2;
     syslog(LOG_INFO, "Crop VDO image X=%d Y=%d (%d x %d)", clipX, clipY, clipW, clipH);
 
+    if (useMotionRoi) {
+        MotionRoiConfig roiConfig = {
+            .streamWidth  = streamWidth,
+            .streamHeight = streamHeight,
+            .cropWidth    = inputWidth,
+            .cropHeight   = inputHeight,
+            .fullView     = {clipX, clipY, clipW, clipH},
+            .cellSize     = ROI_CELL_SIZE,
+            .threshold    = ROI_THRESHOLD,
+            .minCells     = ROI_MIN_CELLS,
+            .maxCrops     = ROI_MAX_CROPS,
+        };
+        motionRoi = createMotionRoi(&roiConfig);
+        if (!motionRoi) {
+            syslog(LOG_ERR, "%s: Could not set up motion analysis", __func__);
+            goto end;
+        }
+        syslog(LOG_INFO, "Running inference on areas with motion only");
+    }
+
     // Create preprocessing maps
     syslog(LOG_INFO, "Create preprocessing maps");
     ppMap = larodCreateMap(&error);
@@ -280,32 +379,36 @@ int main(int argc, char** argv) {
         goto end;
     }
 
-    // Use libyuv as image preprocessing backend
-    const char* larodLibyuvPP = "cpu-proc";
-    const larodDevice* dev_pp;
-    dev_pp  = larodGetDevice(conn, larodLibyuvPP, 0, &error);
-    ppModel = larodLoadModel(conn, -1, dev_pp, LAROD_ACCESS_PRIVATE, "", ppMap, &error);
-    if (!ppModel) {
-        syslog(LOG_ERR,
-               "Unable to load preprocessing model with chip %s: %s",
-               larodLibyuvPP,
-               error->msg);
-        goto end;
-    } else {
-        syslog(LOG_INFO, "Loading preprocessing model with chip %s", larodLibyuvPP);
+    // Use libyuv as image preprocessing backend, unless OpenCL is selected
+    if (!useOpenClPP) {
+        const char* larodLibyuvPP = PP_BACKEND_CPU;
+        const larodDevice* dev_pp;
+        dev_pp  = larodGetDevice(conn, larodLibyuvPP, 0, &error);
+        ppModel = larodLoadModel(conn, -1, dev_pp, LAROD_ACCESS_PRIVATE, "", ppMap, &error);
+        if (!ppModel) {
+            syslog(LOG_ERR,
+                   "Unable to load preprocessing model with chip %s: %s",
+                   larodLibyuvPP,
+                   error->msg);
+            goto end;
+        } else {
+            syslog(LOG_INFO, "Loading preprocessing model with chip %s", larodLibyuvPP);
+        }
     }
 
     // Create input/output tensors
     syslog(LOG_INFO, "Create input/output tensors");
-    ppInputTensors = larodCreateModelInputs(ppModel, &ppNumInputs, &error);
-    if (!ppInputTensors) {
-        syslog(LOG_ERR, "Failed retrieving input tensors: %s", error->msg);
-        goto end;
-    }
-    ppOutputTensors = larodCreateModelOutputs(ppModel, &ppNumOutputs, &error);
-    if (!ppOutputTensors) {
-        syslog(LOG_ERR, "Failed retrieving output tensors: %s", error->msg);
-        goto end;
+    if (ppModel) {
+        ppInputTensors = larodCreateModelInputs(ppModel, &ppNumInputs, &error);
+        if (!ppInputTensors) {
+            syslog(LOG_ERR, "Failed retrieving input tensors: %s", error->msg);
+            goto end;
+        }
+        ppOutputTensors = larodCreateModelOutputs(ppModel, &ppNumOutputs, &error);
+        if (!ppOutputTensors) {
+            syslog(LOG_ERR, "Failed retrieving output tensors: %s", error->msg);
+            goto end;
+        }
     }
     inputTensors = larodCreateModelInputs(model, &numInputs, &error);
     if (!inputTensors) {
@@ -330,25 +433,30 @@ int main(int argc, char** argv) {
 
     // Determine tensor buffer sizes
     syslog(LOG_INFO, "Determine tensor buffer sizes");
-    const larodTensorPitches* ppInputPitches = larodGetTensorPitches(ppInputTensors[0], &error);
-    if (!ppInputPitches) {
-        syslog(LOG_ERR, "Could not get pitches of tensor: %s", error->msg);
-        goto end;
-    }
-    size_t yuyvBufferSize                     = ppInputPitches->pitches[0];
-    const larodTensorPitches* ppOutputPitches = larodGetTensorPitches(ppOutputTensors[0], &error);
-    if (!ppOutputPitches) {
-        syslog(LOG_ERR, "Could not get pitches of tensor: %s", error->msg);
-        goto end;
-    }
-    size_t rgbBufferSize = ppOutputPitches->pitches[0];
-    size_t expectedSize  = inputWidth * inputHeight * CHANNELS;
-    if (expectedSize != rgbBufferSize) {
-        syslog(LOG_ERR,
-               "Expected video output size %ld, actual %ld",
-               (unsigned long)expectedSize,
-               (unsigned long)rgbBufferSize);
-        goto end;
+    size_t yuyvBufferSize = 0;
+    if (ppModel) {
+        const larodTensorPitches* ppInputPitches =
+            larodGetTensorPitches(ppInputTensors[0], &error);
+        if (!ppInputPitches) {
+            syslog(LOG_ERR, "Could not get pitches of tensor: %s", error->msg);
+            goto end;
+        }
+        yuyvBufferSize = ppInputPitches->pitches[0];
+        const larodTensorPitches* ppOutputPitches =
+            larodGetTensorPitches(ppOutputTensors[0], &error);
+        if (!ppOutputPitches) {
+            syslog(LOG_ERR, "Could not get pitches of tensor: %s", error->msg);
+            goto end;
+        }
+        size_t rgbBufferSize = ppOutputPitches->pitches[0];
+        size_t expectedSize  = inputWidth * inputHeight * CHANNELS;
+        if (expectedSize != rgbBufferSize) {
+            syslog(LOG_ERR,
+                   "Expected video output size %ld, actual %ld",
+                   (unsigned long)expectedSize,
+                   (unsigned long)rgbBufferSize);
+            goto end;
+        }
     }
     const larodTensorPitches* outputPitches = larodGetTensorPitches(outputTensors[0], &error);
     if (!outputPitches) {
@@ -358,7 +466,8 @@ int main(int argc, char** argv) {
 
     // Allocate memory for input/output buffers
     syslog(LOG_INFO, "Allocate memory for input/output buffers");
-    if (!createAndMapTmpFile(CONV_PP_FILE_PATTERN, yuyvBufferSize, &ppInputAddr, &ppInputFd)) {
+    if (ppModel &&
+        !createAndMapTmpFile(CONV_PP_FILE_PATTERN, yuyvBufferSize, &ppInputAddr, &ppInputFd)) {
         goto end;
     }
     if (!createAndMapTmpFile(CONV_INP_FILE_PATTERN,
@@ -376,11 +485,11 @@ int main(int argc, char** argv) {
 
     // Connect tensors to file descriptors
     syslog(LOG_INFO, "Connect tensors to file descriptors");
-    if (!larodSetTensorFd(ppInputTensors[0], ppInputFd, &error)) {
+    if (ppModel && !larodSetTensorFd(ppInputTensors[0], ppInputFd, &error)) {
         syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
         goto end;
     }
-    if (!larodSetTensorFd(ppOutputTensors[0], larodInputFd, &error)) {
+    if (ppModel && !larodSetTensorFd(ppOutputTensors[0], larodInputFd, &error)) {
         syslog(LOG_ERR, "Failed setting input tensor fd: %s", error->msg);
         goto end;
     }
@@ -400,17 +509,51 @@ int main(int argc, char** argv) {
 
     // Create job requests
     syslog(LOG_INFO, "Create job requests");
-    ppReq = larodCreateJobRequest(ppModel,
-                                  ppInputTensors,
-                                  ppNumInputs,
-                                  ppOutputTensors,
-                                  ppNumOutputs,
-                                  cropMap,
-                                  &error);
-    if (!ppReq) {
-        syslog(LOG_ERR, "Failed creating preprocessing job request: %s", error->msg);
-        goto end;
+    if (ppModel) {
+        ppReq = larodCreateJobRequest(ppModel,
+                                      ppInputTensors,
+                                      ppNumInputs,
+                                      ppOutputTensors,
+                                      ppNumOutputs,
+                                      cropMap,
+                                      &error);
+        if (!ppReq) {
+            syslog(LOG_ERR, "Failed creating preprocessing job request: %s", error->msg);
+            goto end;
+        }
+    }
+
+#ifdef OPENCL_PREPROCESSING
+    // The OpenCL kernel writes the RGB image straight into the mapped input
+    // tensor of the inference model, the same memory the cpu-proc output
+    // tensor is connected to.
+    if (useOpenClPP) {
+        ClPreprocessorConfig ppConfig = {
+            .programFile = PP_OPENCL_PROGRAM,
+            .inWidth     = streamWidth,
+            .inHeight    = streamHeight,
+            .cropX       = clipX,
+            .cropY       = clipY,
+            .cropWidth   = clipW,
+            .cropHeight  = clipH,
+            .outWidth    = inputWidth,
+            .outHeight   = inputHeight,
+            .planar      = strcmp(chipString, "ambarella-cvflow") == 0,
+            .sampling    = PP_SAMPLING_AUTO,
+        };
+        if (strcmp(ppBackend, PP_BACKEND_OPENCL_BUFFER) == 0) {
+            ppConfig.sampling = PP_SAMPLING_BUFFER;
+        } else if (strcmp(ppBackend, PP_BACKEND_OPENCL_IMAGE) == 0) {
+            ppConfig.sampling = PP_SAMPLING_IMAGE;
+        }
+        clPreprocessor = createClPreprocessor(&ppConfig, larodInputAddr);
+        if (!clPreprocessor) {
+            syslog(LOG_ERR, "Failed setting up OpenCL preprocessing");
+            goto end;
+        }
+        syslog(LOG_INFO, "Using OpenCL as preprocessing backend");
     }
+#endif
 
     // App supports only one input/output tensor.
     infReq = larodCreateJobRequest(model, inputTensors, 1, outputTensors, 2, NULL, &error);
@@ -424,6 +567,10 @@ int main(int argc, char** argv) {
         goto end;
     }
 
+    unsigned int numFrames     = 0;
+    unsigned int numInferences = 0;
+    unsigned int numSkipped    = 0;
+
     for (int i = 0; i < numRounds && !stopRunning; i++) {
         struct timeval startTs, endTs;
         unsigned int elapsedMs = 0;
@@ -437,76 +584,144 @@ int main(int argc, char** argv) {
         // Get data from latest frame.
         uint8_t* nv12Data = (uint8_t*)vdo_buffer_get_data(buf);
 
-        // Covert image data from NV12 format to interleaved uint8_t RGB format
-        gettimeofday(&startTs, NULL);
-        memcpy(ppInputAddr, nv12Data, yuyvBufferSize);
-        if (!larodRunJob(conn, ppReq, &error)) {
-            syslog(LOG_ERR,
-                   "Unable to run job to preprocess model: %s (%d)",
-                   error->msg,
-                   error->code);
-            goto end;
-        }
-        gettimeofday(&endTs, NULL);
-
-        elapsedMs = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) +
-                                   ((endTs.tv_usec - startTs.tv_usec) / 1000));
-        syslog(LOG_INFO, "Converted image in %u ms", elapsedMs);
-
-        // Save the RGB image as a PPM file
-        const char* filename = "/tmp/output.ppm";
-        saveRgbImageAsPpm(larodInputAddr, inputWidth, inputHeight, filename);
-
-        // Since larodOutputAddr points to the beginning of the fd we should
-        // rewind the file position before each job.
-        if (lseek(larodOutput1Fd, 0, SEEK_SET) == -1) {
-            syslog(LOG_ERR, "Unable to rewind output file position: %s", strerror(errno));
-            goto end;
-        }
-
-        if (lseek(larodOutput2Fd, 0, SEEK_SET) == -1) {
-            syslog(LOG_ERR, "Unable to rewind output file position: %s", strerror(errno));
-            goto end;
+        // Run inference on the areas with motion only, or on the whole view.
+        MotionCrop crops[MAX_MOTION_CROPS] = {{clipX, clipY, clipW, clipH}};
+        size_t numCrops                    = 1;
+        numFrames++;
+        if (motionRoi) {
+            numCrops = findMotionCrops(motionRoi, nv12Data, crops);
+            if (numCrops == 0) {
+                syslog(LOG_INFO, "No motion, skipping inference");
+                numSkipped++;
+                returnFrame(provider, buf);
+                continue;
+            }
+            syslog(LOG_INFO, "Motion covered by %zu crops", numCrops);
         }
 
-        gettimeofday(&startTs, NULL);
-        if (!larodRunJob(conn, infReq, &error)) {
-            syslog(LOG_ERR,
-                   "Unable to run inference on model %s: %s (%d)",
-                   modelFile,
-                   error->msg,
-                   error->code);
-            goto end;
+        // The preprocessing input is the same for all crops of the frame.
+        if (ppReq) {
+            memcpy(ppInputAddr, nv12Data, yuyvBufferSize);
         }
-        gettimeofday(&endTs, NULL);
-
-        elapsedMs = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) +
-                                   ((endTs.tv_usec - startTs.tv_usec) / 1000));
-        syslog(LOG_INFO, "Ran inference for %u ms", elapsedMs);
 
-        if (strcmp(chipString, "ambarella-cvflow") != 0) {
-            uint8_t* person_pred = (uint8_t*)larodOutput1Addr;
-            uint8_t* car_pred    = (uint8_t*)larodOutput2Addr;
-
-            syslog(LOG_INFO,
-                   "Person detected: %.2f%% - Car detected: %.2f%%",
-                   (float)person_pred[0] / 2.55f,
-                   (float)car_pred[0] / 2.55f);
-        } else {
-            uint8_t* car_pred        = (uint8_t*)larodOutput1Addr;
-            uint8_t* person_pred     = (uint8_t*)larodOutput2Addr;
-            float float_score_car    = *((float*)car_pred);
-            float float_score_person = *((float*)person_pred);
-            syslog(LOG_INFO,
-                   "Person detected: %.2f%% - Car detected: %.2f%%",
-                   float_score_person * 100,
-                   float_score_car * 100);
+        for (size_t c = 0; c < numCrops; c++) {
+            const MotionCrop* crop = &crops[c];
+            if (motionRoi) {
+                syslog(LOG_INFO,
+                       "Crop X=%u Y=%u (%u x %u)",
+                       crop->x,
+                       crop->y,
+                       crop->width,
+                       crop->height);
+#ifdef OPENCL_PREPROCESSING
+                if (clPreprocessor && !setClPreprocessorCrop(clPreprocessor,
+                                                             crop->x,
+                                                             crop->y,
+                                                             crop->width,
+                                                             crop->height)) {
+                    goto end;
+                }
+#endif
+                if (ppReq && (!larodMapSetIntArr4(cropMap,
+                                                  "image.input.crop",
+                                                  crop->x,
+                                                  crop->y,
+                                                  crop->width,
+                                                  crop->height,
+                                                  &error) ||
+                              !larodSetJobRequestParams(ppReq, cropMap, &error))) {
+                    syslog(LOG_ERR, "Failed setting preprocessing crop: %s", error->msg);
+                    goto end;
+                }
+            }
+
+            // Covert image data from NV12 format to interleaved uint8_t RGB format
+            gettimeofday(&startTs, NULL);
+#ifdef OPENCL_PREPROCESSING
+            if (clPreprocessor) {
+                if (!runClPreprocessor(clPreprocessor, nv12Data)) {
+                    syslog(LOG_ERR, "Unable to run OpenCL preprocessing");
+                    goto end;
+                }
+            }
+#endif
+            if (ppReq) {
+                if (!larodRunJob(conn, ppReq, &error)) {
+                    syslog(LOG_ERR,
+                           "Unable to run job to preprocess model: %s (%d)",
+                           error->msg,
+                           error->code);
+                    goto end;
+                }
+            }
+            gettimeofday(&endTs, NULL);
+
+            elapsedMs = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) +
+                                       ((endTs.tv_usec - startTs.tv_usec) / 1000));
+            syslog(LOG_INFO, "Converted image in %u ms", elapsedMs);
+
+            // Save the RGB image as a PPM file
+            const char* filename = "/tmp/output.ppm";
+            saveRgbImageAsPpm(larodInputAddr, inputWidth, inputHeight, filename);
+
+            // Since larodOutputAddr points to the beginning of the fd we should
+            // rewind the file position before each job.
+            if (lseek(larodOutput1Fd, 0, SEEK_SET) == -1) {
+                syslog(LOG_ERR, "Unable to rewind output file position: %s", strerror(errno));
+                goto end;
+            }
+
+            if (lseek(larodOutput2Fd, 0, SEEK_SET) == -1) {
+                syslog(LOG_ERR, "Unable to rewind output file position: %s", strerror(errno));
+                goto end;
+            }
+
+            gettimeofday(&startTs, NULL);
+            if (!larodRunJob(conn, infReq, &error)) {
+                syslog(LOG_ERR,
+                       "Unable to run inference on model %s: %s (%d)",
+                       modelFile,
+                       error->msg,
+                       error->code);
+                goto end;
+            }
+            gettimeofday(&endTs, NULL);
+            numInferences++;
+
+            elapsedMs = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) +
+                                       ((endTs.tv_usec - startTs.tv_usec) / 1000));
+            syslog(LOG_INFO, "Ran inference for %u ms", elapsedMs);
+
+            if (strcmp(chipString, "ambarella-cvflow") != 0) {
+                uint8_t* person_pred = (uint8_t*)larodOutput1Addr;
+                uint8_t* car_pred    = (uint8_t*)larodOutput2Addr;
+
+                syslog(LOG_INFO,
+                       "Person detected: %.2f%% - Car detected: %.2f%%",
+                       (float)person_pred[0] / 2.55f,
+                       (float)car_pred[0] / 2.55f);
+            } else {
+                uint8_t* car_pred        = (uint8_t*)larodOutput1Addr;
+                uint8_t* person_pred     = (uint8_t*)larodOutput2Addr;
+                float float_score_car    = *((float*)car_pred);
+                float float_score_person = *((float*)person_pred);
+                syslog(LOG_INFO,
+                       "Person detected: %.2f%% - Car detected: %.2f%%",
+                       float_score_person * 100,
+                       float_score_car * 100);
+            }
         }
 
         // Release frame reference to provider.
         returnFrame(provider, buf);
     }
 
+    syslog(LOG_INFO,
+           "Ran %u inferences on %u frames, skipped %u frames without motion",
+           numInferences,
+           numFrames,
+           numSkipped);
+
     syslog(LOG_INFO, "Stop streaming video from VDO");
     if (!stopFrameFetch(provider)) {
         goto end;
@@ -518,6 +733,11 @@ end:
     if (provider) {
         destroyImgProvider(provider);
     }
+    destroyMotionRoi(motionRoi);
+#ifdef OPENCL_PREPROCESSING
+    // Released before the larod input tensor memory it writes to is unmapped
+    destroyClPreprocessor(clPreprocessor);
+#endif
     // Only the model handle is released here. We count on larod service to
     // release the privately loaded model when the session is disconnected in
     // larodDisconnect().
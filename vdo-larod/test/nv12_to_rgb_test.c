@@ -0,0 +1,498 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - nv12_to_rgb_test -
+ *
+ * This program checks the kernels in nv12_to_rgb.cl on the build machine,
+ * without a device. It runs them on the first OpenCL device found, such as
+ * PoCL on the CPU, on an NV12 test pattern, and compares the output with the
+ * same crop, bilinear scale and BT.601 conversion done on the CPU in double
+ * precision.
+ *
+ * Both the buffer kernel and, if the device supports images, the image kernel
+ * are run for a set of crops and output sizes, with interleaved and planar
+ * output. The largest difference per channel is printed for every case, and
+ * the program fails if it is larger than a rounding difference.
+ *
+ * The program takes the path of the OpenCL program source as argument:
+ *  ./nv12_to_rgb_test ../app/nv12_to_rgb.cl
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+#define MAX_SOURCE_SIZE (0x100000)
+
+#define IN_WIDTH  64
+#define IN_HEIGHT 48
+
+/// Largest difference per channel from the CPU conversion, float against double rounding.
+#define MAX_BUFFER_DIFF (1)
+
+/// The sampler may interpolate with less precision than the kernel does.
+#define MAX_IMAGE_DIFF (2)
+
+/**
+ * brief A crop of the input scaled to an output size.
+ */
+typedef struct TestCase {
+    const char* name;
+    /// Crop in input pixels, x, y, width and height.
+    float crop[4];
+    int outWidth;
+    int outHeight;
+    int planar;
+} TestCase;
+
+static const TestCase testCases[] = {
+    {"same size", {0, 0, IN_WIDTH, IN_HEIGHT}, IN_WIDTH, IN_HEIGHT, 0},
+    {"downscale", {0, 0, IN_WIDTH, IN_HEIGHT}, 24, 18, 1},
+    {"crop upscale", {10, 6, 32, 24}, 40, 30, 0},
+    {"crop at edge", {48, 32, 16, 16}, 20, 20, 1},
+    {"aspect change", {4, 0, 56, 48}, 30, 30, 0},
+};
+
+typedef struct TestContext {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    cl_kernel imageKernel;
+    cl_mem input;
+    cl_mem yImage;
+    cl_mem uvImage;
+} TestContext;
+
+/**
+ * brief Fill an NV12 image with a pattern covering the whole range of each channel.
+ *
+ * Luma and chroma change at different rates in both directions, so a wrong
+ * position or plane offset shows up as a large difference.
+ *
+ * param nv12 Image of IN_WIDTH x IN_HEIGHT pixels, with the Y plane first.
+ */
+static void fillPattern(uint8_t* nv12) {
+    uint8_t* uv = nv12 + IN_WIDTH * IN_HEIGHT;
+
+    for (int y = 0; y < IN_HEIGHT; y++) {
+        for (int x = 0; x < IN_WIDTH; x++)
+            nv12[y * IN_WIDTH + x] = (uint8_t)(x * 13 + y * 7);
+    }
+    for (int y = 0; y < IN_HEIGHT / 2; y++) {
+        for (int x = 0; x < IN_WIDTH / 2; x++) {
+            uv[y * IN_WIDTH + 2 * x]     = (uint8_t)(x * 29 + y * 3);
+            uv[y * IN_WIDTH + 2 * x + 1] = (uint8_t)(x * 5 + y * 31);
+        }
+    }
+}
+
+static double mix(double x, double y, double a) {
+    return x + (y - x) * a;
+}
+
+/**
+ * brief Bilinear sample of one byte channel, with positions clamped to the plane.
+ */
+static double samplePlane(const uint8_t* plane,
+                          int stride,
+                          int pixelStep,
+                          int maxX,
+                          int maxY,
+                          double x,
+                          double y) {
+    x = fmin(fmax(x, 0.0), maxX);
+    y = fmin(fmax(y, 0.0), maxY);
+
+    int x0              = (int)x;
+    int y0              = (int)y;
+    int x1              = x0 + 1 < maxX ? x0 + 1 : maxX;
+    int y1              = y0 + 1 < maxY ? y0 + 1 : maxY;
+    double fx           = x - x0;
+    double fy           = y - y0;
+    const uint8_t* top  = plane + y0 * stride;
+    const uint8_t* next = plane + y1 * stride;
+
+    return mix(mix(top[x0 * pixelStep], top[x1 * pixelStep], fx),
+               mix(next[x0 * pixelStep], next[x1 * pixelStep], fx),
+               fy);
+}
+
+static uint8_t toByte(double value) {
+    value = rint(value);
+    return value < 0.0 ? 0 : value > 255.0 ? 255 : (uint8_t)value;
+}
+
+/**
+ * brief Convert on the CPU what the kernels convert, in double precision.
+ *
+ * param nv12 Input image.
+ * param test Crop, output size and layout.
+ * param rgb Output of test->outWidth x test->outHeight RGB pixels.
+ */
+static void convertReference(const uint8_t* nv12, const TestCase* test, uint8_t* rgb) {
+    const uint8_t* uv = nv12 + IN_WIDTH * IN_HEIGHT;
+    int planeSize     = test->outWidth * test->outHeight;
+    int uvMaxX        = IN_WIDTH / 2 - 1;
+    int uvMaxY        = IN_HEIGHT / 2 - 1;
+
+    for (int y = 0; y < test->outHeight; y++) {
+        for (int x = 0; x < test->outWidth; x++) {
+            // Center of the output pixel in input coordinates
+            double srcX = test->crop[0] + (x + 0.5) * test->crop[2] / test->outWidth - 0.5;
+            double srcY = test->crop[1] + (y + 0.5) * test->crop[3] / test->outHeight - 0.5;
+            double uvX  = (srcX + 0.5) * 0.5 - 0.5;
+            double uvY  = (srcY + 0.5) * 0.5 - 0.5;
+
+            double luma = samplePlane(nv12, IN_WIDTH, 1, IN_WIDTH - 1, IN_HEIGHT - 1, srcX, srcY);
+            double u    = samplePlane(uv, IN_WIDTH, 2, uvMaxX, uvMaxY, uvX, uvY);
+            double v    = samplePlane(uv + 1, IN_WIDTH, 2, uvMaxX, uvMaxY, uvX, uvY);
+
+            luma = 1.164 * (luma - 16.0);
+            u -= 128.0;
+            v -= 128.0;
+
+            uint8_t pixel[3] = {toByte(luma + 1.596 * v),
+                                toByte(luma - 0.813 * v - 0.391 * u),
+                                toByte(luma + 2.018 * u)};
+            int id           = y * test->outWidth + x;
+            for (int c = 0; c < 3; c++) {
+                if (test->planar)
+                    rgb[id + c * planeSize] = pixel[c];
+                else
+                    rgb[id * 3 + c] = pixel[c];
+            }
+        }
+    }
+}
+
+/**
+ * brief Read the program source and build it for the device.
+ *
+ * param ctx Context to build the program in.
+ * param fileName Path of the OpenCL program source.
+ * return False if any errors occur, otherwise true.
+ */
+static bool buildProgram(TestContext* ctx, const char* fileName) {
+    cl_int ret;
+    FILE* fp = fopen(fileName, "r");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s\n", fileName);
+        return false;
+    }
+    char* source      = (char*)malloc(MAX_SOURCE_SIZE);
+    size_t sourceSize = fread(source, 1, MAX_SOURCE_SIZE, fp);
+    fclose(fp);
+
+    ctx->program = clCreateProgramWithSource(ctx->context,
+                                             1,
+                                             (const char**)&source,
+                                             (const size_t*)&sourceSize,
+                                             &ret);
+    free(source);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create cl program: %d\n", ret);
+        return false;
+    }
+
+    ret = clBuildProgram(ctx->program, 1, &ctx->device, "", NULL, NULL);
+    if (ret != CL_SUCCESS) {
+        size_t logSize = 0;
+        clGetProgramBuildInfo(ctx->program,
+                              ctx->device,
+                              CL_PROGRAM_BUILD_LOG,
+                              0,
+                              NULL,
+                              &logSize);
+        char* log = (char*)calloc(1, logSize + 1);
+        clGetProgramBuildInfo(ctx->program,
+                              ctx->device,
+                              CL_PROGRAM_BUILD_LOG,
+                              logSize,
+                              log,
+                              NULL);
+        fprintf(stderr, "Could not build cl program: %d\n%s\n", ret, log);
+        free(log);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * brief Create a read only image of one NV12 plane, with rows of IN_WIDTH bytes.
+ */
+static cl_mem createPlaneImage(TestContext* ctx,
+                               uint8_t* addr,
+                               cl_channel_order order,
+                               size_t width,
+                               size_t height) {
+    cl_int ret;
+    cl_image_format format = {order, CL_UNORM_INT8};
+    cl_image_desc desc;
+
+    memset(&desc, 0, sizeof(desc));
+    desc.image_type      = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width     = width;
+    desc.image_height    = height;
+    desc.image_row_pitch = IN_WIDTH;
+
+    cl_mem image = clCreateImage(ctx->context,
+                                 CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                 &format,
+                                 &desc,
+                                 addr,
+                                 &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Unable to create input cl image: %d\n", ret);
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * brief Set up the first OpenCL device found, and the input memory objects.
+ *
+ * The image kernel is left NULL if the device has no image support.
+ *
+ * param ctx Context to set up.
+ * param fileName Path of the OpenCL program source.
+ * param nv12 Input image, copied to the device.
+ * return False if any errors occur, otherwise true.
+ */
+static bool setup(TestContext* ctx, const char* fileName, uint8_t* nv12) {
+    cl_int ret;
+    cl_platform_id platform;
+    cl_bool imageSupport = CL_FALSE;
+    char name[256]       = "";
+
+    ret = clGetPlatformIDs(1, &platform, NULL);
+    if (ret == CL_SUCCESS)
+        ret = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &ctx->device, NULL);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "No OpenCL device found: %d\n", ret);
+        return false;
+    }
+    clGetDeviceInfo(ctx->device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+    clGetDeviceInfo(ctx->device,
+                    CL_DEVICE_IMAGE_SUPPORT,
+                    sizeof(imageSupport),
+                    &imageSupport,
+                    NULL);
+    printf("Running on %s, %s image support\n", name, imageSupport ? "with" : "without");
+
+    ctx->context = clCreateContext(NULL, 1, &ctx->device, NULL, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create cl context: %d\n", ret);
+        return false;
+    }
+    ctx->queue = clCreateCommandQueue(ctx->context, ctx->device, 0, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create cl command queue: %d\n", ret);
+        return false;
+    }
+    if (!buildProgram(ctx, fileName))
+        return false;
+
+    ctx->kernel = clCreateKernel(ctx->program, "nv12_to_rgb", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create kernel nv12_to_rgb: %d\n", ret);
+        return false;
+    }
+    ctx->input = clCreateBuffer(ctx->context,
+                                CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                IN_WIDTH * IN_HEIGHT * 3 / 2,
+                                nv12,
+                                &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create input buffer: %d\n", ret);
+        return false;
+    }
+
+    if (!imageSupport)
+        return true;
+    ctx->imageKernel = clCreateKernel(ctx->program, "nv12_to_rgb_image", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create kernel nv12_to_rgb_image: %d\n", ret);
+        return false;
+    }
+    ctx->yImage  = createPlaneImage(ctx, nv12, CL_R, IN_WIDTH, IN_HEIGHT);
+    ctx->uvImage = createPlaneImage(ctx,
+                                    nv12 + IN_WIDTH * IN_HEIGHT,
+                                    CL_RG,
+                                    IN_WIDTH / 2,
+                                    IN_HEIGHT / 2);
+    return ctx->yImage && ctx->uvImage;
+}
+
+/**
+ * brief Run a kernel for a test case and read back its output.
+ *
+ * param ctx Context set up for the test.
+ * param image True for the image kernel, false for the buffer kernel.
+ * param test Crop, output size and layout.
+ * param rgb Output of test->outWidth x test->outHeight RGB pixels.
+ * return False if any errors occur, otherwise true.
+ */
+static bool runKernel(TestContext* ctx, bool image, const TestCase* test, uint8_t* rgb) {
+    cl_int ret;
+    cl_int inWidth   = IN_WIDTH;
+    cl_int inHeight  = IN_HEIGHT;
+    cl_int outWidth  = test->outWidth;
+    cl_int outHeight = test->outHeight;
+    cl_int planar    = test->planar;
+    size_t outSize   = (size_t)outWidth * outHeight * 3;
+    size_t global[2] = {(size_t)outWidth, (size_t)outHeight};
+    cl_float4 crop;
+
+    memcpy(&crop, test->crop, sizeof(crop));
+    cl_mem output = clCreateBuffer(ctx->context, CL_MEM_WRITE_ONLY, outSize, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not create output buffer: %d\n", ret);
+        return false;
+    }
+
+    cl_kernel kernel = image ? ctx->imageKernel : ctx->kernel;
+    if (image) {
+        ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), &ctx->yImage);
+        ret |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &ctx->uvImage);
+        ret |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output);
+        ret |= clSetKernelArg(kernel, 3, sizeof(crop), &crop);
+        ret |= clSetKernelArg(kernel, 4, sizeof(outWidth), &outWidth);
+        ret |= clSetKernelArg(kernel, 5, sizeof(outHeight), &outHeight);
+        ret |= clSetKernelArg(kernel, 6, sizeof(planar), &planar);
+    } else {
+        ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), &ctx->input);
+        ret |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+        ret |= clSetKernelArg(kernel, 2, sizeof(inWidth), &inWidth);
+        ret |= clSetKernelArg(kernel, 3, sizeof(inHeight), &inHeight);
+        ret |= clSetKernelArg(kernel, 4, sizeof(crop), &crop);
+        ret |= clSetKernelArg(kernel, 5, sizeof(outWidth), &outWidth);
+        ret |= clSetKernelArg(kernel, 6, sizeof(outHeight), &outHeight);
+        ret |= clSetKernelArg(kernel, 7, sizeof(planar), &planar);
+    }
+    if (ret == CL_SUCCESS)
+        ret = clEnqueueNDRangeKernel(ctx->queue, kernel, 2, NULL, global, NULL, 0, NULL, NULL);
+    if (ret == CL_SUCCESS)
+        ret = clEnqueueReadBuffer(ctx->queue, output, CL_TRUE, 0, outSize, rgb, 0, NULL, NULL);
+    clReleaseMemObject(output);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Could not run kernel: %d\n", ret);
+        return false;
+    }
+    return true;
+}
+
+static void teardown(TestContext* ctx) {
+    if (ctx->yImage)
+        clReleaseMemObject(ctx->yImage);
+    if (ctx->uvImage)
+        clReleaseMemObject(ctx->uvImage);
+    if (ctx->input)
+        clReleaseMemObject(ctx->input);
+    if (ctx->imageKernel)
+        clReleaseKernel(ctx->imageKernel);
+    if (ctx->kernel)
+        clReleaseKernel(ctx->kernel);
+    if (ctx->program)
+        clReleaseProgram(ctx->program);
+    if (ctx->queue)
+        clReleaseCommandQueue(ctx->queue);
+    if (ctx->context)
+        clReleaseContext(ctx->context);
+}
+
+/**
+ * brief Run one kernel for a test case and compare with the CPU conversion.
+ *
+ * param ctx Context set up for the test.
+ * param image True for the image kernel, false for the buffer kernel.
+ * param test Crop, output size and layout.
+ * param nv12 Input image.
+ * return True if no channel differs by more than allowed, otherwise false.
+ */
+static bool check(TestContext* ctx, bool image, const TestCase* test, const uint8_t* nv12) {
+    size_t outSize     = (size_t)test->outWidth * test->outHeight * 3;
+    uint8_t* expected  = (uint8_t*)malloc(outSize);
+    uint8_t* actual    = (uint8_t*)malloc(outSize);
+    int maxDiff        = image ? MAX_IMAGE_DIFF : MAX_BUFFER_DIFF;
+    int largest        = 0;
+    size_t largestAt   = 0;
+    bool ran           = runKernel(ctx, image, test, actual);
+    const char* kernel = image ? "nv12_to_rgb_image" : "nv12_to_rgb";
+
+    convertReference(nv12, test, expected);
+    for (size_t i = 0; ran && i < outSize; i++) {
+        int diff = abs(actual[i] - expected[i]);
+        if (diff > largest) {
+            largest   = diff;
+            largestAt = i;
+        }
+    }
+
+    bool passed = ran && largest <= maxDiff;
+    if (!ran)
+        printf("FAIL %-18s %-14s could not run\n", kernel, test->name);
+    else if (passed)
+        printf("ok   %-18s %-14s max diff %d\n", kernel, test->name, largest);
+    else
+        printf("FAIL %-18s %-14s max diff %d at byte %zu, %d instead of %d\n",
+               kernel,
+               test->name,
+               largest,
+               largestAt,
+               actual[largestAt],
+               expected[largestAt]);
+
+    free(expected);
+    free(actual);
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    TestContext ctx;
+    static uint8_t nv12[IN_WIDTH * IN_HEIGHT * 3 / 2];
+    int failed = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <path to nv12_to_rgb.cl>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    fillPattern(nv12);
+    if (!setup(&ctx, argv[1], nv12)) {
+        teardown(&ctx);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(testCases) / sizeof(testCases[0]); i++) {
+        failed += !check(&ctx, false, &testCases[i], nv12);
+        if (ctx.imageKernel)
+            failed += !check(&ctx, true, &testCases[i], nv12);
+    }
+
+    teardown(&ctx);
+    printf("%s, %d failed\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
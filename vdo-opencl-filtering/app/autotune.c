@@ -0,0 +1,226 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file selects the local work size of a kernel by benchmarking candidate
+ * sizes on the actual device.
+ */
+
+#include "autotune.h"
+
+#include <syslog.h>
+
+/* Runs per candidate before and while timing */
+#define WARMUP_RUNS    2
+#define BENCHMARK_RUNS 10
+
+/* Largest candidate extent in each dimension */
+#define MAX_LOCAL_SIZE 64
+
+/* Characters allowed in key file group names */
+#define GROUP_NAME_CHARS                   \
+    "abcdefghijklmnopqrstuvwxyz"           \
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789" \
+    " .-_()"
+
+static gchar* get_device_string(cl_device_id device, cl_device_info param) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+        return g_strdup("unknown");
+
+    gchar* info = g_malloc0(size);
+    clGetDeviceInfo(device, param, size, info, NULL);
+    return info;
+}
+
+/* Group name in the cache file, unique per device and driver version */
+static gchar* get_device_group(cl_device_id device) {
+    gchar* name    = get_device_string(device, CL_DEVICE_NAME);
+    gchar* version = get_device_string(device, CL_DRIVER_VERSION);
+    gchar* group   = g_strdup_printf("%s %s", name, version);
+
+    g_strcanon(group, GROUP_NAME_CHARS, '_');
+    g_free(name);
+    g_free(version);
+    return group;
+}
+
+/* Average time in seconds of one run, or a negative value if the kernel could not be run */
+static gdouble benchmark(const struct autotune_job* job, const size_t local_work_size[2]) {
+    cl_int ret = CL_SUCCESS;
+
+    if (job->local_mem_size) {
+        ret = clSetKernelArg(job->kernel,
+                             job->local_mem_arg,
+                             job->local_mem_size(local_work_size),
+                             NULL);
+        if (ret != CL_SUCCESS)
+            return -1.0;
+    }
+
+    gint64 start = 0;
+    for (int i = 0; i < WARMUP_RUNS + BENCHMARK_RUNS; i++) {
+        if (i == WARMUP_RUNS) {
+            ret   = clFinish(job->queue);
+            start = g_get_monotonic_time();
+        }
+        ret |= clEnqueueNDRangeKernel(job->queue,
+                                      job->kernel,
+                                      2,
+                                      job->offset,
+                                      job->global_work_size,
+                                      local_work_size,
+                                      0,
+                                      NULL,
+                                      NULL);
+        if (ret != CL_SUCCESS) {
+            clFinish(job->queue);
+            return -1.0;
+        }
+    }
+    if (clFinish(job->queue) != CL_SUCCESS)
+        return -1.0;
+
+    return (g_get_monotonic_time() - start) / ((gdouble)G_USEC_PER_SEC * BENCHMARK_RUNS);
+}
+
+static gboolean is_candidate(const struct autotune_job* job,
+                             const size_t local_work_size[2],
+                             size_t max_group_size,
+                             cl_ulong local_mem_limit) {
+    if (job->global_work_size[0] % local_work_size[0] ||
+        job->global_work_size[1] % local_work_size[1])
+        return FALSE;
+    if (local_work_size[0] * local_work_size[1] > max_group_size)
+        return FALSE;
+    if (job->local_mem_size && job->local_mem_size(local_work_size) > local_mem_limit)
+        return FALSE;
+    return TRUE;
+}
+
+static gdouble benchmark_candidates(const struct autotune_job* job, size_t best[2]) {
+    size_t max_group_size     = 0;
+    cl_ulong local_mem_limit  = 0;
+    cl_ulong kernel_local_mem = 0;
+    gdouble best_time         = -1.0;
+
+    clGetKernelWorkGroupInfo(job->kernel,
+                             job->device,
+                             CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(max_group_size),
+                             &max_group_size,
+                             NULL);
+    clGetKernelWorkGroupInfo(job->kernel,
+                             job->device,
+                             CL_KERNEL_LOCAL_MEM_SIZE,
+                             sizeof(kernel_local_mem),
+                             &kernel_local_mem,
+                             NULL);
+    clGetDeviceInfo(job->device,
+                    CL_DEVICE_LOCAL_MEM_SIZE,
+                    sizeof(local_mem_limit),
+                    &local_mem_limit,
+                    NULL);
+    local_mem_limit -= MIN(kernel_local_mem, local_mem_limit);
+
+    for (size_t rows = 1; rows <= MAX_LOCAL_SIZE; rows <<= 1) {
+        for (size_t cols = 1; cols <= MAX_LOCAL_SIZE; cols <<= 1) {
+            size_t candidate[2] = {rows, cols};
+            if (!is_candidate(job, candidate, max_group_size, local_mem_limit))
+                continue;
+
+            gdouble seconds = benchmark(job, candidate);
+            if (seconds < 0.0) {
+                syslog(LOG_INFO, "Local work size {%zu, %zu} could not be run", rows, cols);
+                continue;
+            }
+            syslog(LOG_INFO,
+                   "Local work size {%zu, %zu}: %.3f ms",
+                   rows,
+                   cols,
+                   seconds * 1000.0);
+
+            if (best_time < 0.0 || seconds < best_time) {
+                best_time = seconds;
+                best[0]   = rows;
+                best[1]   = cols;
+            }
+        }
+    }
+    return best_time;
+}
+
+int autotune_local_work_size(const struct autotune_job* job,
+                             const char* config_name,
+                             const char* cache_file,
+                             gboolean retune,
+                             size_t local_work_size[2]) {
+    GError* error     = NULL;
+    GKeyFile* cache   = g_key_file_new();
+    gchar* group      = get_device_group(job->device);
+    gchar* time_key   = g_strdup_printf("%s-seconds", config_name);
+    gint* cached_size = NULL;
+    gsize length      = 0;
+    gdouble seconds   = -1.0;
+    int ret           = -1;
+
+    /* A missing cache file is expected on the first start */
+    g_key_file_load_from_file(cache, cache_file, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+    if (!retune)
+        cached_size = g_key_file_get_integer_list(cache, group, config_name, &length, NULL);
+
+    if (cached_size && length == 2 && cached_size[0] > 0 && cached_size[1] > 0) {
+        local_work_size[0] = cached_size[0];
+        local_work_size[1] = cached_size[1];
+        seconds            = g_key_file_get_double(cache, group, time_key, NULL);
+        syslog(LOG_INFO, "Using cached local work size for %s on %s", config_name, group);
+    } else {
+        syslog(LOG_INFO, "Benchmarking local work sizes for %s on %s", config_name, group);
+        seconds = benchmark_candidates(job, local_work_size);
+        if (seconds < 0.0) {
+            syslog(LOG_ERR, "No local work size could be run for %s", config_name);
+            goto exit;
+        }
+
+        gint tuned_size[2] = {local_work_size[0], local_work_size[1]};
+        g_key_file_set_integer_list(cache, group, config_name, tuned_size, 2);
+        g_key_file_set_double(cache, group, time_key, seconds);
+        if (!g_key_file_save_to_file(cache, cache_file, &error)) {
+            /* Not fatal, the size is tuned again on the next start */
+            syslog(LOG_WARNING, "Unable to save autotune cache: %s", error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    if (seconds > 0.0) {
+        syslog(LOG_INFO,
+               "Local work size {%zu, %zu} for %s: %.3f ms per frame, %.1f Mpixel/s",
+               local_work_size[0],
+               local_work_size[1],
+               config_name,
+               seconds * 1000.0,
+               job->pixels / seconds / 1e6);
+    }
+    ret = 0;
+
+exit:
+    g_free(cached_size);
+    g_free(time_key);
+    g_free(group);
+    g_key_file_free(cache);
+    return ret;
+}
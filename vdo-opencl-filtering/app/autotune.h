@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file selects the local work size of a kernel by benchmarking
+ * candidate sizes on the actual device.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+/* Returns the number of bytes of local memory a kernel needs for a work group size */
+typedef size_t (*local_mem_size_func)(const size_t local_work_size[2]);
+
+/* A two dimensional NDRange and the kernel to run over it */
+struct autotune_job {
+    cl_command_queue queue;
+    cl_device_id device;
+    /* Kernel with all arguments except the local memory argument already set */
+    cl_kernel kernel;
+    const size_t* offset;
+    const size_t* global_work_size;
+    /* Set for kernels that take a __local buffer as argument local_mem_arg */
+    local_mem_size_func local_mem_size;
+    cl_uint local_mem_arg;
+    /* Number of pixels processed per run, used to report throughput */
+    size_t pixels;
+};
+
+/**
+ * brief Find the fastest local work size for a kernel.
+ *
+ * The winner is cached per device and driver version under config_name in
+ * cache_file. Candidates are only benchmarked when no cached value exists, or
+ * when retune is set.
+ *
+ * Every candidate divides the global work size evenly in both dimensions and
+ * fits within the kernel work group and device local memory limits.
+ *
+ * param job Kernel and NDRange to tune.
+ * param config_name Name of the kernel configuration, e.g. kernel and resolution.
+ * param cache_file Path of the key file holding tuned sizes.
+ * param retune Benchmark even if a cached size exists.
+ * param local_work_size Selected local work size.
+ * return 0 on success, -1 if no candidate could be run.
+ */
+int autotune_local_work_size(const struct autotune_job* job,
+                             const char* config_name,
+                             const char* cache_file,
+                             gboolean retune,
+                             size_t local_work_size[2]);
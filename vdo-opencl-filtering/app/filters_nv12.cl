@@ -0,0 +1,343 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Library of luma filters for NV12 images. Like the Sobel kernels, every work
+ * item filters 8 pixels of one row, so the NDRange is (height, width / 8). The
+ * chroma plane is left untouched; the host copies it from the input frame, or
+ * keeps it when the frame was already copied to the output.
+ *
+ * Reads outside the image are clamped to the nearest edge pixel, so all
+ * kernels may run over the full image, including the first and last rows.
+ */
+
+/* Load 16 pixels of a row starting at col, clamping rows and columns to the image */
+uchar16 load16_clamped(__global const unsigned char *In_y,
+                       int row,
+                       int col,
+                       int width,
+                       int height)
+{
+    __global const unsigned char *line = In_y + clamp(row, 0, height - 1) * width;
+
+    if (col >= 0 && col + 16 <= width)
+        return vload16(0, line + col);
+
+    unsigned char pixels[16];
+    for (int i = 0; i < 16; i++)
+        pixels[i] = line[clamp(col + i, 0, width - 1)];
+    return vload16(0, pixels);
+}
+
+/* Load 8 pixels of a row starting at col, clamping the row to the image */
+uchar8 load8_row_clamped(__global const unsigned char *In_y,
+                         int row,
+                         int col,
+                         int width,
+                         int height)
+{
+    return vload8(0, In_y + clamp(row, 0, height - 1) * width + col);
+}
+
+/* Horizontal pass of the separable 5x5 Gaussian, weights 1 4 6 4 1 */
+__kernel void gaussian_5x1(__global const unsigned char *In_y,
+                           __global unsigned char *Out_y,
+                           int width,
+                           int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    ushort16 p = convert_ushort16(load16_clamped(In_y, row, col - 2, width, height));
+
+    ushort8 sum = p.s01234567 + p.s456789ab;
+    sum += (p.s12345678 + p.s3456789a) << (ushort8)2;
+    sum += p.s23456789 * (ushort8)6;
+
+    vstore8(convert_uchar8((sum + (ushort8)8) >> (ushort8)4), 0, &Out_y[row * width + col]);
+}
+
+/* Vertical pass of the separable 5x5 Gaussian, weights 1 4 6 4 1 */
+__kernel void gaussian_1x5(__global const unsigned char *In_y,
+                           __global unsigned char *Out_y,
+                           int width,
+                           int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+
+    ushort8 sum = convert_ushort8(load8_row_clamped(In_y, row - 2, col, width, height));
+    sum += convert_ushort8(load8_row_clamped(In_y, row + 2, col, width, height));
+    sum += (convert_ushort8(load8_row_clamped(In_y, row - 1, col, width, height)) +
+            convert_ushort8(load8_row_clamped(In_y, row + 1, col, width, height))) << (ushort8)2;
+    sum += convert_ushort8(vload8(0, &In_y[row * width + col])) * (ushort8)6;
+
+    vstore8(convert_uchar8((sum + (ushort8)8) >> (ushort8)4), 0, &Out_y[row * width + col]);
+}
+
+/* Horizontal pass of the separable 5x5 box filter */
+__kernel void box_5x1(__global const unsigned char *In_y,
+                      __global unsigned char *Out_y,
+                      int width,
+                      int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    ushort16 p = convert_ushort16(load16_clamped(In_y, row, col - 2, width, height));
+
+    ushort8 sum = p.s23456789 + p.s12345678 + p.s3456789a + p.s01234567 + p.s456789ab;
+
+    vstore8(convert_uchar8((sum + (ushort8)2) / (ushort8)5), 0, &Out_y[row * width + col]);
+}
+
+/* Vertical pass of the separable 5x5 box filter */
+__kernel void box_1x5(__global const unsigned char *In_y,
+                      __global unsigned char *Out_y,
+                      int width,
+                      int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+
+    ushort8 sum = (ushort8)0;
+    for (int r = -2; r <= 2; r++)
+        sum += convert_ushort8(load8_row_clamped(In_y, row + r, col, width, height));
+
+    vstore8(convert_uchar8((sum + (ushort8)2) / (ushort8)5), 0, &Out_y[row * width + col]);
+}
+
+/*
+ * Median by forgetful selection. The median of n values is found among any
+ * n / 2 + 2 of them after dropping their minimum and maximum, so only that
+ * many values are kept. After each drop the next value is added, until all
+ * have been seen and the median is the middle of the three left. All eight
+ * pixels are selected in parallel, one per vector lane.
+ */
+void move_min_max(uchar8 *v, int count)
+{
+    for (int i = 1; i < count; i++) {
+        uchar8 lo = min(v[0], v[i]);
+        v[i] = max(v[0], v[i]);
+        v[0] = lo;
+    }
+    for (int i = 1; i < count - 1; i++) {
+        uchar8 hi = max(v[count - 1], v[i]);
+        v[i] = min(v[count - 1], v[i]);
+        v[count - 1] = hi;
+    }
+}
+
+uchar8 forgetful_median(uchar8 *v, int n)
+{
+    int count = n / 2 + 2;
+
+    for (int next = count; next < n; next++) {
+        move_min_max(v, count);
+        /* Replace the minimum with the next value and drop the maximum */
+        v[0] = v[next];
+        count--;
+    }
+    move_min_max(v, count);
+    return v[1];
+}
+
+__kernel void median_3x3(__global const unsigned char *In_y,
+                         __global unsigned char *Out_y,
+                         int width,
+                         int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    uchar8 v[9];
+
+    for (int r = 0; r < 3; r++) {
+        uchar16 p = load16_clamped(In_y, row + r - 1, col - 1, width, height);
+        v[r * 3] = p.s01234567;
+        v[r * 3 + 1] = p.s12345678;
+        v[r * 3 + 2] = p.s23456789;
+    }
+
+    vstore8(forgetful_median(v, 9), 0, &Out_y[row * width + col]);
+}
+
+__kernel void median_5x5(__global const unsigned char *In_y,
+                         __global unsigned char *Out_y,
+                         int width,
+                         int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    uchar8 v[25];
+
+    for (int r = 0; r < 5; r++) {
+        uchar16 p = load16_clamped(In_y, row + r - 2, col - 2, width, height);
+        v[r * 5] = p.s01234567;
+        v[r * 5 + 1] = p.s12345678;
+        v[r * 5 + 2] = p.s23456789;
+        v[r * 5 + 3] = p.s3456789a;
+        v[r * 5 + 4] = p.s456789ab;
+    }
+
+    vstore8(forgetful_median(v, 25), 0, &Out_y[row * width + col]);
+}
+
+/* Minimum of the 3x3 neighborhood, shrinks bright areas */
+__kernel void erode_3x3(__global const unsigned char *In_y,
+                        __global unsigned char *Out_y,
+                        int width,
+                        int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    uchar8 result = (uchar8)255;
+
+    for (int r = -1; r <= 1; r++) {
+        uchar16 p = load16_clamped(In_y, row + r, col - 1, width, height);
+        result = min(result, min(p.s01234567, min(p.s12345678, p.s23456789)));
+    }
+
+    vstore8(result, 0, &Out_y[row * width + col]);
+}
+
+/* Maximum of the 3x3 neighborhood, grows bright areas */
+__kernel void dilate_3x3(__global const unsigned char *In_y,
+                         __global unsigned char *Out_y,
+                         int width,
+                         int height)
+{
+    int row = get_global_id(0);
+    if (row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    uchar8 result = (uchar8)0;
+
+    for (int r = -1; r <= 1; r++) {
+        uchar16 p = load16_clamped(In_y, row + r, col - 1, width, height);
+        result = max(result, max(p.s01234567, max(p.s12345678, p.s23456789)));
+    }
+
+    vstore8(result, 0, &Out_y[row * width + col]);
+}
+
+/*
+ * Accumulate a 256 bin histogram of the luma. Every work group first counts
+ * into its own bins in local memory, then adds the non-empty bins to the
+ * global histogram, so most atomic operations stay on-chip. The histogram is
+ * accumulated over all frames until the host clears it.
+ */
+__kernel void luma_histogram(__global const unsigned char *In_y,
+                             __global unsigned int *histogram,
+                             int width,
+                             int height,
+                             __local unsigned int *bins)
+{
+    int local_id = get_local_id(0) * get_local_size(1) + get_local_id(1);
+    int local_items = get_local_size(0) * get_local_size(1);
+
+    for (int i = local_id; i < 256; i += local_items)
+        bins[i] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int row = get_global_id(0);
+    if (row < height) {
+        int col = (get_global_id(1) << 3);
+        uchar8 p = vload8(0, &In_y[row * width + col]);
+
+        atomic_inc(&bins[p.s0]);
+        atomic_inc(&bins[p.s1]);
+        atomic_inc(&bins[p.s2]);
+        atomic_inc(&bins[p.s3]);
+        atomic_inc(&bins[p.s4]);
+        atomic_inc(&bins[p.s5]);
+        atomic_inc(&bins[p.s6]);
+        atomic_inc(&bins[p.s7]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int i = local_id; i < 256; i += local_items) {
+        if (bins[i])
+            atomic_add(&histogram[i], bins[i]);
+    }
+}
+
+/*
+ * Sobel gradient magnitude summed per work group, in one pass and without
+ * writing an edge image. Every work group covers one block of local rows by
+ * local columns * 8 pixels, and writes the sum of its block to
+ * energy[group]. The tree reduction in local memory needs a power of two
+ * work group size, which all autotuned sizes are.
+ */
+__kernel void edge_energy(__global const unsigned char *In_y,
+                          __global unsigned int *energy,
+                          int width,
+                          int height,
+                          __local unsigned int *partial)
+{
+    int local_id = get_local_id(0) * get_local_size(1) + get_local_id(1);
+    int local_items = get_local_size(0) * get_local_size(1);
+    int row = get_global_id(0);
+    unsigned int sum = 0;
+
+    if (row < height) {
+        int col = (get_global_id(1) << 3);
+        short16 prev = convert_short16(load16_clamped(In_y, row - 1, col - 1, width, height));
+        short16 cur = convert_short16(load16_clamped(In_y, row, col - 1, width, height));
+        short16 next = convert_short16(load16_clamped(In_y, row + 1, col - 1, width, height));
+
+        short8 gx = (prev.s23456789 - prev.s01234567) +
+                    ((cur.s23456789 - cur.s01234567) << (short8)1) +
+                    (next.s23456789 - next.s01234567);
+        short8 gy = (next.s01234567 + (next.s12345678 << (short8)1) + next.s23456789) -
+                    (prev.s01234567 + (prev.s12345678 << (short8)1) + prev.s23456789);
+
+        ushort8 mag = abs(gx) + abs(gy);
+        uint4 halves = convert_uint4(mag.lo) + convert_uint4(mag.hi);
+        sum = halves.x + halves.y + halves.z + halves.w;
+    }
+
+    partial[local_id] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = local_items >> 1; stride > 0; stride >>= 1) {
+        if (local_id < stride)
+            partial[local_id] += partial[local_id + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (local_id == 0)
+        energy[get_group_id(0) * get_num_groups(1) + get_group_id(1)] = partial[0];
+}
@@ -0,0 +1,329 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file collects OpenCL event profiling information.
+ *
+ * Execution times are kept in log-linear histograms, with eight buckets per
+ * power of two, so memory use is fixed however long the application runs.
+ * Percentiles are reported as the upper bound of their bucket, which is at
+ * most 12.5% above the true value.
+ *
+ * The share of a command is the part of the time between the first start and
+ * the last end of all commands in the report that was spent executing it.
+ * With a queue per stream, commands of different streams run at the same
+ * time, so the shares are busy shares per queue summed up and may add up to
+ * more than 100%. How busy the device was kept is reported on its own, from
+ * the execution intervals of all commands merged, so overlapping time is
+ * only counted once.
+ */
+
+#include "profiler.h"
+
+#include <string.h>
+#include <syslog.h>
+
+/* Commands with different names that can be profiled */
+#define MAX_COMMANDS 16
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_BUCKETS  (64 << HISTOGRAM_SUB_BITS)
+
+struct timing_stats {
+    guint64 count;
+    /* Sums in nanoseconds */
+    cl_ulong queued_ns;
+    cl_ulong submitted_ns;
+    cl_ulong executed_ns;
+    cl_ulong max_executed_ns;
+    guint32 histogram[HISTOGRAM_BUCKETS];
+};
+
+struct command_profile {
+    const char* name;
+    struct timing_stats interval;
+    struct timing_stats total;
+};
+
+/* Device time span of the commands in a report, and the time any of them was executing */
+struct time_span {
+    cl_ulong first_start;
+    cl_ulong last_end;
+    cl_ulong busy_ns;
+};
+
+/* Execution interval of a command, merged with the others before a report */
+struct busy_interval {
+    cl_ulong started;
+    cl_ulong ended;
+};
+
+struct pending_event {
+    cl_event event;
+    struct command_profile* command;
+};
+
+struct profiler {
+    struct command_profile commands[MAX_COMMANDS];
+    guint num_commands;
+    /* Recorded events not yet completed, oldest first */
+    GQueue* pending;
+    struct time_span interval_span;
+    struct time_span total_span;
+    /* Execution intervals since the previous report */
+    GArray* busy;
+    gint64 next_report;
+    guint report_interval;
+};
+
+static guint histogram_bucket(cl_ulong ns) {
+    if (ns < (1 << HISTOGRAM_SUB_BITS))
+        return ns;
+
+    guint msb = 63 - __builtin_clzll(ns);
+    guint sub = (ns >> (msb - HISTOGRAM_SUB_BITS)) & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    return ((msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+/* Largest value that falls in a bucket */
+static cl_ulong histogram_bucket_max(guint bucket) {
+    if (bucket < (1 << HISTOGRAM_SUB_BITS))
+        return bucket;
+
+    guint shift  = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    cl_ulong sub = bucket & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    return (((1 << HISTOGRAM_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+static cl_ulong histogram_percentile(const struct timing_stats* stats, gdouble percentile) {
+    guint64 rank  = (guint64)(stats->count * percentile / 100.0);
+    guint64 count = 0;
+
+    for (guint i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        count += stats->histogram[i];
+        if (count > rank)
+            return MIN(histogram_bucket_max(i), stats->max_executed_ns);
+    }
+    return stats->max_executed_ns;
+}
+
+static void add_sample(struct timing_stats* stats,
+                       cl_ulong queued,
+                       cl_ulong submitted,
+                       cl_ulong started,
+                       cl_ulong ended) {
+    cl_ulong executed = ended - started;
+
+    stats->count++;
+    stats->queued_ns += submitted - queued;
+    stats->submitted_ns += started - submitted;
+    stats->executed_ns += executed;
+    stats->max_executed_ns = MAX(stats->max_executed_ns, executed);
+    stats->histogram[histogram_bucket(executed)]++;
+}
+
+static void extend_span(struct time_span* span, cl_ulong started, cl_ulong ended) {
+    if (span->first_start == 0 || started < span->first_start)
+        span->first_start = started;
+    span->last_end = MAX(span->last_end, ended);
+}
+
+/* Read the timestamps of a completed command */
+static void collect_event(struct profiler* prof, struct pending_event* pending) {
+    cl_ulong queued = 0, submitted = 0, started = 0, ended = 0;
+
+    cl_int ret = clGetEventProfilingInfo(pending->event,
+                                         CL_PROFILING_COMMAND_QUEUED,
+                                         sizeof(queued),
+                                         &queued,
+                                         NULL);
+    ret |= clGetEventProfilingInfo(pending->event,
+                                   CL_PROFILING_COMMAND_SUBMIT,
+                                   sizeof(submitted),
+                                   &submitted,
+                                   NULL);
+    ret |= clGetEventProfilingInfo(pending->event,
+                                   CL_PROFILING_COMMAND_START,
+                                   sizeof(started),
+                                   &started,
+                                   NULL);
+    ret |= clGetEventProfilingInfo(pending->event,
+                                   CL_PROFILING_COMMAND_END,
+                                   sizeof(ended),
+                                   &ended,
+                                   NULL);
+    if (ret != CL_SUCCESS || ended < started || started < submitted || submitted < queued) {
+        syslog(LOG_WARNING, "No valid profiling info for %s: %d", pending->command->name, ret);
+        return;
+    }
+
+    add_sample(&pending->command->interval, queued, submitted, started, ended);
+    add_sample(&pending->command->total, queued, submitted, started, ended);
+    extend_span(&prof->interval_span, started, ended);
+    extend_span(&prof->total_span, started, ended);
+
+    struct busy_interval busy = {started, ended};
+    g_array_append_val(prof->busy, busy);
+}
+
+/* Collect commands in the order they were recorded, until one is still running */
+static void collect_completed(struct profiler* prof, gboolean wait) {
+    struct pending_event* pending;
+
+    while ((pending = g_queue_peek_head(prof->pending))) {
+        cl_int status = CL_COMPLETE;
+
+        if (wait) {
+            clWaitForEvents(1, &pending->event);
+        } else {
+            clGetEventInfo(pending->event,
+                           CL_EVENT_COMMAND_EXECUTION_STATUS,
+                           sizeof(status),
+                           &status,
+                           NULL);
+            if (status > CL_COMPLETE)
+                break;
+        }
+
+        /* A negative status means the command failed and has no timestamps */
+        if (status == CL_COMPLETE)
+            collect_event(prof, pending);
+
+        g_queue_pop_head(prof->pending);
+        clReleaseEvent(pending->event);
+        g_free(pending);
+    }
+}
+
+static gint compare_intervals(gconstpointer a, gconstpointer b) {
+    const struct busy_interval* first  = a;
+    const struct busy_interval* second = b;
+
+    return first->started < second->started ? -1 : first->started > second->started;
+}
+
+/* Merge the execution intervals since the previous report, and add up the time covered */
+static void merge_busy(struct profiler* prof) {
+    cl_ulong busy_ns = 0;
+    cl_ulong end     = 0;
+
+    g_array_sort(prof->busy, compare_intervals);
+    for (guint i = 0; i < prof->busy->len; i++) {
+        const struct busy_interval* interval = &g_array_index(prof->busy, struct busy_interval, i);
+
+        if (interval->started >= end)
+            busy_ns += interval->ended - interval->started;
+        else if (interval->ended > end)
+            busy_ns += interval->ended - end;
+        end = MAX(end, interval->ended);
+    }
+    g_array_set_size(prof->busy, 0);
+
+    prof->interval_span.busy_ns += busy_ns;
+    prof->total_span.busy_ns += busy_ns;
+}
+
+static void log_report(struct profiler* prof, gboolean total) {
+    const struct time_span* span = total ? &prof->total_span : &prof->interval_span;
+    gdouble span_ns;
+
+    merge_busy(prof);
+    span_ns = span->last_end - span->first_start;
+
+    syslog(LOG_INFO,
+           "OpenCL profile (%s), device busy %.1f%%, times in us: mean queued, submitted, "
+           "executed; p99 executed",
+           total ? "whole run" : "interval",
+           span_ns > 0.0 ? 100.0 * span->busy_ns / span_ns : 0.0);
+
+    for (guint i = 0; i < prof->num_commands; i++) {
+        struct command_profile* command  = &prof->commands[i];
+        const struct timing_stats* stats = total ? &command->total : &command->interval;
+        if (stats->count == 0)
+            continue;
+
+        syslog(LOG_INFO,
+               "- %-16s n=%-6llu %8.1f %8.1f %8.1f; p99 %8.1f, max %8.1f, share %5.1f%%",
+               command->name,
+               (unsigned long long)stats->count,
+               stats->queued_ns / 1000.0 / stats->count,
+               stats->submitted_ns / 1000.0 / stats->count,
+               stats->executed_ns / 1000.0 / stats->count,
+               histogram_percentile(stats, 99.0) / 1000.0,
+               stats->max_executed_ns / 1000.0,
+               span_ns > 0.0 ? 100.0 * stats->executed_ns / span_ns : 0.0);
+    }
+}
+
+struct profiler* profiler_new(guint report_interval) {
+    struct profiler* prof = g_new0(struct profiler, 1);
+
+    prof->pending         = g_queue_new();
+    prof->busy            = g_array_new(FALSE, FALSE, sizeof(struct busy_interval));
+    prof->report_interval = report_interval;
+    prof->next_report     = g_get_monotonic_time() + report_interval * G_USEC_PER_SEC;
+    return prof;
+}
+
+void profiler_record(struct profiler* prof, const char* name, cl_event event) {
+    struct command_profile* command = NULL;
+
+    for (guint i = 0; i < prof->num_commands && !command; i++) {
+        if (prof->commands[i].name == name || g_strcmp0(prof->commands[i].name, name) == 0)
+            command = &prof->commands[i];
+    }
+    if (!command) {
+        if (prof->num_commands == MAX_COMMANDS) {
+            syslog(LOG_WARNING, "Too many commands to profile, ignoring %s", name);
+            return;
+        }
+        command       = &prof->commands[prof->num_commands++];
+        command->name = name;
+    }
+
+    struct pending_event* pending = g_new0(struct pending_event, 1);
+    pending->event                = event;
+    pending->command              = command;
+    clRetainEvent(event);
+    g_queue_push_tail(prof->pending, pending);
+}
+
+void profiler_report_if_due(struct profiler* prof) {
+    collect_completed(prof, FALSE);
+
+    gint64 now = g_get_monotonic_time();
+    if (now < prof->next_report)
+        return;
+
+    log_report(prof, FALSE);
+
+    for (guint i = 0; i < prof->num_commands; i++)
+        memset(&prof->commands[i].interval, 0, sizeof(prof->commands[i].interval));
+    memset(&prof->interval_span, 0, sizeof(prof->interval_span));
+    prof->next_report = now + prof->report_interval * G_USEC_PER_SEC;
+}
+
+void profiler_free(struct profiler* prof) {
+    if (!prof)
+        return;
+
+    collect_completed(prof, TRUE);
+    log_report(prof, TRUE);
+
+    g_queue_free(prof->pending);
+    g_array_free(prof->busy, TRUE);
+    g_free(prof);
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file collects OpenCL event profiling information and reports
+ * per command statistics.
+ *
+ * The command queue must be created with CL_QUEUE_PROFILING_ENABLE. For every
+ * recorded event, the time from queued to submitted, from submitted to
+ * started and from started to ended is accumulated per command name.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+struct profiler;
+
+/**
+ * brief Create a profiler.
+ *
+ * param report_interval Seconds between periodic reports.
+ * return The new profiler.
+ */
+struct profiler* profiler_new(guint report_interval);
+
+/**
+ * brief Record an enqueued command.
+ *
+ * The profiler keeps a reference to the event until the command has
+ * completed and its timestamps have been read, so the caller may release
+ * its own reference right away.
+ *
+ * param prof The profiler.
+ * param name Name of the command, e.g. the kernel name. Must outlive prof.
+ * param event Event of the enqueued command.
+ */
+void profiler_record(struct profiler* prof, const char* name, cl_event event);
+
+/**
+ * brief Collect completed commands, and log a report when the interval has passed.
+ *
+ * The report covers the commands completed since the previous report.
+ *
+ * param prof The profiler.
+ */
+void profiler_report_if_due(struct profiler* prof);
+
+/**
+ * brief Wait for all recorded commands, log a report of the whole run and free the profiler.
+ *
+ * param prof The profiler.
+ */
+void profiler_free(struct profiler* prof);
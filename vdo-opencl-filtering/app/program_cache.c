@@ -0,0 +1,256 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file builds OpenCL programs and caches the built binaries.
+ *
+ * A cache file consists of a fixed size header followed by the program binary
+ * as returned by CL_PROGRAM_BINARIES:
+ *
+ *   magic (8 bytes) | key (64 hex characters) | binary size (8 bytes) | binary
+ */
+
+#include "program_cache.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#define CACHE_MAGIC      "CLBIN001"
+#define CACHE_MAGIC_LEN  8
+#define CACHE_KEY_LEN    64
+#define CACHE_HEADER_LEN (CACHE_MAGIC_LEN + CACHE_KEY_LEN + sizeof(guint64))
+
+/* Source files a program can be built from */
+#define MAX_SOURCE_FILES 8
+
+static void print_build_log(cl_program program, cl_device_id device) {
+    /* Determine the size of the program log */
+    size_t log_size;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    /* Allocate memory for the program log */
+    char* log = (char*)malloc(log_size);
+
+    /* Get the program log */
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+
+    /* Print the program log */
+    syslog(LOG_INFO, "%s", log);
+    free(log);
+}
+
+static void add_device_info(GChecksum* checksum, cl_device_id device, cl_device_info param) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+        return;
+
+    guint8* info = g_malloc(size);
+    if (clGetDeviceInfo(device, param, size, info, NULL) == CL_SUCCESS)
+        g_checksum_update(checksum, info, size);
+    g_free(info);
+}
+
+/* Hash of everything that decides whether a cached binary is valid */
+static gchar* get_cache_key(cl_device_id device,
+                            gchar** sources,
+                            const size_t* source_sizes,
+                            cl_uint count,
+                            const char* options) {
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    add_device_info(checksum, device, CL_DEVICE_NAME);
+    add_device_info(checksum, device, CL_DEVICE_VERSION);
+    add_device_info(checksum, device, CL_DRIVER_VERSION);
+    for (cl_uint i = 0; i < count; i++) {
+        guint64 size = source_sizes[i];
+        g_checksum_update(checksum, (const guint8*)&size, sizeof(size));
+        g_checksum_update(checksum, (const guint8*)sources[i], source_sizes[i]);
+    }
+    /* Include the terminator so "a" + "bc" and "ab" + "c" hash differently */
+    g_checksum_update(checksum, (const guint8*)options, strlen(options) + 1);
+
+    gchar* key = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+    return key;
+}
+
+/* Create and build a program from the cached binary, or return NULL if the cache can't be used */
+static cl_program load_cached_program(cl_context context,
+                                      cl_device_id device,
+                                      const char* options,
+                                      const char* cache_file,
+                                      const gchar* key) {
+    gchar* contents    = NULL;
+    gsize length       = 0;
+    guint64 size       = 0;
+    cl_int binary_ret  = CL_SUCCESS;
+    cl_int ret         = CL_SUCCESS;
+    cl_program program = NULL;
+
+    if (!g_file_get_contents(cache_file, &contents, &length, NULL))
+        return NULL;
+
+    if (length < CACHE_HEADER_LEN || memcmp(contents, CACHE_MAGIC, CACHE_MAGIC_LEN) ||
+        memcmp(contents + CACHE_MAGIC_LEN, key, CACHE_KEY_LEN)) {
+        syslog(LOG_INFO, "Program cache %s is stale", cache_file);
+        goto exit;
+    }
+
+    memcpy(&size, contents + CACHE_MAGIC_LEN + CACHE_KEY_LEN, sizeof(size));
+    if (size == 0 || size != length - CACHE_HEADER_LEN) {
+        syslog(LOG_WARNING, "Program cache %s is truncated", cache_file);
+        goto exit;
+    }
+
+    const size_t binary_size    = size;
+    const unsigned char* binary = (const unsigned char*)contents + CACHE_HEADER_LEN;
+    program =
+        clCreateProgramWithBinary(context, 1, &device, &binary_size, &binary, &binary_ret, &ret);
+    if (ret != CL_SUCCESS || binary_ret != CL_SUCCESS) {
+        syslog(LOG_WARNING, "Driver rejected cached program binary: %d, %d", ret, binary_ret);
+        goto exit;
+    }
+
+    /* Binaries must be built too, but this only links the device code */
+    ret = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_WARNING, "Could not build cached program binary: %d", ret);
+        goto exit;
+    }
+
+    g_free(contents);
+    return program;
+
+exit:
+    if (program)
+        clReleaseProgram(program);
+    g_free(contents);
+    return NULL;
+}
+
+static void save_program_binary(cl_program program, const char* cache_file, const gchar* key) {
+    GError* error   = NULL;
+    size_t size     = 0;
+    gchar* contents = NULL;
+
+    cl_int ret = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL);
+    if (ret != CL_SUCCESS || size == 0) {
+        syslog(LOG_WARNING, "Program binary not available for caching: %d", ret);
+        return;
+    }
+
+    contents              = g_malloc(CACHE_HEADER_LEN + size);
+    unsigned char* binary = (unsigned char*)contents + CACHE_HEADER_LEN;
+    guint64 binary_size   = size;
+
+    memcpy(contents, CACHE_MAGIC, CACHE_MAGIC_LEN);
+    memcpy(contents + CACHE_MAGIC_LEN, key, CACHE_KEY_LEN);
+    memcpy(contents + CACHE_MAGIC_LEN + CACHE_KEY_LEN, &binary_size, sizeof(binary_size));
+
+    ret = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_WARNING, "Unable to get program binary: %d", ret);
+        goto exit;
+    }
+
+    /* Written to a temporary file and renamed, so a crash never leaves half a cache */
+    if (!g_file_set_contents(cache_file, contents, CACHE_HEADER_LEN + size, &error)) {
+        syslog(LOG_WARNING, "Unable to save program cache: %s", error->message);
+        g_clear_error(&error);
+        goto exit;
+    }
+    syslog(LOG_INFO, "Saved program binary of %zu bytes to %s", size, cache_file);
+
+exit:
+    g_free(contents);
+}
+
+cl_program build_cached_program(cl_context context,
+                                cl_device_id device,
+                                const char* const* source_files,
+                                const char* options,
+                                const char* cache_file,
+                                cl_int* ret) {
+    GError* error                         = NULL;
+    gchar* sources[MAX_SOURCE_FILES]      = {NULL};
+    size_t source_sizes[MAX_SOURCE_FILES] = {0};
+    cl_uint count                         = 0;
+    gchar* key                            = NULL;
+    cl_program program                    = NULL;
+    gint64 start                          = g_get_monotonic_time();
+
+    *ret = CL_SUCCESS;
+    for (; source_files[count]; count++) {
+        gsize size = 0;
+
+        if (count == MAX_SOURCE_FILES) {
+            syslog(LOG_ERR, "Too many program source files");
+            *ret = CL_INVALID_VALUE;
+            goto exit;
+        }
+        if (!g_file_get_contents(source_files[count], &sources[count], &size, &error)) {
+            syslog(LOG_ERR, "Failed to load kernel: %s", error->message);
+            g_clear_error(&error);
+            *ret = CL_INVALID_VALUE;
+            goto exit;
+        }
+        source_sizes[count] = size;
+
+        syslog(LOG_INFO, "Read cl file \"%s\", size of %zu bytes", source_files[count], size);
+    }
+
+    key = get_cache_key(device, sources, source_sizes, count, options);
+
+    program = load_cached_program(context, device, options, cache_file, key);
+    if (program) {
+        syslog(LOG_INFO,
+               "Loaded cached program binary in %.1f ms",
+               (g_get_monotonic_time() - start) / 1000.0);
+        *ret = CL_SUCCESS;
+        goto exit;
+    }
+
+    program = clCreateProgramWithSource(context, count, (const char**)sources, source_sizes, ret);
+    if (*ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Could not create cl program");
+        goto exit;
+    }
+
+    *ret = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if (*ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Could not build cl_program");
+
+        if (*ret == CL_BUILD_PROGRAM_FAILURE)
+            print_build_log(program, device);
+
+        clReleaseProgram(program);
+        program = NULL;
+        goto exit;
+    }
+
+    syslog(LOG_INFO,
+           "Built program from source in %.1f ms",
+           (g_get_monotonic_time() - start) / 1000.0);
+
+    save_program_binary(program, cache_file, key);
+
+exit:
+    g_free(key);
+    for (cl_uint i = 0; i < count; i++)
+        g_free(sources[i]);
+    return program;
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file builds OpenCL programs and caches the built binaries, such
+ * that later starts can skip compiling the program source.
+ */
+
+#pragma once
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+/**
+ * brief Create and build an OpenCL program for one device.
+ *
+ * The program is loaded from the binary in cache_file when the cache key
+ * matches. The key is a hash of the device name, device version, driver
+ * version, program sources and build options. If the cache is missing, stale
+ * or rejected by the driver, the program is built from source and the new
+ * binary is written to cache_file.
+ *
+ * param context Context to create the program in.
+ * param device Device to build the program for.
+ * param source_files NULL terminated list of paths of the OpenCL C sources.
+ * param options Build options passed to clBuildProgram.
+ * param cache_file Path of the program binary cache.
+ * param ret Set to CL_SUCCESS, or the error of the failing OpenCL call.
+ * return The built program, or NULL on failure.
+ */
+cl_program build_cached_program(cl_context context,
+                                cl_device_id device,
+                                const char* const* source_files,
+                                const char* options,
+                                const char* cache_file,
+                                cl_int* ret);
@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+/*
+ * The kernels read the row above each row, so row 0 is not filtered. Each work
+ * item writes the 8 pixels right of its column, such that the first column of
+ * a launch is not written, and the column right of it is.
+ */
 __kernel void sobel_3x1(__global const unsigned char *In_y,
                         __global unsigned char *Out_y,
                         __global unsigned char *Out_cbcr,
@@ -21,7 +26,7 @@ __kernel void sobel_3x1(__global const unsigned char *In_y,
                         int height)
 {
     int row = get_global_id(0);
-    if (row > height - 1)
+    if (row < 1 || row > height - 1)
         return;
 
     /* Since we work on 8 pixels at a time, col needs to be multiplied by 8. */
@@ -74,7 +79,7 @@ __kernel void sobel_3x3(__global const unsigned char *In_y,
                         int height)
 {
     int row = get_global_id(0);
-    if (row > height - 1)
+    if (row < 1 || row > height - 1)
         return;
 
     int col = (get_global_id(1) << 3);
@@ -126,3 +131,159 @@ __kernel void sobel_3x3(__global const unsigned char *In_y,
     uchar8 cbcr = (uchar8) 128;
     vstore8(cbcr, 0, &Out_cbcr[cbcr_id]);
 }
+
+/*
+ * Tiled variants of the kernels above. Every work group first stages the rows
+ * it filters, plus a halo of one row above and below, in local memory. Each
+ * input pixel is then read from global memory once per work group instead of
+ * up to three times per work item.
+ *
+ * The tile is (local rows + 2) rows high and (local columns + 1) * 8 bytes
+ * wide, see sobel_tile_size() on the host side. All work items must reach the
+ * barrier, so items outside the image only help loading the tile.
+ */
+void load_tile(__global const unsigned char *In_y,
+               __local unsigned char *tile,
+               int tile_width,
+               int width,
+               int height)
+{
+    int local_rows = get_local_size(0);
+    int local_cols = get_local_size(1);
+    int chunks_per_row = local_cols + 1;
+    int chunks = (local_rows + 2) * chunks_per_row;
+
+    /* First row and column of the group, minus the halo */
+    int row0 = get_global_id(0) - get_local_id(0) - 1;
+    int col0 = (get_global_id(1) - get_local_id(1)) << 3;
+    int last = (width * height) - 8;
+
+    for (int i = get_local_id(0) * local_cols + get_local_id(1);
+         i < chunks;
+         i += local_rows * local_cols) {
+        int r = i / chunks_per_row;
+        int c = i - r * chunks_per_row;
+        int src = clamp((row0 + r) * width + col0 + (c << 3), 0, last);
+        vstore8(vload8(0, &In_y[src]), 0, &tile[r * tile_width + (c << 3)]);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+__kernel void sobel_3x1_tiled(__global const unsigned char *In_y,
+                              __global unsigned char *Out_y,
+                              __global unsigned char *Out_cbcr,
+                              int width,
+                              int height,
+                              __local unsigned char *tile)
+{
+    int tile_width = (get_local_size(1) + 1) << 3;
+    load_tile(In_y, tile, tile_width, width, height);
+
+    int row = get_global_id(0);
+    if (row < 1 || row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    int pix_id = (row * width) + col + 1;
+    int cbcr_id = ((row >> 1) * width) + (col);
+
+    /* Tile row of the previous image row, and column of the 16 byte window */
+    int tile_id = get_local_id(0) * tile_width + (get_local_id(1) << 3);
+
+    short8 gx = (short8)0;
+    short8 gy = (short8)0;
+    uchar8 mag = (uchar8)0;
+
+    /* Previous row */
+    uchar16 temp = vload16(0, &tile[tile_id]);
+    short8 middle = convert_short8(temp.s12345678);
+
+    gy += middle * (short8)(-2);
+
+    /* Current row */
+    temp = vload16(0, &tile[tile_id + tile_width]);
+    short8 left = convert_short8(temp.s01234567);
+    short8 right = convert_short8(temp.s23456789);
+
+    gx += left * (short8)(-2);
+    gx += right * (short8)(2);
+
+    /* Next row */
+    temp = vload16(0, &tile[tile_id + 2 * tile_width]);
+    middle = convert_short8(temp.s12345678);
+
+    gy += middle * (short8)(2);
+
+    mag = convert_uchar8(clamp(abs(gx) + abs(gy),1, 255));
+    vstore8(mag, 0, &Out_y[pix_id]);
+
+    /* Write cbcr data (128 for greyscale) */
+    uchar8 cbcr = (uchar8) 128;
+    vstore8(cbcr, 0, &Out_cbcr[cbcr_id]);
+}
+
+__kernel void sobel_3x3_tiled(__global const unsigned char *In_y,
+                              __global unsigned char *Out_y,
+                              __global unsigned char *Out_cbcr,
+                              int width,
+                              int height,
+                              __local unsigned char *tile)
+{
+    int tile_width = (get_local_size(1) + 1) << 3;
+    load_tile(In_y, tile, tile_width, width, height);
+
+    int row = get_global_id(0);
+    if (row < 1 || row > height - 1)
+        return;
+
+    int col = (get_global_id(1) << 3);
+    int pix_id = (row * width) + col + 1;
+    int cbcr_id = ((row >> 1) * width) + (col);
+    int tile_id = get_local_id(0) * tile_width + (get_local_id(1) << 3);
+
+    short8 gx = (short8)0;
+    short8 gy = (short8)0;
+    uchar8 mag = (uchar8)0;
+
+    /* Previous row */
+    uchar16 temp = vload16(0, &tile[tile_id]);
+    short8 left = convert_short8(temp.s01234567);
+    short8 middle = convert_short8(temp.s12345678);
+    short8 right = convert_short8(temp.s23456789);
+
+    gx += left * (short8)(-1);
+    gx += right * (short8)(1);
+
+    gy += left * (short8)(-1);
+    gy += middle * (short8)(-2);
+    gy += right * (short8)(-1);
+
+    /* Current row */
+    temp = vload16(0, &tile[tile_id + tile_width]);
+    left = convert_short8(temp.s01234567);
+    right = convert_short8(temp.s23456789);
+
+    gx += left * (short8)(-2);
+    gx += right * (short8)(2);
+
+    /* Next row */
+    temp = vload16(0, &tile[tile_id + 2 * tile_width]);
+    left = convert_short8(temp.s01234567);
+    middle = convert_short8(temp.s12345678);
+    right = convert_short8(temp.s23456789);
+
+    gx += left * (short8)(-1);
+    gx += right * (short8)(1);
+
+    gy += left * (short8)(1);
+    gy += middle * (short8)(2);
+    gy += right * (short8)(1);
+
+    mag = convert_uchar8(clamp(abs(gx) + abs(gy),1, 255));
+    vstore8(mag, 0, &Out_y[pix_id]);
+
+    /* Write cbcr data (128 for greyscale) */
+    uchar8 cbcr = (uchar8) 128;
+    vstore8(cbcr, 0, &Out_cbcr[cbcr_id]);
+}
@@ -0,0 +1,321 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file detects tampering and defocus from per block edge energy.
+ *
+ * Only blocks with texture in their baseline are judged, since a flat wall
+ * or sky has no edges to lose. A covered lens removes nearly all edge energy,
+ * while a defocused lens weakens the edges of most blocks. The baseline is
+ * frozen while a state is raised, so a tampered view is never learned as the
+ * new normal.
+ *
+ * The tracker is updated from the writer thread of its stream, while the
+ * event handler belongs to the main context. A state change therefore only
+ * schedules an idle callback, which sends the latest state from the main
+ * context.
+ */
+
+#include "tamper.h"
+
+#include <axsdk/axevent.h>
+#include <syslog.h>
+
+/* Frames over which the baseline is first learned */
+#define LEARNING_FRAMES 25
+
+/* Weight of a new frame in the baseline once learned */
+#define BASELINE_ALPHA 0.01
+
+/* Mean gradient per pixel below which a block is too flat to judge */
+#define MIN_BLOCK_ENERGY 4.0
+
+/* A block has lost its edges below this share of its baseline */
+#define DROP_RATIO 0.35
+
+/* Share of the total baseline energy below which the view is tampered */
+#define TAMPER_RATIO 0.15
+
+/* Share of textured blocks that must lose their edges for a defocus */
+#define DEFOCUS_BLOCKS 0.6
+
+/* Consecutive frames a new state must be seen before it is raised or cleared */
+#define HOLD_FRAMES 10
+
+struct tamper_tracker {
+    guint num_blocks;
+    gdouble pixels_per_block;
+    /* Mean gradient per pixel of every block */
+    gdouble* baseline;
+    guint64 frames;
+    enum tamper_state state;
+    /* State seen in the latest frames, and for how many frames in a row */
+    enum tamper_state candidate;
+    guint candidate_frames;
+
+    guint stream;
+    AXEventHandler* event_handler;
+    guint declaration;
+    gboolean declared;
+    /* Guards state against the main context, and the idle callback that sends it */
+    GMutex lock;
+    guint send_source;
+};
+
+static const char* state_name(enum tamper_state state) {
+    switch (state) {
+        case TAMPER_STATE_DEFOCUSED:
+            return "defocused";
+        case TAMPER_STATE_TAMPERED:
+            return "tampered";
+        case TAMPER_STATE_NORMAL:
+        default:
+            return "normal";
+    }
+}
+
+/* Add the keys of the event, with the values of a state */
+static void
+add_keys(AXEventKeyValueSet* key_value_set, const guint* stream, enum tamper_state state) {
+    gboolean tampered  = state == TAMPER_STATE_TAMPERED;
+    gboolean defocused = state == TAMPER_STATE_DEFOCUSED;
+
+    ax_event_key_value_set_add_key_value(key_value_set,
+                                         "Stream",
+                                         NULL,
+                                         stream,
+                                         AX_VALUE_TYPE_INT,
+                                         NULL);
+    ax_event_key_value_set_add_key_value(key_value_set,
+                                         "Tampered",
+                                         NULL,
+                                         &tampered,
+                                         AX_VALUE_TYPE_BOOL,
+                                         NULL);
+    ax_event_key_value_set_add_key_value(key_value_set,
+                                         "Defocused",
+                                         NULL,
+                                         &defocused,
+                                         AX_VALUE_TYPE_BOOL,
+                                         NULL);
+}
+
+static void send_event(struct tamper_tracker* tracker, enum tamper_state state) {
+    AXEventKeyValueSet* key_value_set = ax_event_key_value_set_new();
+    GError* error                     = NULL;
+
+    add_keys(key_value_set, &tracker->stream, state);
+
+    /* Use ax_event_new2 since ax_event_new is deprecated from 3.2 */
+    AXEvent* event = ax_event_new2(key_value_set, NULL);
+    ax_event_key_value_set_free(key_value_set);
+
+    if (!ax_event_handler_send_event(tracker->event_handler, tracker->declaration, event, &error)) {
+        syslog(LOG_WARNING, "Could not send tamper event: %s", error->message);
+        g_error_free(error);
+    }
+    ax_event_free(event);
+}
+
+/* Idle callback on the main context, sends the latest state */
+static gboolean send_state(gpointer data) {
+    struct tamper_tracker* tracker = (struct tamper_tracker*)data;
+
+    g_mutex_lock(&tracker->lock);
+    enum tamper_state state = tracker->state;
+    tracker->send_source    = 0;
+    g_mutex_unlock(&tracker->lock);
+
+    /* Otherwise it is sent once the declaration completes */
+    if (tracker->declared)
+        send_event(tracker, state);
+    return G_SOURCE_REMOVE;
+}
+
+static void declaration_complete(guint declaration, gpointer data) {
+    struct tamper_tracker* tracker = (struct tamper_tracker*)data;
+
+    syslog(LOG_INFO, "Declaration complete for tamper event: %u", declaration);
+    tracker->declared = TRUE;
+
+    /* The declaration holds the normal state, a state raised since is sent now */
+    g_mutex_lock(&tracker->lock);
+    enum tamper_state state = tracker->state;
+    g_mutex_unlock(&tracker->lock);
+    if (state != TAMPER_STATE_NORMAL)
+        send_event(tracker, state);
+}
+
+/*
+ * Declare a stateful event that looks like this, using the Axis namespace
+ * "tnsaxis".
+ *
+ * Topic: tnsaxis:CameraApplicationPlatform/EdgeTamper
+ * <tt:MessageDescription IsProperty="true">
+ *  <tt:Source>
+ *   <tt:SimpleItemDescription Name="Stream" Type="xs:int"/>
+ *  </tt:Source>
+ *  <tt:Data>
+ *   <tt:SimpleItemDescription Name="Tampered" Type="xs:boolean"/>
+ *   <tt:SimpleItemDescription Name="Defocused" Type="xs:boolean"/>
+ *  </tt:Data>
+ * </tt:MessageDescription>
+ */
+static void declare_event(struct tamper_tracker* tracker) {
+    AXEventKeyValueSet* key_value_set = ax_event_key_value_set_new();
+    GError* error                     = NULL;
+
+    ax_event_key_value_set_add_key_value(key_value_set,
+                                         "topic0",
+                                         "tnsaxis",
+                                         "CameraApplicationPlatform",
+                                         AX_VALUE_TYPE_STRING,
+                                         NULL);
+    ax_event_key_value_set_add_key_value(key_value_set,
+                                         "topic1",
+                                         "tnsaxis",
+                                         "EdgeTamper",
+                                         AX_VALUE_TYPE_STRING,
+                                         NULL);
+    add_keys(key_value_set, &tracker->stream, TAMPER_STATE_NORMAL);
+
+    ax_event_key_value_set_mark_as_source(key_value_set, "Stream", NULL, NULL);
+    ax_event_key_value_set_mark_as_user_defined(key_value_set,
+                                                "Stream",
+                                                NULL,
+                                                "wstype:xs:int",
+                                                NULL);
+    ax_event_key_value_set_mark_as_data(key_value_set, "Tampered", NULL, NULL);
+    ax_event_key_value_set_mark_as_user_defined(key_value_set,
+                                                "Tampered",
+                                                NULL,
+                                                "wstype:xs:boolean",
+                                                NULL);
+    ax_event_key_value_set_mark_as_data(key_value_set, "Defocused", NULL, NULL);
+    ax_event_key_value_set_mark_as_user_defined(key_value_set,
+                                                "Defocused",
+                                                NULL,
+                                                "wstype:xs:boolean",
+                                                NULL);
+
+    if (!ax_event_handler_declare(tracker->event_handler,
+                                  key_value_set,
+                                  FALSE, /* Indicate a property state event */
+                                  &tracker->declaration,
+                                  declaration_complete,
+                                  tracker,
+                                  &error)) {
+        syslog(LOG_WARNING, "Could not declare tamper event: %s", error->message);
+        g_error_free(error);
+    }
+    ax_event_key_value_set_free(key_value_set);
+}
+
+struct tamper_tracker* tamper_tracker_new(guint stream, guint num_blocks, guint pixels_per_block) {
+    struct tamper_tracker* tracker = g_new0(struct tamper_tracker, 1);
+
+    tracker->num_blocks       = num_blocks;
+    tracker->pixels_per_block = MAX(pixels_per_block, 1);
+    tracker->baseline         = g_new0(gdouble, num_blocks);
+    tracker->stream           = stream;
+    tracker->event_handler    = ax_event_handler_new();
+    g_mutex_init(&tracker->lock);
+    declare_event(tracker);
+    return tracker;
+}
+
+enum tamper_state tamper_tracker_update(struct tamper_tracker* tracker, const guint32* energy) {
+    enum tamper_state seen = TAMPER_STATE_NORMAL;
+    guint textured         = 0;
+    guint dropped          = 0;
+    gdouble total          = 0.0;
+    gdouble total_baseline = 0.0;
+
+    tracker->frames++;
+
+    if (tracker->frames > LEARNING_FRAMES) {
+        for (guint i = 0; i < tracker->num_blocks; i++) {
+            gdouble block = energy[i] / tracker->pixels_per_block;
+            if (tracker->baseline[i] < MIN_BLOCK_ENERGY)
+                continue;
+
+            textured++;
+            total += block;
+            total_baseline += tracker->baseline[i];
+            if (block < DROP_RATIO * tracker->baseline[i])
+                dropped++;
+        }
+
+        if (textured == 0)
+            seen = tracker->state;
+        else if (total < TAMPER_RATIO * total_baseline)
+            seen = TAMPER_STATE_TAMPERED;
+        else if (dropped >= DEFOCUS_BLOCKS * textured)
+            seen = TAMPER_STATE_DEFOCUSED;
+    }
+
+    if (seen == tracker->state) {
+        tracker->candidate_frames = 0;
+    } else if (seen == tracker->candidate && tracker->candidate_frames > 0) {
+        tracker->candidate_frames++;
+    } else {
+        tracker->candidate        = seen;
+        tracker->candidate_frames = 1;
+    }
+
+    if (tracker->candidate_frames >= HOLD_FRAMES) {
+        syslog(seen == TAMPER_STATE_NORMAL ? LOG_INFO : LOG_WARNING,
+               "Camera view %s: edge energy at %.0f%% of baseline, %u of %u textured blocks "
+               "lost their edges",
+               state_name(seen),
+               total_baseline > 0.0 ? 100.0 * total / total_baseline : 0.0,
+               dropped,
+               textured);
+        tracker->candidate_frames = 0;
+
+        g_mutex_lock(&tracker->lock);
+        tracker->state = seen;
+        if (!tracker->send_source)
+            tracker->send_source = g_idle_add(send_state, tracker);
+        g_mutex_unlock(&tracker->lock);
+    }
+
+    /* Learn the scene, but only while it looks normal */
+    if (tracker->state == TAMPER_STATE_NORMAL && seen == TAMPER_STATE_NORMAL) {
+        gdouble alpha =
+            tracker->frames <= LEARNING_FRAMES ? 1.0 / tracker->frames : BASELINE_ALPHA;
+        for (guint i = 0; i < tracker->num_blocks; i++) {
+            gdouble block = energy[i] / tracker->pixels_per_block;
+            tracker->baseline[i] += alpha * (block - tracker->baseline[i]);
+        }
+    }
+    return tracker->state;
+}
+
+void tamper_tracker_free(struct tamper_tracker* tracker) {
+    if (!tracker)
+        return;
+
+    if (tracker->send_source)
+        g_source_remove(tracker->send_source);
+    if (tracker->declaration)
+        ax_event_handler_undeclare(tracker->event_handler, tracker->declaration, NULL);
+    ax_event_handler_free(tracker->event_handler);
+    g_mutex_clear(&tracker->lock);
+
+    g_free(tracker->baseline);
+    g_free(tracker);
+}
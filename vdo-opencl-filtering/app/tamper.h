@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file detects tampering and defocus from the per block edge
+ * energy computed by the edge_energy kernel, and sends the state as an event.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+enum tamper_state {
+    TAMPER_STATE_NORMAL = 0,
+    /* Most textured blocks have lost their edges */
+    TAMPER_STATE_DEFOCUSED,
+    /* Almost all edges are gone, e.g. the lens is covered or spray painted */
+    TAMPER_STATE_TAMPERED,
+};
+
+struct tamper_tracker;
+
+/**
+ * brief Create a tracker, and declare its event.
+ *
+ * A stateful event is declared under the topic
+ * tnsaxis:CameraApplicationPlatform/EdgeTamper, with the stream as its source
+ * and the booleans Tampered and Defocused as its data, so that action rules
+ * and other applications can act on the state. The declaration completes, and
+ * the events are sent, through the default GLib main context, which the
+ * application must iterate.
+ *
+ * param stream Index of the stream, the source of the event.
+ * param num_blocks Number of blocks in each edge energy update.
+ * param pixels_per_block Number of pixels summed into each block.
+ * return The new tracker.
+ */
+struct tamper_tracker* tamper_tracker_new(guint stream, guint num_blocks, guint pixels_per_block);
+
+/**
+ * brief Update the tracker with the edge energy of a frame.
+ *
+ * The baseline energy of each block is learned over the first frames and
+ * then follows slow scene changes. A state is raised, or cleared, when the
+ * energy has stayed below, or returned to, its baseline for a number of
+ * consecutive frames. State changes are logged, and sent as events from the
+ * main context. May be called from any one thread.
+ *
+ * param tracker The tracker.
+ * param energy Summed gradient magnitude of every block.
+ * return The current state.
+ */
+enum tamper_state tamper_tracker_update(struct tamper_tracker* tracker, const guint32* energy);
+
+/**
+ * brief Undeclare the event and free a tracker.
+ *
+ * Must be called from the thread that iterates the main context, after the
+ * last update.
+ *
+ * param tracker The tracker, may be NULL.
+ */
+void tamper_tracker_free(struct tamper_tracker* tracker);
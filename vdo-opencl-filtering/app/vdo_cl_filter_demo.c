@@ -25,15 +25,73 @@
  * All image memory is allocated such that it may be zero-copied to the GPU,
  * ensuring good performance.
  *
- * Sobel filtering is performed according to the sobel_nv12 OpenCL program.
- * You may choose to filter a half or a full image, with two different filter
- * kernels. The result is written to an output file with default name
- * /usr/local/packages/vdo_cl_filter_demo/localdata/cl_vdo_demo.yuv.
+ * Sobel filtering is performed according to the sobel_nv12 OpenCL program,
+ * with two different filter kernels. Both kernels also come in a tiled variant
+ * that stages its input in local memory. Filtering is limited to one or more
+ * rectangular regions of the image, the left half by default. The rest of the
+ * frame is copied on the device, so the memory traffic per frame scales with
+ * the filtered area. The result is written to an output file with default
+ * name /usr/local/packages/vdo_cl_filter_demo/localdata/cl_vdo_demo.yuv.
+ *
+ * The filters_nv12 OpenCL program adds a library of luma filters: separable
+ * Gaussian and box blur, 3x3 and 5x5 median, erosion, dilation and a luma
+ * histogram. Filters are chained on the device, e.g. a blur before the Sobel
+ * filter, with intermediate images that never leave device memory.
+ *
+ * The edge_energy kernel sums the Sobel gradient magnitude per block without
+ * writing an edge image. When it is part of the chain, a tamper tracker raises
+ * its own tampered or defocused state when the edge energy drops sharply, and
+ * sends it as an event. A chain without image filters, such as edge_energy
+ * alone, writes no output file: only the block sums are read back.
+ *
+ * The built OpenCL program binary is cached in localdata/program.clbin, so
+ * later starts skip compiling the program sources. The cache is rebuilt when
+ * the sources, build options, device or driver changes.
+ *
+ * At startup the local work size of the kernel is autotuned, by benchmarking
+ * candidate sizes for the device and resolution. The fastest size is cached in
+ * localdata/autotune.conf and reused on later starts.
+ *
+ * Frames are processed in a pipeline of one or more output buffers. The kernel
+ * and the mapping of its output are chained with OpenCL events, and a writer
+ * thread waits for each mapping before writing the frame to file. With a
+ * pipeline depth of two or more the GPU filters frame n+1 while frame n is
+ * being written. The sustained frame rate is logged when the example exits.
+ *
+ * With --streams several VDO streams are filtered concurrently, each in a
+ * thread of its own. The streams share the OpenCL context and the built
+ * program, while every stream has its own command queue, filter chain kernels
+ * and VDO buffer mappings. The aggregate frame rate of all streams is logged
+ * when the example exits.
+ *
+ * With --profile the command queue is created with profiling enabled, and the
+ * device timestamps of every unmap, kernel and map command are collected. Mean
+ * and p99 times and the busy share per command, along with how busy the device
+ * was kept, are logged every given number of seconds, and for the whole run
+ * when the example exits.
  *
  * Suppose you have completed the steps of installation. You may then go to
  * /usr/local/packages/vdo_cl_filter_demo on your device and run the example as:
  *  ./vdo_cl_filter_demo
  *
+ * or with a pipeline of three output buffers over 100 frames:
+ *  ./vdo_cl_filter_demo --pipeline-depth 3 --frames 100
+ *
+ * or with OpenCL profiling reported every 5 seconds:
+ *  ./vdo_cl_filter_demo --frames 1000 --profile 5
+ *
+ * or with a denoising blur before the Sobel filter:
+ *  ./vdo_cl_filter_demo --kernel gaussian_5x5,sobel_3x3
+ *
+ * or with tamper and defocus detection on the unfiltered stream:
+ *  ./vdo_cl_filter_demo --kernel edge_energy --frames 10000
+ *
+ * or with two streams filtered on one OpenCL context:
+ *  ./vdo_cl_filter_demo --streams 2 --frames 1000
+ *
+ * or to benchmark every filter kernel at 720p and 1080p:
+ *  ./vdo_cl_filter_demo --benchmark
+ *
  * It can also be ran from the Apps menu.
  */
 #include <errno.h>
@@ -46,50 +104,285 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "autotune.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "tamper.h"
 #include "vdo-error.h"
 #include "vdo-map.h"
 #include "vdo-stream.h"
 #include "vdo-types.h"
 
-#define CL_TARGET_OPENCL_VERSION 120
-#include <CL/cl.h>
+/* Upper limit of output buffers in flight at the same time */
+#define MAX_PIPELINE_DEPTH 8
+
+/* Upper limit of kernels in a filter chain */
+#define MAX_FILTER_STAGES 8
 
-#define MAX_SOURCE_SIZE (0x100000)
+/* Upper limit of regions to filter */
+#define MAX_REGIONS 8
+
+/* Upper limit of streams filtered concurrently */
+#define MAX_STREAMS 4
 
 #define VDO_CLIENT_ERROR   g_quark_from_static_string("vdo-client-error")
 #define VDO_SUBFORMAT_NV12 "NV12"
 
-/* Supported filter kernels */
+/* Default filter kernel */
 #define FILTER_SOBEL_3X3 "sobel_3x3"
-#define FILTER_SOBEL_3X1 "sobel_3x1"
 
-/* Which part of the captured images to filter with OpenCL */
-enum render_area {
-    FULL_AREA = 0,
-    HALF_AREA,
+/* Paths of the OpenCL program sources, and of the cached program binary */
+#define SOBEL_SOURCE_FILE   "/usr/local/packages/vdo_cl_filter_demo/sobel_nv12.cl"
+#define FILTERS_SOURCE_FILE "/usr/local/packages/vdo_cl_filter_demo/filters_nv12.cl"
+#define PROGRAM_CACHE_FILE  "/usr/local/packages/vdo_cl_filter_demo/localdata/program.clbin"
+
+/* Tuned local work sizes are cached here per device */
+#define AUTOTUNE_CACHE_FILE "/usr/local/packages/vdo_cl_filter_demo/localdata/autotune.conf"
+
+/* Number of bins of the luma histogram */
+#define HISTOGRAM_BINS 256
+
+/*
+ * A part of the captured images to filter with OpenCL, in pixels. Kernels
+ * filter 8 pixels per work item, so columns are multiples of 8, and chroma
+ * rows cover two luma rows, so rows are multiples of 2.
+ */
+struct region {
+    guint x;
+    guint y;
+    guint width;
+    guint height;
 };
 
-/* VDO Data */
-static VdoStream* stream;
+/* What a filter kernel writes, which also decides its arguments */
+enum filter_output {
+    /* Filtered luma to Out_y, and grey chroma to Out_cbcr */
+    OUTPUT_LUMA_GREY_CHROMA,
+    /* Filtered luma to Out_y, the chroma of the frame is kept */
+    OUTPUT_LUMA,
+    /* Luma histogram accumulated over all frames, the image passes through */
+    OUTPUT_HISTOGRAM,
+    /* Edge energy per block for the tamper tracker, the image passes through */
+    OUTPUT_EDGE_ENERGY,
+};
+
+/* Filter kernels, and the size of their __local argument if they take one */
+struct filter_kernel {
+    const char* name;
+    enum filter_output output;
+    /*
+     * Rows at the top of the frame and columns at the left of a launch that the
+     * kernel does not write. The Sobel kernels skip row 0, since they read the
+     * row above without clamping, and write the 8 pixels to the right of their
+     * column.
+     */
+    guint first_row;
+    guint first_col;
+    local_mem_size_func tile_size;
+};
+
+/*
+ * The tiled kernels stage (local rows + 2) rows of (local columns + 1) * 8
+ * bytes, i.e. the pixels of the work group plus a one pixel halo.
+ */
+static size_t sobel_tile_size(const size_t local_size[2]) {
+    return (local_size[0] + 2) * ((local_size[1] + 1) << 3);
+}
+
+/* Every work group of the histogram kernel counts into its own bins */
+static size_t histogram_bins_size(const size_t local_size[2]) {
+    (void)local_size;
+    return HISTOGRAM_BINS * sizeof(cl_uint);
+}
 
-/* OpenCL Data */
+/* The edge energy kernel reduces one partial sum per work item */
+static size_t edge_energy_partial_size(const size_t local_size[2]) {
+    return local_size[0] * local_size[1] * sizeof(cl_uint);
+}
+
+static const struct filter_kernel filter_kernels[] = {
+    {"sobel_3x3", OUTPUT_LUMA_GREY_CHROMA, 1, 1, NULL},
+    {"sobel_3x1", OUTPUT_LUMA_GREY_CHROMA, 1, 1, NULL},
+    {"sobel_3x3_tiled", OUTPUT_LUMA_GREY_CHROMA, 1, 1, sobel_tile_size},
+    {"sobel_3x1_tiled", OUTPUT_LUMA_GREY_CHROMA, 1, 1, sobel_tile_size},
+    {"gaussian_5x1", OUTPUT_LUMA, 0, 0, NULL},
+    {"gaussian_1x5", OUTPUT_LUMA, 0, 0, NULL},
+    {"box_5x1", OUTPUT_LUMA, 0, 0, NULL},
+    {"box_1x5", OUTPUT_LUMA, 0, 0, NULL},
+    {"median_3x3", OUTPUT_LUMA, 0, 0, NULL},
+    {"median_5x5", OUTPUT_LUMA, 0, 0, NULL},
+    {"erode_3x3", OUTPUT_LUMA, 0, 0, NULL},
+    {"dilate_3x3", OUTPUT_LUMA, 0, 0, NULL},
+    {"luma_histogram", OUTPUT_HISTOGRAM, 0, 0, histogram_bins_size},
+    {"edge_energy", OUTPUT_EDGE_ENERGY, 0, 0, edge_energy_partial_size},
+};
+
+static gboolean writes_image(const struct filter_kernel* filter) {
+    return filter->output == OUTPUT_LUMA || filter->output == OUTPUT_LUMA_GREY_CHROMA;
+}
+
+/* Filters that are run as a chain of separable passes */
+static const struct {
+    const char* name;
+    const char* chain;
+} filter_aliases[] = {
+    {"gaussian_5x5", "gaussian_5x1,gaussian_1x5"},
+    {"box_5x5", "box_5x1,box_1x5"},
+};
+
+/* One NDRange of a filter stage, covering a region of the frame */
+struct stage_launch {
+    size_t offset[2];
+    size_t global_work_size[2];
+    size_t local_work_size[2];
+};
+
+/*
+ * One kernel of the filter chain. Image stages are launched once per region,
+ * while histogram and edge energy stages always cover the whole frame.
+ */
+struct filter_stage {
+    const struct filter_kernel* filter;
+    cl_kernel kernel;
+    struct stage_launch launches[MAX_REGIONS];
+    guint num_launches;
+    /* Parts of the launches the kernel does not write, copied from its input */
+    struct region borders[2 * MAX_REGIONS];
+    guint num_borders;
+};
+
+/* OpenCL Data, shared by all streams */
 cl_platform_id platform_id = NULL;
 cl_device_id device_id     = NULL;
 cl_uint ret_num_devices;
 cl_uint ret_num_platforms;
 cl_context context;
 cl_program program;
-cl_kernel kernel;
-cl_command_queue command_queue;
 
-/* OpenCL memory objects */
-cl_mem out_image;
-cl_mem out_image_y;
-cl_mem out_image_cbcr;
+/* Collects the device timestamps of every command, NULL if not profiling */
+static struct profiler* profiler;
+/* Streams enqueue commands from their own threads */
+static GMutex profiler_lock;
+
+/* Run by the main thread while the streams are filtered, and sends the tamper events */
+static GMainLoop* main_loop;
+/* Streams still filtering, the main loop quits when the last one is done */
+static gint streams_running;
+
+/*
+ * This is the setting for local_work_size that works the best in terms
+ * of not only speed, but also achieving correct functionality when stream
+ * is rotated. This is due to the fact that global_work_size needs to be
+ * evenly divisible by local_work_size in all dimensions. Every launch starts
+ * out with it, and it is replaced by the autotuned size at startup.
+ */
+static const size_t default_local_work_size[2] = {8, 4};
+
+/*
+ * A filter chain. Each stage reads the luma written by the stage before it,
+ * the first stage reads the VDO buffer and the last image stage writes to the
+ * output buffer. Images in between are kept on the device in scratch_y.
+ */
+struct filter_chain {
+    struct filter_stage stages[MAX_FILTER_STAGES];
+    guint num_stages;
+    cl_mem scratch_y[2];
+    /* Index of the last stage that writes an image, -1 if the input passes through */
+    gint last_image_stage;
+
+    /* Accumulated by luma_histogram stages, NULL if there are none */
+    cl_mem histogram;
+
+    /*
+     * Written by edge_energy stages, one sum per work group, NULL if there are
+     * none. The number of blocks depends on the tuned local work size.
+     */
+    cl_mem edge_energy;
+    guint energy_blocks;
+    guint energy_block_pixels;
+
+    /*
+     * Parts of the frame outside all filtered regions. They are copied from the
+     * input frame on the device, after the kernels have run. NULL without
+     * image stages.
+     */
+    GArray* passthrough;
+};
+
+/*
+ * An output buffer together with the VDO buffer that was filtered into it.
+ * Slots circulate between the main thread, which enqueues the filtering, and
+ * the writer thread, which writes the result to file.
+ */
+struct output_slot {
+    /* OpenCL memory objects */
+    cl_mem image;
+    cl_mem image_y;
+    cl_mem image_cbcr;
+    /* Host mapping of image, only valid once mapped has completed */
+    void* data;
+    /*
+     * Completes when the filtered frame has been mapped for the host, or when
+     * the last command has run if the chain writes no image
+     */
+    cl_event mapped;
+    /* Input buffer, kept until the slot is reused since the kernel reads it */
+    VdoBuffer* buffer;
+    /* Number of bytes to write to file */
+    size_t frame_size;
+    /* Edge energy of every block, read back with the frame if tracking tampering */
+    cl_uint* energy;
+};
+
+/* State shared between the main thread and the writer thread */
+struct frame_writer {
+    /* NULL if the chain writes no image */
+    FILE* file;
+    /* Slots ready to be filled with a new frame */
+    GAsyncQueue* free_slots;
+    /* Slots with a filtering operation enqueued, waiting to be written */
+    GAsyncQueue* pending_slots;
+    gint failed;
+    /* Updated with the edge energy of every frame, NULL without edge_energy */
+    struct tamper_tracker* tamper;
+};
 
-size_t global_work_size[2];
+/* Pushed to the pending queue to stop the writer thread */
+static struct output_slot writer_stop;
 
-GHashTable* table = NULL;
+/*
+ * One VDO stream and everything it needs to filter frames on its own: a
+ * command queue, a filter chain whose kernels hold the arguments of this
+ * stream, the OpenCL memory objects wrapping its VDO buffers and its output
+ * slots. Streams only share the context and the program, and each stream is
+ * filtered in a thread of its own.
+ */
+struct filter_stream {
+    guint index;
+    VdoStream* stream;
+    cl_command_queue command_queue;
+    struct filter_chain chain;
+
+    /* Maps VDO buffer addresses to the cl memory objects in in_images */
+    GHashTable* table;
+    cl_mem* in_images;
+    guint num_in_images;
+    guint buffer_count;
+
+    unsigned width;
+    unsigned height;
+    gint frames;
+    gint pipeline_depth;
+    struct output_slot* slots;
+    struct frame_writer writer;
+    GThread* writer_thread;
+    GThread* thread;
+
+    guint frames_done;
+    gint64 start_time;
+    gint64 end_time;
+    GError* error;
+};
 
 static void print_cl_platform_info(cl_platform_id id) {
     cl_platform_info param_names[] = {CL_PLATFORM_PROFILE,
@@ -112,66 +405,558 @@ static void print_cl_platform_info(cl_platform_id id) {
     syslog(LOG_INFO, "End of info");
 }
 
-/* Create cl kernel program */
-static cl_program create_cl_program(cl_context cont, const char* file_name, cl_int* ret) {
-    FILE* fp;
-    char* source_str;
-    size_t source_size;
-    fp = fopen(file_name, "r");
-    if (!fp) {
-        syslog(LOG_ERR, "Failed to load kernel.");
-        exit(1);
-    }
-    source_str = (char*)malloc(MAX_SOURCE_SIZE);
+/* Hand a command to the profiler, if profiling */
+static void profile_command(const char* name, cl_event event) {
+    if (!profiler)
+        return;
+    g_mutex_lock(&profiler_lock);
+    profiler_record(profiler, name, event);
+    g_mutex_unlock(&profiler_lock);
+}
 
-    source_size = fread(source_str, 1, MAX_SOURCE_SIZE, fp);
+static int free_filter_chain(struct filter_chain* chain) {
+    int cl_ret = CL_SUCCESS;
 
-    syslog(LOG_INFO, "Read cl file \"%s\", size of %zu bytes", file_name, source_size);
+    for (guint i = 0; i < chain->num_stages; i++) {
+        if (chain->stages[i].kernel)
+            cl_ret |= clReleaseKernel(chain->stages[i].kernel);
+    }
+    chain->num_stages       = 0;
+    chain->last_image_stage = -1;
 
-    fclose(fp);
+    for (guint i = 0; i < G_N_ELEMENTS(chain->scratch_y); i++) {
+        if (chain->scratch_y[i])
+            cl_ret |= clReleaseMemObject(chain->scratch_y[i]);
+        chain->scratch_y[i] = NULL;
+    }
+    if (chain->histogram)
+        cl_ret |= clReleaseMemObject(chain->histogram);
+    chain->histogram = NULL;
+    if (chain->edge_energy)
+        cl_ret |= clReleaseMemObject(chain->edge_energy);
+    chain->edge_energy   = NULL;
+    chain->energy_blocks = 0;
+    if (chain->passthrough)
+        g_array_free(chain->passthrough, TRUE);
+    chain->passthrough = NULL;
 
-    cl_program prog = clCreateProgramWithSource(cont,
-                                                1,
-                                                (const char**)&source_str,
-                                                (const size_t*)&source_size,
-                                                ret);
-    free(source_str);
-    return prog;
+    if (cl_ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Failed to release the filter chain: %d", cl_ret);
+        return -1;
+    }
+    return 0;
 }
 
 static int free_opencl(void) {
     int cl_ret;
-    cl_ret = clReleaseMemObject(out_image_y);
-    cl_ret |= clReleaseMemObject(out_image_cbcr);
+    cl_ret = clReleaseProgram(program);
     if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Failed to release memory objects: %d", cl_ret);
+        syslog(LOG_ERR, "Failed to release the program: %d", cl_ret);
         return -1;
     }
-    cl_ret = clReleaseKernel(kernel);
+    cl_ret = clReleaseContext(context);
     if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Failed to release the kernel: %d", cl_ret);
+        syslog(LOG_ERR, "Failed to release the context: %d", cl_ret);
         return -1;
     }
-    cl_ret = clReleaseProgram(program);
-    if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Failed to release the program: %d", cl_ret);
+    return 0;
+}
+
+/*
+ * Set the arguments of a stage. Image stages write to out_y, and the Sobel
+ * kernels also write grey chroma to out_cbcr. Histogram and edge energy
+ * stages only read in_y.
+ * Returns the index of the __local argument, for kernels that take one.
+ */
+static cl_int set_stage_args(const struct filter_chain* chain,
+                             const struct filter_stage* stage,
+                             const struct stage_launch* launch,
+                             cl_mem* in_y,
+                             cl_mem* out_y,
+                             cl_mem* out_cbcr,
+                             unsigned width,
+                             unsigned height,
+                             cl_uint* local_mem_arg) {
+    cl_uint arg = 0;
+    cl_int ret;
+
+    ret = clSetKernelArg(stage->kernel, arg++, sizeof(cl_mem), (void*)in_y);
+    switch (stage->filter->output) {
+        case OUTPUT_HISTOGRAM:
+            ret |= clSetKernelArg(stage->kernel, arg++, sizeof(cl_mem), (void*)&chain->histogram);
+            break;
+        case OUTPUT_EDGE_ENERGY:
+            ret |= clSetKernelArg(stage->kernel, arg++, sizeof(cl_mem), (void*)&chain->edge_energy);
+            break;
+        case OUTPUT_LUMA_GREY_CHROMA:
+            ret |= clSetKernelArg(stage->kernel, arg++, sizeof(cl_mem), (void*)out_y);
+            ret |= clSetKernelArg(stage->kernel, arg++, sizeof(cl_mem), (void*)out_cbcr);
+            break;
+        case OUTPUT_LUMA:
+        default:
+            ret |= clSetKernelArg(stage->kernel, arg++, sizeof(cl_mem), (void*)out_y);
+            break;
+    }
+    ret |= clSetKernelArg(stage->kernel, arg++, sizeof(width), &width);
+    ret |= clSetKernelArg(stage->kernel, arg++, sizeof(height), &height);
+    if (stage->filter->tile_size) {
+        ret |= clSetKernelArg(stage->kernel,
+                              arg,
+                              stage->filter->tile_size(launch->local_work_size),
+                              NULL);
+    }
+
+    if (local_mem_arg)
+        *local_mem_arg = arg;
+    return ret;
+}
+
+/*
+ * Select the local work size of a stage launch by benchmarking its kernel on
+ * scratch buffers of the same size as the stream, or by reusing a size cached
+ * on an earlier start.
+ */
+static int tune_local_work_size(cl_command_queue command_queue,
+                                const struct filter_chain* chain,
+                                struct filter_stage* stage,
+                                struct stage_launch* launch,
+                                unsigned width,
+                                unsigned height,
+                                gboolean retune) {
+    cl_int ret;
+    cl_mem in_y       = NULL;
+    cl_mem out        = NULL;
+    cl_mem out_y      = NULL;
+    cl_mem out_cbcr   = NULL;
+    size_t y_size     = (size_t)width * height;
+    size_t cbcr_size  = y_size / 2;
+    cl_uint local_arg = 0;
+    int tuned         = -1;
+
+    cl_buffer_region y_region = {
+        .origin = 0,
+        .size   = y_size,
+    };
+
+    cl_buffer_region c_region = {
+        .origin = y_size,
+        .size   = cbcr_size,
+    };
+
+    /* Like a VDO buffer, so kernels reading one row past the luma stay inside */
+    in_y = clCreateBuffer(context, CL_MEM_READ_ONLY, y_size + cbcr_size, NULL, &ret);
+    if (ret != CL_SUCCESS)
+        goto exit;
+    out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, y_size + cbcr_size, NULL, &ret);
+    if (ret != CL_SUCCESS)
+        goto exit;
+    out_y =
+        clCreateSubBuffer(out, CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &y_region, &ret);
+    if (ret != CL_SUCCESS)
+        goto exit;
+    out_cbcr =
+        clCreateSubBuffer(out, CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &c_region, &ret);
+    if (ret != CL_SUCCESS)
+        goto exit;
+
+    ret = set_stage_args(chain,
+                         stage,
+                         launch,
+                         &in_y,
+                         &out_y,
+                         &out_cbcr,
+                         width,
+                         height,
+                         &local_arg);
+    if (ret != CL_SUCCESS)
+        goto exit;
+
+    struct autotune_job job = {
+        .queue            = command_queue,
+        .device           = device_id,
+        .kernel           = stage->kernel,
+        .offset           = launch->offset,
+        .global_work_size = launch->global_work_size,
+        .local_mem_size   = stage->filter->tile_size,
+        .local_mem_arg    = local_arg,
+        .pixels           = launch->global_work_size[0] * launch->global_work_size[1] * 8,
+    };
+
+    /* The region as <width>x<height>+<x>+<y>, or full if it is the whole frame */
+    size_t region_width = launch->global_work_size[1] * 8;
+    gchar* region       = NULL;
+    if (region_width == width && launch->global_work_size[0] == height)
+        region = g_strdup("full");
+    else
+        region = g_strdup_printf("%zux%zu+%zu+%zu",
+                                 region_width,
+                                 launch->global_work_size[0],
+                                 launch->offset[1] * 8,
+                                 launch->offset[0]);
+
+    gchar* config_name =
+        g_strdup_printf("%s-%ux%u-%s", stage->filter->name, width, height, region);
+    tuned = autotune_local_work_size(&job,
+                                     config_name,
+                                     AUTOTUNE_CACHE_FILE,
+                                     retune,
+                                     launch->local_work_size);
+    g_free(config_name);
+    g_free(region);
+
+exit:
+    if (ret != CL_SUCCESS)
+        syslog(LOG_ERR, "Unable to set up autotuning buffers: %d", ret);
+    if (out_cbcr)
+        clReleaseMemObject(out_cbcr);
+    if (out_y)
+        clReleaseMemObject(out_y);
+    if (out)
+        clReleaseMemObject(out);
+    if (in_y)
+        clReleaseMemObject(in_y);
+    return tuned;
+}
+
+static int add_filter_stage(struct filter_chain* chain, const char* name) {
+    const struct filter_kernel* filter = NULL;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(filter_aliases); i++) {
+        if (g_strcmp0(name, filter_aliases[i].name) == 0) {
+            gchar** passes = g_strsplit(filter_aliases[i].chain, ",", -1);
+            int ret        = 0;
+            for (gchar** pass = passes; *pass && ret == 0; pass++)
+                ret = add_filter_stage(chain, *pass);
+            g_strfreev(passes);
+            return ret;
+        }
+    }
+
+    for (size_t i = 0; i < G_N_ELEMENTS(filter_kernels); i++) {
+        if (g_strcmp0(name, filter_kernels[i].name) == 0)
+            filter = &filter_kernels[i];
+    }
+    if (!filter) {
+        syslog(LOG_ERR, "Unsupported filter kernel \"%s\"", name);
         return -1;
     }
-    cl_ret = clReleaseCommandQueue(command_queue);
-    if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Failed to release the command queue: %d", cl_ret);
+    if (chain->num_stages == MAX_FILTER_STAGES) {
+        syslog(LOG_ERR, "At most %d filter kernels can be chained", MAX_FILTER_STAGES);
         return -1;
     }
-    cl_ret = clReleaseContext(context);
-    if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Failed to release the context: %d", cl_ret);
+
+    struct filter_stage* stage = &chain->stages[chain->num_stages];
+    cl_int ret;
+
+    stage->kernel = clCreateKernel(program, filter->name, &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Could not create kernel %s: %d", filter->name, ret);
         return -1;
     }
+    stage->filter       = filter;
+    stage->num_launches = 0;
+    stage->num_borders  = 0;
+    chain->num_stages++;
     return 0;
 }
 
-static int
-setup_opencl(const char* kernel_name, enum render_area area, unsigned width, unsigned height) {
+/*
+ * Add a launch of a stage over a region. The launch covers the rows of the
+ * region exactly, so that its size stays divisible by the local work size, and
+ * the Sobel kernels skip row 0 themselves. The rows and columns a kernel does
+ * not write are recorded as borders, so that they get the pixels of its input
+ * rather than whatever the output buffer held.
+ */
+static void add_stage_launch(struct filter_stage* stage, const struct region* region) {
+    struct stage_launch* launch = &stage->launches[stage->num_launches++];
+    const guint first_row       = stage->filter->first_row;
+    const guint first_col       = stage->filter->first_col;
+    guint top                   = MAX(region->y, first_row);
+
+    if (top > region->y) {
+        struct region rows = {region->x, region->y, region->width, top - region->y};
+        stage->borders[stage->num_borders++] = rows;
+    }
+    if (first_col > 0 && top < region->y + region->height) {
+        struct region cols = {region->x, top, first_col, region->y + region->height - top};
+        stage->borders[stage->num_borders++] = cols;
+    }
+
+    launch->offset[0]           = region->y;
+    launch->offset[1]           = region->x / 8;
+    launch->global_work_size[0] = region->height;
+    launch->global_work_size[1] = region->width / 8;
+    launch->local_work_size[0]  = default_local_work_size[0];
+    launch->local_work_size[1]  = default_local_work_size[1];
+}
+
+static gint compare_guint(gconstpointer a, gconstpointer b) {
+    guint x = *(const guint*)a;
+    guint y = *(const guint*)b;
+    return x < y ? -1 : x > y;
+}
+
+static gint compare_region_x(gconstpointer a, gconstpointer b) {
+    return compare_guint(&((const struct region*)a)->x, &((const struct region*)b)->x);
+}
+
+/*
+ * Split the parts of the frame outside all regions into rectangles. The frame
+ * is cut into bands at every top and bottom edge of a region, and within each
+ * band the columns not covered by any region make up the rectangles.
+ */
+static GArray* find_passthrough(const struct region* regions,
+                                guint num_regions,
+                                unsigned width,
+                                unsigned height) {
+    guint edges[2 * MAX_REGIONS + 2];
+    guint num_edges = 0;
+
+    edges[num_edges++] = 0;
+    edges[num_edges++] = height;
+    for (guint i = 0; i < num_regions; i++) {
+        edges[num_edges++] = regions[i].y;
+        edges[num_edges++] = regions[i].y + regions[i].height;
+    }
+    qsort(edges, num_edges, sizeof(edges[0]), compare_guint);
+
+    GArray* passthrough = g_array_new(FALSE, FALSE, sizeof(struct region));
+
+    for (guint e = 0; e + 1 < num_edges; e++) {
+        guint top    = edges[e];
+        guint bottom = edges[e + 1];
+        if (top == bottom)
+            continue;
+
+        struct region covering[MAX_REGIONS];
+        guint num_covering = 0;
+        for (guint i = 0; i < num_regions; i++) {
+            if (regions[i].y <= top && regions[i].y + regions[i].height >= bottom)
+                covering[num_covering++] = regions[i];
+        }
+        qsort(covering, num_covering, sizeof(covering[0]), compare_region_x);
+
+        guint x = 0;
+        for (guint i = 0; i <= num_covering; i++) {
+            guint end = i < num_covering ? covering[i].x : width;
+            if (end > x) {
+                struct region gap = {x, top, end - x, bottom - top};
+                g_array_append_val(passthrough, gap);
+            }
+            if (i < num_covering)
+                x = MAX(x, covering[i].x + covering[i].width);
+        }
+    }
+    return passthrough;
+}
+
+/*
+ * Set up a chain of comma separated filter kernels, e.g.
+ * "gaussian_5x5,sobel_3x3", over the given regions, and the device buffers
+ * between them. A chain of only histogram and edge energy stages writes no
+ * image at all.
+ */
+static int setup_filter_chain(struct filter_chain* chain,
+                              cl_command_queue command_queue,
+                              const char* kernels,
+                              const struct region* regions,
+                              guint num_regions,
+                              unsigned width,
+                              unsigned height,
+                              gboolean retune) {
+    gchar** names             = g_strsplit(kernels, ",", -1);
+    cl_int ret                = CL_SUCCESS;
+    const struct region frame = {0, 0, width, height};
+
+    for (gchar** name = names; *name; name++) {
+        if (add_filter_stage(chain, g_strstrip(*name))) {
+            g_strfreev(names);
+            return -1;
+        }
+    }
+    g_strfreev(names);
+
+    for (guint i = 0; i < chain->num_stages; i++) {
+        if (!writes_image(chain->stages[i].filter))
+            continue;
+        /*
+         * Every image stage but the last writes to a scratch buffer. They are
+         * as large as a whole frame, since the Sobel kernels read one row past
+         * the luma like they do in the VDO buffers.
+         */
+        if (chain->last_image_stage >= 0 && !chain->scratch_y[0]) {
+            size_t size = (size_t)width * height * 3 / 2;
+            for (guint j = 0; j < G_N_ELEMENTS(chain->scratch_y) && ret == CL_SUCCESS; j++)
+                chain->scratch_y[j] = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, &ret);
+        }
+        chain->last_image_stage = i;
+    }
+
+    gboolean whole_frame = num_regions == 1 && !memcmp(&regions[0], &frame, sizeof(frame));
+    guint image_stages   = 0;
+
+    for (guint i = 0; i < chain->num_stages; i++) {
+        if (writes_image(chain->stages[i].filter))
+            image_stages++;
+        else if (image_stages > 0 && !whole_frame) {
+            /* They cover the whole frame, but the image would only be filtered in the regions */
+            syslog(LOG_ERR,
+                   "%s must come before the image filters when filtering regions",
+                   chain->stages[i].filter->name);
+            return -1;
+        }
+    }
+
+    for (guint i = 0; i < chain->num_stages; i++) {
+        struct filter_stage* stage = &chain->stages[i];
+
+        if (!writes_image(stage->filter)) {
+            add_stage_launch(stage, &frame);
+            continue;
+        }
+
+        /*
+         * Stages before the last filter a margin around each region, so the
+         * stages after them read filtered pixels at the region edges. The
+         * margin is 8 columns and 2 rows per remaining stage, more than the
+         * radius of any kernel.
+         */
+        guint margin = --image_stages;
+        for (guint j = 0; j < num_regions; j++) {
+            struct region r = regions[j];
+            guint left      = MIN(r.x, margin * 8);
+            guint top       = MIN(r.y, margin * 2);
+
+            r.width  = MIN(r.width + left + margin * 8, width - (r.x - left));
+            r.height = MIN(r.height + top + margin * 2, height - (r.y - top));
+            r.x -= left;
+            r.y -= top;
+            add_stage_launch(stage, &r);
+        }
+    }
+
+    for (guint i = 0; i < chain->num_stages && ret == CL_SUCCESS; i++) {
+        if (chain->stages[i].filter->output == OUTPUT_HISTOGRAM && !chain->histogram) {
+            chain->histogram = clCreateBuffer(context,
+                                              CL_MEM_READ_WRITE,
+                                              HISTOGRAM_BINS * sizeof(cl_uint),
+                                              NULL,
+                                              &ret);
+        }
+        /* Large enough for one block per work item, the smallest tuning candidate */
+        if (chain->stages[i].filter->output == OUTPUT_EDGE_ENERGY && !chain->edge_energy) {
+            chain->edge_energy = clCreateBuffer(context,
+                                                CL_MEM_READ_WRITE,
+                                                (size_t)height * (width / 8) * sizeof(cl_uint),
+                                                NULL,
+                                                &ret);
+        }
+    }
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Unable to create filter chain buffers: %d", ret);
+        return -1;
+    }
+
+    /* Keep the default local work size if no candidate could be benchmarked */
+    for (guint i = 0; i < chain->num_stages; i++) {
+        for (guint j = 0; j < chain->stages[i].num_launches; j++) {
+            struct stage_launch* launch = &chain->stages[i].launches[j];
+            if (tune_local_work_size(command_queue,
+                                     chain,
+                                     &chain->stages[i],
+                                     launch,
+                                     width,
+                                     height,
+                                     retune))
+                syslog(LOG_WARNING,
+                       "Autotuning %s failed, using local work size {%zu, %zu}",
+                       chain->stages[i].filter->name,
+                       launch->local_work_size[0],
+                       launch->local_work_size[1]);
+        }
+
+        if (chain->stages[i].filter->output == OUTPUT_EDGE_ENERGY) {
+            const struct stage_launch* launch = &chain->stages[i].launches[0];
+            const size_t* local               = launch->local_work_size;
+
+            chain->energy_blocks = (launch->global_work_size[0] / local[0]) *
+                                   (launch->global_work_size[1] / local[1]);
+            chain->energy_block_pixels = local[0] * local[1] * 8;
+        }
+    }
+
+    /* Without image stages there is no output to copy the frame to */
+    if (chain->last_image_stage >= 0)
+        chain->passthrough = find_passthrough(regions, num_regions, width, height);
+
+    /* Autotuning ran the histogram kernel too, start counting from zero */
+    if (chain->histogram) {
+        const cl_uint zero = 0;
+
+        ret = clEnqueueFillBuffer(command_queue,
+                                  chain->histogram,
+                                  &zero,
+                                  sizeof(zero),
+                                  0,
+                                  HISTOGRAM_BINS * sizeof(cl_uint),
+                                  0,
+                                  NULL,
+                                  NULL);
+        if (ret != CL_SUCCESS) {
+            syslog(LOG_ERR, "Unable to clear the histogram: %d", ret);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Log a summary of the histogram accumulated over all frames */
+static void report_histogram(const struct filter_chain* chain, cl_command_queue command_queue) {
+    cl_uint bins[HISTOGRAM_BINS];
+    guint64 pixels = 0;
+    guint64 sum    = 0;
+
+    cl_int ret = clEnqueueReadBuffer(command_queue,
+                                     chain->histogram,
+                                     CL_TRUE,
+                                     0,
+                                     sizeof(bins),
+                                     bins,
+                                     0,
+                                     NULL,
+                                     NULL);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Unable to read the histogram: %d", ret);
+        return;
+    }
+
+    for (guint i = 0; i < HISTOGRAM_BINS; i++) {
+        pixels += bins[i];
+        sum += (guint64)i * bins[i];
+    }
+    if (pixels == 0)
+        return;
+
+    /* Luma at the 5th, 50th and 95th percentile */
+    static const guint percents[] = {5, 50, 95};
+    guint percentiles[3]          = {0};
+    guint64 count                 = 0;
+    for (guint i = 0, p = 0; i < HISTOGRAM_BINS; i++) {
+        count += bins[i];
+        for (; p < G_N_ELEMENTS(percents) && count * 100 >= pixels * percents[p]; p++)
+            percentiles[p] = i;
+    }
+
+    syslog(LOG_INFO,
+           "Luma histogram of %llu pixels: mean %.1f, 5%% %u, median %u, 95%% %u",
+           (unsigned long long)pixels,
+           (gdouble)sum / pixels,
+           percentiles[0],
+           percentiles[1],
+           percentiles[2]);
+}
+
+static int setup_opencl(gint profile_interval) {
     cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
     if (ret != CL_SUCCESS) {
         syslog(LOG_ERR, "Could not get device id's");
@@ -192,135 +977,426 @@ setup_opencl(const char* kernel_name, enum render_area area, unsigned width, uns
         return -1;
     }
 
-    program =
-        create_cl_program(context, "/usr/local/packages/vdo_cl_filter_demo/sobel_nv12.cl", &ret);
+    /*
+     * This string can be used to pass paramaters to the OpenCl compiler. It is
+     * part of the cache key, so changing it invalidates the cached binary.
+     */
+    char options[] = "";
 
-    if (ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Could not create cl program");
+    /* The Sobel kernels and the filter library are built as one program */
+    const char* source_files[] = {SOBEL_SOURCE_FILE, FILTERS_SOURCE_FILE, NULL};
+
+    program =
+        build_cached_program(context, device_id, source_files, options, PROGRAM_CACHE_FILE, &ret);
+    if (!program) {
+        syslog(LOG_ERR, "Could not build cl_program: %d", ret);
         return -1;
     }
 
-    /* This string can be used to pass paramaters to the OpenCl compiler */
-    char options[] = "";
-    ret            = clBuildProgram(program, 1, &device_id, options, NULL, NULL);
+    if (profile_interval > 0)
+        profiler = profiler_new(profile_interval);
+
+    return 0;
+}
+
+/*
+ * Create a command queue on the shared context. Every stream has its own, so
+ * the commands of one stream never wait on those of another.
+ */
+static cl_command_queue create_command_queue(void) {
+    cl_int ret;
+
+    /* Profiling adds timestamps to every command, only enable it if asked for */
+    cl_command_queue_properties properties = 0;
+    if (profiler)
+        properties = CL_QUEUE_PROFILING_ENABLE;
+
+    cl_command_queue queue = clCreateCommandQueue(context, device_id, properties, &ret);
     if (ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Could not build cl_program");
+        syslog(LOG_ERR, "Could not create command queue: %d", ret);
+        return NULL;
+    }
+    return queue;
+}
 
-        if (ret == CL_BUILD_PROGRAM_FAILURE) {
-            /* Determine the size of the program log */
-            size_t log_size;
-            clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-            /* Allocate memory for the program log */
-            char* log = (char*)malloc(log_size);
+/*
+ * Benchmark every filter kernel on its own at 720p and 1080p, without
+ * starting a stream. The throughput of the fastest local work size is logged,
+ * and the tuned sizes are cached for later runs at the same resolutions.
+ */
+static int run_benchmarks(void) {
+    static const unsigned resolutions[][2] = {{1280, 720}, {1920, 1080}};
+    int ret                                = 0;
 
-            /* Get the program log */
-            clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+    cl_command_queue command_queue = create_command_queue();
+    if (!command_queue)
+        return -1;
 
-            /* Print the program log */
-            syslog(LOG_INFO, "%s", log);
-            free(log);
+    for (size_t r = 0; r < G_N_ELEMENTS(resolutions); r++) {
+        const struct region frame = {0, 0, resolutions[r][0], resolutions[r][1]};
+
+        for (size_t i = 0; i < G_N_ELEMENTS(filter_kernels); i++) {
+            struct filter_chain chain = {.last_image_stage = -1};
+
+            if (setup_filter_chain(&chain,
+                                   command_queue,
+                                   filter_kernels[i].name,
+                                   &frame,
+                                   1,
+                                   resolutions[r][0],
+                                   resolutions[r][1],
+                                   TRUE))
+                ret = -1;
+            if (free_filter_chain(&chain))
+                ret = -1;
         }
+    }
+    clReleaseCommandQueue(command_queue);
+    return ret;
+}
+
+/*
+ * Allocate the output buffer of a slot and map it to the CPU. In this case
+ * it's more practical with a separate output buffer since we're performing a
+ * filtering operation.
+ *
+ * If possible, allocate the buffer using OpenCL, and then map up that memory
+ * to the CPU.
+ */
+static int setup_output_slot(cl_command_queue command_queue,
+                             struct output_slot* slot,
+                             size_t image_y_size,
+                             size_t image_cbcr_size) {
+    cl_int ret;
+
+    cl_buffer_region y_region = {
+        .origin = 0,
+        .size   = image_y_size,
+    };
+
+    cl_buffer_region c_region = {
+        .origin = image_y_size,
+        .size   = image_cbcr_size,
+    };
+
+    slot->image =
+        clCreateBuffer(context, CL_MEM_ALLOC_HOST_PTR, image_y_size + image_cbcr_size, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Unable to create new cl out memory object: %d", ret);
         return -1;
     }
 
-    kernel = clCreateKernel(program, kernel_name, &ret);
+    /*
+     * Since we use NV12 data we could also create a single memory object
+     * direcly with luma and chroma included. For simplicity we split them up.
+     * The sub-buffers live as long as the slot, so they are only created once.
+     */
+    slot->image_y = clCreateSubBuffer(slot->image,
+                                      CL_MEM_WRITE_ONLY,
+                                      CL_BUFFER_CREATE_TYPE_REGION,
+                                      &y_region,
+                                      &ret);
     if (ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Could not create cl_program");
+        syslog(LOG_ERR, "Unable to create cl memory objects");
         return -1;
     }
 
-    command_queue = clCreateCommandQueue(context, device_id, 0, &ret);
+    slot->image_cbcr = clCreateSubBuffer(slot->image,
+                                         CL_MEM_WRITE_ONLY,
+                                         CL_BUFFER_CREATE_TYPE_REGION,
+                                         &c_region,
+                                         &ret);
     if (ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Could not create command queue");
+        syslog(LOG_ERR, "Unable to create cl memory objects");
         return -1;
     }
 
-    switch (area) {
-        case HALF_AREA:
-            global_work_size[0] = height;
-            global_work_size[1] = width / 16;
-            break;
-        case FULL_AREA:
-        default:
-            global_work_size[0] = height;
-            global_work_size[1] = width / 8;
-            break;
+    /*
+     * A free slot is always mapped, such that the CPU may write the background
+     * image data into it before the filtering is enqueued.
+     */
+    slot->data = clEnqueueMapBuffer(command_queue,
+                                    slot->image,
+                                    CL_TRUE,
+                                    CL_MAP_READ | CL_MAP_WRITE,
+                                    0,
+                                    image_y_size + image_cbcr_size,
+                                    0,
+                                    NULL,
+                                    NULL,
+                                    &ret);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Unable to map cl out memory object: %d", ret);
+        return -1;
     }
+    return 0;
+}
+
+static int free_output_slot(struct filter_stream* fs, struct output_slot* slot) {
+    int ret = CL_SUCCESS;
 
+    if (slot->mapped) {
+        ret |= clWaitForEvents(1, &slot->mapped);
+        ret |= clReleaseEvent(slot->mapped);
+    }
+    if (slot->buffer)
+        vdo_stream_buffer_unref(fs->stream, &slot->buffer, NULL);
+    if (slot->data)
+        ret |= clEnqueueUnmapMemObject(fs->command_queue, slot->image, slot->data, 0, NULL, NULL);
+    ret |= clFinish(fs->command_queue);
+    if (slot->image_y)
+        ret |= clReleaseMemObject(slot->image_y);
+    if (slot->image_cbcr)
+        ret |= clReleaseMemObject(slot->image_cbcr);
+    if (slot->image)
+        ret |= clReleaseMemObject(slot->image);
+    g_free(slot->energy);
+    if (ret != CL_SUCCESS) {
+        syslog(LOG_ERR, "Failed to release output slot: %d", ret);
+        return -1;
+    }
     return 0;
 }
 
 /*
+ * The filter chain runs between unmapping and mapping the output buffer, as
+ * a chain of OpenCL commands where each waits on the event of the previous
+ * one. Nothing here blocks; the writer thread waits on slot->mapped before it
+ * reads the result.
+ *
  * For our sobel operations we ignore cbcr values and simply output 128 for all
- * pixels directly in the kernel.
+ * pixels directly in the kernel. Other filters keep the chroma of the frame,
+ * which is copied on the device. Outside the filtered regions the frame is
+ * copied on the device as well, rectangle by rectangle, so the memory traffic
+ * per frame scales with the filtered area.
+ *
+ * A chain without image stages leaves the output buffer alone, and only runs
+ * its kernels and reads back what they computed.
  */
-static int do_opencl_filtering(cl_mem* in_image_y,
-                               cl_mem* out_image,
+static int do_opencl_filtering(struct filter_stream* fs,
+                               cl_mem* in_image,
+                               struct output_slot* slot,
                                unsigned width,
                                unsigned height,
                                size_t image_y_size,
                                size_t image_cbcr_size) {
-    int ret;
+    cl_int ret;
+    struct filter_chain* chain = &fs->chain;
+    cl_event previous          = NULL;
+    cl_event done              = NULL;
+    cl_mem* in_y               = in_image;
+    guint next_scratch         = 0;
+    gboolean writes_output     = chain->last_image_stage >= 0;
+
+    /* Hand the output buffer back to the device before the kernels write it */
+    if (writes_output) {
+        void* data = slot->data;
+        slot->data = NULL;
+        ret        = clEnqueueUnmapMemObject(fs->command_queue,
+                                             slot->image,
+                                             data,
+                                             0,
+                                             NULL,
+                                             &previous);
+        if (ret != CL_SUCCESS) {
+            syslog(LOG_ERR, "Unable to unmap cl memory object: %d", ret);
+            return -1;
+        }
+        profile_command("unmap", previous);
+    }
 
-    /*
-     * This is the setting for local_work_size that works the best in terms
-     * of not only speed, but also achieving correct functionality when stream
-     * is rotated. This is due to the fact that global_work_size needs to be
-     * evenly divisible by local_work_size in all dimensions.
-     */
-    size_t local_work_size[2] = {8, 4};
-    size_t offset[2]          = {1, 0};
+    for (guint i = 0; i < chain->num_stages; i++) {
+        struct filter_stage* stage = &chain->stages[i];
+        cl_mem* out_y              = NULL;
 
-    cl_buffer_region y_region = {
-        .origin = 0,
-        .size   = image_y_size,
-    };
+        if ((gint)i == chain->last_image_stage) {
+            out_y = &slot->image_y;
+        } else if (writes_image(stage->filter)) {
+            out_y = &chain->scratch_y[next_scratch];
+            next_scratch ^= 1;
+        }
 
-    cl_buffer_region c_region = {
-        .origin = image_y_size,
-        .size   = image_cbcr_size,
-    };
+        for (guint j = 0; j < stage->num_launches; j++) {
+            const struct stage_launch* launch = &stage->launches[j];
+
+            /* The tile size of tiled kernels follows the local work size */
+            ret = set_stage_args(chain,
+                                 stage,
+                                 launch,
+                                 in_y,
+                                 out_y,
+                                 &slot->image_cbcr,
+                                 width,
+                                 height,
+                                 NULL);
+            ret |= clEnqueueNDRangeKernel(fs->command_queue,
+                                          stage->kernel,
+                                          2,
+                                          launch->offset,
+                                          launch->global_work_size,
+                                          launch->local_work_size,
+                                          previous ? 1 : 0,
+                                          previous ? &previous : NULL,
+                                          &done);
+            if (previous)
+                clReleaseEvent(previous);
+            if (ret != CL_SUCCESS) {
+                syslog(LOG_ERR,
+                       "Unable to enqueue OpenCL kernel %s: %d",
+                       stage->filter->name,
+                       ret);
+                return -1;
+            }
+            previous = done;
+            profile_command(stage->filter->name, done);
+        }
+
+        /*
+         * After all launches of the stage, since the Sobel kernels also write
+         * the column just right of a launch, which may be the border of another
+         * launch.
+         */
+        for (guint j = 0; j < stage->num_borders; j++) {
+            const struct region* rect = &stage->borders[j];
+            size_t origin[3]          = {rect->x, rect->y, 0};
+            size_t extent[3]          = {rect->width, rect->height, 1};
+
+            ret = clEnqueueCopyBufferRect(fs->command_queue,
+                                          *in_y,
+                                          *out_y,
+                                          origin,
+                                          origin,
+                                          extent,
+                                          width,
+                                          0,
+                                          width,
+                                          0,
+                                          1,
+                                          &previous,
+                                          &done);
+            clReleaseEvent(previous);
+            if (ret != CL_SUCCESS) {
+                syslog(LOG_ERR, "Unable to copy the border of %s: %d", stage->filter->name, ret);
+                return -1;
+            }
+            previous = done;
+            profile_command("copy", done);
+        }
+
+        if (out_y)
+            in_y = out_y;
+
+        /* The writer thread hands the energy to the tamper tracker */
+        if (stage->filter->output == OUTPUT_EDGE_ENERGY) {
+            ret = clEnqueueReadBuffer(fs->command_queue,
+                                      chain->edge_energy,
+                                      CL_FALSE,
+                                      0,
+                                      chain->energy_blocks * sizeof(cl_uint),
+                                      slot->energy,
+                                      1,
+                                      &previous,
+                                      &done);
+            clReleaseEvent(previous);
+            if (ret != CL_SUCCESS) {
+                syslog(LOG_ERR, "Unable to read the edge energy: %d", ret);
+                return -1;
+            }
+            previous = done;
+            profile_command("read_energy", done);
+        }
+    }
+
+    /* Nothing to copy or map, the writer waits for the last command */
+    if (!writes_output) {
+        slot->mapped = previous;
+        ret          = clFlush(fs->command_queue);
+        if (ret != CL_SUCCESS) {
+            syslog(LOG_ERR, "Unable to complete OpenCL operations: %d", ret);
+            return -1;
+        }
+        return 0;
+    }
 
     /*
-     * Since we use NV12 data we could also create a single memory object
-     * direcly with luma and chroma included. For simplicity we split them up.
-     *
-     * The idea is to use CL_MEM_USE_HOST_PTR which means GPU access system
-     * memory, such that no unnecessary data has to be copied to GPU memory.
-     * This data may still however be cached in the GPU.
+     * Copy the frame outside the regions. The Sobel kernels wrote grey chroma
+     * in the regions, so only the chroma outside them is copied. Other image
+     * filters keep the chroma of the whole frame, which is copied in one go.
      */
-    out_image_y = clCreateSubBuffer(*out_image,
-                                    CL_MEM_WRITE_ONLY,
-                                    CL_BUFFER_CREATE_TYPE_REGION,
-                                    &y_region,
-                                    &ret);
+    gboolean grey_chroma =
+        chain->stages[chain->last_image_stage].filter->output == OUTPUT_LUMA_GREY_CHROMA;
+    gboolean keep_chroma = !grey_chroma;
+
+    for (guint i = 0; i < chain->passthrough->len; i++) {
+        const struct region* rect = &g_array_index(chain->passthrough, struct region, i);
+
+        for (guint plane = 0; plane < (keep_chroma ? 1 : 2); plane++) {
+            /* Chroma rows follow the luma rows and cover two of them each */
+            size_t first_row = plane ? height + rect->y / 2 : rect->y;
+            size_t origin[3] = {rect->x, first_row, 0};
+            size_t extent[3] = {rect->width, plane ? rect->height / 2 : rect->height, 1};
+
+            ret = clEnqueueCopyBufferRect(fs->command_queue,
+                                          *in_image,
+                                          slot->image,
+                                          origin,
+                                          origin,
+                                          extent,
+                                          width,
+                                          0,
+                                          width,
+                                          0,
+                                          1,
+                                          &previous,
+                                          &done);
+            clReleaseEvent(previous);
+            if (ret != CL_SUCCESS) {
+                syslog(LOG_ERR, "Unable to copy the frame outside the regions: %d", ret);
+                return -1;
+            }
+            previous = done;
+            profile_command("copy", done);
+        }
+    }
+
+    if (keep_chroma) {
+        ret = clEnqueueCopyBuffer(fs->command_queue,
+                                  *in_image,
+                                  slot->image_cbcr,
+                                  image_y_size,
+                                  0,
+                                  image_cbcr_size,
+                                  1,
+                                  &previous,
+                                  &done);
+        clReleaseEvent(previous);
+        if (ret != CL_SUCCESS) {
+            syslog(LOG_ERR, "Unable to copy the chroma: %d", ret);
+            return -1;
+        }
+        previous = done;
+        profile_command("copy", done);
+    }
 
-    out_image_cbcr = clCreateSubBuffer(*out_image,
-                                       CL_MEM_WRITE_ONLY,
-                                       CL_BUFFER_CREATE_TYPE_REGION,
-                                       &c_region,
-                                       &ret);
+    slot->data = clEnqueueMapBuffer(fs->command_queue,
+                                    slot->image,
+                                    CL_FALSE,
+                                    CL_MAP_READ | CL_MAP_WRITE,
+                                    0,
+                                    image_y_size + image_cbcr_size,
+                                    1,
+                                    &previous,
+                                    &slot->mapped,
+                                    &ret);
+    clReleaseEvent(previous);
     if (ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Unable to create cl memory objects");
+        syslog(LOG_ERR, "Unable to map cl out memory object: %d", ret);
         return -1;
     }
+    profile_command("map", slot->mapped);
 
-    ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)in_image_y);
-    ret |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&out_image_y);
-    ret |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&out_image_cbcr);
-    ret |= clSetKernelArg(kernel, 3, sizeof(width), &width);
-    ret |= clSetKernelArg(kernel, 4, sizeof(height), &height);
-    ret |= clEnqueueNDRangeKernel(command_queue,
-                                  kernel,
-                                  2,
-                                  offset,
-                                  global_work_size,
-                                  local_work_size,
-                                  0,
-                                  NULL,
-                                  NULL);
-
-    ret |= clFinish(command_queue);
+    /* Submit the commands now instead of when the writer starts waiting */
+    ret = clFlush(fs->command_queue);
     if (ret != CL_SUCCESS) {
         syslog(LOG_ERR, "Unable to complete OpenCL operations: %d", ret);
         return -1;
@@ -328,6 +1404,42 @@ static int do_opencl_filtering(cl_mem* in_image_y,
     return 0;
 }
 
+/*
+ * Writer thread. Waits for each filtered frame to be mapped, writes it to file
+ * and hands the slot back to the main thread. The VDO buffer is released by
+ * the main thread when it reuses the slot. Without an output file, only the
+ * edge energy is handed on.
+ */
+static gpointer write_frames(gpointer data) {
+    struct frame_writer* writer = (struct frame_writer*)data;
+
+    while (TRUE) {
+        struct output_slot* slot = g_async_queue_pop(writer->pending_slots);
+        if (slot == &writer_stop)
+            break;
+
+        cl_int ret = clWaitForEvents(1, &slot->mapped);
+        clReleaseEvent(slot->mapped);
+        slot->mapped = NULL;
+
+        if (ret != CL_SUCCESS) {
+            syslog(LOG_ERR, "Unable to complete OpenCL operations: %d", ret);
+            g_atomic_int_set(&writer->failed, TRUE);
+        } else if (writer->file && !g_atomic_int_get(&writer->failed) &&
+                   !fwrite(slot->data, slot->frame_size, 1, writer->file)) {
+            syslog(LOG_ERR, "Unable to write frame: %m");
+            g_atomic_int_set(&writer->failed, TRUE);
+        }
+
+        /* The energy was read before the frame was mapped */
+        if (ret == CL_SUCCESS && writer->tamper)
+            tamper_tracker_update(writer->tamper, slot->energy);
+
+        g_async_queue_push(writer->free_slots, slot);
+    }
+    return NULL;
+}
+
 static void free_table_entry(gpointer key, gpointer value, gpointer user_data) {
     (void)key;
     (void)user_data;
@@ -339,7 +1451,7 @@ static void free_table_entry(gpointer key, gpointer value, gpointer user_data) {
 }
 
 /* Release cl memory objects on hash table cleanup */
-static void hash_table_destroy(void) {
+static void hash_table_destroy(GHashTable* table) {
     g_hash_table_foreach(table, free_table_entry, NULL);
     g_hash_table_destroy(table);
 }
@@ -347,33 +1459,31 @@ static void hash_table_destroy(void) {
 /*
  * Map a VDO buffer address to an OpenCL memory object. If the address has
  * already been mapped, look up the OpenCL memory object in the hash table
+ * of the stream.
  */
-static int map_input_buffer(void* buffer,
-                            cl_mem* in_images,
-                            cl_mem* in_image_y,
-                            size_t image_size,
-                            enum render_area area,
-                            unsigned buffer_count) {
+static int map_input_buffer(struct filter_stream* fs,
+                            void* buffer,
+                            cl_mem* in_image,
+                            size_t image_size) {
     int ret;
-    static unsigned count = 0;
-    (void)area;
 
-    if (g_hash_table_contains(table, buffer)) {
-        *in_image_y = *((cl_mem*)g_hash_table_lookup(table, buffer));
+    if (g_hash_table_contains(fs->table, buffer)) {
+        *in_image = *((cl_mem*)g_hash_table_lookup(fs->table, buffer));
         return 0;
     }
 
     /* Make sure we're not getting any more unique addresses than asked for */
-    if (count == buffer_count) {
+    if (fs->num_in_images == fs->buffer_count) {
         return -1;
     }
 
     /*
      * Re-use already allocated VDO frame buffer as input to OpenCL program.
-     * In this specific example we don't need the bottom 1/3rd of the frame
-     * containing cbcr data, so we simply ignore it.
+     * The kernels only read the luma, but the bottom 1/3rd of the frame
+     * containing cbcr data is copied to the output by filters that keep it.
      */
-    in_images[count] =
+    cl_mem* mem_obj = &fs->in_images[fs->num_in_images];
+    *mem_obj =
         clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, image_size, buffer, &ret);
 
     if (ret != CL_SUCCESS) {
@@ -381,35 +1491,37 @@ static int map_input_buffer(void* buffer,
         return -1;
     }
 
-    g_hash_table_insert(table, (gpointer)buffer, (gpointer)(&in_images[count]));
-    *in_image_y = in_images[count];
-    count++;
+    g_hash_table_insert(fs->table, (gpointer)buffer, (gpointer)mem_obj);
+    *in_image = *mem_obj;
+    fs->num_in_images++;
     return 0;
 }
 
-int main(void) {
-    GError* error           = NULL;
-    FILE* output_file       = NULL;
-    VdoMap* settings        = NULL;
-    VdoMap* vdo_stream_info = NULL;
-    void* out_data          = NULL;
-    cl_mem* in_images       = NULL;
-    cl_int cl_ret           = CL_SUCCESS;
-
+/*
+ * Start a VDO stream and set up everything needed to filter it: the output
+ * file, a command queue, the filter chain and the output slots. With several
+ * streams, the output files are numbered by stream.
+ */
+static int setup_filter_stream(struct filter_stream* fs,
+                               const char* kernels,
+                               const struct region* regions,
+                               guint num_regions,
+                               gboolean retune,
+                               guint num_streams) {
     const gchar* output_file_format = "yuv"; /* Also the VDO stream format */
+    VdoMap* settings                = NULL;
+    VdoMap* vdo_stream_info         = NULL;
 
-    /* VDO stream dimensions */
-    const unsigned image_width  = 1280;
-    const unsigned image_height = 720;
-    const guint frames          = 5; /* Number of frames to process */
-    const guint buffer_count    = 3; /* Number of unique VDO buffers */
-
-    /* Render settings specific for this example */
-    const char* kernel_name          = FILTER_SOBEL_3X3;
-    enum render_area cur_render_area = HALF_AREA;
+    /* Size of luma data in the image buffer */
+    size_t image_y_size = (size_t)fs->width * fs->height;
+    /* Size of chroma data in the image buffer */
+    size_t image_cbcr_size = image_y_size / 2;
 
-    /* Open connection to syslog */
-    openlog(NULL, LOG_PID, LOG_USER);
+    /*
+     * Number of unique VDO buffers. Every slot in the pipeline holds on to its
+     * input buffer until it is reused, so leave room for VDO to fill two more.
+     */
+    fs->buffer_count = fs->pipeline_depth + 2;
 
     /* Set up VDO */
     settings = vdo_map_new();
@@ -421,26 +1533,27 @@ int main(void) {
      * the luma.
      */
     vdo_map_set_string(settings, "subformat", VDO_SUBFORMAT_NV12);
-    vdo_map_set_uint32(settings, "width", image_width);
-    vdo_map_set_uint32(settings, "height", image_height);
-    vdo_map_set_uint32(settings, "buffer.count", buffer_count);
+    vdo_map_set_uint32(settings, "width", fs->width);
+    vdo_map_set_uint32(settings, "height", fs->height);
+    vdo_map_set_uint32(settings, "buffer.count", fs->buffer_count);
 
     /* Create a new stream */
-    stream = vdo_stream_new(settings, NULL, &error);
+    fs->stream = vdo_stream_new(settings, NULL, &fs->error);
     g_clear_object(&settings);
-    if (!stream)
-        goto exit;
+    if (!fs->stream)
+        return -1;
 
-    if (!vdo_stream_attach(stream, NULL, &error))
-        goto exit;
+    if (!vdo_stream_attach(fs->stream, NULL, &fs->error))
+        return -1;
 
     /* Collect stream information */
-    vdo_stream_info = vdo_stream_get_info(stream, &error);
+    vdo_stream_info = vdo_stream_get_info(fs->stream, &fs->error);
     if (!vdo_stream_info)
-        goto exit;
+        return -1;
 
     syslog(LOG_INFO,
-           "Starting stream: %s in %s, %ux%u, %u fps.",
+           "Starting stream %u: %s in %s, %ux%u, %u fps.",
+           fs->index,
            output_file_format,
            vdo_map_get_string(vdo_stream_info, "subformat", NULL, "N/A"),
            vdo_map_get_uint32(vdo_stream_info, "width", 0),
@@ -450,167 +1563,563 @@ int main(void) {
     g_clear_object(&vdo_stream_info);
 
     /* Start the stream */
-    if (!vdo_stream_start(stream, &error))
-        goto exit;
+    if (!vdo_stream_start(fs->stream, &fs->error))
+        return -1;
 
-    /* Open output file */
-    char file_path[128];
-    snprintf(file_path,
-             sizeof(file_path),
-             "/usr/local/packages/"
-             "vdo_cl_filter_demo/localdata/cl_vdo_demo.%s",
-             output_file_format);
-
-    output_file = fopen(file_path, "wb");
-    if (!output_file) {
-        syslog(LOG_ERR, "Failed to open file: %s\n", file_path);
-        g_set_error(&error, VDO_CLIENT_ERROR, VDO_ERROR_IO, "open failed: %m");
-        goto exit;
+    fs->command_queue = create_command_queue();
+    if (!fs->command_queue) {
+        g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Unable to create a command queue");
+        return -1;
     }
 
-    /* Size of luma data in the image buffer */
-    size_t image_y_size = image_width * image_height;
-    /* Size of chroma data in the image buffer */
-    size_t image_cbcr_size = image_y_size / 2;
+    if (setup_filter_chain(&fs->chain,
+                           fs->command_queue,
+                           kernels,
+                           regions,
+                           num_regions,
+                           fs->width,
+                           fs->height,
+                           retune)) {
+        g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Unable to setup the filter chain");
+        return -1;
+    }
 
-    /* Set up OpenCL */
-    if (setup_opencl(kernel_name, cur_render_area, image_width, image_height)) {
-        syslog(LOG_ERR, "Unable to setup OpenCL");
-        goto exit;
+    /* Open output file, unless the chain only computes statistics of the frames */
+    char file_path[128];
+    if (num_streams > 1)
+        snprintf(file_path,
+                 sizeof(file_path),
+                 "/usr/local/packages/"
+                 "vdo_cl_filter_demo/localdata/cl_vdo_demo-%u.%s",
+                 fs->index,
+                 output_file_format);
+    else
+        snprintf(file_path,
+                 sizeof(file_path),
+                 "/usr/local/packages/"
+                 "vdo_cl_filter_demo/localdata/cl_vdo_demo.%s",
+                 output_file_format);
+
+    if (fs->chain.last_image_stage >= 0) {
+        fs->writer.file = fopen(file_path, "wb");
+        if (!fs->writer.file) {
+            syslog(LOG_ERR, "Failed to open file: %s\n", file_path);
+            g_set_error(&fs->error, VDO_CLIENT_ERROR, VDO_ERROR_IO, "open failed: %m");
+            return -1;
+        }
+    } else {
+        syslog(LOG_INFO, "The filter chain writes no image, stream %u is not saved", fs->index);
     }
 
     /* Initialize hash table for mapping VDO buffers to OpenCL memory objects */
-    table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    fs->table = g_hash_table_new(g_direct_hash, g_direct_equal);
 
     /*
      * Allocate space for cl memory objects. The addresses to the memory objects
      * will be stored in the hash table.
      */
-    in_images = (cl_mem*)malloc(sizeof(cl_mem) * buffer_count);
-
-    /*
-     * Allocate memory for output buffer. In this case it's more practical with
-     * a separate output buffer since we're performing a filtering operation.
-     *
-     * If possible, allocate the buffer using OpenCL, and then map up that memory
-     * to the CPU.
-     */
-    out_image = clCreateBuffer(context,
-                               CL_MEM_ALLOC_HOST_PTR,
-                               image_y_size + image_cbcr_size,
-                               NULL,
-                               &cl_ret);
-    if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Unable to create new cl out memory object: %d", cl_ret);
-        return -1;
+    fs->in_images = (cl_mem*)malloc(sizeof(cl_mem) * fs->buffer_count);
+
+    /* Allocate the output buffers, all of them are free to begin with */
+    fs->writer.free_slots    = g_async_queue_new();
+    fs->writer.pending_slots = g_async_queue_new();
+    fs->slots                = g_new0(struct output_slot, fs->pipeline_depth);
+    for (gint i = 0; i < fs->pipeline_depth; i++) {
+        if (fs->writer.file &&
+            setup_output_slot(fs->command_queue, &fs->slots[i], image_y_size, image_cbcr_size)) {
+            g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Unable to setup the output buffers");
+            return -1;
+        }
+        if (fs->chain.edge_energy)
+            fs->slots[i].energy = g_new0(cl_uint, fs->chain.energy_blocks);
+        g_async_queue_push(fs->writer.free_slots, &fs->slots[i]);
     }
-    out_data = clEnqueueMapBuffer(command_queue,
-                                  out_image,
-                                  CL_TRUE,
-                                  CL_MAP_READ,
-                                  0,
-                                  image_y_size + image_cbcr_size,
-                                  0,
-                                  NULL,
-                                  NULL,
-                                  &cl_ret);
-    if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Unable to map cl out memory object: %d", cl_ret);
-        return -1;
+
+    if (fs->chain.edge_energy) {
+        fs->writer.tamper = tamper_tracker_new(fs->index,
+                                               fs->chain.energy_blocks,
+                                               fs->chain.energy_block_pixels);
+        syslog(LOG_INFO,
+               "Tracking edge energy of stream %u in %u blocks of %u pixels",
+               fs->index,
+               fs->chain.energy_blocks,
+               fs->chain.energy_block_pixels);
     }
+    return 0;
+}
+
+/* Idle callback on the main context, run once by every stream when it is done */
+static gboolean stream_finished(gpointer data) {
+    (void)data;
+    if (g_atomic_int_dec_and_test(&streams_running))
+        g_main_loop_quit(main_loop);
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Stream thread. Fetches the frames of one stream, enqueues the filtering on
+ * the command queue of the stream and hands the frames to its writer thread.
+ */
+static gpointer filter_frames(gpointer data) {
+    struct filter_stream* fs = (struct filter_stream*)data;
+
+    /* Size of luma data in the image buffer */
+    size_t image_y_size = (size_t)fs->width * fs->height;
+    /* Size of chroma data in the image buffer */
+    size_t image_cbcr_size = image_y_size / 2;
+
+    fs->writer_thread = g_thread_new("frame-writer", write_frames, &fs->writer);
 
     /* Loop for the pre-determined number of frames */
-    for (guint n = 0; n < frames; n++) {
+    for (gint n = 0; n < fs->frames; n++) {
+        /* Wait until the writer is done with the oldest frame in flight */
+        struct output_slot* slot = g_async_queue_pop(fs->writer.free_slots);
+
+        if (g_atomic_int_get(&fs->writer.failed))
+            break;
+
+        /* Release the previous buffer of this slot and allow the server to reuse it */
+        if (slot->buffer && !vdo_stream_buffer_unref(fs->stream, &slot->buffer, &fs->error))
+            break;
+
         /* Lifetimes of buffer and frame are linked, no need to free frame */
-        VdoBuffer* buffer = vdo_stream_get_buffer(stream, &error);
-        VdoFrame* frame   = vdo_buffer_get_frame(buffer);
+        slot->buffer    = vdo_stream_get_buffer(fs->stream, &fs->error);
+        VdoFrame* frame = vdo_buffer_get_frame(slot->buffer);
 
         /* Error occurred */
         if (!frame)
-            goto exit;
+            break;
+
+        if (n == 0)
+            fs->start_time = g_get_monotonic_time();
 
         /* Get VDO frame buffer data */
-        gpointer in_data = vdo_buffer_get_data(buffer);
+        gpointer in_data = vdo_buffer_get_data(slot->buffer);
         if (!in_data) {
-            g_set_error(&error, VDO_CLIENT_ERROR, 0, "Failed to get data: %m");
-            vdo_stream_buffer_unref(stream, &buffer, NULL);
-            goto exit;
+            g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Failed to get data: %m");
+            break;
         }
 
-        /*
-         * Copying the image data to the output buffer is not always necessary,
-         * if the filtering is done over the full image area.
-         * For HALF_AREA however, we need to write the background image data
-         * as the cl program will not render a full image.
-         */
-        if (cur_render_area != FULL_AREA)
-            memcpy(out_data, in_data, image_y_size + image_cbcr_size);
-
         /*
          * Map a received VDO frame buffer with a cl memory object. A cl buffer
          * will be created for every unique VDO buffer determined by buffer_count.
          * If the frame buffer has already been mapped, re-use its assigned
          * cl buffer.
          */
-        cl_mem in_image_y;
-        if (map_input_buffer(in_data,
-                             in_images,
-                             &in_image_y,
-                             image_y_size,
-                             cur_render_area,
-                             buffer_count))
-            goto exit;
+        cl_mem in_image;
+        if (map_input_buffer(fs, in_data, &in_image, image_y_size + image_cbcr_size)) {
+            g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Unable to map the VDO buffer");
+            break;
+        }
 
-        if (do_opencl_filtering(&in_image_y,
-                                &out_image,
-                                image_width,
-                                image_height,
+        if (do_opencl_filtering(fs,
+                                &in_image,
+                                slot,
+                                fs->width,
+                                fs->height,
                                 image_y_size,
-                                image_cbcr_size))
-            goto exit;
+                                image_cbcr_size)) {
+            g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Unable to filter the frame");
+            break;
+        }
+
+        /* The writer takes it from here, fetch the next frame right away */
+        slot->frame_size = vdo_frame_get_size(frame);
+        g_async_queue_push(fs->writer.pending_slots, slot);
+        fs->frames_done++;
+
+        if (profiler) {
+            g_mutex_lock(&profiler_lock);
+            profiler_report_if_due(profiler);
+            g_mutex_unlock(&profiler_lock);
+        }
+    }
+
+    /* Let the writer finish the frames in flight */
+    g_async_queue_push(fs->writer.pending_slots, &writer_stop);
+    g_thread_join(fs->writer_thread);
+    fs->writer_thread = NULL;
+    fs->end_time      = g_get_monotonic_time();
+
+    if (!fs->error && g_atomic_int_get(&fs->writer.failed))
+        g_set_error(&fs->error, VDO_CLIENT_ERROR, 0, "Unable to write frame");
+
+    if (fs->frames_done > 1) {
+        gdouble elapsed = (fs->end_time - fs->start_time) / (gdouble)G_USEC_PER_SEC;
+        syslog(LOG_INFO,
+               "Stream %u: Filtered %u frames in %.2f s, sustained %.1f fps with pipeline depth %d",
+               fs->index,
+               fs->frames_done,
+               elapsed,
+               fs->frames_done / elapsed,
+               fs->pipeline_depth);
+    }
+
+    g_idle_add(stream_finished, NULL);
+    return NULL;
+}
+
+/* Log the combined frame rate of all streams, from the first to the last frame */
+static void report_aggregate_throughput(const struct filter_stream* streams, guint num_streams) {
+    guint frames_done = 0;
+    gint64 start_time = G_MAXINT64;
+    gint64 end_time   = 0;
+
+    for (guint i = 0; i < num_streams; i++) {
+        if (streams[i].frames_done == 0)
+            continue;
+        frames_done += streams[i].frames_done;
+        start_time = MIN(start_time, streams[i].start_time);
+        end_time   = MAX(end_time, streams[i].end_time);
+    }
+    if (frames_done <= 1 || end_time <= start_time)
+        return;
+
+    gdouble elapsed = (end_time - start_time) / (gdouble)G_USEC_PER_SEC;
+    syslog(LOG_INFO,
+           "Filtered %u frames of %u streams in %.2f s, aggregate %.1f fps",
+           frames_done,
+           num_streams,
+           elapsed,
+           frames_done / elapsed);
+}
+
+static int free_filter_stream(struct filter_stream* fs) {
+    int ret = 0;
+
+    /* The histogram is read on the command queue of the stream */
+    if (fs->chain.histogram && fs->frames_done > 0)
+        report_histogram(&fs->chain, fs->command_queue);
+
+    if (fs->slots) {
+        for (gint i = 0; i < fs->pipeline_depth; i++) {
+            if (free_output_slot(fs, &fs->slots[i]))
+                ret = -1;
+        }
+        g_free(fs->slots);
+    }
+    if (fs->writer.free_slots)
+        g_async_queue_unref(fs->writer.free_slots);
+    if (fs->writer.pending_slots)
+        g_async_queue_unref(fs->writer.pending_slots);
+    tamper_tracker_free(fs->writer.tamper);
+
+    if (fs->table)
+        hash_table_destroy(fs->table);
+
+    if (fs->in_images)
+        free(fs->in_images);
+
+    if (fs->writer.file)
+        fclose(fs->writer.file);
+
+    if (free_filter_chain(&fs->chain))
+        ret = -1;
+    if (fs->command_queue && clReleaseCommandQueue(fs->command_queue) != CL_SUCCESS) {
+        syslog(LOG_ERR, "Failed to release the command queue of stream %u", fs->index);
+        ret = -1;
+    }
 
-        if (!fwrite(out_data, vdo_frame_get_size(frame), 1, output_file)) {
-            g_set_error(&error, VDO_CLIENT_ERROR, 0, "Unable to write frame: %m");
-            vdo_stream_buffer_unref(stream, &buffer, NULL);
+    g_clear_error(&fs->error);
+    g_clear_object(&fs->stream);
+    return ret;
+}
+
+/*
+ * Check that an integer option is within min-max, naming the option otherwise.
+ */
+static gboolean check_option(const gchar* name, gint value, gint min, gint max, GError** error) {
+    if (value >= min && value <= max)
+        return TRUE;
+
+    if (max == G_MAXINT)
+        g_set_error(error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "Invalid --%s %d, must be at least %d",
+                    name,
+                    value,
+                    min);
+    else
+        g_set_error(error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "Invalid --%s %d, must be %d-%d",
+                    name,
+                    value,
+                    min,
+                    max);
+    return FALSE;
+}
+
+/*
+ * Parse regions given as "x,y,width,height". Without any region, the left half
+ * of the image is filtered.
+ */
+static gboolean parse_regions(gchar** specs,
+                              unsigned width,
+                              unsigned height,
+                              struct region* regions,
+                              guint* num_regions,
+                              GError** error) {
+    *num_regions = 0;
+
+    if (!specs || !specs[0]) {
+        regions[0]   = (struct region){0, 0, width / 2, height};
+        *num_regions = 1;
+        return TRUE;
+    }
+
+    for (guint i = 0; specs[i]; i++) {
+        struct region r;
+        gchar end;
+
+        if (*num_regions == MAX_REGIONS) {
+            g_set_error(error,
+                        VDO_CLIENT_ERROR,
+                        VDO_ERROR_INVALID_ARGUMENT,
+                        "At most %d regions can be filtered",
+                        MAX_REGIONS);
+            return FALSE;
+        }
+        if (sscanf(specs[i], "%u,%u,%u,%u%c", &r.x, &r.y, &r.width, &r.height, &end) != 4 ||
+            !r.width || !r.height || r.x % 8 || r.width % 8 || r.y % 2 || r.height % 2 ||
+            r.x + r.width > width || r.y + r.height > height) {
+            g_set_error(error,
+                        VDO_CLIENT_ERROR,
+                        VDO_ERROR_INVALID_ARGUMENT,
+                        "Invalid region %s, x and width must be multiples of 8, y and height "
+                        "multiples of 2, inside %ux%u",
+                        specs[i],
+                        width,
+                        height);
+            return FALSE;
+        }
+        regions[(*num_regions)++] = r;
+    }
+    return TRUE;
+}
+
+/**
+ * Main function that starts one or more streams with the following options:
+ *
+ * --frames [number of frames per stream]
+ * --pipeline-depth [number of output buffers in flight, 1 to 8]
+ * --kernel [comma separated chain of filter kernels]
+ * --region [x,y,width,height, may be repeated]
+ * --streams [number of streams filtered concurrently, 1 to 4]
+ * --retune
+ * --profile [seconds between reports, 0 to disable]
+ * --benchmark
+ */
+int main(int argc, char* argv[]) {
+    GError* error                 = NULL;
+    GOptionContext* option_ctx    = NULL;
+    struct filter_stream* streams = NULL;
+    gboolean opencl_initialized   = FALSE;
+
+    /* VDO stream dimensions */
+    const unsigned image_width  = 1280;
+    const unsigned image_height = 720;
+    gint frames                 = 5; /* Number of frames to process per stream */
+    gint pipeline_depth         = 1; /* Number of output buffers in flight per stream */
+    gint num_streams            = 1; /* Number of streams filtered concurrently */
+
+    /* Render settings specific for this example */
+    gchar* kernel_name    = FILTER_SOBEL_3X3;
+    gchar** region_specs  = NULL;
+    gboolean retune       = FALSE;
+    gint profile_interval = 0;
+    gboolean benchmark    = FALSE;
+    struct region regions[MAX_REGIONS];
+    guint num_regions = 0;
+
+    GOptionEntry options[] = {
+        {"frames", 'n', 0, G_OPTION_ARG_INT, &frames, "number of frames", NULL},
+        {"pipeline-depth",
+         'p',
+         0,
+         G_OPTION_ARG_INT,
+         &pipeline_depth,
+         "number of output buffers in flight (1-8)",
+         NULL},
+        {"kernel",
+         'k',
+         0,
+         G_OPTION_ARG_STRING,
+         &kernel_name,
+         "comma separated chain of filter kernels, e.g. gaussian_5x5,sobel_3x3",
+         NULL},
+        {"region",
+         'R',
+         0,
+         G_OPTION_ARG_STRING_ARRAY,
+         &region_specs,
+         "region to filter as x,y,width,height, may be repeated (default: left half)",
+         NULL},
+        {"streams",
+         's',
+         0,
+         G_OPTION_ARG_INT,
+         &num_streams,
+         "number of streams filtered concurrently on one OpenCL context (1-4)",
+         NULL},
+        {"retune",
+         'r',
+         0,
+         G_OPTION_ARG_NONE,
+         &retune,
+         "benchmark local work sizes even if a tuned size is cached",
+         NULL},
+        {"profile",
+         'P',
+         0,
+         G_OPTION_ARG_INT,
+         &profile_interval,
+         "profile OpenCL commands, reporting every given number of seconds",
+         NULL},
+        {"benchmark",
+         'b',
+         0,
+         G_OPTION_ARG_NONE,
+         &benchmark,
+         "benchmark every filter kernel at 720p and 1080p, then exit",
+         NULL},
+        {
+            NULL,
+            0,
+            0,
+            0,
+            NULL,
+            NULL,
+            NULL,
+        }};
+
+    /* Open connection to syslog */
+    openlog(NULL, LOG_PID, LOG_USER);
+
+    option_ctx = g_option_context_new("");
+    g_option_context_set_summary(option_ctx, "OpenCL filtering of VDO frames");
+    g_option_context_add_main_entries(option_ctx, options, NULL);
+    if (!g_option_context_parse(option_ctx, &argc, &argv, &error))
+        goto exit;
+
+    if (!check_option("frames", frames, 0, G_MAXINT, &error) ||
+        !check_option("pipeline-depth", pipeline_depth, 1, MAX_PIPELINE_DEPTH, &error) ||
+        !check_option("streams", num_streams, 1, MAX_STREAMS, &error) ||
+        !check_option("profile", profile_interval, 0, G_MAXINT, &error))
+        goto exit;
+
+    if (!parse_regions(region_specs, image_width, image_height, regions, &num_regions, &error))
+        goto exit;
+
+    /* Benchmark the filter kernels on device buffers, no stream is needed */
+    if (benchmark) {
+        if (setup_opencl(profile_interval)) {
+            syslog(LOG_ERR, "Unable to setup OpenCL");
             goto exit;
         }
+        opencl_initialized = TRUE;
+
+        if (run_benchmarks())
+            g_set_error(&error, VDO_CLIENT_ERROR, 0, "Unable to benchmark all filter kernels");
+        goto exit;
+    }
 
-        /* Release the buffer and allow the server to reuse it */
-        if (!vdo_stream_buffer_unref(stream, &buffer, &error))
+    /* Set up OpenCL, the context and program are shared by all streams */
+    if (setup_opencl(profile_interval)) {
+        syslog(LOG_ERR, "Unable to setup OpenCL");
+        goto exit;
+    }
+    opencl_initialized = TRUE;
+
+    /* Streams are set up one at a time, so autotuning runs on an idle device */
+    main_loop = g_main_loop_new(NULL, FALSE);
+    streams   = g_new0(struct filter_stream, num_streams);
+    for (gint i = 0; i < num_streams; i++) {
+        struct filter_stream* fs = &streams[i];
+
+        fs->index                  = i;
+        fs->width                  = image_width;
+        fs->height                 = image_height;
+        fs->frames                 = frames;
+        fs->pipeline_depth         = pipeline_depth;
+        fs->chain.last_image_stage = -1;
+
+        if (setup_filter_stream(fs, kernel_name, regions, num_regions, retune, num_streams)) {
+            g_propagate_error(&error, fs->error);
+            fs->error = NULL;
             goto exit;
+        }
     }
 
+    syslog(LOG_INFO,
+           "Filtering %d frames in each of %d streams with pipeline depth %d",
+           frames,
+           num_streams,
+           pipeline_depth);
+
+    streams_running = num_streams;
+    for (gint i = 0; i < num_streams; i++)
+        streams[i].thread = g_thread_new("filter-stream", filter_frames, &streams[i]);
+
+    /* Tamper events are declared and sent from the main context until the streams are done */
+    g_main_loop_run(main_loop);
+
 exit:
+    if (streams) {
+        for (gint i = 0; i < num_streams; i++) {
+            if (!streams[i].thread)
+                continue;
+            g_thread_join(streams[i].thread);
+            streams[i].thread = NULL;
+
+            /* Ignore expected error */
+            if (vdo_error_is_expected(&streams[i].error))
+                g_clear_error(&streams[i].error);
+            if (streams[i].error && !error) {
+                g_propagate_error(&error, streams[i].error);
+                streams[i].error = NULL;
+            }
+        }
+        if (num_streams > 1)
+            report_aggregate_throughput(streams, num_streams);
+    }
+
+    /* Report the whole run while the command queues are still alive */
+    profiler_free(profiler);
+    profiler = NULL;
+
     /* Ignore expected error */
     if (vdo_error_is_expected(&error))
         g_clear_error(&error);
 
-    cl_ret = clEnqueueUnmapMemObject(command_queue, out_image, out_data, 0, NULL, NULL);
-    if (cl_ret != CL_SUCCESS) {
-        syslog(LOG_ERR, "Unable to unmap cl memory object: %d", cl_ret);
-        return -1;
-    }
-
-    hash_table_destroy();
+    gint ret = EXIT_SUCCESS;
 
-    if (in_images)
-        free(in_images);
+    if (streams) {
+        for (gint i = 0; i < num_streams; i++) {
+            if (free_filter_stream(&streams[i]))
+                ret = EXIT_FAILURE;
+        }
+        g_free(streams);
+    }
 
-    gint ret = EXIT_SUCCESS;
     if (error) {
         syslog(LOG_INFO, "vdo-encode-client: %s", error->message);
         ret = EXIT_FAILURE;
     }
 
-    if (output_file)
-        fclose(output_file);
-
-    if (free_opencl() != 0) {
+    if (opencl_initialized && free_opencl() != 0) {
         syslog(LOG_ERR, "Unable to clean up opencl");
         ret = EXIT_FAILURE;
     }
 
+    if (main_loop)
+        g_main_loop_unref(main_loop);
+    if (option_ctx)
+        g_option_context_free(option_ctx);
+    g_strfreev(region_specs);
+
     g_clear_error(&error);
-    g_clear_object(&stream);
     return ret;
 }
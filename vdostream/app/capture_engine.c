@@ -0,0 +1,230 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file captures frames from several VDO streams on one thread.
+ *
+ * Each stream is created non-blocking, and its file descriptor is added to
+ * one epoll instance. When a descriptor becomes readable, the buffers ready
+ * on that stream are fetched until the stream reports that there is no more
+ * data, and each is passed to the handler of the stream. No thread is needed
+ * per stream, and an idle stream costs nothing.
+ *
+ * The CPU time of the capture thread is measured, both in total and inside
+ * the handlers, and logged periodically. The difference is the overhead of
+ * capturing itself.
+ */
+
+#include "capture_engine.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vdo-error.h"
+
+// Ready descriptors handled per wakeup
+#define MAX_EVENTS 16
+
+// Wake up at least this often to check for interruption
+#define POLL_TIMEOUT_MS 1000
+
+// Throughput and CPU use are logged this often
+#define REPORT_INTERVAL_USEC (10 * G_USEC_PER_SEC)
+
+struct capture_source {
+    VdoStream* stream;
+    capture_handler handler;
+    gpointer user_data;
+    guint64 frames;
+};
+
+struct capture_engine {
+    gint epoll_fd;
+    GPtrArray* sources;
+    gboolean stopped;
+
+    // CPU time of the capture thread spent in handlers, and the current report interval
+    gint64 handler_cpu;
+    guint64 frames;
+    gint64 report_time;
+    gint64 report_cpu;
+    gint64 report_handler_cpu;
+    guint64 report_frames;
+};
+
+static gint64 thread_cpu_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_nsec / 1000;
+}
+
+static void start_report(struct capture_engine* engine) {
+    engine->report_time        = g_get_monotonic_time();
+    engine->report_cpu         = thread_cpu_time();
+    engine->report_handler_cpu = engine->handler_cpu;
+    engine->report_frames      = engine->frames;
+}
+
+static void report_if_due(struct capture_engine* engine) {
+    gint64 elapsed = g_get_monotonic_time() - engine->report_time;
+    if (elapsed < REPORT_INTERVAL_USEC)
+        return;
+
+    gint64 cpu         = thread_cpu_time() - engine->report_cpu;
+    gint64 handler_cpu = engine->handler_cpu - engine->report_handler_cpu;
+    syslog(LOG_INFO,
+           "Captured %.1f frames/s from %u streams, capture thread at %.1f%% CPU, "
+           "%.1f%% of it outside the frame handlers",
+           (engine->frames - engine->report_frames) * (double)G_USEC_PER_SEC / elapsed,
+           engine->sources->len,
+           cpu * 100.0 / elapsed,
+           (cpu - handler_cpu) * 100.0 / elapsed);
+    start_report(engine);
+}
+
+void capture_engine_configure(VdoMap* settings) {
+    vdo_map_set_boolean(settings, "socket.blocking", FALSE);
+}
+
+struct capture_engine* capture_engine_new(GError** error) {
+    gint epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to create epoll instance: %s",
+                    g_strerror(errno));
+        return NULL;
+    }
+
+    struct capture_engine* engine = g_new0(struct capture_engine, 1);
+    engine->epoll_fd              = epoll_fd;
+    engine->sources               = g_ptr_array_new_with_free_func(g_free);
+    return engine;
+}
+
+gboolean capture_engine_add(struct capture_engine* engine,
+                            VdoStream* stream,
+                            capture_handler handler,
+                            gpointer user_data,
+                            GError** error) {
+    gint fd = vdo_stream_get_fd(stream, error);
+    if (fd < 0)
+        return FALSE;
+
+    struct capture_source* source = g_new0(struct capture_source, 1);
+    source->stream                = stream;
+    source->handler               = handler;
+    source->user_data             = user_data;
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = source};
+    if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to watch stream: %s",
+                    g_strerror(errno));
+        g_free(source);
+        return FALSE;
+    }
+
+    g_ptr_array_add(engine->sources, source);
+    return TRUE;
+}
+
+// Fetch and handle the buffers ready on a stream, without blocking
+static gboolean drain(struct capture_engine* engine,
+                      struct capture_source* source,
+                      GError** error) {
+    while (!engine->stopped) {
+        GError* fetch_error = NULL;
+        VdoBuffer* buffer   = vdo_stream_get_buffer(source->stream, &fetch_error);
+        if (!buffer) {
+            // Nothing more until the descriptor is readable again
+            if (g_error_matches(fetch_error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
+                g_clear_error(&fetch_error);
+                return TRUE;
+            }
+            g_propagate_error(error, fetch_error);
+            return FALSE;
+        }
+
+        source->frames++;
+        engine->frames++;
+
+        gint64 start = thread_cpu_time();
+        gboolean ret = source->handler(source->stream, buffer, source->user_data, error);
+        engine->handler_cpu += thread_cpu_time() - start;
+        if (!ret)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean capture_engine_run(struct capture_engine* engine,
+                            const volatile gboolean* interrupted,
+                            GError** error) {
+    struct epoll_event events[MAX_EVENTS];
+
+    engine->stopped = FALSE;
+    start_report(engine);
+
+    while (!engine->stopped && !*interrupted) {
+        gint count = epoll_wait(engine->epoll_fd, events, MAX_EVENTS, POLL_TIMEOUT_MS);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(error,
+                        G_FILE_ERROR,
+                        g_file_error_from_errno(errno),
+                        "Failed to wait for frames: %s",
+                        g_strerror(errno));
+            return FALSE;
+        }
+
+        for (gint i = 0; i < count && !engine->stopped && !*interrupted; i++) {
+            if (!drain(engine, events[i].data.ptr, error))
+                return FALSE;
+        }
+        report_if_due(engine);
+    }
+    return TRUE;
+}
+
+void capture_engine_stop(struct capture_engine* engine) {
+    engine->stopped = TRUE;
+}
+
+void capture_engine_free(struct capture_engine* engine) {
+    if (!engine)
+        return;
+
+    for (guint i = 0; i < engine->sources->len; i++) {
+        struct capture_source* source = g_ptr_array_index(engine->sources, i);
+        syslog(LOG_INFO,
+               "Stream %u: captured %" G_GUINT64_FORMAT " frames",
+               vdo_stream_get_id(source->stream),
+               source->frames);
+    }
+
+    close(engine->epoll_fd);
+    g_ptr_array_unref(engine->sources);
+    g_free(engine);
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file captures frames from any number of VDO streams on one
+ * thread, waiting on the file descriptors of all streams with epoll.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "vdo-map.h"
+#include "vdo-stream.h"
+
+struct capture_engine;
+
+/**
+ * brief Handle a captured frame.
+ *
+ * The handler takes over the buffer, and has to release it.
+ *
+ * param stream Stream the frame is from.
+ * param buffer VDO buffer holding the frame.
+ * param user_data User data given when adding the stream.
+ * param error Set on failure.
+ * return FALSE on failure, which stops capturing, otherwise TRUE.
+ */
+typedef gboolean (*capture_handler)(VdoStream* stream,
+                                    VdoBuffer* buffer,
+                                    gpointer user_data,
+                                    GError** error);
+
+/**
+ * brief Prepare the settings of a stream to be captured.
+ *
+ * Makes fetching a buffer return at once when none is ready.
+ *
+ * param settings Settings the stream will be created with.
+ */
+void capture_engine_configure(VdoMap* settings);
+
+/**
+ * brief Create a capture engine.
+ *
+ * param error Set on failure.
+ * return The capture engine, or NULL on failure.
+ */
+struct capture_engine* capture_engine_new(GError** error);
+
+/**
+ * brief Capture frames from a started stream.
+ *
+ * param engine A capture engine.
+ * param stream Stream created with settings from capture_engine_configure().
+ * param handler Function called for each frame.
+ * param user_data User data passed to the handler.
+ * param error Set on failure.
+ * return FALSE on failure, otherwise TRUE.
+ */
+gboolean capture_engine_add(struct capture_engine* engine,
+                            VdoStream* stream,
+                            capture_handler handler,
+                            gpointer user_data,
+                            GError** error);
+
+/**
+ * brief Capture frames until stopped, interrupted or a handler fails.
+ *
+ * param engine A capture engine.
+ * param interrupted Flag checked between frames, set by a signal handler.
+ * param error Set on failure.
+ * return FALSE on failure, otherwise TRUE.
+ */
+gboolean capture_engine_run(struct capture_engine* engine,
+                            const volatile gboolean* interrupted,
+                            GError** error);
+
+/**
+ * brief Make capture_engine_run() return once the current handler returns.
+ *
+ * param engine A capture engine.
+ */
+void capture_engine_stop(struct capture_engine* engine);
+
+/**
+ * brief Log the frames captured from each stream, and free the engine.
+ *
+ * param engine A capture engine, may be NULL.
+ */
+void capture_engine_free(struct capture_engine* engine);
@@ -0,0 +1,594 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file records event clips from encoded frames kept in memory.
+ *
+ * Frames are copied into a byte ring of fixed size, with an index next to it
+ * sized from the pre-event time and the frame rate, so memory use does not
+ * depend on the stream. If either fills up before the pre-event time, a
+ * warning is logged, as clips then start later than asked for. The ring always
+ * starts at a keyframe: when room is needed, or the oldest frames are older
+ * than the pre-event time, a whole GOP is dropped at once. A clip can thus
+ * be decoded from its first frame, without re-encoding anything.
+ *
+ * When the event is triggered, everything in the ring is copied out at once,
+ * with at most two copies since frames are stored back to back. The following
+ * frames are copied as they arrive, until the post-event time after the last
+ * event has passed. Opening, writing, syncing and closing the clip all happen
+ * on a writer thread, so the capture thread never waits on storage. If the
+ * writer falls more than twice the ring behind, frames are dropped up to the
+ * next keyframe.
+ *
+ * Clips are named after the time of the event down to the millisecond, and
+ * never replace an existing file: a clip whose name is taken gets a number
+ * appended.
+ */
+
+#include "event_recorder.h"
+
+#include <axsdk/axevent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+// Clips with a taken name get a number appended, up to this one
+#define MAX_NAME_SUFFIX 100
+
+// The frame index holds the pre-event time and this much more, for the GOP that starts before it
+#define GOP_MARGIN_SECONDS 10
+
+// Frame rate the index is sized for when the stream does not tell
+#define DEFAULT_FRAMERATE 60
+
+// Most frames in the index, whatever the settings
+#define MAX_FRAMES (1024 * 1024)
+
+// Frame kept in memory, offset is a position in the byte ring that only increases
+struct ring_frame {
+    gsize offset;
+    gsize size;
+    guint64 timestamp;
+    gboolean sync;
+};
+
+enum clip_job_type { CLIP_OPEN = 0, CLIP_WRITE, CLIP_CLOSE, CLIP_STOP };
+
+// Work for the writer thread, the name for CLIP_OPEN and the frames for CLIP_WRITE
+struct clip_job {
+    enum clip_job_type type;
+    gchar* name;
+    GByteArray* data;
+};
+
+struct event_recorder {
+    enum event_trigger trigger;
+    AXEventHandler* event_handler;
+    guint subscription;
+
+    gchar* dir;
+    gchar* extension;
+    guint64 pre_usec;
+    guint64 post_usec;
+
+    // Frames from tail to head, the oldest one a keyframe
+    guint8* ring;
+    gsize capacity;
+    gsize head;
+    gsize tail;
+    struct ring_frame* frames;
+    guint max_frames;
+    guint first;
+    guint count;
+    gboolean warned_full;
+
+    // Set by the event callback, handled with the next frame
+    gboolean triggered;
+
+    // Clip state of the capture thread
+    gboolean clip_open;
+    gboolean clip_started;
+    gboolean await_keyframe;
+    guint64 clip_end;
+    guint frames_dropped;
+
+    // Clips written by the writer thread
+    GThread* thread;
+    GAsyncQueue* jobs;
+    atomic_size_t queued_bytes;
+    atomic_int failed;
+    GError* write_error;
+    gint clip_fd;
+    gchar* clip_path;
+};
+
+static gboolean is_sync(VdoFrameType type) {
+    return type == VDO_FRAME_TYPE_H264_IDR || type == VDO_FRAME_TYPE_H265_IDR ||
+           type == VDO_FRAME_TYPE_H264_I || type == VDO_FRAME_TYPE_H265_I ||
+           type == VDO_FRAME_TYPE_JPEG || type == VDO_FRAME_TYPE_YUV;
+}
+
+static struct ring_frame* frame_at(struct event_recorder* recorder, guint index) {
+    return &recorder->frames[(recorder->first + index) % recorder->max_frames];
+}
+
+// Drop the oldest frames, up to the next keyframe
+static void drop_oldest_gop(struct event_recorder* recorder) {
+    do {
+        recorder->first = (recorder->first + 1) % recorder->max_frames;
+        recorder->count--;
+    } while (recorder->count && !frame_at(recorder, 0)->sync);
+
+    recorder->tail = recorder->count ? frame_at(recorder, 0)->offset : recorder->head;
+}
+
+// Drop the oldest GOP as long as the GOP after it starts before the pre-event time
+static void drop_expired(struct event_recorder* recorder, guint64 now) {
+    while (recorder->count) {
+        guint next = 1;
+        while (next < recorder->count && !frame_at(recorder, next)->sync)
+            next++;
+        if (next == recorder->count ||
+            frame_at(recorder, next)->timestamp + recorder->pre_usec > now)
+            return;
+        drop_oldest_gop(recorder);
+    }
+}
+
+static void keep_frame(struct event_recorder* recorder,
+                       const guint8* data,
+                       gsize size,
+                       guint64 timestamp,
+                       gboolean sync) {
+    if (size > recorder->capacity) {
+        recorder->count = 0;
+        recorder->tail  = recorder->head;
+        return;
+    }
+
+    // Frames still within the pre-event time are dropped, the clips get shorter
+    while (recorder->count && (recorder->head - recorder->tail + size > recorder->capacity ||
+                               recorder->count == recorder->max_frames)) {
+        if (!recorder->warned_full) {
+            syslog(LOG_WARNING,
+                   "%s, keeping less than %u s before an event",
+                   recorder->count == recorder->max_frames ? "More frames than the index holds"
+                                                           : "More frames than the buffer holds",
+                   (guint)(recorder->pre_usec / G_USEC_PER_SEC));
+            recorder->warned_full = TRUE;
+        }
+        drop_oldest_gop(recorder);
+    }
+
+    // Without the start of its GOP the frame cannot be decoded
+    if (!sync && !recorder->count)
+        return;
+
+    gsize offset = recorder->head % recorder->capacity;
+    gsize first  = MIN(size, recorder->capacity - offset);
+    memcpy(recorder->ring + offset, data, first);
+    memcpy(recorder->ring, data + first, size - first);
+
+    *frame_at(recorder, recorder->count++) =
+        (struct ring_frame){recorder->head, size, timestamp, sync};
+    recorder->head += size;
+
+    drop_expired(recorder, timestamp);
+}
+
+static gboolean write_all(struct event_recorder* recorder, const GByteArray* data) {
+    const guint8* bytes = data->data;
+    gsize size          = data->len;
+
+    while (size) {
+        ssize_t written = write(recorder->clip_fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(&recorder->write_error,
+                        G_FILE_ERROR,
+                        g_file_error_from_errno(errno),
+                        "Failed to write %s: %s",
+                        recorder->clip_path,
+                        g_strerror(errno));
+            return FALSE;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return TRUE;
+}
+
+// Create a clip, appending a number to the name as long as it is taken
+static gboolean open_clip(struct event_recorder* recorder, const gchar* name) {
+    for (guint suffix = 0; suffix <= MAX_NAME_SUFFIX; suffix++) {
+        gchar* file = suffix ? g_strdup_printf("%s-%u.%s", name, suffix, recorder->extension)
+                             : g_strdup_printf("%s.%s", name, recorder->extension);
+
+        recorder->clip_path = g_build_filename(recorder->dir, file, NULL);
+        g_free(file);
+        recorder->clip_fd =
+            g_open(recorder->clip_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (recorder->clip_fd >= 0) {
+            syslog(LOG_INFO, "Writing event clip %s", recorder->clip_path);
+            return TRUE;
+        }
+        if (errno != EEXIST)
+            break;
+        g_clear_pointer(&recorder->clip_path, g_free);
+    }
+
+    g_set_error(&recorder->write_error,
+                G_FILE_ERROR,
+                g_file_error_from_errno(errno),
+                "Failed to create a clip named %s in %s: %s",
+                name,
+                recorder->dir,
+                g_strerror(errno));
+    g_clear_pointer(&recorder->clip_path, g_free);
+    return FALSE;
+}
+
+static void close_clip(struct event_recorder* recorder) {
+    if (recorder->clip_fd < 0)
+        return;
+
+    syslog(LOG_INFO, "Closed event clip %s", recorder->clip_path);
+    fsync(recorder->clip_fd);
+    close(recorder->clip_fd);
+    recorder->clip_fd = -1;
+    g_clear_pointer(&recorder->clip_path, g_free);
+}
+
+static void free_job(struct clip_job* job) {
+    g_free(job->name);
+    if (job->data)
+        g_byte_array_unref(job->data);
+    g_free(job);
+}
+
+// Run the queued jobs until stopped, discarding them once one has failed
+static gpointer write_clips(gpointer data) {
+    struct event_recorder* recorder = (struct event_recorder*)data;
+    gboolean stopping               = FALSE;
+
+    while (!stopping) {
+        struct clip_job* job = g_async_queue_pop(recorder->jobs);
+        gboolean ok          = TRUE;
+
+        if (job->data)
+            atomic_fetch_sub(&recorder->queued_bytes, job->data->len);
+        if (atomic_load(&recorder->failed)) {
+            free_job(job);
+            continue;
+        }
+
+        switch (job->type) {
+            case CLIP_OPEN:
+                ok = open_clip(recorder, job->name);
+                break;
+            case CLIP_WRITE:
+                ok = write_all(recorder, job->data);
+                break;
+            case CLIP_CLOSE:
+                close_clip(recorder);
+                break;
+            case CLIP_STOP:
+                close_clip(recorder);
+                stopping = TRUE;
+                break;
+        }
+        if (!ok) {
+            syslog(LOG_ERR, "%s", recorder->write_error->message);
+            close_clip(recorder);
+            atomic_store(&recorder->failed, TRUE);
+        }
+        free_job(job);
+    }
+    return NULL;
+}
+
+static void queue_job(struct event_recorder* recorder,
+                      enum clip_job_type type,
+                      gchar* name,
+                      GByteArray* data) {
+    struct clip_job* job = g_new0(struct clip_job, 1);
+
+    job->type = type;
+    job->name = name;
+    job->data = data;
+    if (data)
+        atomic_fetch_add(&recorder->queued_bytes, data->len);
+    g_async_queue_push(recorder->jobs, job);
+}
+
+// Queue a new clip, named after the time of the event, with all frames kept in memory
+static void start_clip(struct event_recorder* recorder) {
+    GDateTime* now = g_date_time_new_now_local();
+    gchar* date    = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gint msec      = g_date_time_get_microsecond(now) / 1000;
+    gchar* name    = g_strdup_printf("event-%s.%03d", date, msec);
+    g_date_time_unref(now);
+    g_free(date);
+
+    recorder->clip_open      = TRUE;
+    recorder->clip_started   = recorder->count > 0;
+    recorder->await_keyframe = FALSE;
+    recorder->frames_dropped = 0;
+    syslog(LOG_INFO,
+           "Event triggered, writing %u frames (%.1f s) before it to %s in %s",
+           recorder->count,
+           recorder->count ? (frame_at(recorder, recorder->count - 1)->timestamp -
+                              frame_at(recorder, 0)->timestamp) /
+                                 (double)G_USEC_PER_SEC
+                           : 0.0,
+           name,
+           recorder->dir);
+    queue_job(recorder, CLIP_OPEN, name, NULL);
+
+    // The frames are back to back, wrapping at most once
+    gsize offset       = recorder->tail % recorder->capacity;
+    gsize size         = recorder->head - recorder->tail;
+    gsize first        = MIN(size, recorder->capacity - offset);
+    GByteArray* frames = g_byte_array_sized_new(size);
+    g_byte_array_append(frames, recorder->ring + offset, first);
+    g_byte_array_append(frames, recorder->ring, size - first);
+    queue_job(recorder, CLIP_WRITE, NULL, frames);
+}
+
+static void end_clip(struct event_recorder* recorder) {
+    if (!recorder->clip_open)
+        return;
+
+    if (recorder->frames_dropped)
+        syslog(LOG_WARNING,
+               "Dropped %u frames of the event clip, storage is too slow",
+               recorder->frames_dropped);
+    recorder->clip_open = FALSE;
+    queue_job(recorder, CLIP_CLOSE, NULL, NULL);
+}
+
+// Queue a frame of the clip, dropping frames up to the next keyframe when storage falls behind
+static void queue_frame(struct event_recorder* recorder,
+                        gconstpointer data,
+                        gsize size,
+                        gboolean sync) {
+    if (sync)
+        recorder->await_keyframe = FALSE;
+    if (recorder->await_keyframe ||
+        atomic_load(&recorder->queued_bytes) + size > 2 * recorder->capacity) {
+        recorder->await_keyframe = TRUE;
+        recorder->frames_dropped++;
+        return;
+    }
+
+    GByteArray* frame = g_byte_array_sized_new(size);
+    g_byte_array_append(frame, data, size);
+    queue_job(recorder, CLIP_WRITE, NULL, frame);
+}
+
+gboolean event_recorder_push(struct event_recorder* recorder,
+                             VdoFrame* frame,
+                             gconstpointer data,
+                             GError** error) {
+    guint64 timestamp = vdo_frame_get_timestamp(frame);
+    gsize size        = vdo_frame_get_size(frame);
+    gboolean sync     = is_sync(vdo_frame_get_frame_type(frame));
+
+    if (atomic_load(&recorder->failed)) {
+        g_propagate_error(error, g_error_copy(recorder->write_error));
+        return FALSE;
+    }
+
+    keep_frame(recorder, data, size, timestamp, sync);
+
+    // Another event during a clip extends it
+    if (recorder->triggered) {
+        recorder->triggered = FALSE;
+        recorder->clip_end  = timestamp + recorder->post_usec;
+        if (!recorder->clip_open) {
+            start_clip(recorder);
+            return TRUE;
+        }
+    }
+
+    if (!recorder->clip_open)
+        return TRUE;
+
+    // A clip triggered before the first keyframe starts at the next one
+    if (!recorder->clip_started && !sync)
+        return TRUE;
+    recorder->clip_started = TRUE;
+
+    queue_frame(recorder, data, size, sync);
+
+    if (timestamp >= recorder->clip_end)
+        end_clip(recorder);
+    return TRUE;
+}
+
+/**
+ * brief Callback function which is called when the subscribed event occurs.
+ *
+ * The manual trigger is stateful, and only starts or extends a clip when it
+ * becomes active. Tampering is stateless, and always does.
+ *
+ * param subscription Subscription id.
+ * param event Subscribed event.
+ * param recorder Event recorder as user data.
+ */
+static void event_callback(guint subscription, AXEvent* event, struct event_recorder* recorder) {
+    const AXEventKeyValueSet* key_value_set = ax_event_get_key_value_set(event);
+    gboolean state                          = TRUE;
+
+    // The subscription id is not used
+    (void)subscription;
+
+    if (recorder->trigger == EVENT_TRIGGER_MANUAL)
+        ax_event_key_value_set_get_boolean(key_value_set, "state", NULL, &state, NULL);
+    if (state)
+        recorder->triggered = TRUE;
+
+    /*
+     * Free the received event, n.b. AXEventKeyValueSet should not be freed
+     * since it's owned by the event system until unsubscribing
+     */
+    ax_event_free(event);
+}
+
+static gboolean subscribe(struct event_recorder* recorder, GError** error) {
+    AXEventKeyValueSet* key_value_set = ax_event_key_value_set_new();
+    gint port                         = 1;
+    gint channel                      = 1;
+
+    if (recorder->trigger == EVENT_TRIGGER_MANUAL) {
+        /* Initialize an AXEventKeyValueSet that matches the manual trigger event.
+         *
+         *    tns1:topic0=Device
+         * tnsaxis:topic1=IO
+         * tnsaxis:topic2=VirtualPort
+         *           port=&port    <-- Subscribe to port number 1
+         *          state=NULL     <-- Subscribe to all states
+         */
+        ax_event_key_value_set_add_key_values(key_value_set,
+                                              NULL,
+                                              "topic0",
+                                              "tns1",
+                                              "Device",
+                                              AX_VALUE_TYPE_STRING,
+                                              "topic1",
+                                              "tnsaxis",
+                                              "IO",
+                                              AX_VALUE_TYPE_STRING,
+                                              "topic2",
+                                              "tnsaxis",
+                                              "VirtualPort",
+                                              AX_VALUE_TYPE_STRING,
+                                              "port",
+                                              NULL,
+                                              &port,
+                                              AX_VALUE_TYPE_INT,
+                                              "state",
+                                              NULL,
+                                              NULL,
+                                              AX_VALUE_TYPE_BOOL,
+                                              NULL);
+    } else {
+        /* Initialize an AXEventKeyValueSet that matches the tampering event.
+         *
+         *    tns1:topic0=VideoSource
+         * tnsaxis:topic1=Tampering
+         *        channel=&channel    <-- Subscribe to channel number 1
+         *      tampering=NULL        <-- Subscribe to all values
+         */
+        ax_event_key_value_set_add_key_values(key_value_set,
+                                              NULL,
+                                              "topic0",
+                                              "tns1",
+                                              "VideoSource",
+                                              AX_VALUE_TYPE_STRING,
+                                              "topic1",
+                                              "tnsaxis",
+                                              "Tampering",
+                                              AX_VALUE_TYPE_STRING,
+                                              "channel",
+                                              NULL,
+                                              &channel,
+                                              AX_VALUE_TYPE_INT,
+                                              "tampering",
+                                              NULL,
+                                              NULL,
+                                              AX_VALUE_TYPE_INT,
+                                              NULL);
+    }
+
+    gboolean ret = ax_event_handler_subscribe(recorder->event_handler,
+                                              key_value_set,
+                                              &recorder->subscription,
+                                              (AXSubscriptionCallback)event_callback,
+                                              recorder,
+                                              error);
+    ax_event_key_value_set_free(key_value_set);
+    return ret;
+}
+
+struct event_recorder* event_recorder_new(enum event_trigger trigger,
+                                          const gchar* dir,
+                                          const gchar* extension,
+                                          guint pre_seconds,
+                                          guint post_seconds,
+                                          guint framerate,
+                                          gsize buffer_size,
+                                          GError** error) {
+    struct event_recorder* recorder = g_new0(struct event_recorder, 1);
+
+    // Room for the pre-event time, and for the GOP that started before it
+    guint64 max_frames = ((guint64)pre_seconds + GOP_MARGIN_SECONDS) *
+                         (framerate ? framerate : DEFAULT_FRAMERATE);
+
+    recorder->trigger       = trigger;
+    recorder->dir           = g_strdup(dir);
+    recorder->extension     = g_strdup(extension);
+    recorder->pre_usec      = (guint64)pre_seconds * G_USEC_PER_SEC;
+    recorder->post_usec     = (guint64)post_seconds * G_USEC_PER_SEC;
+    recorder->capacity      = buffer_size;
+    recorder->ring          = g_malloc(buffer_size);
+    recorder->max_frames    = MIN(max_frames, MAX_FRAMES);
+    recorder->frames        = g_new(struct ring_frame, recorder->max_frames);
+    recorder->clip_fd       = -1;
+    recorder->jobs          = g_async_queue_new();
+    recorder->thread        = g_thread_new("event-clip-writer", write_clips, recorder);
+    recorder->event_handler = ax_event_handler_new();
+
+    if (!subscribe(recorder, error)) {
+        event_recorder_free(recorder);
+        return NULL;
+    }
+
+    syslog(LOG_INFO,
+           "Keeping %u s in %zu bytes and %u frames, writing clips of events to %s",
+           pre_seconds,
+           buffer_size,
+           recorder->max_frames,
+           dir);
+    return recorder;
+}
+
+void event_recorder_free(struct event_recorder* recorder) {
+    if (!recorder)
+        return;
+
+    if (recorder->subscription)
+        ax_event_handler_unsubscribe(recorder->event_handler, recorder->subscription, NULL);
+    ax_event_handler_free(recorder->event_handler);
+
+    // The current clip is written completely before the writer thread stops
+    end_clip(recorder);
+    queue_job(recorder, CLIP_STOP, NULL, NULL);
+    g_thread_join(recorder->thread);
+    g_async_queue_unref(recorder->jobs);
+    g_clear_error(&recorder->write_error);
+
+    g_free(recorder->ring);
+    g_free(recorder->frames);
+    g_free(recorder->dir);
+    g_free(recorder->extension);
+    g_free(recorder);
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file keeps the last seconds of encoded frames in memory, and
+ * writes them to a clip together with the following seconds when an event is
+ * triggered. Clips are written from a thread of their own.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "vdo-frame.h"
+
+enum event_trigger {
+    // Device/IO/VirtualPort, the manual trigger, becoming active
+    EVENT_TRIGGER_MANUAL = 0,
+    // VideoSource/Tampering
+    EVENT_TRIGGER_TAMPERING,
+};
+
+struct event_recorder;
+
+/**
+ * brief Subscribe to an event, start keeping frames in memory and start the
+ * clip writer thread.
+ *
+ * Events are delivered through the default main context, which the caller
+ * has to iterate.
+ *
+ * param trigger Event that starts a clip.
+ * param dir Directory the clips are written to.
+ * param extension File name extension of the clips.
+ * param pre_seconds Seconds kept in memory before an event.
+ * param post_seconds Seconds written after the last event of a clip.
+ * param framerate Frames per second of the stream, which the frame index is sized from, 0 if
+ *                 not known.
+ * param buffer_size Bytes of frames kept in memory, at most.
+ * param error Set if the event subscription failed.
+ * return The recorder, or NULL on failure.
+ */
+struct event_recorder* event_recorder_new(enum event_trigger trigger,
+                                          const gchar* dir,
+                                          const gchar* extension,
+                                          guint pre_seconds,
+                                          guint post_seconds,
+                                          guint framerate,
+                                          gsize buffer_size,
+                                          GError** error);
+
+/**
+ * brief Add a frame to memory, and to the current clip if any.
+ *
+ * Never blocks. The frame is copied, so its buffer can be released right
+ * after, and frames of a clip are queued for the writer thread.
+ *
+ * param recorder An event recorder.
+ * param frame VDO frame.
+ * param data Frame data.
+ * param error Set if writing a clip has failed.
+ * return FALSE if writing a clip has failed, otherwise TRUE.
+ */
+gboolean event_recorder_push(struct event_recorder* recorder,
+                             VdoFrame* frame,
+                             gconstpointer data,
+                             GError** error);
+
+/**
+ * brief Unsubscribe, write and close the current clip, stop the writer thread
+ * and free the recorder.
+ *
+ * param recorder An event recorder, may be NULL.
+ */
+void event_recorder_free(struct event_recorder* recorder);
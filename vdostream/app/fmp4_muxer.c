@@ -0,0 +1,696 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file writes H.264 and H.265 VDO frames as fragmented MP4.
+ *
+ * The file starts with an initialization segment (ftyp and moov) describing a
+ * single video track, built from the parameter sets of the first keyframe.
+ * Each GOP is then written as one fragment (moof and mdat), and synced to
+ * storage, so the file is playable up to the last complete fragment even if
+ * the device loses power.
+ *
+ * VDO delivers Annex-B, where each NAL unit follows a start code, while MP4
+ * samples prefix each NAL unit with its length. Each frame is copied into the
+ * mdat of the current fragment with length prefixes as it arrives, so its VDO
+ * buffer goes back to the stream right away. Complete fragments are handed to
+ * a writer thread, which writes and syncs them, so neither storage nor the
+ * sync ever blocks the capture thread. When storage falls too far behind,
+ * fragments are dropped rather than queued, along with the fragments after
+ * them up to the next keyframe, which they depend on.
+ */
+
+#include "fmp4_muxer.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define FMP4_MUXER_ERROR g_quark_from_static_string("fmp4-muxer-error")
+
+// VDO timestamps are in microseconds, and used as they are
+#define TIMESCALE 1000000
+#define TRACK_ID 1
+
+// Complete fragments waiting for the writer thread, more are dropped
+#define MAX_QUEUED_FRAGMENTS 4
+
+enum parameter_set { PARAM_VPS = 0, PARAM_SPS, PARAM_PPS, NUM_PARAMS, PARAM_NONE };
+
+struct sample {
+    guint64 timestamp;
+    guint32 size;
+    gboolean sync;
+};
+
+// Boxes handed to the writer thread, the moof box followed by the sample data of the mdat box
+struct fragment {
+    GByteArray* boxes;
+    GByteArray* data;
+};
+
+// Queued to stop the writer thread
+static struct fragment stop_fragment;
+
+struct fmp4_muxer {
+    VdoStream* stream;
+    int fd;
+    VdoFormat format;
+    guint width;
+    guint height;
+    guint64 frame_duration;
+
+    // Parameter sets of the first keyframe, for the initialization segment
+    GByteArray* params[NUM_PARAMS];
+    gboolean initialized;
+    guint64 base_timestamp;
+    guint32 sequence;
+
+    // Samples of the current fragment, and their length prefixed NAL units
+    struct sample samples[FMP4_MAX_SAMPLES];
+    guint num_samples;
+    GByteArray* data;
+
+    // Fragments written by the writer thread
+    GThread* thread;
+    GAsyncQueue* fragments;
+    atomic_int failed;
+    GError* write_error;
+    guint fragments_written;
+    guint fragments_dropped;
+    gboolean await_keyframe;
+};
+
+static void put_u8(GByteArray* box, guint8 value) {
+    g_byte_array_append(box, &value, 1);
+}
+
+static void put_u16(GByteArray* box, guint16 value) {
+    value = GUINT16_TO_BE(value);
+    g_byte_array_append(box, (const guint8*)&value, sizeof(value));
+}
+
+static void put_u32(GByteArray* box, guint32 value) {
+    value = GUINT32_TO_BE(value);
+    g_byte_array_append(box, (const guint8*)&value, sizeof(value));
+}
+
+static void put_u64(GByteArray* box, guint64 value) {
+    value = GUINT64_TO_BE(value);
+    g_byte_array_append(box, (const guint8*)&value, sizeof(value));
+}
+
+static void put_tag(GByteArray* box, const char* tag) {
+    g_byte_array_append(box, (const guint8*)tag, 4);
+}
+
+static void put_zeros(GByteArray* box, guint count) {
+    while (count--)
+        put_u8(box, 0);
+}
+
+static void put_matrix(GByteArray* box) {
+    static const guint32 identity[] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+
+    for (gsize i = 0; i < G_N_ELEMENTS(identity); i++)
+        put_u32(box, identity[i]);
+}
+
+// Start a box, the returned offset is passed to end_box once its contents are added
+static guint begin_box(GByteArray* box, const char* type) {
+    guint offset = box->len;
+
+    put_u32(box, 0);
+    put_tag(box, type);
+    return offset;
+}
+
+static guint begin_full_box(GByteArray* box, const char* type, guint8 version, guint32 flags) {
+    guint offset = begin_box(box, type);
+
+    put_u32(box, (guint32)version << 24 | flags);
+    return offset;
+}
+
+static void end_box(GByteArray* box, guint offset) {
+    guint32 size = GUINT32_TO_BE(box->len - offset);
+
+    memcpy(box->data + offset, &size, sizeof(size));
+}
+
+static gboolean is_sync(VdoFrameType type) {
+    return type == VDO_FRAME_TYPE_H264_IDR || type == VDO_FRAME_TYPE_H265_IDR ||
+           type == VDO_FRAME_TYPE_H264_I || type == VDO_FRAME_TYPE_H265_I;
+}
+
+// Classify a NAL unit by its header, access unit delimiters are dropped
+static enum parameter_set classify_nal(VdoFormat format, guint8 header, gboolean* drop) {
+    if (format == VDO_FORMAT_H264) {
+        guint type = header & 0x1f;
+        *drop      = type == 7 || type == 8 || type == 9;
+        return type == 7 ? PARAM_SPS : type == 8 ? PARAM_PPS : PARAM_NONE;
+    }
+
+    guint type = (header >> 1) & 0x3f;
+    *drop      = type >= 32 && type <= 35;
+    return type == 32 ? PARAM_VPS : type == 33 ? PARAM_SPS : type == 34 ? PARAM_PPS : PARAM_NONE;
+}
+
+static void add_nal(struct fmp4_muxer* muxer,
+                    struct sample* sample,
+                    const guint8* data,
+                    guint32 length) {
+    gboolean drop;
+    enum parameter_set param = classify_nal(muxer->format, data[0], &drop);
+
+    // Parameter sets go in the initialization segment rather than in the samples
+    if (param != PARAM_NONE && !muxer->initialized) {
+        g_byte_array_set_size(muxer->params[param], 0);
+        g_byte_array_append(muxer->params[param], data, length);
+    }
+    if (drop)
+        return;
+
+    guint32 prefix = GUINT32_TO_BE(length);
+    g_byte_array_append(muxer->data, (const guint8*)&prefix, sizeof(prefix));
+    g_byte_array_append(muxer->data, data, length);
+    sample->size += sizeof(prefix) + length;
+}
+
+// Split an Annex-B access unit at its start codes
+static void add_nals(struct fmp4_muxer* muxer,
+                     struct sample* sample,
+                     const guint8* data,
+                     gsize size) {
+    gsize i = 0;
+
+    while (i + 3 <= size) {
+        if (data[i] || data[i + 1] || data[i + 2] != 1) {
+            i++;
+            continue;
+        }
+
+        gsize start = i + 3;
+        gsize end   = start;
+        while (end + 3 <= size && (data[end] || data[end + 1] || data[end + 2] != 1))
+            end++;
+        if (end + 3 > size)
+            end = size;
+
+        // Zero bytes before a start code are not part of the NAL unit
+        while (end > start && !data[end - 1])
+            end--;
+        if (end > start)
+            add_nal(muxer, sample, data + start, end - start);
+        i = end;
+    }
+}
+
+static void put_avcc(GByteArray* box, struct fmp4_muxer* muxer) {
+    const GByteArray* sps = muxer->params[PARAM_SPS];
+    const GByteArray* pps = muxer->params[PARAM_PPS];
+    guint avcc            = begin_box(box, "avcC");
+
+    // Version, then profile, compatibility and level from the SPS
+    put_u8(box, 1);
+    g_byte_array_append(box, sps->data + 1, 3);
+    // Four byte NAL unit lengths, one SPS
+    put_u8(box, 0xff);
+    put_u8(box, 0xe1);
+    put_u16(box, sps->len);
+    g_byte_array_append(box, sps->data, sps->len);
+    put_u8(box, 1);
+    put_u16(box, pps->len);
+    g_byte_array_append(box, pps->data, pps->len);
+    end_box(box, avcc);
+}
+
+/*
+ * Read the byte holding max_sub_layers_minus1 and temporal_id_nesting_flag,
+ * followed by the general profile, tier and level of an H.265 SPS. Emulation
+ * prevention bytes are removed on the way.
+ */
+static gboolean read_profile_tier_level(const GByteArray* sps, guint8 rbsp[13]) {
+    guint n     = 0;
+    guint zeros = 0;
+
+    for (guint i = 2; i < sps->len && n < 13; i++) {
+        if (zeros >= 2 && sps->data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros     = sps->data[i] ? 0 : zeros + 1;
+        rbsp[n++] = sps->data[i];
+    }
+    return n == 13;
+}
+
+static void put_hvcc(GByteArray* box, struct fmp4_muxer* muxer, const guint8 rbsp[13]) {
+    guint hvcc = begin_box(box, "hvcC");
+
+    put_u8(box, 1);
+    g_byte_array_append(box, rbsp + 1, 12);
+    // No spatial segmentation or parallelism, 4:2:0 at 8 bits
+    put_u16(box, 0xf000);
+    put_u8(box, 0xfc);
+    put_u8(box, 0xfd);
+    put_u8(box, 0xf8);
+    put_u8(box, 0xf8);
+    put_u16(box, 0);
+    // Temporal layers and nesting from the SPS, four byte NAL unit lengths
+    put_u8(box, (((rbsp[0] >> 1) & 7) + 1) << 3 | (rbsp[0] & 1) << 2 | 3);
+
+    put_u8(box, NUM_PARAMS);
+    for (guint i = 0; i < NUM_PARAMS; i++) {
+        const GByteArray* param = muxer->params[i];
+
+        put_u8(box, 0x80 | ((param->data[0] >> 1) & 0x3f));
+        put_u16(box, 1);
+        put_u16(box, param->len);
+        g_byte_array_append(box, param->data, param->len);
+    }
+    end_box(box, hvcc);
+}
+
+static void put_sample_entry(GByteArray* box, struct fmp4_muxer* muxer, const guint8 rbsp[13]) {
+    guint entry = begin_box(box, muxer->format == VDO_FORMAT_H264 ? "avc1" : "hvc1");
+
+    put_zeros(box, 6);
+    put_u16(box, 1);
+    put_zeros(box, 16);
+    put_u16(box, muxer->width);
+    put_u16(box, muxer->height);
+    // 72 dpi, one frame per sample, no compressor name, 24 bit color
+    put_u32(box, 0x00480000);
+    put_u32(box, 0x00480000);
+    put_u32(box, 0);
+    put_u16(box, 1);
+    put_zeros(box, 32);
+    put_u16(box, 0x0018);
+    put_u16(box, 0xffff);
+
+    if (muxer->format == VDO_FORMAT_H264)
+        put_avcc(box, muxer);
+    else
+        put_hvcc(box, muxer, rbsp);
+    end_box(box, entry);
+}
+
+static void put_empty_table(GByteArray* box, const char* type) {
+    guint table = begin_full_box(box, type, 0, 0);
+
+    put_u32(box, 0);
+    if (!strcmp(type, "stsz"))
+        put_u32(box, 0);
+    end_box(box, table);
+}
+
+static void put_init_segment(GByteArray* box, struct fmp4_muxer* muxer, const guint8 rbsp[13]) {
+    guint ftyp = begin_box(box, "ftyp");
+    put_tag(box, "iso5");
+    put_u32(box, 512);
+    put_tag(box, "iso5");
+    put_tag(box, "iso6");
+    put_tag(box, "mp41");
+    end_box(box, ftyp);
+
+    guint moov = begin_box(box, "moov");
+
+    // Durations are left at zero, they are given by the fragments
+    guint mvhd = begin_full_box(box, "mvhd", 0, 0);
+    put_zeros(box, 8);
+    put_u32(box, TIMESCALE);
+    put_u32(box, 0);
+    put_u32(box, 0x00010000);
+    put_u16(box, 0x0100);
+    put_zeros(box, 10);
+    put_matrix(box);
+    put_zeros(box, 24);
+    put_u32(box, TRACK_ID + 1);
+    end_box(box, mvhd);
+
+    guint trak = begin_box(box, "trak");
+
+    // Track enabled and in movie
+    guint tkhd = begin_full_box(box, "tkhd", 0, 3);
+    put_zeros(box, 8);
+    put_u32(box, TRACK_ID);
+    put_zeros(box, 8);
+    put_zeros(box, 16);
+    put_matrix(box);
+    put_u32(box, muxer->width << 16);
+    put_u32(box, muxer->height << 16);
+    end_box(box, tkhd);
+
+    guint mdia = begin_box(box, "mdia");
+
+    // Language "und"
+    guint mdhd = begin_full_box(box, "mdhd", 0, 0);
+    put_zeros(box, 8);
+    put_u32(box, TIMESCALE);
+    put_u32(box, 0);
+    put_u16(box, 0x55c4);
+    put_u16(box, 0);
+    end_box(box, mdhd);
+
+    guint hdlr = begin_full_box(box, "hdlr", 0, 0);
+    put_u32(box, 0);
+    put_tag(box, "vide");
+    put_zeros(box, 12);
+    g_byte_array_append(box, (const guint8*)"VideoHandler", sizeof("VideoHandler"));
+    end_box(box, hdlr);
+
+    guint minf = begin_box(box, "minf");
+
+    guint vmhd = begin_full_box(box, "vmhd", 0, 1);
+    put_zeros(box, 8);
+    end_box(box, vmhd);
+
+    // Sample data is in this file
+    guint dinf = begin_box(box, "dinf");
+    guint dref = begin_full_box(box, "dref", 0, 0);
+    put_u32(box, 1);
+    end_box(box, begin_full_box(box, "url ", 0, 1));
+    end_box(box, dref);
+    end_box(box, dinf);
+
+    // The sample table only holds the sample entry, samples are in the fragments
+    guint stbl = begin_box(box, "stbl");
+    guint stsd = begin_full_box(box, "stsd", 0, 0);
+    put_u32(box, 1);
+    put_sample_entry(box, muxer, rbsp);
+    end_box(box, stsd);
+    put_empty_table(box, "stts");
+    put_empty_table(box, "stsc");
+    put_empty_table(box, "stsz");
+    put_empty_table(box, "stco");
+    end_box(box, stbl);
+
+    end_box(box, minf);
+    end_box(box, mdia);
+    end_box(box, trak);
+
+    guint mvex = begin_box(box, "mvex");
+    guint trex = begin_full_box(box, "trex", 0, 0);
+    put_u32(box, TRACK_ID);
+    put_u32(box, 1);
+    put_zeros(box, 12);
+    end_box(box, trex);
+    end_box(box, mvex);
+
+    end_box(box, moov);
+}
+
+// Write vectors completely and sync them to storage
+static gboolean write_vectors(int fd, struct iovec* iov, int count, GError** error) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            goto error;
+        }
+
+        // Skip the vectors that were written completely, and resume within the next one
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (guint8*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    // Files such as /dev/null cannot be synced
+    if (fdatasync(fd) && errno != EINVAL && errno != EROFS)
+        goto error;
+    return TRUE;
+
+error:
+    g_set_error(error,
+                G_FILE_ERROR,
+                g_file_error_from_errno(errno),
+                "Failed to write fragment: %s",
+                g_strerror(errno));
+    return FALSE;
+}
+
+static gboolean write_init_segment(struct fmp4_muxer* muxer, GError** error) {
+    guint8 rbsp[13];
+
+    for (guint i = muxer->format == VDO_FORMAT_H264 ? PARAM_SPS : PARAM_VPS; i < NUM_PARAMS; i++) {
+        if (!muxer->params[i]->len) {
+            g_set_error(error, FMP4_MUXER_ERROR, 0, "Keyframe without parameter sets");
+            return FALSE;
+        }
+    }
+    const GByteArray* sps = muxer->params[PARAM_SPS];
+    if (muxer->format == VDO_FORMAT_H264 ? sps->len < 4 : !read_profile_tier_level(sps, rbsp)) {
+        g_set_error(error, FMP4_MUXER_ERROR, 0, "Truncated sequence parameter set");
+        return FALSE;
+    }
+
+    // Nothing is queued before the initialization segment, so it is never dropped
+    struct fragment* init = g_new0(struct fragment, 1);
+    init->boxes           = g_byte_array_new();
+    put_init_segment(init->boxes, muxer, rbsp);
+    g_async_queue_push(muxer->fragments, init);
+
+    muxer->initialized = TRUE;
+    return TRUE;
+}
+
+static void free_fragment(struct fragment* fragment) {
+    if (fragment->boxes)
+        g_byte_array_unref(fragment->boxes);
+    if (fragment->data)
+        g_byte_array_unref(fragment->data);
+    g_free(fragment);
+}
+
+// Write the queued fragments until stopped, discarding them once a write has failed
+static gpointer write_fragments(gpointer data) {
+    struct fmp4_muxer* muxer = (struct fmp4_muxer*)data;
+
+    while (TRUE) {
+        struct fragment* fragment = g_async_queue_pop(muxer->fragments);
+        if (fragment == &stop_fragment)
+            break;
+
+        struct iovec iov[2] = {{fragment->boxes->data, fragment->boxes->len}};
+        int count           = 1;
+        if (fragment->data) {
+            iov[1].iov_base = fragment->data->data;
+            iov[1].iov_len  = fragment->data->len;
+            count++;
+        }
+        if (!atomic_load(&muxer->failed)) {
+            if (write_vectors(muxer->fd, iov, count, &muxer->write_error))
+                muxer->fragments_written++;
+            else
+                atomic_store(&muxer->failed, TRUE);
+        }
+        free_fragment(fragment);
+    }
+    return NULL;
+}
+
+/*
+ * Hand the samples held to the writer thread as one fragment. The timestamp
+ * of the frame following the fragment gives the duration of its last sample,
+ * if it is not known the nominal frame duration is used. Unless last is set,
+ * the fragment is dropped if too many are queued already.
+ */
+static void queue_fragment(struct fmp4_muxer* muxer, guint64 next_timestamp, gboolean last) {
+    if (!muxer->num_samples)
+        return;
+
+    // A fragment that does not start with a keyframe depends on the one before it
+    gboolean sync = muxer->samples[0].sync;
+    if ((!last && g_async_queue_length(muxer->fragments) >= MAX_QUEUED_FRAGMENTS) ||
+        (muxer->await_keyframe && !sync)) {
+        muxer->await_keyframe = TRUE;
+        muxer->fragments_dropped++;
+        muxer->num_samples = 0;
+        g_byte_array_set_size(muxer->data, 0);
+        return;
+    }
+    muxer->await_keyframe = FALSE;
+
+    GByteArray* box = g_byte_array_new();
+    guint32 size    = 0;
+
+    guint moof = begin_box(box, "moof");
+    guint mfhd = begin_full_box(box, "mfhd", 0, 0);
+    put_u32(box, ++muxer->sequence);
+    end_box(box, mfhd);
+
+    guint traf = begin_box(box, "traf");
+
+    // Sample data offsets are relative to the moof box
+    guint tfhd = begin_full_box(box, "tfhd", 0, 0x020000);
+    put_u32(box, TRACK_ID);
+    end_box(box, tfhd);
+
+    guint tfdt = begin_full_box(box, "tfdt", 1, 0);
+    put_u64(box, muxer->samples[0].timestamp - muxer->base_timestamp);
+    end_box(box, tfdt);
+
+    // Data offset, and duration, size and flags for each sample
+    guint trun = begin_full_box(box, "trun", 0, 0x000701);
+    put_u32(box, muxer->num_samples);
+    guint data_offset = box->len;
+    put_u32(box, 0);
+    for (guint i = 0; i < muxer->num_samples; i++) {
+        const struct sample* sample = &muxer->samples[i];
+        gboolean last               = i + 1 == muxer->num_samples;
+        guint64 next                = last ? next_timestamp : sample[1].timestamp;
+
+        put_u32(box, next > sample->timestamp ? next - sample->timestamp : muxer->frame_duration);
+        put_u32(box, sample->size);
+        put_u32(box, sample->sync ? 0x02000000 : 0x01010000);
+        size += sample->size;
+    }
+    end_box(box, trun);
+    end_box(box, traf);
+    end_box(box, moof);
+
+    guint32 offset = GUINT32_TO_BE(box->len - moof + 8);
+    memcpy(box->data + data_offset, &offset, sizeof(offset));
+    put_u32(box, size + 8);
+    put_tag(box, "mdat");
+
+    // The next fragment starts with room for one as large as this one
+    struct fragment* fragment = g_new0(struct fragment, 1);
+    fragment->boxes           = box;
+    fragment->data            = muxer->data;
+    muxer->data               = g_byte_array_sized_new(fragment->data->len);
+    muxer->num_samples        = 0;
+    g_async_queue_push(muxer->fragments, fragment);
+}
+
+static gboolean check_writer(struct fmp4_muxer* muxer, GError** error) {
+    if (!atomic_load(&muxer->failed))
+        return TRUE;
+    g_propagate_error(error, g_error_copy(muxer->write_error));
+    return FALSE;
+}
+
+struct fmp4_muxer* fmp4_muxer_new(VdoStream* stream,
+                                  int fd,
+                                  VdoFormat format,
+                                  guint width,
+                                  guint height,
+                                  guint framerate,
+                                  GError** error) {
+    if (format != VDO_FORMAT_H264 && format != VDO_FORMAT_H265) {
+        g_set_error(error, FMP4_MUXER_ERROR, 0, "Only H.264 and H.265 can be muxed to MP4");
+        return NULL;
+    }
+
+    struct fmp4_muxer* muxer = g_new0(struct fmp4_muxer, 1);
+
+    muxer->stream         = stream;
+    muxer->fd             = fd;
+    muxer->format         = format;
+    muxer->width          = width;
+    muxer->height         = height;
+    muxer->frame_duration = TIMESCALE / (framerate ? framerate : 30);
+    muxer->data           = g_byte_array_new();
+    muxer->fragments      = g_async_queue_new();
+    for (guint i = 0; i < NUM_PARAMS; i++)
+        muxer->params[i] = g_byte_array_new();
+
+    muxer->thread = g_thread_new("fmp4-writer", write_fragments, muxer);
+    return muxer;
+}
+
+gboolean fmp4_muxer_push(struct fmp4_muxer* muxer, VdoBuffer** buffer, GError** error) {
+    VdoFrame* frame    = vdo_buffer_get_frame(*buffer);
+    const guint8* data = vdo_buffer_get_data(*buffer);
+    guint64 timestamp  = vdo_frame_get_timestamp(frame);
+    gboolean sync      = is_sync(vdo_frame_get_frame_type(frame));
+
+    gboolean ret       = FALSE;
+
+    if (!data) {
+        g_set_error(error, FMP4_MUXER_ERROR, 0, "Failed to get data");
+        goto exit;
+    }
+    if (!check_writer(muxer, error))
+        goto exit;
+
+    // Decoding starts at a keyframe, frames before the first one are dropped
+    if (!muxer->initialized && !sync) {
+        ret = TRUE;
+        goto exit;
+    }
+
+    // A keyframe starts a new fragment, as does a full fragment
+    if (sync || muxer->num_samples == FMP4_MAX_SAMPLES)
+        queue_fragment(muxer, timestamp, FALSE);
+
+    struct sample* sample = &muxer->samples[muxer->num_samples];
+    sample->timestamp     = timestamp;
+    sample->size          = 0;
+    sample->sync          = sync;
+    add_nals(muxer, sample, data, vdo_frame_get_size(frame));
+
+    if (!muxer->initialized) {
+        if (!write_init_segment(muxer, error)) {
+            g_byte_array_set_size(muxer->data, 0);
+            goto exit;
+        }
+        muxer->base_timestamp = timestamp;
+    }
+
+    muxer->num_samples++;
+    ret = TRUE;
+
+exit:
+    // The frame has been copied, or is dropped
+    vdo_stream_buffer_unref(muxer->stream, buffer, NULL);
+    return ret;
+}
+
+gboolean fmp4_muxer_free(struct fmp4_muxer* muxer, GError** error) {
+    if (!muxer)
+        return TRUE;
+
+    // Capturing is over, so the last fragment waits for the writer thread however far behind
+    queue_fragment(muxer, 0, TRUE);
+    g_async_queue_push(muxer->fragments, &stop_fragment);
+    g_thread_join(muxer->thread);
+
+    syslog(LOG_INFO,
+           "Wrote %u fragments, dropped %u fragments",
+           muxer->fragments_written,
+           muxer->fragments_dropped);
+    gboolean ret = check_writer(muxer, error);
+
+    for (guint i = 0; i < NUM_PARAMS; i++)
+        g_byte_array_unref(muxer->params[i]);
+    g_byte_array_unref(muxer->data);
+    g_async_queue_unref(muxer->fragments);
+    g_clear_error(&muxer->write_error);
+    g_free(muxer);
+    return ret;
+}
@@ -0,0 +1,83 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file wraps H.264 and H.265 VDO frames in fragmented MP4, one
+ * fragment per GOP, so the output is seekable and carries frame timestamps.
+ * Fragments are written from a thread of their own, so a slow storage device
+ * never blocks the capture loop.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "vdo-stream.h"
+#include "vdo-types.h"
+
+// Most frames in one fragment, a longer GOP is split over several fragments
+#define FMP4_MAX_SAMPLES 32
+
+struct fmp4_muxer;
+
+/**
+ * brief Create a muxer writing to a file, and start its writer thread.
+ *
+ * Nothing is written until the first keyframe, which provides the parameter
+ * sets for the initialization segment.
+ *
+ * param stream Stream the buffers are returned to.
+ * param fd File descriptor to write to, owned by the caller.
+ * param format VDO_FORMAT_H264 or VDO_FORMAT_H265.
+ * param width Frame width in pixels.
+ * param height Frame height in pixels.
+ * param framerate Nominal frame rate, used for the duration of the last frame.
+ * param error Set if the format is not supported.
+ * return The muxer, or NULL on failure.
+ */
+struct fmp4_muxer* fmp4_muxer_new(VdoStream* stream,
+                                  int fd,
+                                  VdoFormat format,
+                                  guint width,
+                                  guint height,
+                                  guint framerate,
+                                  GError** error);
+
+/**
+ * brief Add a frame to the current fragment.
+ *
+ * Never blocks. The frame is copied into the fragment and the buffer returned
+ * to the stream right away, and a complete fragment is queued for the writer
+ * thread. When too many fragments are queued, fragments are dropped up to the
+ * next keyframe. Either way the muxer takes over the buffer reference and
+ * sets *buffer to NULL.
+ *
+ * param muxer An fMP4 muxer.
+ * param buffer VDO buffer holding an encoded frame.
+ * param error Set if writing an earlier fragment failed.
+ * return FALSE if writing an earlier fragment failed, otherwise TRUE.
+ */
+gboolean fmp4_muxer_push(struct fmp4_muxer* muxer, VdoBuffer** buffer, GError** error);
+
+/**
+ * brief Write the last fragment and all queued ones, stop the writer thread
+ * and free the muxer.
+ *
+ * param muxer An fMP4 muxer, may be NULL.
+ * param error Set if writing the last fragment failed.
+ * return FALSE if writing the last fragment failed, otherwise TRUE.
+ */
+gboolean fmp4_muxer_free(struct fmp4_muxer* muxer, GError** error);
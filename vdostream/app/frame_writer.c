@@ -0,0 +1,567 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file writes VDO frames to file from a writer thread.
+ *
+ * The capture thread and the writer thread share a single producer, single
+ * consumer ring. Both ends only ever advance their own counter, so no lock is
+ * taken and queueing a frame never waits on storage. A semaphore wakes the
+ * writer when frames are queued.
+ *
+ * In copy mode the ring holds the frame bytes. It is aligned to the block size
+ * and written in batches of BATCH_SIZE bytes, so storage sees few, large and
+ * aligned writes. In reference mode the ring holds the VDO buffers themselves,
+ * and all queued buffers are written with a single writev call before they
+ * are returned to the stream.
+ *
+ * When the ring fills up, frames are dropped so that what is written can
+ * still be decoded. Above half full, non-reference frames are dropped, since
+ * no other frame is predicted from them. A predicted frame is only queued if
+ * there is still room for a keyframe as large as the last one after it, and
+ * once a predicted frame is dropped, the rest of its GOP is dropped as well,
+ * up to the next keyframe. Dropping the tail of a GOP keeps room for the
+ * keyframe that follows it, which the stream recovers from.
+ *
+ * With a keyframe index, IDR frames are queued for the index as they are
+ * queued for writing, with the file offset they will be written at. The
+ * writer thread appends them to the index once the frame has been written,
+ * so the index never points past the end of the recording.
+ */
+
+#include "frame_writer.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+// Frame bytes are written in batches of this size, a multiple of BLOCK_SIZE
+#define BATCH_SIZE (1024 * 1024)
+
+// Alignment of the ring, and of the batches written from it
+#define BLOCK_SIZE 4096
+
+// A partial batch is written when nothing has been written for this long, even while frames
+// keep arriving
+#define FLUSH_INTERVAL_USEC G_USEC_PER_SEC
+
+// Writes that take longer than this are counted as stalls
+#define STALL_USEC (100 * 1000)
+
+// Dropped frames and stalls are logged at most this often
+#define REPORT_INTERVAL_USEC (10 * G_USEC_PER_SEC)
+
+// Keyframes that can wait to be indexed
+#define INDEX_QUEUE_SIZE 64
+
+enum drop_reason {
+    // Nothing is predicted from the frame, dropped when the ring is half full
+    DROP_NON_REFERENCE = 0,
+    // No room for the frame and the next keyframe, the GOP ends early
+    DROP_GOP_TAIL,
+    // A frame of the GOP has been dropped, which the frame depends on
+    DROP_AWAIT_KEYFRAME,
+    // No room for a keyframe
+    DROP_KEYFRAME,
+    NUM_DROP_REASONS,
+};
+
+struct frame_writer {
+    VdoStream* stream;
+    int fd;
+    enum write_mode mode;
+    GThread* thread;
+
+    // Posted for every queued frame, and to stop the writer thread
+    sem_t queued;
+    atomic_int stop;
+    atomic_int failed;
+    int write_errno;
+
+    // Frame bytes in copy mode
+    guint8* ring;
+    gsize capacity;
+    // VDO buffers in reference mode
+    VdoBuffer* refs[FRAME_WRITER_REF_BUFFERS];
+
+    // Bytes in copy mode, buffers in reference mode, queued and written so far
+    atomic_size_t head;
+    atomic_size_t tail;
+
+    // Updated by the capture thread
+    guint64 frames_queued;
+    atomic_uint frames_dropped;
+    gsize max_fill;
+    guint drops[NUM_DROP_REASONS];
+    gboolean await_keyframe;
+    gsize keyframe_size;
+
+    // Updated by the writer thread
+    guint64 bytes_written;
+    atomic_uint stalls;
+    gint64 max_write_usec;
+    gint64 last_write;
+    gint64 last_report;
+    guint reported_drops;
+    guint reported_stalls;
+
+    // Keyframes queued by the capture thread, and indexed by the writer thread
+    struct keyframe_index_writer* index;
+    struct keyframe_entry keyframes[INDEX_QUEUE_SIZE];
+    atomic_size_t keyframes_head;
+    atomic_size_t keyframes_tail;
+    guint64 bytes_queued;
+    atomic_uint keyframes_dropped;
+    guint keyframes_indexed;
+    gboolean index_failed;
+};
+
+// Write vectors completely, counting the write as a stall if it is slow
+static gboolean write_vectors(struct frame_writer* writer, struct iovec* iov, int count) {
+    gint64 start = g_get_monotonic_time();
+
+    while (count > 0) {
+        ssize_t written = writev(writer->fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            writer->write_errno = errno;
+            return FALSE;
+        }
+        writer->bytes_written += written;
+
+        // Skip the vectors that were written completely, and resume within the next one
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (guint8*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    gint64 elapsed         = g_get_monotonic_time() - start;
+    writer->max_write_usec = MAX(writer->max_write_usec, elapsed);
+    if (elapsed > STALL_USEC)
+        atomic_fetch_add(&writer->stalls, 1);
+    return TRUE;
+}
+
+/*
+ * Write the ring in batches. The first batch after a partial flush is cut
+ * short, so the following ones are aligned to BATCH_SIZE again. With flush
+ * set, everything queued is written.
+ */
+static gboolean write_ring(struct frame_writer* writer, gboolean flush) {
+    gsize tail = atomic_load_explicit(&writer->tail, memory_order_relaxed);
+    gsize head = atomic_load_explicit(&writer->head, memory_order_acquire);
+
+    while (head - tail >= BATCH_SIZE || (flush && head != tail)) {
+        gsize offset = tail % writer->capacity;
+        gsize length = MIN(head - tail, writer->capacity - offset);
+        if (!flush)
+            length = MIN(length, BATCH_SIZE - offset % BATCH_SIZE);
+
+        struct iovec iov = {writer->ring + offset, length};
+        if (!write_vectors(writer, &iov, 1))
+            return FALSE;
+
+        tail += length;
+        atomic_store_explicit(&writer->tail, tail, memory_order_release);
+        writer->last_write = g_get_monotonic_time();
+    }
+
+    // Nothing is waiting to be written, the next partial batch is due an interval from now
+    if (head == tail)
+        writer->last_write = g_get_monotonic_time();
+    return TRUE;
+}
+
+// Write all queued buffers at once and return them to the stream
+static gboolean write_refs(struct frame_writer* writer) {
+    gsize tail = atomic_load_explicit(&writer->tail, memory_order_relaxed);
+    gsize head = atomic_load_explicit(&writer->head, memory_order_acquire);
+
+    while (head != tail) {
+        struct iovec iov[FRAME_WRITER_REF_BUFFERS];
+        int count = 0;
+
+        for (gsize i = tail; i != head; i++, count++) {
+            VdoBuffer* buffer   = writer->refs[i % FRAME_WRITER_REF_BUFFERS];
+            iov[count].iov_base = vdo_buffer_get_data(buffer);
+            iov[count].iov_len  = vdo_frame_get_size(vdo_buffer_get_frame(buffer));
+        }
+        gboolean written = write_vectors(writer, iov, count);
+
+        for (gsize i = tail; i != head; i++)
+            vdo_stream_buffer_unref(writer->stream,
+                                    &writer->refs[i % FRAME_WRITER_REF_BUFFERS],
+                                    NULL);
+        tail = head;
+        atomic_store_explicit(&writer->tail, tail, memory_order_release);
+        if (!written)
+            return FALSE;
+
+        head = atomic_load_explicit(&writer->head, memory_order_acquire);
+    }
+    writer->last_write = g_get_monotonic_time();
+    return TRUE;
+}
+
+// Index the queued keyframes that have been written completely
+static void index_keyframes(struct frame_writer* writer) {
+    gsize tail = atomic_load_explicit(&writer->keyframes_tail, memory_order_relaxed);
+    gsize head = atomic_load_explicit(&writer->keyframes_head, memory_order_acquire);
+    struct keyframe_entry entries[INDEX_QUEUE_SIZE];
+    guint count = 0;
+
+    for (; tail != head; tail++, count++) {
+        const struct keyframe_entry* entry = &writer->keyframes[tail % INDEX_QUEUE_SIZE];
+        if (entry->offset + entry->size > writer->bytes_written)
+            break;
+        entries[count] = *entry;
+    }
+    atomic_store_explicit(&writer->keyframes_tail, tail, memory_order_release);
+
+    // Recording goes on without the index if it cannot be written
+    GError* error = NULL;
+    if (!count || writer->index_failed)
+        return;
+    if (!keyframe_index_writer_append(writer->index, entries, count, &error)) {
+        syslog(LOG_ERR, "%s, no more keyframes are indexed", error->message);
+        g_clear_error(&error);
+        writer->index_failed = TRUE;
+        return;
+    }
+    writer->keyframes_indexed += count;
+}
+
+// Wait for a frame to be queued, or until a partial batch is due to be written
+static void wait_for_frames(struct frame_writer* writer) {
+    struct timespec deadline;
+    gint64 remaining = writer->last_write + FLUSH_INTERVAL_USEC - g_get_monotonic_time();
+
+    // sem_timedwait() only takes a deadline on the realtime clock
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (remaining > 0) {
+        deadline.tv_sec += remaining / G_USEC_PER_SEC;
+        deadline.tv_nsec += remaining % G_USEC_PER_SEC * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    while (sem_timedwait(&writer->queued, &deadline) != 0) {
+        if (errno != EINTR)
+            return;
+    }
+}
+
+// Log dropped frames and stalls, if there are new ones since the last report
+static void report_if_due(struct frame_writer* writer) {
+    gint64 now = g_get_monotonic_time();
+    if (now - writer->last_report < REPORT_INTERVAL_USEC)
+        return;
+
+    guint drops  = atomic_load(&writer->frames_dropped);
+    guint stalls = atomic_load(&writer->stalls);
+    if (drops != writer->reported_drops || stalls != writer->reported_stalls)
+        syslog(LOG_WARNING,
+               "Writer falling behind: %u frames dropped and %u writes stalled in %u s",
+               drops - writer->reported_drops,
+               stalls - writer->reported_stalls,
+               (guint)((now - writer->last_report) / G_USEC_PER_SEC));
+
+    writer->last_report     = now;
+    writer->reported_drops  = drops;
+    writer->reported_stalls = stalls;
+}
+
+static gpointer write_frames(gpointer data) {
+    struct frame_writer* writer = (struct frame_writer*)data;
+    gboolean flush              = FALSE;
+
+    writer->last_report = g_get_monotonic_time();
+    writer->last_write  = writer->last_report;
+
+    while (TRUE) {
+        // Frames queued before stopping are written before the thread exits
+        gboolean stopping = atomic_load(&writer->stop);
+        gboolean written  = writer->mode == WRITE_MODE_REF ? write_refs(writer)
+                                                           : write_ring(writer, flush || stopping);
+        if (writer->index)
+            index_keyframes(writer);
+        if (!written) {
+            syslog(LOG_ERR, "Failed to write frames: %s", g_strerror(writer->write_errno));
+            atomic_store(&writer->failed, TRUE);
+            break;
+        }
+        if (stopping)
+            break;
+
+        report_if_due(writer);
+        wait_for_frames(writer);
+        flush = g_get_monotonic_time() - writer->last_write >= FLUSH_INTERVAL_USEC;
+    }
+    return NULL;
+}
+
+struct frame_writer* frame_writer_new(VdoStream* stream,
+                                      int fd,
+                                      enum write_mode mode,
+                                      gsize ring_size,
+                                      struct keyframe_index_writer* index,
+                                      GError** error) {
+    struct frame_writer* writer = g_new0(struct frame_writer, 1);
+
+    writer->stream = stream;
+    writer->fd     = fd;
+    writer->mode   = mode;
+    writer->index  = index;
+
+    if (mode == WRITE_MODE_COPY) {
+        writer->capacity = MAX(ring_size + BATCH_SIZE - 1, BATCH_SIZE) / BATCH_SIZE * BATCH_SIZE;
+        if (posix_memalign((void**)&writer->ring, BLOCK_SIZE, writer->capacity)) {
+            g_set_error(error,
+                        G_FILE_ERROR,
+                        G_FILE_ERROR_NOMEM,
+                        "Unable to allocate a ring of %zu bytes",
+                        writer->capacity);
+            g_free(writer);
+            return NULL;
+        }
+    }
+
+    sem_init(&writer->queued, 0, 0);
+    writer->thread = g_thread_new("frame-writer", write_frames, writer);
+    return writer;
+}
+
+static gboolean is_predicted(VdoFrameType type) {
+    return type == VDO_FRAME_TYPE_H264_P || type == VDO_FRAME_TYPE_H264_B ||
+           type == VDO_FRAME_TYPE_H265_P || type == VDO_FRAME_TYPE_H265_B;
+}
+
+// Check the first slice of a frame for whether other frames are predicted from it
+static gboolean is_reference(VdoBuffer* buffer, gboolean h265) {
+    const guint8* data = vdo_buffer_get_data(buffer);
+    gsize size         = vdo_frame_get_size(vdo_buffer_get_frame(buffer));
+
+    for (gsize i = 0; data && i + 3 < size; i++) {
+        if (data[i] || data[i + 1] || data[i + 2] != 1)
+            continue;
+
+        // H.264 signals it with nal_ref_idc, H.265 with sub-layer non-reference types
+        guint8 header = data[i + 3];
+        guint type    = h265 ? (header >> 1) & 0x3f : header & 0x1f;
+        if (!h265 && type >= 1 && type <= 5)
+            return (header & 0x60) != 0;
+        if (h265 && type <= 31)
+            return type > 14 || type % 2;
+        i += 3;
+    }
+    return TRUE;
+}
+
+// Decide whether to queue a frame, so the frames written can still be decoded
+static gboolean admit_frame(struct frame_writer* writer, VdoBuffer* buffer) {
+    gsize head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    gsize tail = atomic_load_explicit(&writer->tail, memory_order_acquire);
+
+    // Room is counted in bytes in copy mode, and in buffers in reference mode
+    VdoFrame* frame   = vdo_buffer_get_frame(buffer);
+    VdoFrameType type = vdo_frame_get_frame_type(frame);
+    gboolean ref_mode = writer->mode == WRITE_MODE_REF;
+    gsize capacity    = ref_mode ? FRAME_WRITER_REF_BUFFERS : writer->capacity;
+    gsize size        = ref_mode ? 1 : vdo_frame_get_size(frame);
+    gsize room        = capacity - (head - tail);
+    gsize reserve     = MIN(writer->keyframe_size, capacity / 2);
+    gboolean h265     = type == VDO_FRAME_TYPE_H265_P || type == VDO_FRAME_TYPE_H265_B;
+    enum drop_reason reason;
+
+    if (!is_predicted(type)) {
+        if (size <= room) {
+            writer->await_keyframe = FALSE;
+            writer->keyframe_size  = size;
+            return TRUE;
+        }
+        reason                 = DROP_KEYFRAME;
+        writer->await_keyframe = TRUE;
+    } else if (writer->await_keyframe) {
+        reason = DROP_AWAIT_KEYFRAME;
+    } else if (room <= capacity / 2 && !is_reference(buffer, h265)) {
+        reason = DROP_NON_REFERENCE;
+    } else if (size + reserve > room) {
+        reason                 = DROP_GOP_TAIL;
+        writer->await_keyframe = TRUE;
+    } else {
+        return TRUE;
+    }
+
+    writer->drops[reason]++;
+    return FALSE;
+}
+
+static gboolean push_copy(struct frame_writer* writer, VdoBuffer** buffer) {
+    gsize head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    gsize tail = atomic_load_explicit(&writer->tail, memory_order_acquire);
+
+    const guint8* data = vdo_buffer_get_data(*buffer);
+    gsize size         = vdo_frame_get_size(vdo_buffer_get_frame(*buffer));
+    gboolean queued    = data && size <= writer->capacity - (head - tail);
+
+    if (queued) {
+        gsize offset = head % writer->capacity;
+        gsize first  = MIN(size, writer->capacity - offset);
+
+        memcpy(writer->ring + offset, data, first);
+        memcpy(writer->ring, data + first, size - first);
+        atomic_store_explicit(&writer->head, head + size, memory_order_release);
+        writer->max_fill = MAX(writer->max_fill, head + size - tail);
+    }
+
+    // The frame is in the ring, or dropped, so the buffer can go back right away
+    vdo_stream_buffer_unref(writer->stream, buffer, NULL);
+    return queued;
+}
+
+static gboolean push_ref(struct frame_writer* writer, VdoBuffer** buffer) {
+    gsize head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    gsize tail = atomic_load_explicit(&writer->tail, memory_order_acquire);
+
+    if (head - tail == FRAME_WRITER_REF_BUFFERS) {
+        vdo_stream_buffer_unref(writer->stream, buffer, NULL);
+        return FALSE;
+    }
+
+    writer->refs[head % FRAME_WRITER_REF_BUFFERS] = *buffer;
+    *buffer                                       = NULL;
+    atomic_store_explicit(&writer->head, head + 1, memory_order_release);
+    writer->max_fill = MAX(writer->max_fill, head + 1 - tail);
+    return TRUE;
+}
+
+// Queue an IDR frame for the index, it is not indexed if the queue is full
+static void queue_keyframe(struct frame_writer* writer, const struct keyframe_entry* entry) {
+    gsize head = atomic_load_explicit(&writer->keyframes_head, memory_order_relaxed);
+    gsize tail = atomic_load_explicit(&writer->keyframes_tail, memory_order_acquire);
+
+    if (head - tail == INDEX_QUEUE_SIZE) {
+        atomic_fetch_add(&writer->keyframes_dropped, 1);
+        return;
+    }
+    writer->keyframes[head % INDEX_QUEUE_SIZE] = *entry;
+    atomic_store_explicit(&writer->keyframes_head, head + 1, memory_order_release);
+}
+
+gboolean frame_writer_push(struct frame_writer* writer, VdoBuffer** buffer) {
+    if (atomic_load(&writer->failed)) {
+        vdo_stream_buffer_unref(writer->stream, buffer, NULL);
+        return FALSE;
+    }
+
+    // The frame is gone once pushed in copy mode, so take what the index needs first
+    VdoFrame* frame             = vdo_buffer_get_frame(*buffer);
+    VdoFrameType type           = vdo_frame_get_frame_type(frame);
+    struct keyframe_entry entry = {
+        .offset    = writer->bytes_queued,
+        .timestamp = vdo_frame_get_timestamp(frame),
+        .sequence  = vdo_frame_get_sequence_nbr(frame),
+        .size      = vdo_frame_get_size(frame),
+    };
+
+    gboolean queued;
+    if (!admit_frame(writer, *buffer)) {
+        vdo_stream_buffer_unref(writer->stream, buffer, NULL);
+        queued = FALSE;
+    } else {
+        queued = writer->mode == WRITE_MODE_REF ? push_ref(writer, buffer)
+                                                : push_copy(writer, buffer);
+    }
+    if (queued) {
+        writer->frames_queued++;
+        writer->bytes_queued += entry.size;
+        if (writer->index && (type == VDO_FRAME_TYPE_H264_IDR || type == VDO_FRAME_TYPE_H265_IDR))
+            queue_keyframe(writer, &entry);
+        sem_post(&writer->queued);
+    } else {
+        atomic_fetch_add(&writer->frames_dropped, 1);
+    }
+    return TRUE;
+}
+
+gboolean frame_writer_free(struct frame_writer* writer, GError** error) {
+    if (!writer)
+        return TRUE;
+
+    atomic_store(&writer->stop, TRUE);
+    sem_post(&writer->queued);
+    g_thread_join(writer->thread);
+
+    // Return buffers left behind by a failed write
+    gsize tail = atomic_load(&writer->tail);
+    gsize head = atomic_load(&writer->head);
+    for (gsize i = tail; writer->mode == WRITE_MODE_REF && i != head; i++)
+        vdo_stream_buffer_unref(writer->stream,
+                                &writer->refs[i % FRAME_WRITER_REF_BUFFERS],
+                                NULL);
+
+    gsize capacity = writer->mode == WRITE_MODE_REF ? FRAME_WRITER_REF_BUFFERS : writer->capacity;
+    syslog(LOG_INFO,
+           "Wrote %" G_GUINT64_FORMAT " bytes of %" G_GUINT64_FORMAT
+           " frames, dropped %u frames, %u writes stalled, slowest write %.1f ms, "
+           "ring at most %zu%% full",
+           writer->bytes_written,
+           writer->frames_queued,
+           atomic_load(&writer->frames_dropped),
+           atomic_load(&writer->stalls),
+           writer->max_write_usec / 1000.0,
+           writer->max_fill * 100 / capacity);
+    syslog(LOG_INFO,
+           "Dropped %u non-reference frames, %u frames ending a GOP early, %u frames "
+           "waiting for a keyframe and %u keyframes",
+           writer->drops[DROP_NON_REFERENCE],
+           writer->drops[DROP_GOP_TAIL],
+           writer->drops[DROP_AWAIT_KEYFRAME],
+           writer->drops[DROP_KEYFRAME]);
+    if (writer->index)
+        syslog(LOG_INFO,
+               "Indexed %u keyframes, %u could not be queued for the index",
+               writer->keyframes_indexed,
+               atomic_load(&writer->keyframes_dropped));
+
+    gboolean ret = !atomic_load(&writer->failed);
+    if (!ret)
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(writer->write_errno),
+                    "Failed to write frames: %s",
+                    g_strerror(writer->write_errno));
+
+    sem_destroy(&writer->queued);
+    free(writer->ring);
+    g_free(writer);
+    return ret;
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file writes VDO frames to file from a thread of its own, so a
+ * slow storage device never blocks the capture loop.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "keyframe_index.h"
+#include "vdo-stream.h"
+
+enum write_mode {
+    // Copy each frame into a ring and return the VDO buffer right away
+    WRITE_MODE_COPY = 0,
+    // Queue a reference to the VDO buffer, returned once it has been written
+    WRITE_MODE_REF,
+};
+
+// Number of VDO buffers the writer can hold on to in WRITE_MODE_REF
+#define FRAME_WRITER_REF_BUFFERS 8
+
+struct frame_writer;
+
+/**
+ * brief Start a writer thread.
+ *
+ * param stream Stream the buffers are returned to.
+ * param fd File descriptor to write to, owned by the caller.
+ * param mode Copy frames, or hold on to the VDO buffers until written.
+ * param ring_size Bytes of frame data that can be queued in WRITE_MODE_COPY.
+ * param index Index to append the IDR frames to once written, or NULL. Offsets
+ *        are counted from where the writer starts writing.
+ * param error Set if the writer could not be started.
+ * return The writer, or NULL on failure.
+ */
+struct frame_writer* frame_writer_new(VdoStream* stream,
+                                      int fd,
+                                      enum write_mode mode,
+                                      gsize ring_size,
+                                      struct keyframe_index_writer* index,
+                                      GError** error);
+
+/**
+ * brief Queue a frame for writing.
+ *
+ * Never blocks. When the ring fills up, frames are dropped and counted, in an
+ * order that keeps the frames written decodable: non-reference frames first,
+ * then the rest of the current GOP up to the next keyframe. Either way the
+ * writer takes over the buffer reference and sets *buffer to NULL.
+ *
+ * param writer A frame writer.
+ * param buffer VDO buffer holding the frame.
+ * return FALSE if writing has failed, otherwise TRUE.
+ */
+gboolean frame_writer_push(struct frame_writer* writer, VdoBuffer** buffer);
+
+/**
+ * brief Write all queued frames, stop the writer thread and log its counters.
+ *
+ * param writer A frame writer, may be NULL.
+ * param error Set if any write failed.
+ * return FALSE if any write failed, otherwise TRUE.
+ */
+gboolean frame_writer_free(struct frame_writer* writer, GError** error);
@@ -0,0 +1,259 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file writes and reads keyframe index files.
+ *
+ * An index file is a 16 byte header followed by one 24 byte entry per
+ * keyframe, all fields little endian:
+ *
+ *   header: magic "VDOKFIDX", version (u32), entry size (u32)
+ *   entry:  offset (u64), timestamp (u64), sequence number (u32), size (u32)
+ *
+ * Entries are only ever appended, in recording order, so the timestamps are
+ * increasing and a reader can binary search the mapped file directly. An
+ * entry cut short by a crash is ignored by the reader.
+ */
+
+#include "keyframe_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC "VDOKFIDX"
+#define INDEX_VERSION 1
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 24
+
+// Entries serialized per write
+#define APPEND_BATCH 16
+
+struct keyframe_index_writer {
+    gint fd;
+};
+
+struct keyframe_index {
+    guint8* map;
+    gsize map_size;
+    guint count;
+};
+
+static gboolean write_all(gint fd, const guint8* data, gsize size, GError** error) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(error,
+                        G_FILE_ERROR,
+                        g_file_error_from_errno(errno),
+                        "Failed to write keyframe index: %s",
+                        g_strerror(errno));
+            return FALSE;
+        }
+        data += written;
+        size -= written;
+    }
+    return TRUE;
+}
+
+struct keyframe_index_writer* keyframe_index_writer_new(const gchar* path, GError** error) {
+    gint fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to create keyframe index %s: %s",
+                    path,
+                    g_strerror(errno));
+        return NULL;
+    }
+
+    guint8 header[HEADER_SIZE];
+    guint32 version    = GUINT32_TO_LE(INDEX_VERSION);
+    guint32 entry_size = GUINT32_TO_LE(ENTRY_SIZE);
+    memcpy(header, INDEX_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &entry_size, 4);
+    if (!write_all(fd, header, sizeof(header), error)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct keyframe_index_writer* writer = g_new0(struct keyframe_index_writer, 1);
+    writer->fd                           = fd;
+    return writer;
+}
+
+gboolean keyframe_index_writer_append(struct keyframe_index_writer* writer,
+                                      const struct keyframe_entry* entries,
+                                      guint count,
+                                      GError** error) {
+    guint8 data[APPEND_BATCH * ENTRY_SIZE];
+
+    while (count > 0) {
+        guint batch = MIN(count, APPEND_BATCH);
+
+        for (guint i = 0; i < batch; i++) {
+            guint8* entry      = data + i * ENTRY_SIZE;
+            guint64 offset     = GUINT64_TO_LE(entries[i].offset);
+            guint64 timestamp  = GUINT64_TO_LE(entries[i].timestamp);
+            guint32 sequence   = GUINT32_TO_LE(entries[i].sequence);
+            guint32 frame_size = GUINT32_TO_LE(entries[i].size);
+            memcpy(entry, &offset, 8);
+            memcpy(entry + 8, &timestamp, 8);
+            memcpy(entry + 16, &sequence, 4);
+            memcpy(entry + 20, &frame_size, 4);
+        }
+
+        // A whole batch in one write, so a reader rarely sees a partial entry
+        if (!write_all(writer->fd, data, batch * ENTRY_SIZE, error))
+            return FALSE;
+        entries += batch;
+        count -= batch;
+    }
+    return TRUE;
+}
+
+void keyframe_index_writer_free(struct keyframe_index_writer* writer) {
+    if (!writer)
+        return;
+
+    close(writer->fd);
+    g_free(writer);
+}
+
+struct keyframe_index* keyframe_index_open(const gchar* path, GError** error) {
+    struct keyframe_index* index = NULL;
+    struct stat info;
+
+    gint fd = g_open(path, O_RDONLY, 0);
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to open keyframe index %s: %s",
+                    path,
+                    g_strerror(errno));
+        goto exit;
+    }
+
+    // The size is fixed now, entries appended later are not mapped
+    if (info.st_size < HEADER_SIZE) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a keyframe index", path);
+        goto exit;
+    }
+
+    guint8* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to map keyframe index %s: %s",
+                    path,
+                    g_strerror(errno));
+        goto exit;
+    }
+
+    guint32 version, entry_size;
+    memcpy(&version, map + 8, 4);
+    memcpy(&entry_size, map + 12, 4);
+    if (memcmp(map, INDEX_MAGIC, 8) || GUINT32_FROM_LE(version) != INDEX_VERSION ||
+        GUINT32_FROM_LE(entry_size) != ENTRY_SIZE) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_INVAL,
+                    "%s is not a keyframe index of version %d",
+                    path,
+                    INDEX_VERSION);
+        munmap(map, info.st_size);
+        goto exit;
+    }
+
+    index           = g_new0(struct keyframe_index, 1);
+    index->map      = map;
+    index->map_size = info.st_size;
+    index->count    = (info.st_size - HEADER_SIZE) / ENTRY_SIZE;
+
+exit:
+    if (fd >= 0)
+        close(fd);
+    return index;
+}
+
+guint keyframe_index_get_count(const struct keyframe_index* index) {
+    return index->count;
+}
+
+static guint64 timestamp_at(const struct keyframe_index* index, guint position) {
+    guint64 timestamp;
+
+    memcpy(&timestamp, index->map + HEADER_SIZE + (gsize)position * ENTRY_SIZE + 8, 8);
+    return GUINT64_FROM_LE(timestamp);
+}
+
+void keyframe_index_get(const struct keyframe_index* index,
+                        guint position,
+                        struct keyframe_entry* entry) {
+    const guint8* data = index->map + HEADER_SIZE + (gsize)position * ENTRY_SIZE;
+
+    memcpy(&entry->offset, data, 8);
+    memcpy(&entry->timestamp, data + 8, 8);
+    memcpy(&entry->sequence, data + 16, 4);
+    memcpy(&entry->size, data + 20, 4);
+    entry->offset    = GUINT64_FROM_LE(entry->offset);
+    entry->timestamp = GUINT64_FROM_LE(entry->timestamp);
+    entry->sequence  = GUINT32_FROM_LE(entry->sequence);
+    entry->size      = GUINT32_FROM_LE(entry->size);
+}
+
+gboolean keyframe_index_seek(const struct keyframe_index* index,
+                             guint64 timestamp,
+                             struct keyframe_entry* entry,
+                             guint* position) {
+    if (!index->count)
+        return FALSE;
+
+    // Find the first keyframe after timestamp, the one before it is the answer
+    guint low  = 0;
+    guint high = index->count;
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (timestamp_at(index, middle) <= timestamp)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    low = low ? low - 1 : 0;
+    keyframe_index_get(index, low, entry);
+    if (position)
+        *position = low;
+    return TRUE;
+}
+
+void keyframe_index_close(struct keyframe_index* index) {
+    if (!index)
+        return;
+
+    munmap(index->map, index->map_size);
+    g_free(index);
+}
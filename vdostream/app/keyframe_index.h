@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file writes and reads a sidecar index of the keyframes in a
+ * raw recording, so a recording can be cut or played from any point in time
+ * without scanning it for IDR frames.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+// Keyframe in a recording
+struct keyframe_entry {
+    // Byte offset of the frame in the recording
+    guint64 offset;
+    // Frame timestamp in microseconds
+    guint64 timestamp;
+    guint32 sequence;
+    guint32 size;
+};
+
+struct keyframe_index_writer;
+struct keyframe_index;
+
+/**
+ * brief Create an index file, replacing any existing one.
+ *
+ * param path Path of the index file.
+ * param error Set on failure.
+ * return The index writer, or NULL on failure.
+ */
+struct keyframe_index_writer* keyframe_index_writer_new(const gchar* path, GError** error);
+
+/**
+ * brief Append keyframes to the index.
+ *
+ * Keyframes are appended in the order they occur in the recording, and only
+ * once the frames themselves have been written.
+ *
+ * param writer An index writer.
+ * param entries Keyframes to append.
+ * param count Number of keyframes.
+ * param error Set on failure.
+ * return FALSE on failure, otherwise TRUE.
+ */
+gboolean keyframe_index_writer_append(struct keyframe_index_writer* writer,
+                                      const struct keyframe_entry* entries,
+                                      guint count,
+                                      GError** error);
+
+/**
+ * brief Close the index file.
+ *
+ * param writer An index writer, may be NULL.
+ */
+void keyframe_index_writer_free(struct keyframe_index_writer* writer);
+
+/**
+ * brief Map an index file into memory.
+ *
+ * The index may still be growing, only the keyframes written when it was
+ * opened are seen.
+ *
+ * param path Path of the index file.
+ * param error Set on failure.
+ * return The index, or NULL on failure.
+ */
+struct keyframe_index* keyframe_index_open(const gchar* path, GError** error);
+
+/**
+ * brief Get the number of keyframes in an index.
+ *
+ * param index A keyframe index.
+ * return Number of keyframes.
+ */
+guint keyframe_index_get_count(const struct keyframe_index* index);
+
+/**
+ * brief Get a keyframe.
+ *
+ * param index A keyframe index.
+ * param position Position of the keyframe, less than the number of keyframes.
+ * param entry Set to the keyframe.
+ */
+void keyframe_index_get(const struct keyframe_index* index,
+                        guint position,
+                        struct keyframe_entry* entry);
+
+/**
+ * brief Find the last keyframe at or before a point in time.
+ *
+ * A binary search, so it takes O(log n) time in the number of keyframes.
+ *
+ * param index A keyframe index.
+ * param timestamp Timestamp in microseconds.
+ * param entry Set to the keyframe found.
+ * param position Set to the position of the keyframe found, may be NULL.
+ * return FALSE if the index is empty, otherwise TRUE. If timestamp is before
+ *        the first keyframe, the first keyframe is returned.
+ */
+gboolean keyframe_index_seek(const struct keyframe_index* index,
+                             guint64 timestamp,
+                             struct keyframe_entry* entry,
+                             guint* position);
+
+/**
+ * brief Unmap an index.
+ *
+ * param index A keyframe index, may be NULL.
+ */
+void keyframe_index_close(struct keyframe_index* index);
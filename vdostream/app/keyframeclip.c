@@ -0,0 +1,234 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * - keyframeclip -
+ *
+ * This application cuts a clip out of a raw recording made by vdoencodeclient
+ * with --index, using the keyframe index next to it, <recording>.idx.
+ *
+ * The clip starts at the keyframe at or before --start seconds into the
+ * recording, and ends at the first keyframe at or after --duration seconds
+ * later, so it can be decoded from its first frame and covers at least the
+ * time asked for. Both keyframes are found with a binary search in the index,
+ * and only the bytes of the clip are read from the recording, with sendfile.
+ * Without a keyframe after the end, the clip runs to the end of the recording.
+ *
+ * The recording may still be growing. Only the keyframes indexed when the
+ * application starts are used.
+ *
+ * Suppose that you have recorded with:
+ *     ./vdoencodeclient --format h264 --index --output localdata/vdo.h264
+ *
+ * Then you could cut ten seconds starting one minute in with:
+ *     ./keyframeclip --start 60 --duration 10 localdata/vdo.h264 localdata/clip.h264
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <sys/sendfile.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "keyframe_index.h"
+
+#define KEYFRAME_CLIP_ERROR g_quark_from_static_string("keyframe-clip-error")
+
+// Copy bytes from offset up to end, or to the end of the input if end is G_MAXUINT64
+static gboolean copy_range(gint in_fd,
+                           gint out_fd,
+                           guint64 offset,
+                           guint64 end,
+                           guint64* copied,
+                           GError** error) {
+    off_t position = offset;
+
+    *copied = 0;
+    while ((guint64)position < end) {
+        gsize count     = MIN(end - position, (guint64)G_MAXINT32);
+        ssize_t written = sendfile(out_fd, in_fd, &position, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(error,
+                        G_FILE_ERROR,
+                        g_file_error_from_errno(errno),
+                        "Failed to copy the clip: %s",
+                        g_strerror(errno));
+            return FALSE;
+        }
+
+        // The end of the recording
+        if (written == 0)
+            break;
+        *copied += written;
+    }
+    return TRUE;
+}
+
+static gboolean cut_clip(const gchar* recording,
+                         const gchar* output,
+                         gdouble start,
+                         gdouble duration,
+                         GError** error) {
+    gchar* index_path            = g_strdup_printf("%s.idx", recording);
+    struct keyframe_index* index = keyframe_index_open(index_path, error);
+    gint in_fd                   = -1;
+    gint out_fd                  = -1;
+    gboolean ret                 = FALSE;
+    struct keyframe_entry first  = {0};
+    struct keyframe_entry begin  = {0};
+    struct keyframe_entry end    = {0};
+    guint begin_position         = 0;
+    guint end_position           = 0;
+    guint64 end_offset           = G_MAXUINT64;
+    guint64 copied               = 0;
+
+    g_free(index_path);
+    if (!index)
+        return FALSE;
+    if (!keyframe_index_get_count(index)) {
+        g_set_error(error, KEYFRAME_CLIP_ERROR, 0, "No keyframes indexed in %s", recording);
+        goto exit;
+    }
+
+    // Times are counted from the first keyframe of the recording
+    keyframe_index_get(index, 0, &first);
+    guint64 start_time = first.timestamp + (guint64)(start * G_USEC_PER_SEC);
+    guint64 end_time   = start_time + (guint64)(duration * G_USEC_PER_SEC);
+
+    keyframe_index_seek(index, start_time, &begin, &begin_position);
+    keyframe_index_seek(index, end_time, &end, &end_position);
+
+    // End at the first keyframe at or after the end time, with at least one GOP in the clip
+    if (end.timestamp < end_time || end_position == begin_position)
+        end_position++;
+    gboolean to_end = end_position >= keyframe_index_get_count(index);
+    if (!to_end) {
+        keyframe_index_get(index, end_position, &end);
+        end_offset = end.offset;
+    }
+
+    in_fd = g_open(recording, O_RDONLY | O_CLOEXEC, 0);
+    if (in_fd < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to open %s: %s",
+                    recording,
+                    g_strerror(errno));
+        goto exit;
+    }
+    out_fd = g_open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to open %s: %s",
+                    output,
+                    g_strerror(errno));
+        goto exit;
+    }
+
+    if (!copy_range(in_fd, out_fd, begin.offset, end_offset, &copied, error))
+        goto exit;
+
+    if (to_end)
+        syslog(LOG_INFO,
+               "Cut %" G_GUINT64_FORMAT " bytes from %.1f s into %s to its end, to %s",
+               copied,
+               (begin.timestamp - first.timestamp) / (gdouble)G_USEC_PER_SEC,
+               recording,
+               output);
+    else
+        syslog(LOG_INFO,
+               "Cut %" G_GUINT64_FORMAT " bytes from %.1f s into %s, %.1f s long, to %s",
+               copied,
+               (begin.timestamp - first.timestamp) / (gdouble)G_USEC_PER_SEC,
+               recording,
+               (end.timestamp - begin.timestamp) / (gdouble)G_USEC_PER_SEC,
+               output);
+    ret = TRUE;
+
+exit:
+    if (out_fd >= 0)
+        close(out_fd);
+    if (in_fd >= 0)
+        close(in_fd);
+    keyframe_index_close(index);
+    return ret;
+}
+
+int main(int argc, char* argv[]) {
+    GError* error    = NULL;
+    gdouble start    = 0.0;
+    gdouble duration = 10.0;
+    gint ret         = EXIT_SUCCESS;
+
+    openlog(NULL, LOG_PID, LOG_USER);
+
+    GOptionEntry options[] = {
+        {"start",
+         's',
+         0,
+         G_OPTION_ARG_DOUBLE,
+         &start,
+         "seconds into the recording the clip starts at",
+         "SECONDS"},
+        {"duration", 'd', 0, G_OPTION_ARG_DOUBLE, &duration, "seconds of the clip", "SECONDS"},
+        {
+            NULL,
+            0,
+            0,
+            0,
+            NULL,
+            NULL,
+            NULL,
+        }};
+
+    GOptionContext* context = g_option_context_new("RECORDING OUTPUT");
+    if (!context)
+        return EXIT_FAILURE;
+
+    g_option_context_set_summary(context,
+                                 "Cut a clip out of a raw recording using its keyframe index");
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+        goto exit;
+
+    if (argc != 3 || start < 0.0 || duration < 0.0) {
+        g_set_error(&error,
+                    KEYFRAME_CLIP_ERROR,
+                    0,
+                    "Expected a recording and an output, and times that are not negative");
+        goto exit;
+    }
+
+    cut_clip(argv[1], argv[2], start, duration, &error);
+
+exit:
+    if (error) {
+        syslog(LOG_INFO, "keyframeclip: %s\n", error->message);
+        ret = EXIT_FAILURE;
+    }
+
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return ret;
+}
@@ -0,0 +1,270 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file receives RTP packets on the loopback interface and measures the
+ * stream they make up.
+ *
+ * Packets are received in batches with recvmmsg. Gaps in the sequence
+ * numbers are counted as lost packets. The last packet of each frame, the one
+ * with the marker bit, gives the latency of the frame: the time from when the
+ * sender started sending it, according to the header extension, to when it
+ * has been received completely. Both ends read the same monotonic clock.
+ */
+
+// For recvmmsg
+#define _GNU_SOURCE
+
+#include "rtp_receiver.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "rtp_sender.h"
+
+// Packets per recvmmsg call, and the largest packet expected
+#define BATCH_SIZE 32
+#define PACKET_SIZE 2048
+
+// Room for the packets of a few keyframes
+#define RECEIVE_BUFFER_SIZE (4 * 1024 * 1024)
+
+// The thread checks whether to stop at least this often
+#define RECEIVE_TIMEOUT_USEC (200 * 1000)
+
+#define RTP_RECEIVER_ERROR g_quark_from_static_string("rtp-receiver-error")
+
+// Statistics are logged this often
+#define REPORT_INTERVAL_USEC (10 * G_USEC_PER_SEC)
+
+struct counters {
+    guint64 packets;
+    guint64 bytes;
+    guint64 frames;
+    guint64 lost;
+    guint64 latency_count;
+    gint64 latency_sum;
+    gint64 latency_max;
+};
+
+struct rtp_receiver {
+    gint fd;
+    GThread* thread;
+    atomic_int stop;
+
+    guint8 packets[BATCH_SIZE][PACKET_SIZE];
+    struct iovec iov[BATCH_SIZE];
+    struct mmsghdr messages[BATCH_SIZE];
+
+    gboolean has_sequence;
+    guint16 next_sequence;
+    guint64 invalid;
+
+    // Since the last report, and since the start
+    struct counters interval;
+    struct counters total;
+    gint64 report_time;
+    gint64 start_time;
+};
+
+// Find the send time in a one-byte header extension, see RFC 8285
+static gint64 find_send_time(const guint8* extension, gsize size) {
+    if (size < 4 || extension[0] != 0xbe || extension[1] != 0xde)
+        return -1;
+
+    gsize end = MIN(size, 4 + (gsize)(extension[2] << 8 | extension[3]) * 4);
+    for (gsize pos = 4; pos < end;) {
+        guint id     = extension[pos] >> 4;
+        gsize length = (extension[pos] & 0x0f) + 1;
+
+        // Padding, and the reserved id that ends the extension
+        if (!extension[pos]) {
+            pos++;
+            continue;
+        }
+        if (id == 15 || pos + 1 + length > end)
+            break;
+
+        if (id == RTP_SEND_TIME_ID && length == 8) {
+            guint64 time;
+            memcpy(&time, extension + pos + 1, 8);
+            return GUINT64_FROM_BE(time);
+        }
+        pos += 1 + length;
+    }
+    return -1;
+}
+
+static void add_latency(struct counters* counters, gint64 latency) {
+    counters->latency_count++;
+    counters->latency_sum += latency;
+    counters->latency_max = MAX(counters->latency_max, latency);
+}
+
+static void handle_packet(struct rtp_receiver* receiver,
+                          const guint8* packet,
+                          gsize size,
+                          gint64 now) {
+    if (size < 12 || packet[0] >> 6 != 2) {
+        receiver->invalid++;
+        return;
+    }
+
+    // Late or repeated packets do not move the expected sequence number back
+    guint16 sequence = packet[2] << 8 | packet[3];
+    guint16 gap      = sequence - receiver->next_sequence;
+    if (!receiver->has_sequence || gap < 0x8000) {
+        if (receiver->has_sequence) {
+            receiver->interval.lost += gap;
+            receiver->total.lost += gap;
+        }
+        receiver->has_sequence  = TRUE;
+        receiver->next_sequence = sequence + 1;
+    }
+
+    receiver->interval.packets++;
+    receiver->interval.bytes += size;
+    receiver->total.packets++;
+    receiver->total.bytes += size;
+    if (!(packet[1] & 0x80))
+        return;
+
+    // The marker bit is set on the last packet of a frame
+    receiver->interval.frames++;
+    receiver->total.frames++;
+
+    gsize offset = 12 + (packet[0] & 0x0f) * 4;
+    if (!(packet[0] & 0x10) || offset >= size)
+        return;
+    gint64 send_time = find_send_time(packet + offset, size - offset);
+    if (send_time >= 0) {
+        add_latency(&receiver->interval, now - send_time);
+        add_latency(&receiver->total, now - send_time);
+    }
+}
+
+static void log_counters(const struct counters* counters, gint64 elapsed, const gchar* title) {
+    double seconds = (double)elapsed / G_USEC_PER_SEC;
+    if (seconds <= 0)
+        return;
+
+    double mean = counters->latency_count
+                      ? (double)counters->latency_sum / counters->latency_count / 1000
+                      : 0;
+    syslog(LOG_INFO,
+           "%s: %.0f packets/s, %.1f Mbit/s, %.1f frames/s, %" G_GUINT64_FORMAT
+           " packets lost, latency mean %.2f ms, max %.2f ms",
+           title,
+           counters->packets / seconds,
+           counters->bytes * 8 / 1e6 / seconds,
+           counters->frames / seconds,
+           counters->lost,
+           mean,
+           counters->latency_max / 1000.0);
+}
+
+static gpointer receive_packets(gpointer data) {
+    struct rtp_receiver* receiver = (struct rtp_receiver*)data;
+
+    while (!atomic_load(&receiver->stop)) {
+        gint count = recvmmsg(receiver->fd, receiver->messages, BATCH_SIZE, MSG_WAITFORONE, NULL);
+        gint64 now = g_get_monotonic_time();
+        if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            syslog(LOG_ERR, "Failed to receive RTP packets: %s", g_strerror(errno));
+            break;
+        }
+
+        for (gint i = 0; i < count; i++)
+            handle_packet(receiver, receiver->packets[i], receiver->messages[i].msg_len, now);
+
+        if (now - receiver->report_time >= REPORT_INTERVAL_USEC) {
+            log_counters(&receiver->interval, now - receiver->report_time, "RTP loopback");
+            memset(&receiver->interval, 0, sizeof(receiver->interval));
+            receiver->report_time = now;
+        }
+    }
+    return NULL;
+}
+
+struct rtp_receiver* rtp_receiver_new(const gchar* address, GError** error) {
+    struct sockaddr_in destination;
+    struct timeval timeout = {0, RECEIVE_TIMEOUT_USEC};
+    gint buffer_size       = RECEIVE_BUFFER_SIZE;
+
+    // Bound to the address the stream is sent to, which only gets packets if it is local
+    if (!rtp_sender_parse_address(address, &destination, error))
+        return NULL;
+    if (ntohl(destination.sin_addr.s_addr) >> IN_CLASSA_NSHIFT != IN_LOOPBACKNET) {
+        g_set_error(error,
+                    RTP_RECEIVER_ERROR,
+                    0,
+                    "Only RTP sent to a loopback address can be received, not to \"%s\"",
+                    address);
+        return NULL;
+    }
+
+    gint fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+        bind(fd, (struct sockaddr*)&destination, sizeof(destination)) < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to receive RTP on %s: %s",
+                    address,
+                    g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    // A small receive buffer is not fatal, only more packets are lost
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    struct rtp_receiver* receiver = g_new0(struct rtp_receiver, 1);
+    receiver->fd                  = fd;
+    for (guint i = 0; i < BATCH_SIZE; i++) {
+        receiver->iov[i].iov_base                = receiver->packets[i];
+        receiver->iov[i].iov_len                 = PACKET_SIZE;
+        receiver->messages[i].msg_hdr.msg_iov    = &receiver->iov[i];
+        receiver->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    receiver->start_time  = g_get_monotonic_time();
+    receiver->report_time = receiver->start_time;
+    receiver->thread      = g_thread_new("rtp-receiver", receive_packets, receiver);
+    return receiver;
+}
+
+void rtp_receiver_free(struct rtp_receiver* receiver) {
+    if (!receiver)
+        return;
+
+    atomic_store(&receiver->stop, TRUE);
+    g_thread_join(receiver->thread);
+
+    log_counters(&receiver->total,
+                 g_get_monotonic_time() - receiver->start_time,
+                 "RTP loopback in total");
+    if (receiver->invalid)
+        syslog(LOG_WARNING,
+               "RTP loopback: %" G_GUINT64_FORMAT " packets were not RTP",
+               receiver->invalid);
+    close(receiver->fd);
+    g_free(receiver);
+}
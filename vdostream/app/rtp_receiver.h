@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file receives the RTP packets of rtp_sender.h on the loopback
+ * interface, from a thread of its own, and logs the packet rate, packet loss
+ * and latency of the stream.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+struct rtp_receiver;
+
+/**
+ * brief Start receiving on the loopback interface.
+ *
+ * param address Address and port the stream is sent to, like 127.0.0.1:5004. Fails
+ *               unless it is a loopback address.
+ * param error Set on failure.
+ * return The receiver, or NULL on failure.
+ */
+struct rtp_receiver* rtp_receiver_new(const gchar* address, GError** error);
+
+/**
+ * brief Stop receiving, log a summary and free the receiver.
+ *
+ * param receiver An RTP receiver, may be NULL.
+ */
+void rtp_receiver_free(struct rtp_receiver* receiver);
@@ -0,0 +1,324 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file packetizes H.264 and H.265 frames into RTP packets.
+ *
+ * Each frame is split into NAL units at its start codes. A NAL unit that fits
+ * in one packet is sent as it is, a larger one is split into fragmentation
+ * units, FU-A for H.264 and FU for H.265. Every packet is two vectors, a
+ * header built here and a slice of the frame data, so the frame is never
+ * copied. Packets are batched and handed to the kernel with sendmmsg, one
+ * system call per batch rather than per packet.
+ *
+ * Every packet carries a header extension with the monotonic time the frame
+ * was sent, so a receiver on the same device can measure latency. Receivers
+ * that do not know the extension ignore it.
+ */
+
+// For sendmmsg
+#define _GNU_SOURCE
+
+#include "rtp_sender.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define RTP_SENDER_ERROR g_quark_from_static_string("rtp-sender-error")
+
+// RTP timestamps are in 90 kHz units
+#define CLOCK_RATE 90000
+
+// Payload bytes per packet, leaving room for headers within an Ethernet MTU
+#define MAX_PAYLOAD 1400
+
+// Packets per sendmmsg call
+#define BATCH_SIZE 64
+
+// Fixed RTP header, and the header extension with the send time
+#define RTP_HEADER_SIZE 12
+#define EXTENSION_SIZE 16
+#define HEADER_SIZE (RTP_HEADER_SIZE + EXTENSION_SIZE + 3)
+
+struct rtp_sender {
+    gint fd;
+    VdoFormat format;
+    guint16 sequence;
+    guint32 ssrc;
+
+    // Packets queued for the next sendmmsg call
+    guint8 headers[BATCH_SIZE][HEADER_SIZE];
+    struct iovec iov[BATCH_SIZE][2];
+    struct mmsghdr messages[BATCH_SIZE];
+    guint count;
+
+    guint64 frames;
+    guint64 packets;
+    guint64 dropped;
+};
+
+// Send the queued packets, some may be sent by each call
+static gboolean send_packets(struct rtp_sender* sender, GError** error) {
+    guint sent = 0;
+
+    while (sent < sender->count) {
+        gint ret = sendmmsg(sender->fd, sender->messages + sent, sender->count - sent, 0);
+        if (ret >= 0) {
+            sent += ret;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+
+        // No room in the socket buffer, or no one listening, drops this batch
+        if (errno == ENOBUFS || errno == EAGAIN || errno == ECONNREFUSED) {
+            sender->dropped += sender->count - sent;
+            break;
+        }
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to send RTP packets: %s",
+                    g_strerror(errno));
+        return FALSE;
+    }
+
+    sender->packets += sent;
+    sender->count = 0;
+    return TRUE;
+}
+
+// Queue a packet of a prefix, the payload header, and a slice of the frame data
+static gboolean add_packet(struct rtp_sender* sender,
+                           guint32 timestamp,
+                           gint64 send_time,
+                           const guint8* prefix,
+                           guint prefix_size,
+                           const guint8* data,
+                           gsize size,
+                           GError** error) {
+    if (sender->count == BATCH_SIZE && !send_packets(sender, error))
+        return FALSE;
+
+    guint8* header    = sender->headers[sender->count];
+    guint16 sequence  = GUINT16_TO_BE(sender->sequence++);
+    guint32 rtp_time  = GUINT32_TO_BE(timestamp);
+    guint32 ssrc      = GUINT32_TO_BE(sender->ssrc);
+    guint64 sent_time = GUINT64_TO_BE((guint64)send_time);
+
+    // Version 2 with a header extension, the marker bit is set on the last packet of the frame
+    header[0] = 0x90;
+    header[1] = RTP_PAYLOAD_TYPE;
+    memcpy(header + 2, &sequence, 2);
+    memcpy(header + 4, &rtp_time, 4);
+    memcpy(header + 8, &ssrc, 4);
+
+    // One-byte header extension of three words, an element of 8 bytes and padding
+    guint8* extension = header + RTP_HEADER_SIZE;
+    extension[0]      = 0xbe;
+    extension[1]      = 0xde;
+    extension[2]      = 0;
+    extension[3]      = 3;
+    extension[4]      = RTP_SEND_TIME_ID << 4 | 7;
+    memcpy(extension + 5, &sent_time, 8);
+    memset(extension + 13, 0, 3);
+    if (prefix_size)
+        memcpy(header + RTP_HEADER_SIZE + EXTENSION_SIZE, prefix, prefix_size);
+
+    struct iovec* iov = sender->iov[sender->count];
+    iov[0].iov_base   = header;
+    iov[0].iov_len    = RTP_HEADER_SIZE + EXTENSION_SIZE + prefix_size;
+    iov[1].iov_base   = (void*)data;
+    iov[1].iov_len    = size;
+
+    struct msghdr* message = &sender->messages[sender->count].msg_hdr;
+    memset(message, 0, sizeof(*message));
+    message->msg_iov    = iov;
+    message->msg_iovlen = 2;
+    sender->count++;
+    return TRUE;
+}
+
+// Queue a NAL unit, fragmented if it does not fit in one packet
+static gboolean add_nal(struct rtp_sender* sender,
+                        guint32 timestamp,
+                        gint64 send_time,
+                        const guint8* nal,
+                        gsize size,
+                        GError** error) {
+    if (size <= MAX_PAYLOAD)
+        return add_packet(sender, timestamp, send_time, NULL, 0, nal, size, error);
+
+    guint8 prefix[3];
+    guint header_size;
+    if (sender->format == VDO_FORMAT_H264) {
+        // FU indicator with the F and NRI bits of the NAL unit, then the FU header
+        prefix[0]   = (nal[0] & 0xe0) | 28;
+        prefix[1]   = nal[0] & 0x1f;
+        header_size = 1;
+    } else {
+        // Payload header of type 49 with the layer and temporal id of the NAL unit
+        prefix[0]   = (nal[0] & 0x81) | 49 << 1;
+        prefix[1]   = nal[1];
+        prefix[2]   = (nal[0] >> 1) & 0x3f;
+        header_size = 2;
+    }
+
+    // The NAL unit header is rebuilt from the fragmentation headers, not sent
+    guint prefix_size = header_size + 1;
+    gsize chunk       = MAX_PAYLOAD - prefix_size;
+    guint8* fu_header = &prefix[prefix_size - 1];
+    guint8 type       = *fu_header;
+    for (gsize offset = header_size; offset < size; offset += chunk) {
+        gsize length = MIN(chunk, size - offset);
+
+        *fu_header = type;
+        if (offset == header_size)
+            *fu_header |= 0x80;
+        if (offset + length == size)
+            *fu_header |= 0x40;
+        if (!add_packet(sender,
+                        timestamp,
+                        send_time,
+                        prefix,
+                        prefix_size,
+                        nal + offset,
+                        length,
+                        error))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// Access unit delimiters carry nothing a receiver needs
+static gboolean is_delimiter(VdoFormat format, guint8 header) {
+    return format == VDO_FORMAT_H264 ? (header & 0x1f) == 9 : ((header >> 1) & 0x3f) == 35;
+}
+
+gboolean rtp_sender_parse_address(const gchar* address,
+                                  struct sockaddr_in* destination,
+                                  GError** error) {
+    gchar host[INET_ADDRSTRLEN];
+    guint port;
+
+    // Split the address at the last colon, into an IPv4 address and a port
+    const gchar* colon = strrchr(address, ':');
+    if (!colon || (gsize)(colon - address) >= sizeof(host) || sscanf(colon + 1, "%u", &port) != 1 ||
+        !port || port > G_MAXUINT16) {
+        g_set_error(error, RTP_SENDER_ERROR, 0, "Invalid RTP destination \"%s\"", address);
+        return FALSE;
+    }
+    g_strlcpy(host, address, colon - address + 1);
+
+    memset(destination, 0, sizeof(*destination));
+    destination->sin_family = AF_INET;
+    destination->sin_port   = htons(port);
+    if (inet_pton(AF_INET, host, &destination->sin_addr) != 1) {
+        g_set_error(error, RTP_SENDER_ERROR, 0, "Invalid RTP destination \"%s\"", address);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+struct rtp_sender* rtp_sender_new(VdoFormat format, const gchar* address, GError** error) {
+    struct sockaddr_in destination;
+
+    if (format != VDO_FORMAT_H264 && format != VDO_FORMAT_H265) {
+        g_set_error(error, RTP_SENDER_ERROR, 0, "Only H.264 and H.265 can be sent as RTP");
+        return NULL;
+    }
+    if (!rtp_sender_parse_address(address, &destination, error))
+        return NULL;
+
+    // Connected, so the messages need no address, and the kernel routes once
+    gint fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&destination, sizeof(destination)) < 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Failed to open RTP socket: %s",
+                    g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    struct rtp_sender* sender = g_new0(struct rtp_sender, 1);
+    sender->fd                = fd;
+    sender->format            = format;
+    sender->sequence          = g_random_int();
+    sender->ssrc              = g_random_int();
+    return sender;
+}
+
+gboolean rtp_sender_send(struct rtp_sender* sender,
+                         VdoFrame* frame,
+                         const guint8* data,
+                         GError** error) {
+    gsize size        = vdo_frame_get_size(frame);
+    guint32 timestamp = vdo_frame_get_timestamp(frame) * CLOCK_RATE / G_USEC_PER_SEC;
+    gint64 send_time  = g_get_monotonic_time();
+    gsize i           = 0;
+
+    // Split the access unit at its start codes
+    while (i + 3 <= size) {
+        if (data[i] || data[i + 1] || data[i + 2] != 1) {
+            i++;
+            continue;
+        }
+
+        gsize start = i + 3;
+        gsize end   = start;
+        while (end + 3 <= size && (data[end] || data[end + 1] || data[end + 2] != 1))
+            end++;
+        if (end + 3 > size)
+            end = size;
+
+        // Zero bytes before a start code are not part of the NAL unit
+        while (end > start && !data[end - 1])
+            end--;
+        if (end > start && !is_delimiter(sender->format, data[start]) &&
+            !add_nal(sender, timestamp, send_time, data + start, end - start, error))
+            return FALSE;
+        i = end;
+    }
+
+    // Mark the end of the frame
+    if (sender->count)
+        sender->headers[sender->count - 1][1] |= 0x80;
+    sender->frames++;
+    return send_packets(sender, error);
+}
+
+void rtp_sender_free(struct rtp_sender* sender) {
+    if (!sender)
+        return;
+
+    syslog(LOG_INFO,
+           "Sent %" G_GUINT64_FORMAT " frames as %" G_GUINT64_FORMAT
+           " RTP packets, %" G_GUINT64_FORMAT " packets dropped",
+           sender->frames,
+           sender->packets,
+           sender->dropped);
+    close(sender->fd);
+    g_free(sender);
+}
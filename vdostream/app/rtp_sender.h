@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file sends H.264 and H.265 frames as RTP over UDP, packetized
+ * as described in RFC 6184 and RFC 7798, to forward video to other processes
+ * without going through a file.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "vdo-frame.h"
+#include "vdo-types.h"
+
+// RTP payload type of the stream, from the dynamic range
+#define RTP_PAYLOAD_TYPE 96
+
+// Header extension element holding the time a frame was sent, see RFC 8285
+#define RTP_SEND_TIME_ID 1
+
+struct rtp_sender;
+struct sockaddr_in;
+
+/**
+ * brief Parse an RTP destination.
+ *
+ * param address An IPv4 address and a port, like 127.0.0.1:5004.
+ * param destination Set to the address and port on success.
+ * param error Set on failure.
+ * return TRUE on success.
+ */
+gboolean rtp_sender_parse_address(const gchar* address,
+                                  struct sockaddr_in* destination,
+                                  GError** error);
+
+/**
+ * brief Create an RTP sender.
+ *
+ * param format VDO_FORMAT_H264 or VDO_FORMAT_H265.
+ * param address Destination, an IPv4 address and a port, like 127.0.0.1:5004.
+ * param error Set on failure.
+ * return The sender, or NULL on failure.
+ */
+struct rtp_sender* rtp_sender_new(VdoFormat format, const gchar* address, GError** error);
+
+/**
+ * brief Send a frame.
+ *
+ * The packets point into the frame data, which is not copied, and are all
+ * sent before returning. Packets the network stack has no room for are
+ * dropped and counted, and so are packets refused because nothing receives
+ * them.
+ *
+ * param sender An RTP sender.
+ * param frame VDO frame.
+ * param data Data of the frame.
+ * param error Set on failure.
+ * return FALSE on failure, otherwise TRUE.
+ */
+gboolean rtp_sender_send(struct rtp_sender* sender,
+                         VdoFrame* frame,
+                         const guint8* data,
+                         GError** error);
+
+/**
+ * brief Log the packets sent, and free the sender.
+ *
+ * param sender An RTP sender, may be NULL.
+ */
+void rtp_sender_free(struct rtp_sender* sender);
@@ -0,0 +1,226 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file collects statistics of an encoded stream.
+ *
+ * Counters and fixed size histograms are updated for every frame, and
+ * logged and reset once per interval. Arrival jitter is the difference
+ * between the time from the previous frame to this one as received, and as
+ * captured according to the frame timestamps. Gaps in the frame sequence
+ * numbers are frames that the encoder or the vdo service skipped.
+ */
+
+#include "stream_analyzer.h"
+
+#include <stdio.h>
+#include <syslog.h>
+
+#define NUM_BUCKETS 8
+
+// Upper bounds of the histogram buckets, the last bucket has no upper bound
+static const guint gop_bounds[NUM_BUCKETS - 1]    = {1, 8, 16, 32, 64, 128, 256};
+static const guint jitter_bounds[NUM_BUCKETS - 1] = {500, 1000, 2000, 5000, 10000, 20000, 50000};
+
+struct histogram {
+    guint counts[NUM_BUCKETS];
+    guint total;
+};
+
+struct stream_analyzer {
+    gint64 interval_usec;
+    gint64 window_start;
+
+    // Previous frame, and frames since the last keyframe
+    gboolean has_previous;
+    gint64 previous_arrival;
+    guint64 previous_timestamp;
+    guint previous_sequence;
+    gboolean has_keyframe;
+    guint gop_length;
+
+    // Counters of the current interval
+    guint frames;
+    guint64 bytes;
+    guint i_frames;
+    guint64 i_bytes;
+    guint p_frames;
+    guint64 p_bytes;
+    guint skipped;
+    gsize max_frame_size;
+    struct histogram gop_lengths;
+    struct histogram jitter;
+};
+
+static void histogram_add(struct histogram* histogram, const guint* bounds, guint64 value) {
+    guint bucket = 0;
+
+    while (bucket < NUM_BUCKETS - 1 && value > bounds[bucket])
+        bucket++;
+    histogram->counts[bucket]++;
+    histogram->total++;
+}
+
+// Describe the bucket below which the given fraction of the values are
+static void histogram_percentile(const struct histogram* histogram,
+                                 const guint* bounds,
+                                 double fraction,
+                                 double scale,
+                                 gchar* text,
+                                 gsize size) {
+    guint count = 0;
+    guint bucket;
+
+    for (bucket = 0; bucket < NUM_BUCKETS - 1; bucket++) {
+        count += histogram->counts[bucket];
+        if (count >= fraction * histogram->total)
+            break;
+    }
+
+    if (!histogram->total)
+        g_strlcpy(text, "-", size);
+    else if (bucket < NUM_BUCKETS - 1)
+        snprintf(text, size, "<=%g", bounds[bucket] * scale);
+    else
+        snprintf(text, size, ">%g", bounds[NUM_BUCKETS - 2] * scale);
+}
+
+static void histogram_counts(const struct histogram* histogram, gchar* text, gsize size) {
+    gsize length = 0;
+
+    for (guint i = 0; i < NUM_BUCKETS && length < size; i++)
+        length += snprintf(text + length, size - length, i ? " %u" : "%u", histogram->counts[i]);
+}
+
+static void log_summary(struct stream_analyzer* analyzer, gint64 now) {
+    double seconds = (now - analyzer->window_start) / (double)G_USEC_PER_SEC;
+    if (!analyzer->frames || seconds <= 0)
+        return;
+
+    double i_size = analyzer->i_frames ? (double)analyzer->i_bytes / analyzer->i_frames : 0;
+    double p_size = analyzer->p_frames ? (double)analyzer->p_bytes / analyzer->p_frames : 0;
+    gchar gop[16], jitter_p50[16], jitter_p99[16], gop_counts[64], jitter_counts[64];
+
+    // Jitter is kept in microseconds and logged in milliseconds
+    histogram_percentile(&analyzer->gop_lengths, gop_bounds, 0.5, 1, gop, sizeof(gop));
+    histogram_percentile(&analyzer->jitter,
+                         jitter_bounds,
+                         0.5,
+                         1e-3,
+                         jitter_p50,
+                         sizeof(jitter_p50));
+    histogram_percentile(&analyzer->jitter,
+                         jitter_bounds,
+                         0.99,
+                         1e-3,
+                         jitter_p99,
+                         sizeof(jitter_p99));
+    histogram_counts(&analyzer->gop_lengths, gop_counts, sizeof(gop_counts));
+    histogram_counts(&analyzer->jitter, jitter_counts, sizeof(jitter_counts));
+
+    syslog(LOG_INFO,
+           "%.1f kbit/s, %.1f fps, %u skipped, largest frame %zu bytes, I/P size %.1f, "
+           "GOP p50 %s frames, jitter p50 %s ms p99 %s ms, GOP histogram [%s], "
+           "jitter histogram [%s]",
+           analyzer->bytes * 8 / 1000.0 / seconds,
+           analyzer->frames / seconds,
+           analyzer->skipped,
+           analyzer->max_frame_size,
+           p_size > 0 ? i_size / p_size : 0,
+           gop,
+           jitter_p50,
+           jitter_p99,
+           gop_counts,
+           jitter_counts);
+}
+
+// Start a new interval, keeping what is known about the previous frame
+static void reset_window(struct stream_analyzer* analyzer, gint64 now) {
+    analyzer->window_start   = now;
+    analyzer->frames         = 0;
+    analyzer->bytes          = 0;
+    analyzer->i_frames       = 0;
+    analyzer->i_bytes        = 0;
+    analyzer->p_frames       = 0;
+    analyzer->p_bytes        = 0;
+    analyzer->skipped        = 0;
+    analyzer->max_frame_size = 0;
+    analyzer->gop_lengths    = (struct histogram){{0}, 0};
+    analyzer->jitter         = (struct histogram){{0}, 0};
+}
+
+struct stream_analyzer* stream_analyzer_new(guint interval) {
+    struct stream_analyzer* analyzer = g_new0(struct stream_analyzer, 1);
+
+    analyzer->interval_usec = (gint64)interval * G_USEC_PER_SEC;
+    reset_window(analyzer, g_get_monotonic_time());
+    return analyzer;
+}
+
+void stream_analyzer_add(struct stream_analyzer* analyzer, VdoFrame* frame) {
+    gint64 now         = g_get_monotonic_time();
+    guint64 timestamp  = vdo_frame_get_timestamp(frame);
+    guint sequence     = vdo_frame_get_sequence_nbr(frame);
+    gsize size         = vdo_frame_get_size(frame);
+    VdoFrameType type  = vdo_frame_get_frame_type(frame);
+    gboolean predicted = type == VDO_FRAME_TYPE_H264_P || type == VDO_FRAME_TYPE_H264_B ||
+                         type == VDO_FRAME_TYPE_H265_P || type == VDO_FRAME_TYPE_H265_B;
+
+    analyzer->frames++;
+    analyzer->bytes += size;
+    analyzer->max_frame_size = MAX(analyzer->max_frame_size, size);
+
+    // Frames that are not predicted, JPEG and YUV included, start a GOP. B frames are counted
+    // with the P frames
+    if (predicted) {
+        analyzer->p_frames++;
+        analyzer->p_bytes += size;
+        analyzer->gop_length++;
+    } else {
+        analyzer->i_frames++;
+        analyzer->i_bytes += size;
+        if (analyzer->has_keyframe)
+            histogram_add(&analyzer->gop_lengths, gop_bounds, analyzer->gop_length);
+        analyzer->has_keyframe = TRUE;
+        analyzer->gop_length   = 1;
+    }
+
+    if (analyzer->has_previous) {
+        gint64 arrived  = now - analyzer->previous_arrival;
+        gint64 captured = timestamp - analyzer->previous_timestamp;
+
+        histogram_add(&analyzer->jitter, jitter_bounds, ABS(arrived - captured));
+        if (sequence > analyzer->previous_sequence + 1)
+            analyzer->skipped += sequence - analyzer->previous_sequence - 1;
+    }
+    analyzer->has_previous       = TRUE;
+    analyzer->previous_arrival   = now;
+    analyzer->previous_timestamp = timestamp;
+    analyzer->previous_sequence  = sequence;
+
+    if (now - analyzer->window_start >= analyzer->interval_usec) {
+        log_summary(analyzer, now);
+        reset_window(analyzer, now);
+    }
+}
+
+void stream_analyzer_free(struct stream_analyzer* analyzer) {
+    if (!analyzer)
+        return;
+
+    log_summary(analyzer, g_get_monotonic_time());
+    g_free(analyzer);
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (C) 2026, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file collects statistics of an encoded stream, bitrate, frame
+ * rate, GOP length, I/P frame size ratio and arrival jitter, and logs a
+ * summary of them periodically instead of a line per frame.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "vdo-frame.h"
+
+struct stream_analyzer;
+
+/**
+ * brief Create an analyzer.
+ *
+ * param interval Seconds between summaries.
+ * return The analyzer.
+ */
+struct stream_analyzer* stream_analyzer_new(guint interval);
+
+/**
+ * brief Add a frame, just after it has been received.
+ *
+ * Takes constant time and does not allocate. Logs a summary once the
+ * interval has passed.
+ *
+ * param analyzer A stream analyzer.
+ * param frame VDO frame.
+ */
+void stream_analyzer_add(struct stream_analyzer* analyzer, VdoFrame* frame);
+
+/**
+ * brief Log a summary of the frames since the last one, and free the analyzer.
+ *
+ * param analyzer A stream analyzer, may be NULL.
+ */
+void stream_analyzer_free(struct stream_analyzer* analyzer);
@@ -33,6 +33,35 @@
  *
  * Finally, the third argument, output, is the output filename.
  *
+ * Frames are written from a thread of its own, so a slow storage device does
+ * not stall the capture loop. With --write-mode copy (default) each frame is
+ * copied into a ring of --ring-size MiB and its buffer is returned at once.
+ * With --write-mode ref the buffers themselves are queued and returned once
+ * written. Frames that do not fit are dropped and counted in the log.
+ *
+ * With --index, the IDR frames of a raw recording are indexed by time in a
+ * sidecar file next to it, <output>.idx, see keyframe_index.h.
+ *
+ * With --container mp4, H.264 and H.265 frames are written as fragmented MP4
+ * instead, with one fragment per GOP, rather than as a raw elementary stream.
+ *
+ * With --pre-event, the last seconds of frames are also kept in memory, and
+ * written to a clip in --event-dir together with the following --post-event
+ * seconds whenever the --trigger event occurs.
+ *
+ * With --analyze, frames are not logged one by one. Instead bitrate, frame
+ * rate, GOP length, I/P frame size ratio and arrival jitter are collected and
+ * logged as a summary every --analyze seconds.
+ *
+ * With --rtp, H.264 and H.265 frames are also sent as RTP over UDP, and with
+ * --rtp-loopback received again on the loopback interface to measure the
+ * packet rate and latency.
+ *
+ * Frames are captured by waiting on the file descriptors of the streams with
+ * epoll, so one thread serves any number of streams. With --extra-stream, more
+ * streams of other formats and resolutions are captured alongside the main
+ * one, each written to a file of its own.
+ *
  * Suppose that you have done through the steps of installation.
  * Then you would go to /usr/local/packages/vdoencodeclient on your device
  * and then for example run:
@@ -48,21 +77,50 @@
  *         -o vdo.out
  */
 
+#include "capture_engine.h"
+#include "event_recorder.h"
+#include "fmp4_muxer.h"
+#include "frame_writer.h"
+#include "keyframe_index.h"
+#include "rtp_receiver.h"
+#include "rtp_sender.h"
+#include "stream_analyzer.h"
 #include "vdo-error.h"
 #include "vdo-map.h"
 #include "vdo-stream.h"
 #include "vdo-types.h"
 
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #define VDO_CLIENT_ERROR g_quark_from_static_string("vdo-client-error")
 
+// Where the frames of the main stream go
+struct output {
+    struct capture_engine* engine;
+    guint frames;
+    struct frame_writer* writer;
+    struct fmp4_muxer* muxer;
+    struct event_recorder* recorder;
+    struct stream_analyzer* analyzer;
+    struct rtp_sender* rtp;
+};
+
+// Stream captured alongside the main one, written as it is to a file of its own
+struct extra_stream {
+    VdoStream* stream;
+    gint fd;
+    struct frame_writer* writer;
+};
+
 static VdoStream* stream;
-static gboolean shutdown       = FALSE;
+static volatile gboolean shutdown = FALSE;
 static const gchar* param_desc = "";
 static const gchar* summary    = "Encoded video client";
 
@@ -132,19 +190,174 @@ static gboolean set_format(VdoMap* settings, gchar* format, GError** error) {
     return TRUE;
 }
 
+// Log or analyze a frame of the main stream, and pass it on to be written
+static gboolean handle_frame(VdoStream* stream,
+                             VdoBuffer* buffer,
+                             gpointer user_data,
+                             GError** error) {
+    struct output* output = (struct output*)user_data;
+
+    // Lifetimes of buffer and frame are linked, no need to free frame
+    VdoFrame* frame = vdo_buffer_get_frame(buffer);
+
+    if (output->analyzer)
+        stream_analyzer_add(output->analyzer, frame);
+    else
+        print_frame(frame);
+
+    gpointer data = vdo_buffer_get_data(buffer);
+    if (!data) {
+        g_set_error(error, VDO_CLIENT_ERROR, 0, "Failed to get data: %m");
+        vdo_stream_buffer_unref(stream, &buffer, NULL);
+        return FALSE;
+    }
+
+    // Forward the frame while the buffer is still held
+    if (output->rtp && !rtp_sender_send(output->rtp, frame, data, error)) {
+        vdo_stream_buffer_unref(stream, &buffer, NULL);
+        return FALSE;
+    }
+
+    // Dispatch pending events, and keep the frame for event clips
+    if (output->recorder) {
+        g_main_context_iteration(NULL, FALSE);
+        if (!event_recorder_push(output->recorder, frame, data, error)) {
+            vdo_stream_buffer_unref(stream, &buffer, NULL);
+            return FALSE;
+        }
+    }
+
+    // The muxer or writer releases the buffer and allows the server to reuse it
+    if (output->muxer ? !fmp4_muxer_push(output->muxer, &buffer, error)
+                      : !frame_writer_push(output->writer, &buffer))
+        return FALSE;
+
+    if (--output->frames == 0)
+        capture_engine_stop(output->engine);
+    return TRUE;
+}
+
+static gboolean handle_extra_frame(VdoStream* stream,
+                                   VdoBuffer* buffer,
+                                   gpointer user_data,
+                                   GError** error) {
+    struct extra_stream* extra = (struct extra_stream*)user_data;
+
+    (void)stream;
+    (void)error;
+    return frame_writer_push(extra->writer, &buffer);
+}
+
+/*
+ * Start a stream from a specification like "jpeg:1280x720", the resolution
+ * defaults to 640x360, and capture it to a file of its own.
+ */
+static struct extra_stream* start_extra_stream(struct capture_engine* engine,
+                                               const gchar* spec,
+                                               const gchar* path,
+                                               gsize ring_size,
+                                               GError** error) {
+    struct extra_stream* extra = g_new0(struct extra_stream, 1);
+    gchar** fields             = g_strsplit(spec, ":", 2);
+    guint width                = 640;
+    guint height               = 360;
+    extra->fd                  = -1;
+
+    if (fields[1] && sscanf(fields[1], "%ux%u", &width, &height) != 2) {
+        g_set_error(error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "Invalid stream \"%s\"\n",
+                    spec);
+        goto exit;
+    }
+
+    VdoMap* settings = vdo_map_new();
+    if (!set_format(settings, fields[0], error)) {
+        g_clear_object(&settings);
+        goto exit;
+    }
+    vdo_map_set_uint32(settings, "width", width);
+    vdo_map_set_uint32(settings, "height", height);
+    capture_engine_configure(settings);
+
+    extra->stream = vdo_stream_new(settings, NULL, error);
+    g_clear_object(&settings);
+    if (!extra->stream || !vdo_stream_attach(extra->stream, NULL, error))
+        goto exit;
+
+    extra->fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (extra->fd < 0) {
+        g_set_error(error, VDO_CLIENT_ERROR, VDO_ERROR_IO, "open failed: %m");
+        goto exit;
+    }
+
+    extra->writer =
+        frame_writer_new(extra->stream, extra->fd, WRITE_MODE_COPY, ring_size, NULL, error);
+    if (!extra->writer || !vdo_stream_start(extra->stream, error) ||
+        !capture_engine_add(engine, extra->stream, handle_extra_frame, extra, error))
+        goto exit;
+
+    syslog(LOG_INFO, "Starting stream: %s, %ux%u, to %s\n", fields[0], width, height, path);
+
+exit:
+    g_strfreev(fields);
+    return extra;
+}
+
+// Write the queued frames and free the stream, a write error is reported unless there is another
+static void free_extra_stream(struct extra_stream* extra, GError** error) {
+    frame_writer_free(extra->writer, *error ? NULL : error);
+    if (extra->fd >= 0)
+        close(extra->fd);
+    g_clear_object(&extra->stream);
+    g_free(extra);
+}
+
 /**
  * Main function that starts a stream with the following options:
  *
  * --format [h264, h265, jpeg, nv12, y800]
  * --frames [number of frames]
  * --output [output filename]
+ * --write-mode [copy, ref]
+ * --ring-size [MiB of frames queued in copy mode]
+ * --container [raw, mp4]
+ * --index [write a keyframe index next to a raw recording]
+ * --pre-event [seconds kept before an event, 0 to not record events]
+ * --post-event [seconds recorded after an event]
+ * --event-buffer [MiB of frames kept before an event]
+ * --trigger [manual, tampering]
+ * --event-dir [directory of event clips]
+ * --analyze [seconds between stream summaries, 0 to log each frame]
+ * --extra-stream [format:widthxheight of another stream, may be repeated]
+ * --rtp [address:port to send RTP to]
+ * --rtp-loopback [receive the RTP stream on the loopback interface]
  */
 int main(int argc, char* argv[]) {
-    GError* error      = NULL;
-    gchar* format      = "h264";
-    guint frames       = G_MAXUINT;
-    gchar* output_file = "/dev/null";
-    FILE* dest_f       = NULL;
+    GError* error         = NULL;
+    gchar* format         = "h264";
+    guint frames          = G_MAXUINT;
+    gchar* output_file    = "/dev/null";
+    gchar* write_mode     = "copy";
+    gint ring_size        = 8;
+    gchar* container      = "raw";
+    gboolean index        = FALSE;
+    guint pre_event       = 0;
+    guint post_event      = 10;
+    gint event_buffer     = 16;
+    gchar* trigger        = "manual";
+    gchar* event_dir      = "localdata";
+    guint analyze         = 0;
+    gchar** extra_spec    = NULL;
+    gchar* rtp_address    = NULL;
+    gboolean rtp_loopback = FALSE;
+    gint dest_fd          = -1;
+    GPtrArray* extras     = g_ptr_array_new();
+
+    struct output output                    = {0};
+    struct keyframe_index_writer* keyframes = NULL;
+    struct rtp_receiver* receiver           = NULL;
 
     openlog(NULL, LOG_PID, LOG_USER);
 
@@ -158,6 +371,85 @@ int main(int argc, char* argv[]) {
          NULL},
         {"frames", 'n', 0, G_OPTION_ARG_INT, &frames, "number of frames", NULL},
         {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "output filename", NULL},
+        {"write-mode",
+         'w',
+         0,
+         G_OPTION_ARG_STRING,
+         &write_mode,
+         "copy frames into a ring, or queue the buffers (copy, ref)",
+         NULL},
+        {"ring-size",
+         'r',
+         0,
+         G_OPTION_ARG_INT,
+         &ring_size,
+         "MiB of frames queued in copy mode",
+         NULL},
+        {"container",
+         'c',
+         0,
+         G_OPTION_ARG_STRING,
+         &container,
+         "write frames as they are, or as fragmented MP4 (raw, mp4)",
+         NULL},
+        {"index",
+         'i',
+         0,
+         G_OPTION_ARG_NONE,
+         &index,
+         "write a keyframe index next to a raw recording",
+         NULL},
+        {"pre-event",
+         'p',
+         0,
+         G_OPTION_ARG_INT,
+         &pre_event,
+         "seconds kept before an event, 0 to not record events",
+         NULL},
+        {"post-event", 'a', 0, G_OPTION_ARG_INT, &post_event, "seconds after an event", NULL},
+        {"event-buffer",
+         'b',
+         0,
+         G_OPTION_ARG_INT,
+         &event_buffer,
+         "MiB of frames kept before an event",
+         NULL},
+        {"trigger",
+         'e',
+         0,
+         G_OPTION_ARG_STRING,
+         &trigger,
+         "event starting a clip (manual, tampering)",
+         NULL},
+        {"event-dir", 'd', 0, G_OPTION_ARG_FILENAME, &event_dir, "directory of event clips", NULL},
+        {"analyze",
+         'z',
+         0,
+         G_OPTION_ARG_INT,
+         &analyze,
+         "seconds between stream summaries, 0 to log each frame",
+         NULL},
+        {"extra-stream",
+         'x',
+         0,
+         G_OPTION_ARG_STRING_ARRAY,
+         &extra_spec,
+         "another stream to capture, as format:widthxheight",
+         "STREAM"},
+        {"rtp",
+         'u',
+         0,
+         G_OPTION_ARG_STRING,
+         &rtp_address,
+         "send frames as RTP to an address and port",
+         "ADDRESS:PORT"},
+        {"rtp-loopback",
+         'l',
+         0,
+         G_OPTION_ARG_NONE,
+         &rtp_loopback,
+         "receive the RTP stream on the loopback interface",
+         NULL},
         {
             NULL,
             0,
@@ -177,8 +469,60 @@ int main(int argc, char* argv[]) {
     if (!g_option_context_parse(context, &argc, &argv, &error))
         goto exit;
 
-    dest_f = fopen(output_file, "wb");
-    if (!dest_f) {
+    enum write_mode mode;
+    if (g_strcmp0(write_mode, "copy") == 0) {
+        mode = WRITE_MODE_COPY;
+    } else if (g_strcmp0(write_mode, "ref") == 0) {
+        mode = WRITE_MODE_REF;
+    } else {
+        g_set_error(&error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_NOT_FOUND,
+                    "Write mode \"%s\" is not supported\n",
+                    write_mode);
+        goto exit;
+    }
+
+    gboolean mp4 = g_strcmp0(container, "mp4") == 0;
+    if (!mp4 && g_strcmp0(container, "raw") != 0) {
+        g_set_error(&error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_NOT_FOUND,
+                    "Container \"%s\" is not supported\n",
+                    container);
+        goto exit;
+    }
+
+    // Fragmented MP4 can be seeked without an index
+    if (mp4 && index) {
+        g_set_error(&error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "A keyframe index needs --container raw\n");
+        goto exit;
+    }
+
+    enum event_trigger event_trigger;
+    if (g_strcmp0(trigger, "manual") == 0) {
+        event_trigger = EVENT_TRIGGER_MANUAL;
+    } else if (g_strcmp0(trigger, "tampering") == 0) {
+        event_trigger = EVENT_TRIGGER_TAMPERING;
+    } else {
+        g_set_error(&error,
+                    VDO_CLIENT_ERROR,
+                    VDO_ERROR_NOT_FOUND,
+                    "Trigger \"%s\" is not supported\n",
+                    trigger);
+        goto exit;
+    }
+
+    if (ring_size < 1 || event_buffer < 1) {
+        g_set_error(&error, VDO_CLIENT_ERROR, VDO_ERROR_INVALID_ARGUMENT, "Invalid buffer size\n");
+        goto exit;
+    }
+
+    dest_fd = g_open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dest_fd < 0) {
         g_set_error(&error, VDO_CLIENT_ERROR, VDO_ERROR_IO, "open failed: %m");
         goto exit;
     }
@@ -195,6 +539,11 @@ int main(int argc, char* argv[]) {
     // Set default arguments
     vdo_map_set_uint32(settings, "width", 640);
     vdo_map_set_uint32(settings, "height", 360);
+    capture_engine_configure(settings);
+
+    // The writer holds on to buffers in ref mode, leave some for capturing
+    if (mode == WRITE_MODE_REF)
+        vdo_map_set_uint32(settings, "buffer.count", FRAME_WRITER_REF_BUFFERS + 2);
 
     // Create a new stream
     stream = vdo_stream_new(settings, NULL, &error);
@@ -205,6 +554,17 @@ int main(int argc, char* argv[]) {
     if (!vdo_stream_attach(stream, NULL, &error))
         goto exit;
 
+    // The index is discarded along with the frames
+    if (index) {
+        gchar* path = g_str_equal(output_file, "/dev/null")
+                          ? g_strdup(output_file)
+                          : g_strdup_printf("%s.idx", output_file);
+        keyframes   = keyframe_index_writer_new(path, &error);
+        g_free(path);
+        if (!keyframes)
+            goto exit;
+    }
+
     VdoMap* info = vdo_stream_get_info(stream, &error);
     if (!info)
         goto exit;
@@ -216,64 +576,119 @@ int main(int argc, char* argv[]) {
            vdo_map_get_uint32(info, "height", 0),
            vdo_map_get_uint32(info, "framerate", 0));
 
+    VdoFormat stream_format = vdo_map_get_uint32(info, "format", VDO_FORMAT_NONE);
+    guint framerate         = vdo_map_get_uint32(info, "framerate", 0);
+    if (mp4) {
+        output.muxer = fmp4_muxer_new(stream,
+                                      dest_fd,
+                                      stream_format,
+                                      vdo_map_get_uint32(info, "width", 0),
+                                      vdo_map_get_uint32(info, "height", 0),
+                                      framerate,
+                                      &error);
+    } else {
+        output.writer = frame_writer_new(stream,
+                                         dest_fd,
+                                         mode,
+                                         (gsize)ring_size * 1024 * 1024,
+                                         keyframes,
+                                         &error);
+    }
     g_clear_object(&info);
-
-    // Start the stream
-    if (!vdo_stream_start(stream, &error))
+    if (!output.muxer && !output.writer)
         goto exit;
 
-    // Loop until interrupt by Ctrl-C or reaching G_MAXUINT
-    for (guint n = 0; n < frames; ++n) {
-        // Lifetimes of buffer and frame are linked, no need to free frame
-        VdoBuffer* buffer = vdo_stream_get_buffer(stream, &error);
-        VdoFrame* frame   = vdo_buffer_get_frame(buffer);
-
-        // Error occurred
-        if (!frame)
+    // The receiver listens on the port the frames are sent to
+    if (rtp_address) {
+        output.rtp = rtp_sender_new(stream_format, rtp_address, &error);
+        if (!output.rtp)
             goto exit;
+        if (rtp_loopback) {
+            receiver = rtp_receiver_new(rtp_address, &error);
+            if (!receiver)
+                goto exit;
+        }
+    }
 
-        // SIGINT occurred
-        if (shutdown) {
-            vdo_stream_buffer_unref(stream, &buffer, NULL);
+    if (pre_event) {
+        output.recorder = event_recorder_new(event_trigger,
+                                             event_dir,
+                                             format,
+                                             pre_event,
+                                             post_event,
+                                             framerate,
+                                             (gsize)event_buffer * 1024 * 1024,
+                                             &error);
+        if (!output.recorder)
             goto exit;
-        }
+    }
 
-        print_frame(frame);
+    if (analyze)
+        output.analyzer = stream_analyzer_new(analyze);
 
-        gpointer data = vdo_buffer_get_data(buffer);
-        if (!data) {
-            g_set_error(&error, VDO_CLIENT_ERROR, 0, "Failed to get data: %m");
-            vdo_stream_buffer_unref(stream, &buffer, NULL);
-            goto exit;
-        }
+    output.engine = capture_engine_new(&error);
+    output.frames = frames;
+    if (!output.engine)
+        goto exit;
 
-        if (!fwrite(data, vdo_frame_get_size(frame), 1, dest_f)) {
-            g_set_error(&error, VDO_CLIENT_ERROR, 0, "Failed to write frame: %m");
-            vdo_stream_buffer_unref(stream, &buffer, NULL);
-            goto exit;
-        }
+    // Start the stream
+    if (!vdo_stream_start(stream, &error))
+        goto exit;
+
+    if (!capture_engine_add(output.engine, stream, handle_frame, &output, &error))
+        goto exit;
 
-        // Release the buffer and allow the server to reuse it
-        if (!vdo_stream_buffer_unref(stream, &buffer, &error))
+    // Extra streams are written next to the output file, or discarded along with it
+    for (guint i = 0; extra_spec && extra_spec[i]; i++) {
+        gchar* path = g_str_equal(output_file, "/dev/null")
+                          ? g_strdup(output_file)
+                          : g_strdup_printf("%s.%u", output_file, i + 1);
+        g_ptr_array_add(extras,
+                        start_extra_stream(output.engine,
+                                           extra_spec[i],
+                                           path,
+                                           (gsize)ring_size * 1024 * 1024,
+                                           &error));
+        g_free(path);
+        if (error)
             goto exit;
     }
 
+    // Capture until interrupted by Ctrl-C or reaching the number of frames
+    if (frames && !capture_engine_run(output.engine, &shutdown, &error))
+        goto exit;
+
 exit:
     // Ignore SIGINT and server maintenance
     if (shutdown || vdo_error_is_expected(&error))
         g_clear_error(&error);
 
+    // Write the queued frames, a write error is reported unless there is another error
+    frame_writer_free(output.writer, error ? NULL : &error);
+    keyframe_index_writer_free(keyframes);
+    fmp4_muxer_free(output.muxer, error ? NULL : &error);
+    event_recorder_free(output.recorder);
+    stream_analyzer_free(output.analyzer);
+    rtp_sender_free(output.rtp);
+    rtp_receiver_free(receiver);
+    capture_engine_free(output.engine);
+    for (guint i = 0; i < extras->len; i++)
+        free_extra_stream(g_ptr_array_index(extras, i), &error);
+    g_ptr_array_unref(extras);
+
     gint ret = EXIT_SUCCESS;
     if (error) {
         syslog(LOG_INFO, "vdo-encode-client: %s\n", error->message);
         ret = EXIT_FAILURE;
     }
 
-    if (dest_f)
-        fclose(dest_f);
+    if (dest_fd >= 0)
+        close(dest_fd);
 
     g_clear_error(&error);
     g_clear_object(&stream);
+    g_strfreev(extra_spec);
+    g_free(rtp_address);
 
     g_option_context_free(context);
 